@@ -0,0 +1,165 @@
+/**
+ * Compares passing small messages between two threads through a tlb_pipe against a tlb_channel of each mode.
+ *
+ * A producer thread sends every message (8 bytes each), in batches of up to 64, while the consumer thread handles a
+ * loop with a subscription that reads them. With a pipe each batch is a write and a read, while channels only make a
+ * syscall when the consumer has caught up.
+ *
+ * Usage: channel_bench [messages]
+ */
+
+#include "tlb/channel.h"
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define BATCH 64U
+
+struct bench {
+  struct tlb_event_loop *loop;
+  struct tlb_pipe pipe;
+  struct tlb_channel *channel;
+  size_t messages;
+  size_t received;
+  uint64_t sum;
+};
+
+static struct bench s_bench;
+
+static void *s_malloc(void *userdata, size_t size) {
+  (void)userdata;
+  return malloc(size);
+}
+
+static void *s_calloc(void *userdata, size_t num, size_t size) {
+  (void)userdata;
+  return calloc(num, size);
+}
+
+static void s_free(void *userdata, void *buffer) {
+  (void)userdata;
+  free(buffer);
+}
+
+static struct tlb_allocator_vtable s_vtable = {
+    .malloc = s_malloc,
+    .calloc = s_calloc,
+    .free = s_free,
+};
+
+static struct tlb_allocator s_alloc = {.vtable = &s_vtable};
+
+static uint64_t s_now_ns(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+}
+
+/**********************************************************************************************************************
+ * Consumers                                                                                                          *
+ **********************************************************************************************************************/
+
+static void s_on_pipe(tlb_handle handle, int events, void *userdata) {
+  (void)handle;
+  (void)events;
+  (void)userdata;
+  uint64_t values[BATCH];
+  ssize_t bytes;
+  while ((bytes = tlb_pipe_read_buf(&s_bench.pipe, values, sizeof(values))) > 0) {
+    for (size_t ii = 0; ii < (size_t)bytes / sizeof(values[0]); ++ii) {
+      s_bench.sum += values[ii];
+    }
+    s_bench.received += (size_t)bytes / sizeof(values[0]);
+  }
+}
+
+static void s_on_messages(const void *messages, size_t count, void *userdata) {
+  (void)userdata;
+  const uint64_t *values = messages;
+  for (size_t ii = 0; ii < count; ++ii) {
+    s_bench.sum += values[ii];
+  }
+  s_bench.received += count;
+}
+
+/**********************************************************************************************************************
+ * Producer                                                                                                           *
+ **********************************************************************************************************************/
+
+static int s_producer(void *arg) {
+  (void)arg;
+  uint64_t values[BATCH];
+  for (size_t sent = 0; sent < s_bench.messages;) {
+    const size_t count = TLB_MIN((size_t)BATCH, s_bench.messages - sent);
+    for (size_t ii = 0; ii < count; ++ii) {
+      values[ii] = sent + ii;
+    }
+    size_t done = 0;
+    if (s_bench.channel) {
+      done = tlb_channel_send_batch(s_bench.channel, values, count);
+    } else {
+      /* Pipe writes of up to PIPE_BUF bytes are all or nothing */
+      const ssize_t bytes = tlb_pipe_write_buf(&s_bench.pipe, values, count * sizeof(values[0]));
+      done = bytes > 0 ? (size_t)bytes / sizeof(values[0]) : 0;
+    }
+    if (done == 0) {
+      thrd_yield();
+    }
+    sent += done;
+  }
+  return 0;
+}
+
+static int s_run(const char *name, const enum tlb_channel_mode *mode) {
+  s_bench.loop = TLB_CHECK_RETURN(NULL !=, tlb_evl_new(&s_alloc), TLB_FAIL);
+  s_bench.received = 0;
+  s_bench.sum = 0;
+  s_bench.channel = NULL;
+  tlb_handle handle = TLB_HANDLE_INVALID;
+  if (mode) {
+    s_bench.channel = TLB_CHECK_RETURN(NULL !=, tlb_channel_new(&s_alloc, *mode, 4096, sizeof(uint64_t)), TLB_FAIL);
+    handle = tlb_channel_subscribe(s_bench.loop, s_bench.channel, s_on_messages, NULL);
+  } else {
+    TLB_CHECK(0 ==, tlb_pipe_open(&s_bench.pipe));
+    handle = tlb_evl_add_fd(s_bench.loop, s_bench.pipe.fd_read, TLB_EV_READ, false, s_on_pipe, NULL);
+  }
+  TLB_CHECK_RETURN(TLB_HANDLE_INVALID !=, handle, TLB_FAIL);
+
+  thrd_t producer;
+  const uint64_t start_ns = s_now_ns();
+  TLB_CHECK(thrd_success ==, thrd_create(&producer, s_producer, NULL));
+  while (s_bench.received < s_bench.messages) {
+    tlb_evl_handle_events(s_bench.loop, 0, 100);
+  }
+  thrd_join(producer, NULL);
+  const uint64_t elapsed_ns = s_now_ns() - start_ns;
+
+  const double messages = (double)s_bench.messages;
+  const uint64_t expected = ((uint64_t)s_bench.messages * ((uint64_t)s_bench.messages - 1)) / 2;
+  printf("%-5s %10zu messages %8.1f ms %12.0f messages/s %6.1f ns/message%s\n", name, s_bench.messages,
+         (double)elapsed_ns / 1e6, messages / ((double)elapsed_ns / 1e9), (double)elapsed_ns / messages,
+         s_bench.sum == expected ? "" : " (wrong sum)");
+
+  tlb_evl_remove(s_bench.loop, handle);
+  tlb_evl_destroy(s_bench.loop);
+  if (s_bench.channel) {
+    tlb_channel_destroy(s_bench.channel);
+  } else {
+    tlb_pipe_close(&s_bench.pipe);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  s_bench.messages = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+
+  static const enum tlb_channel_mode spsc = TLB_CHANNEL_SPSC;
+  static const enum tlb_channel_mode mpmc = TLB_CHANNEL_MPMC;
+  TLB_CHECK_RETURN(0 ==, s_run("pipe", NULL), EXIT_FAILURE);
+  TLB_CHECK_RETURN(0 ==, s_run("spsc", &spsc), EXIT_FAILURE);
+  TLB_CHECK_RETURN(0 ==, s_run("mpmc", &mpmc), EXIT_FAILURE);
+  return 0;
+}
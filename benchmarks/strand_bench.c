@@ -0,0 +1,184 @@
+/**
+ * Compares serializing groups of fds with a sub-loop each (tlb_evl_add_evl) against a strand each (tlb_strand).
+ *
+ * Every group has one pipe that keeps writing to itself from its own callback until it's seen the requested number of
+ * events, while a pool of threads handles the top level loop.
+ *
+ * Usage: strand_bench [groups] [events per group] [threads]
+ *
+ * Build without TLB_EVENT_LOGGING, which logs every event to stderr and would swamp what's being measured.
+ */
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+#include "tlb/strand.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
+
+struct group {
+  struct tlb_pipe pipe;
+  struct tlb_event_loop *sub_loop;
+  struct tlb_strand *strand;
+  tlb_handle handle;
+  size_t events;
+};
+
+struct bench {
+  struct tlb_event_loop *loop;
+  struct group *groups;
+  size_t group_count;
+  size_t events_per_group;
+  atomic_size_t done;
+};
+
+static struct bench s_bench;
+
+static void *s_malloc(void *userdata, size_t size) {
+  (void)userdata;
+  return malloc(size);
+}
+
+static void *s_calloc(void *userdata, size_t num, size_t size) {
+  (void)userdata;
+  return calloc(num, size);
+}
+
+static void s_free(void *userdata, void *buffer) {
+  (void)userdata;
+  free(buffer);
+}
+
+static struct tlb_allocator_vtable s_vtable = {
+    .malloc = s_malloc,
+    .calloc = s_calloc,
+    .free = s_free,
+};
+
+static struct tlb_allocator s_alloc = {.vtable = &s_vtable};
+
+static uint64_t s_now_ns(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+}
+
+/**********************************************************************************************************************
+ * Workload                                                                                                           *
+ **********************************************************************************************************************/
+
+static void s_on_readable(tlb_handle handle, int events, void *userdata) {
+  (void)handle;
+  (void)events;
+  struct group *group = userdata;
+
+  uint8_t value = 0;
+  if (tlb_pipe_read(&group->pipe, &value) != 1) {
+    return;
+  }
+  if (++group->events < s_bench.events_per_group) {
+    tlb_pipe_write(&group->pipe, value);
+  } else {
+    atomic_fetch_add(&s_bench.done, 1);
+  }
+}
+
+static int s_worker(void *arg) {
+  (void)arg;
+  while (atomic_load_explicit(&s_bench.done, memory_order_relaxed) < s_bench.group_count) {
+    tlb_evl_handle_events(s_bench.loop, 100, 10);
+  }
+  return 0;
+}
+
+/**********************************************************************************************************************
+ * Modes                                                                                                              *
+ **********************************************************************************************************************/
+
+enum mode {
+  MODE_SUB_LOOP,
+  MODE_STRAND,
+};
+
+static int s_group_init(struct group *group, enum mode mode) {
+  memset(group, 0, sizeof(*group));
+  TLB_CHECK(0 ==, tlb_pipe_open(&group->pipe));
+
+  switch (mode) {
+    case MODE_SUB_LOOP:
+      group->sub_loop = TLB_CHECK_RETURN(NULL !=, tlb_evl_new(&s_alloc), TLB_FAIL);
+      TLB_CHECK_RETURN(TLB_HANDLE_INVALID !=,
+                       tlb_evl_add_fd(group->sub_loop, group->pipe.fd_read, TLB_EV_READ, false, s_on_readable, group),
+                       TLB_FAIL);
+      group->handle =
+          TLB_CHECK_RETURN(TLB_HANDLE_INVALID !=, tlb_evl_add_evl(s_bench.loop, group->sub_loop), TLB_FAIL);
+      break;
+
+    case MODE_STRAND:
+      group->strand = TLB_CHECK_RETURN(NULL !=, tlb_strand_new(s_bench.loop), TLB_FAIL);
+      group->handle = TLB_CHECK_RETURN(
+          TLB_HANDLE_INVALID !=,
+          tlb_strand_add_fd(group->strand, group->pipe.fd_read, TLB_EV_READ, false, s_on_readable, group), TLB_FAIL);
+      break;
+  }
+  return 0;
+}
+
+static void s_group_cleanup(struct group *group) {
+  tlb_evl_remove(s_bench.loop, group->handle);
+  if (group->sub_loop) {
+    tlb_evl_destroy(group->sub_loop);
+  }
+  if (group->strand) {
+    tlb_strand_destroy(group->strand);
+  }
+  tlb_pipe_close(&group->pipe);
+}
+
+static int s_run(enum mode mode, const char *name, size_t thread_count) {
+  s_bench.loop = TLB_CHECK_RETURN(NULL !=, tlb_evl_new(&s_alloc), TLB_FAIL);
+  atomic_store(&s_bench.done, 0);
+  for (size_t ii = 0; ii < s_bench.group_count; ++ii) {
+    TLB_CHECK(0 ==, s_group_init(&s_bench.groups[ii], mode));
+  }
+
+  thrd_t threads[64];
+  const uint64_t start_ns = s_now_ns();
+  for (size_t ii = 0; ii < s_bench.group_count; ++ii) {
+    const uint8_t value = 0;
+    tlb_pipe_write(&s_bench.groups[ii].pipe, value);
+  }
+  for (size_t ii = 0; ii < thread_count; ++ii) {
+    TLB_CHECK(thrd_success ==, thrd_create(&threads[ii], s_worker, NULL));
+  }
+  for (size_t ii = 0; ii < thread_count; ++ii) {
+    thrd_join(threads[ii], NULL);
+  }
+  const uint64_t elapsed_ns = s_now_ns() - start_ns;
+
+  const double events = (double)s_bench.group_count * (double)s_bench.events_per_group;
+  printf("%-9s %8zu groups %8.0f events %8.1f ms %10.0f events/s %8.0f ns/event\n", name, s_bench.group_count, events,
+         (double)elapsed_ns / 1e6, events / ((double)elapsed_ns / 1e9), (double)elapsed_ns / events);
+
+  for (size_t ii = 0; ii < s_bench.group_count; ++ii) {
+    s_group_cleanup(&s_bench.groups[ii]);
+  }
+  tlb_evl_destroy(s_bench.loop);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  s_bench.group_count = argc > 1 ? strtoull(argv[1], NULL, 10) : 256;
+  s_bench.events_per_group = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000;
+  size_t thread_count = argc > 3 ? strtoull(argv[3], NULL, 10) : 4;
+  thread_count = TLB_MIN(TLB_MAX(thread_count, (size_t)1), (size_t)64);
+
+  s_bench.groups = TLB_CHECK_RETURN(NULL !=, calloc(s_bench.group_count, sizeof(struct group)), EXIT_FAILURE);
+
+  TLB_CHECK_RETURN(0 ==, s_run(MODE_SUB_LOOP, "sub-loop", thread_count), EXIT_FAILURE);
+  TLB_CHECK_RETURN(0 ==, s_run(MODE_STRAND, "strand", thread_count), EXIT_FAILURE);
+
+  free(s_bench.groups);
+  return 0;
+}
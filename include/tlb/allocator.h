@@ -17,6 +17,17 @@ struct tlb_allocator {
   void *userdata;
 };
 
+/* Allocations are counted by power of 2 size, the last class also holds everything larger */
+#define TLB_MEMORY_SIZE_CLASSES 32U
+
+struct tlb_memory_stats {
+  size_t live_bytes;
+  size_t peak_bytes; /* Exact when allocating from a single thread, otherwise within 64KB per thread */
+  uint64_t allocations;
+  uint64_t frees;
+  uint64_t size_classes[TLB_MEMORY_SIZE_CLASSES]; /* Allocations of more than 2^(i-1), and up to 2^i, bytes */
+};
+
 TLB_EXTERN_C_BEGIN
 
 void *tlb_malloc(struct tlb_allocator *alloc, size_t size);
@@ -25,6 +36,16 @@ void *tlb_calloc(struct tlb_allocator *alloc, size_t num, size_t size);
 
 void tlb_free(struct tlb_allocator *alloc, void *buffer);
 
+/**
+ * An allocator that counts everything allocated through it before passing it on to inner. Counters are kept per thread
+ * and added up when read, so tracking doesn't make threads contend with each other.
+ */
+struct tlb_allocator *tlb_tracking_allocator_new(struct tlb_allocator *inner);
+void tlb_tracking_allocator_destroy(struct tlb_allocator *tracking);
+
+/** Fails with EINVAL if alloc isn't a tracking allocator */
+int tlb_tracking_allocator_stats(struct tlb_allocator *alloc, struct tlb_memory_stats *stats);
+
 TLB_EXTERN_C_END
 
 #endif /* TLB_ALLOCATOR_H */
@@ -0,0 +1,59 @@
+#ifndef TLB_CHANNEL_H
+#define TLB_CHANNEL_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Bounded in-process channel of fixed-size messages (e.g. pointers), a lock-free ring that doesn't copy through the
+ * kernel like a tlb_pipe does. Consumers can subscribe it to any loop. The eventfd (a pipe where there isn't one)
+ * behind tlb_channel_fd is only signalled when a consumer has found the channel empty since the last time, so a busy
+ * channel costs no syscalls on either side.
+ */
+
+enum tlb_channel_mode {
+  TLB_CHANNEL_SPSC, /* A single producer thread and a single consumer at a time */
+  TLB_CHANNEL_MPMC, /* Any number of producers and consumers */
+};
+
+/* Largest message size, subscriptions pass messages to their callback in batches of up to 4KiB */
+#define TLB_CHANNEL_MAX_MESSAGE_SIZE 256U
+
+struct tlb_channel;
+
+/* Called with count messages, copied out of the channel, that are only valid until it returns */
+typedef void tlb_on_messages(const void *messages, size_t count, void *userdata);
+
+TLB_EXTERN_C_BEGIN
+
+/** Creates a channel holding up to capacity (rounded up to a power of 2) messages of message_size bytes */
+struct tlb_channel *tlb_channel_new(struct tlb_allocator *alloc, enum tlb_channel_mode mode, size_t capacity,
+                                    size_t message_size);
+/** Any subscriptions must have been removed first */
+void tlb_channel_destroy(struct tlb_channel *channel);
+
+/** Copies a message into the channel, fails with EAGAIN if it's full */
+int tlb_channel_send(struct tlb_channel *channel, const void *message);
+
+/** Copies as many of count messages as fit, and returns how many that was. Consumers are signalled at most once. */
+size_t tlb_channel_send_batch(struct tlb_channel *channel, const void *messages, size_t count);
+
+/**
+ * Copies up to count messages out of the channel, and returns how many that was. Only returning 0 (having found the
+ * channel empty) clears the fd's signal, so consumers polling the fd themselves must receive until it does.
+ */
+size_t tlb_channel_receive(struct tlb_channel *channel, void *messages, size_t count);
+
+/** Becomes readable when there are messages to receive */
+int tlb_channel_fd(const struct tlb_channel *channel);
+
+/**
+ * Subscribes a consumer to a loop. on_messages is called with batches until the channel is empty, or until it's been
+ * passed a capacity's worth of messages, after which the subscription is requeued (see tlb_evl_requeue) to give the
+ * loop's other subscriptions a turn. Remove it with tlb_evl_remove. SPSC channels may only have one subscription.
+ */
+tlb_handle tlb_channel_subscribe(struct tlb_event_loop *loop, struct tlb_channel *channel,
+                                 tlb_on_messages *on_messages, void *userdata);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_CHANNEL_H */
@@ -0,0 +1,247 @@
+#ifndef TLB_CORO_HPP
+#define TLB_CORO_HPP
+
+/**
+ * C++20 coroutine bindings, header only.
+ *
+ * libtlb::coro::Task is a detached coroutine that starts running immediately, and frees itself when it finishes.
+ * Inside one, the awaitables below suspend until an fd is ready, a timer fires, or a loop picks it up:
+ *
+ *   libtlb::coro::Task echo(tlb_event_loop *loop, int fd) {
+ *     for (;;) {
+ *       int events = co_await libtlb::coro::readable(loop, fd);
+ *       ...
+ *     }
+ *   }
+ *
+ * Each suspension is a single subscription on the loop, removed again before the coroutine resumes, and the coroutine
+ * resumes on whichever loop thread handled the event. Coroutine frames come from a per-thread pool, so nothing is
+ * allocated once the pool has warmed up.
+ *
+ * Only available when the compiler supports coroutines, the header is empty otherwise.
+ */
+
+#if defined(__cplusplus) && __cplusplus >= 202002L && defined(__has_include)
+#  if __has_include(<coroutine>)
+#    include <coroutine>
+#  endif
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__cpp_lib_coroutine)
+#  define TLB_HAS_CORO 1
+
+#  include "tlb/event_loop.h"
+
+#  include <cstddef>
+#  include <exception>
+#  include <new>
+
+namespace libtlb {
+namespace coro {
+
+/**********************************************************************************************************************
+ * Frame pool                                                                                                         *
+ **********************************************************************************************************************/
+
+/* Free lists of coroutine frames in 64 byte size classes. Frames are returned to whichever thread frees them. */
+class FramePool {
+ public:
+  static constexpr std::size_t kGranularity = 64;
+  static constexpr std::size_t kClasses = 32; /* Frames over 2KB go straight to the heap */
+
+  static void *allocate(std::size_t size) {
+    const std::size_t size_class = class_of(size);
+    if (size_class >= kClasses) {
+      return ::operator new(size);
+    }
+
+    Node *&head = local().heads[size_class];
+    if (head) {
+      Node *node = head;
+      head = node->next;
+      return node;
+    }
+    return ::operator new((size_class + 1) * kGranularity);
+  }
+
+  static void deallocate(void *ptr, std::size_t size) noexcept {
+    const std::size_t size_class = class_of(size);
+    if (size_class >= kClasses) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    Node *node = static_cast<Node *>(ptr);
+    Node *&head = local().heads[size_class];
+    node->next = head;
+    head = node;
+  }
+
+ private:
+  struct Node {
+    Node *next;
+  };
+
+  struct Lists {
+    Node *heads[kClasses] = {};
+
+    ~Lists() {
+      for (Node *head : heads) {
+        while (head) {
+          Node *next = head->next;
+          ::operator delete(head);
+          head = next;
+        }
+      }
+    }
+  };
+
+  static std::size_t class_of(std::size_t size) {
+    return (size + kGranularity - 1) / kGranularity - 1;
+  }
+
+  static Lists &local() {
+    static thread_local Lists lists;
+    return lists;
+  }
+};
+
+/**********************************************************************************************************************
+ * Task                                                                                                               *
+ **********************************************************************************************************************/
+
+class Task {
+ public:
+  struct promise_type {
+    Task get_return_object() noexcept {
+      return {};
+    }
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+    void return_void() noexcept {
+    }
+    void unhandled_exception() noexcept {
+      std::terminate();
+    }
+
+    static void *operator new(std::size_t size) {
+      return FramePool::allocate(size);
+    }
+    static void operator delete(void *ptr, std::size_t size) noexcept {
+      FramePool::deallocate(ptr, size);
+    }
+  };
+};
+
+/**********************************************************************************************************************
+ * Awaitables                                                                                                         *
+ **********************************************************************************************************************/
+
+namespace detail {
+
+/* Shared by all awaitables. The subscription may fire on another thread before await_suspend returns, so nothing in
+ * the awaiter may be touched after subscribing. */
+class Awaiter {
+ public:
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  /* The events that woke the coroutine, or TLB_EV_ERROR if it couldn't subscribe */
+  int await_resume() const noexcept {
+    return events_;
+  }
+
+ protected:
+  explicit Awaiter(tlb_event_loop *loop) : loop_(loop) {
+  }
+
+  void prepare(std::coroutine_handle<> continuation) noexcept {
+    continuation_ = continuation;
+    events_ = TLB_EV_ERROR;
+  }
+
+  static void on_event(tlb_handle handle, int events, void *userdata) {
+    Awaiter *self = static_cast<Awaiter *>(userdata);
+    self->events_ = events;
+    /* Gone from the kernel before the coroutine can subscribe the same fd again */
+    tlb_evl_remove(self->loop_, handle);
+    self->continuation_.resume();
+  }
+
+  static void on_timer(tlb_handle handle, int events, void *userdata) {
+    (void)handle;
+    Awaiter *self = static_cast<Awaiter *>(userdata);
+    self->events_ = events;
+    /* Timers remove themselves */
+    self->continuation_.resume();
+  }
+
+  tlb_event_loop *loop_;
+  std::coroutine_handle<> continuation_;
+  int events_ = 0;
+};
+
+}  // namespace detail
+
+/* Suspends until the fd has any of the requested events */
+class FdAwaiter : public detail::Awaiter {
+ public:
+  FdAwaiter(tlb_event_loop *loop, int fd, int events) : Awaiter(loop), fd_(fd), interest_(events) {
+  }
+
+  bool await_suspend(std::coroutine_handle<> continuation) noexcept {
+    prepare(continuation);
+    return tlb_evl_add_fd(loop_, fd_, interest_, false, &Awaiter::on_event, this) != TLB_HANDLE_INVALID;
+  }
+
+ private:
+  int fd_;
+  int interest_;
+};
+
+/* Suspends for timeout milliseconds, 0 to resume as soon as the loop gets to it */
+class TimerAwaiter : public detail::Awaiter {
+ public:
+  TimerAwaiter(tlb_event_loop *loop, int timeout) : Awaiter(loop), timeout_(timeout) {
+  }
+
+  bool await_suspend(std::coroutine_handle<> continuation) noexcept {
+    prepare(continuation);
+    return tlb_evl_add_timer(loop_, timeout_, &Awaiter::on_timer, this) != TLB_HANDLE_INVALID;
+  }
+
+ private:
+  int timeout_;
+};
+
+inline FdAwaiter readable(tlb_event_loop *loop, int fd) {
+  return FdAwaiter(loop, fd, TLB_EV_READ);
+}
+
+inline FdAwaiter writable(tlb_event_loop *loop, int fd) {
+  return FdAwaiter(loop, fd, TLB_EV_WRITE);
+}
+
+inline TimerAwaiter sleep_for(tlb_event_loop *loop, int timeout) {
+  return TimerAwaiter(loop, timeout);
+}
+
+/**
+ * Moves the coroutine onto loop, e.g. a sub-loop, so it runs with the same exclusivity as everything else subscribed to
+ * it.
+ */
+inline TimerAwaiter resume_on(tlb_event_loop *loop) {
+  return TimerAwaiter(loop, 0);
+}
+
+}  // namespace coro
+}  // namespace libtlb
+
+#endif /* __cpp_impl_coroutine */
+
+#endif /* TLB_CORO_HPP */
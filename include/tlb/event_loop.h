@@ -10,12 +10,49 @@ enum tlb_events {
   TLB_EV_WRITE = TLB_BIT(1),
   TLB_EV_CLOSE = TLB_BIT(2),
   TLB_EV_ERROR = TLB_BIT(3),
+  TLB_EV_TIMEOUT = TLB_BIT(4), /* Reported on its own, see tlb_evl_set_idle_timeout */
 };
 
-typedef void *tlb_handle;
+/** Slot index and generation, stale handles are rejected rather than dereferenced */
+typedef uint64_t tlb_handle;
+
+#define TLB_HANDLE_INVALID ((tlb_handle)0)
 
 typedef void tlb_on_event(tlb_handle handle, int events, void *userdata);
 
+/* A ready subscription passed to a batch handler */
+struct tlb_evl_batch_item {
+  tlb_handle handle;
+  int events; /* enum tlb_events */
+  void *userdata;
+};
+
+typedef void tlb_on_batch(const struct tlb_evl_batch_item *items, size_t count);
+
+/* Called once a subscription is gone and its callback can no longer be running */
+typedef void tlb_on_release(void *userdata);
+
+/* Userdata up to this size may be stored in the subscription itself */
+#define TLB_EVL_INLINE_SIZE 32U
+
+/* Memory held by a loop, see tlb_evl_memory_usage */
+struct tlb_evl_memory {
+  size_t loop_bytes;      /* The loop, its subscription table and tracing state, but not what the kernel holds for it */
+  size_t slot_bytes;      /* Size of a single subscription slot */
+  size_t slots_reserved;  /* Slots in allocated chunks, these are only freed with the loop */
+  size_t slots_live;      /* Slots currently subscribed */
+  size_t slots_extended;  /* Slots that have used optional features (e.g. inline data, strands) and keep their state */
+  bool allocator_tracked; /* Whether the loop's allocator is a tracking allocator and allocator was filled in */
+  struct tlb_memory_stats allocator;
+};
+
+/* A ready subscription collected by tlb_evl_poll, to be passed to tlb_evl_dispatch */
+struct tlb_evl_event {
+  tlb_handle handle;
+  int events;         /* enum tlb_events */
+  uint64_t polled_ns; /* When it was polled while tracing is enabled, so time spent waiting for dispatch is traced */
+};
+
 #define TLB_WAIT_NONE ((int)0)
 #define TLB_WAIT_INDEFINITE ((int)-1)
 
@@ -29,18 +66,121 @@ void tlb_evl_destroy(struct tlb_event_loop *loop);
 tlb_handle tlb_evl_add_fd(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger, tlb_on_event *on_event,
                           void *userdata);
 
+/**
+ * Subscribe a file descriptor with a batch handler. Every subscription with the same handler that a poll reports ready
+ * is passed to a single call, once the poll's other callbacks have run. Each one stays claimed until the handler
+ * returns, the same as with on_event, and events that arrive on their own (e.g. while it was running, or an idle
+ * timeout) are passed in a batch of one.
+ */
+tlb_handle tlb_evl_add_fd_batch(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger,
+                                tlb_on_batch *on_batch, void *userdata);
+
 /** Add a timer to fire in timeout milliseconds */
 tlb_handle tlb_evl_add_timer(struct tlb_event_loop *loop, int timeout, tlb_on_event *trigger, void *userdata);
 
+/**
+ * Variants that copy size bytes of data into the subscription, and pass the callback a pointer to that copy as its
+ * userdata. The copy lives until on_release (optional) is called with it, after removal once the callback has returned.
+ * on_release is only ever called for subscriptions that were added: if adding fails, for any reason, it isn't, and
+ * whatever data refers to is still the caller's to free.
+ */
+tlb_handle tlb_evl_add_fd_inline(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger,
+                                 tlb_on_event *on_event, const void *data, size_t size, tlb_on_release *on_release);
+tlb_handle tlb_evl_add_timer_inline(struct tlb_event_loop *loop, int timeout, tlb_on_event *trigger, const void *data,
+                                    size_t size, tlb_on_release *on_release);
+
 /** Add a sub-loop */
 tlb_handle tlb_evl_add_evl(struct tlb_event_loop *loop, struct tlb_event_loop *sub_loop);
 
-/** Remove a subscription from the loop */
+/** Remove a subscription from the loop, fails with ENOENT if it was already removed */
 int tlb_evl_remove(struct tlb_event_loop *loop, tlb_handle subscription);
 
+/**
+ * Change the events a file descriptor subscription is interested in. When called from the subscription's own callback
+ * the change is applied by the rearm that follows it, otherwise it's applied immediately.
+ */
+int tlb_evl_modify(struct tlb_event_loop *loop, tlb_handle subscription, int events);
+
+/**
+ * Called from a subscription's callback when it stopped with work left, e.g. after hitting its own limit for a single
+ * call. Instead of being rearmed it stays claimed on the loop's ready queue, and is passed the same events again by the
+ * next poll ahead of anything the kernel reports, saving a rearm and a poll. Nothing else can run it while it's queued,
+ * and removing, pausing or migrating it still works. Fails with EINVAL from anywhere but the subscription's own
+ * callback (on the thread running it), and for strand subscriptions and timers.
+ */
+int tlb_evl_requeue(struct tlb_event_loop *loop, tlb_handle subscription);
+
+/** Stop delivering events to a subscription without removing it, until it's resumed */
+int tlb_evl_pause(struct tlb_event_loop *loop, tlb_handle subscription);
+int tlb_evl_resume(struct tlb_event_loop *loop, tlb_handle subscription);
+
+/**
+ * Reports TLB_EV_TIMEOUT to a file descriptor subscription once it's gone timeout milliseconds without a callback, and
+ * again every timeout after that while it stays idle. 0 removes the timeout. Deadlines are kept by the loop itself in a
+ * timing wheel with 10ms ticks, sharing a single timer, so resetting one on every event is just a store.
+ */
+int tlb_evl_set_idle_timeout(struct tlb_event_loop *loop, tlb_handle subscription, int timeout);
+
+/**
+ * Names a subscription in logs, traces, the flight recorder and profiles (see tlb/profile.h), in place of "fd", "timer"
+ * or "sub-loop". Subscriptions sharing a name, e.g. every connection of a protocol, are profiled together. The name
+ * isn't copied, so it has to outlive the recorder's and profile's use of it (e.g. a string literal). It's kept when
+ * the subscription is migrated. Set it before the subscription can fire, or from its own callback.
+ */
+int tlb_evl_set_name(struct tlb_event_loop *loop, tlb_handle subscription, const char *name);
+
+/**
+ * Moves a file descriptor subscription to another loop, and returns its handle there. The old handle is stale once this
+ * returns. A callback that's already running finishes on the old loop, and its thread registers the subscription with
+ * the new one instead of rearming it, so the callback never runs on both at once. Events that were ready but not yet
+ * handled are reported again by the new loop. Timers, strand subscriptions and the library's own (channels, tlb/io.h
+ * and tlb/sendfile.h operations) can't be moved (EINVAL).
+ */
+tlb_handle tlb_evl_migrate(tlb_handle subscription, struct tlb_event_loop *from, struct tlb_event_loop *to);
+
+/**
+ * Reports the memory a loop holds. Give each loop its own tracking allocator (they may all wrap the same one) to have
+ * everything allocated on its behalf, including inline and boxed userdata, attributed to it.
+ */
+int tlb_evl_memory_usage(struct tlb_event_loop *loop, struct tlb_evl_memory *usage);
+
 /** Handles up to budget events, waiting for up to timeout milliseconds (or 0 to not wait, or -1 to wait forever) */
 int tlb_evl_handle_events(struct tlb_event_loop *loop, size_t budget, int timeout);
 
+/**
+ * tlb_evl_handle_events split in two, for embedding a loop in another one. The loop's fd becomes readable whenever
+ * there are events to poll, so it can be watched by the host's own poller.
+ *
+ * tlb_evl_poll collects up to count ready subscriptions into events, waiting like tlb_evl_handle_events, and returns
+ * how many it collected. Each subscription stays disarmed until its event is passed to tlb_evl_dispatch, which runs
+ * the callbacks and rearms them, so every polled event must be dispatched. Dispatching may happen on any thread, and
+ * polling again doesn't have to wait for it.
+ *
+ * Requeued subscriptions (see tlb_evl_requeue) are collected by the next poll without it waiting, but don't make the fd
+ * readable, so hosts should poll again without waiting for it while tlb_evl_requeued_count isn't 0.
+ */
+int tlb_evl_fd(const struct tlb_event_loop *loop);
+size_t tlb_evl_requeued_count(const struct tlb_event_loop *loop);
+int tlb_evl_poll(struct tlb_event_loop *loop, struct tlb_evl_event *events, size_t count, int timeout);
+void tlb_evl_dispatch(struct tlb_event_loop *loop, const struct tlb_evl_event *events, size_t count);
+
+/** The monotonic clock deadlines are measured against, in nanoseconds */
+uint64_t tlb_evl_now_ns(void);
+
+/**
+ * Keeps handling events until deadline_ns (see tlb_evl_now_ns), or until nothing is ready. Only the first poll waits,
+ * for up to timeout milliseconds but never past the deadline. Each poll only claims as many events as recent ones say
+ * there's time for, as claimed events have to be run, so the deadline is overshot by about one callback at most.
+ * Returns the number of events handled.
+ */
+int tlb_evl_handle_events_until(struct tlb_event_loop *loop, uint64_t deadline_ns, int timeout);
+
+/**
+ * How long a sub-loop keeps handling events each time its parent reports it ready, see tlb_evl_add_evl. 0 (the default)
+ * handles a single batch instead.
+ */
+void tlb_evl_set_time_slice(struct tlb_event_loop *sub_loop, uint64_t slice_ns);
+
 TLB_EXTERN_C_END
 
 #endif /* TLB_EVENT_LOOP_H */
@@ -0,0 +1,57 @@
+#ifndef TLB_IO_H
+#define TLB_IO_H
+
+#include "tlb/event_loop.h"
+
+#include <sys/types.h>
+
+/**
+ * Completion-style operations on a loop: each one is started now, and its callback is run by the loop once it's done.
+ * Sockets, pipes and the like are watched by a subscription per descriptor that performs its operations once it's
+ * ready, so they should be non-blocking. The subscription stays for as long as the descriptor has operations in flight,
+ * so one started from the previous one's callback (or going the other way) costs a rearm rather than subscribing it
+ * again. Regular files (and block devices), which can't be polled, are handed to a small pool of threads belonging to
+ * the loop instead of blocking a thread that handles it. Either way the callback is dispatched like any other, so it's
+ * observed, profiled and traced under the name "io", and never overlaps itself.
+ *
+ * A descriptor may have one reading (read, recv, accept) and one writing (write, send) operation in flight at a time,
+ * more fail with EBUSY, and its own subscriptions on the loop are left alone. Operations can't be cancelled, and any
+ * still in flight when the loop is destroyed are dropped without their callbacks.
+ *
+ * Each operation is a single system call made once the descriptor is ready, there's no io_uring backend: registered
+ * buffers and files, multishot accept and recv, and provided buffer rings are out of scope.
+ */
+
+/* Offset for reads and writes that use (and move) the descriptor's file position, rather than a fixed one */
+#define TLB_IO_POSITION ((int64_t)-1)
+
+/* Threads per loop for operations on regular files, started as they're needed */
+#define TLB_IO_THREADS 4U
+
+/* Operations on regular files a loop may have in flight at once, more fail with EAGAIN */
+#define TLB_IO_MAX_IN_FLIGHT 1024U
+
+/* result is what the system call returned (bytes transferred, or the accepted descriptor), or -errno on failure */
+typedef void tlb_on_io(struct tlb_event_loop *loop, ssize_t result, void *userdata);
+
+TLB_EXTERN_C_BEGIN
+
+/** Reads up to size bytes at offset (or TLB_IO_POSITION), completing with 0 at end of file */
+int tlb_evl_read(struct tlb_event_loop *loop, int fd, void *buffer, size_t size, int64_t offset, tlb_on_io *on_io,
+                 void *userdata);
+/** Writes up to size bytes at offset (or TLB_IO_POSITION), which may complete with fewer */
+int tlb_evl_write(struct tlb_event_loop *loop, int fd, const void *buffer, size_t size, int64_t offset,
+                  tlb_on_io *on_io, void *userdata);
+
+/** recv(2) and send(2) on a socket, with their flags */
+int tlb_evl_recv(struct tlb_event_loop *loop, int fd, void *buffer, size_t size, int flags, tlb_on_io *on_io,
+                 void *userdata);
+int tlb_evl_send(struct tlb_event_loop *loop, int fd, const void *buffer, size_t size, int flags, tlb_on_io *on_io,
+                 void *userdata);
+
+/** Accepts a connection on a listening socket, completing with a non-blocking, close-on-exec descriptor for it */
+int tlb_evl_accept(struct tlb_event_loop *loop, int fd, tlb_on_io *on_io, void *userdata);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_IO_H */
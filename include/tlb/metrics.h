@@ -0,0 +1,69 @@
+#ifndef TLB_METRICS_H
+#define TLB_METRICS_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Optional counters published to shared memory, so an out-of-process agent can scrape them without the process having
+ * to do anything. Names are POSIX shared memory names (e.g. "/myapp.loop", which lands in /dev/shm on Linux).
+ *
+ * Counters are split into records that each only have a single writer, a loop has one per thread that dispatches on
+ * it and a tlb one per worker. Each record is guarded by a seqlock, readers retry rather than block writers, so writers
+ * only ever make relaxed stores to a cache line nobody else writes to. While disabled the cost is a branch per batch
+ * and per rearm.
+ */
+
+struct tlb;
+
+enum tlb_metric {
+  TLB_METRIC_DISPATCHES,   /* Events dispatched, including ones that turned out to be stale */
+  TLB_METRIC_WAKEUPS,      /* Polls that returned events */
+  TLB_METRIC_REARMS,       /* Subscriptions rearmed after their callback */
+  TLB_METRIC_SUBSCRIBED,   /* Subscriptions added, minus TLB_METRIC_UNSUBSCRIBED for the live count */
+  TLB_METRIC_UNSUBSCRIBED, /* Subscriptions freed */
+  TLB_METRIC_BUSY_NS,      /* Time spent dispatching, as opposed to waiting in a poll */
+
+  TLB_METRIC_COUNT,
+};
+
+enum tlb_metrics_kind {
+  TLB_METRICS_LOOP = 1, /* Records are per thread, their indices mean nothing outside the process */
+  TLB_METRICS_WORKERS,  /* Records are per worker index, see tlb_current_worker */
+};
+
+struct tlb_metrics_values {
+  uint64_t values[TLB_METRIC_COUNT]; /* Indexed by enum tlb_metric */
+};
+
+struct tlb_metrics_info {
+  enum tlb_metrics_kind kind;
+  int64_t pid; /* Of the publishing process */
+  size_t record_count;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/**
+ * Start publishing a loop's counters under name, replacing whatever the loop published before. Counting starts from 0.
+ * Fails with EEXIST if another publisher (in this process or any other that's still running) has the name, a name left
+ * behind by a process that exited without unpublishing is taken over. Only the same user can read them.
+ */
+int tlb_evl_metrics_enable(struct tlb_event_loop *loop, const char *name);
+/** Stop publishing and remove the name */
+void tlb_evl_metrics_disable(struct tlb_event_loop *loop);
+
+/** Start publishing dispatches, wakeups and busy time of each of a tlb's workers under name, as above */
+int tlb_metrics_enable(struct tlb *tlb, const char *name);
+void tlb_metrics_disable(struct tlb *tlb);
+
+/**
+ * Read published counters, from any process. Totals across all records are added up into total, and up to capacity
+ * records are copied into records, either may be NULL. Fails with ENOENT if nothing is published under name, and EPROTO
+ * if it was published by an incompatible version.
+ */
+int tlb_metrics_read(const char *name, struct tlb_metrics_info *info, struct tlb_metrics_values *total,
+                     struct tlb_metrics_values *records, size_t capacity);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_METRICS_H */
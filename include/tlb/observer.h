@@ -0,0 +1,41 @@
+#ifndef TLB_OBSERVER_H
+#define TLB_OBSERVER_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Hooks around an event loop's polls, callbacks and rearms, for attaching tracing, metrics or epoch bookkeeping of your
+ * own. Hooks run on the thread doing the work, inline, so they should be quick. While a loop has no observer the cost
+ * is one well predicted branch per poll, callback and rearm.
+ */
+
+/* value is the timeout for on_poll_start, and the number of events collected (or -1 on failure) for on_poll_end */
+typedef void tlb_observe_poll(struct tlb_event_loop *loop, int value, void *userdata);
+
+/* Called with the subscription's name (see tlb_evl_set_name) and the events it's being run with, or rearmed for */
+typedef void tlb_observe_sub(struct tlb_event_loop *loop, tlb_handle handle, const char *name, int events,
+                             void *userdata);
+
+/* Any hook may be NULL */
+struct tlb_evl_observer {
+  tlb_observe_poll *on_poll_start;
+  tlb_observe_poll *on_poll_end;
+  /* Around each callback. A batch (see tlb_evl_add_fd_batch) is a single callback, under its first subscription. */
+  tlb_observe_sub *on_dispatch_start;
+  tlb_observe_sub *on_dispatch_end;
+  /* After a subscription is handed back to the kernel following its callback */
+  tlb_observe_sub *on_rearm;
+  void *userdata;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/**
+ * Sets a loop's hooks (they're copied), replacing any it already had, or removes them if observer is NULL. Threads in
+ * the middle of a poll or a batch may still call the old hooks for it, so their userdata has to outlive the loop.
+ */
+int tlb_evl_observe(struct tlb_event_loop *loop, const struct tlb_evl_observer *observer);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_OBSERVER_H */
@@ -0,0 +1,13 @@
+#ifndef TLB_PRIVATE_AFFINITY_H
+#define TLB_PRIVATE_AFFINITY_H
+
+#include "tlb/core.h"
+
+TLB_EXTERN_C_BEGIN
+
+/* Implemented per platform, pins the calling thread to a single CPU. Fails with ENOTSUP where that isn't possible. */
+int tlb_affinity_pin(int cpu);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_AFFINITY_H */
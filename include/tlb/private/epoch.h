@@ -0,0 +1,59 @@
+#ifndef TLB_PRIVATE_EPOCH_H
+#define TLB_PRIVATE_EPOCH_H
+
+#include "tlb/core.h"
+
+#include "tlb/allocator.h"
+
+#include <stdatomic.h>
+
+/**
+ * Epoch based reclamation.
+ *
+ * Any thread that may be holding a pointer to shared memory that can be unlinked concurrently (e.g. a loop's
+ * subscription table) must be pinned. Memory that was unlinked at epoch E may be freed once the global epoch has
+ * reached E + 2, as every thread that could have observed it has since unpinned.
+ */
+
+enum {
+  /* Maximum number of threads that may be pinned at the same time */
+  TLB_EPOCH_MAX_THREADS = 512,
+};
+
+/* Header for retired memory, must be at the start of the allocation */
+struct tlb_epoch_retired {
+  struct tlb_epoch_retired *next;
+  uint64_t epoch;
+};
+
+typedef _Atomic(struct tlb_epoch_retired *) tlb_epoch_retired_list;
+
+TLB_EXTERN_C_BEGIN
+
+/** Pin the calling thread to the current epoch. May be nested. */
+void tlb_epoch_pin(void);
+void tlb_epoch_unpin(void);
+
+/** Dense index of the calling thread's record, no other live thread has the same one */
+size_t tlb_epoch_thread_index(void);
+
+/** Gets the epoch that memory unlinked now should be tagged with */
+uint64_t tlb_epoch_current(void);
+
+/** Attempts to advance the global epoch, and returns the latest value */
+uint64_t tlb_epoch_advance(void);
+
+/** Push unlinked memory onto a retired list */
+void tlb_epoch_retire(tlb_epoch_retired_list *list, struct tlb_epoch_retired *retired);
+
+/** Free everything on a retired list that no thread can still be looking at (or everything if force is set) */
+void tlb_epoch_reclaim(tlb_epoch_retired_list *list, struct tlb_allocator *alloc, bool force);
+
+/** Whether memory tagged with retire_epoch may be freed, given the global epoch */
+static inline bool tlb_epoch_is_safe(uint64_t retire_epoch, uint64_t epoch) {
+  return retire_epoch + 2 <= epoch;
+}
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_EPOCH_H */
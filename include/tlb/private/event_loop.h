@@ -2,53 +2,258 @@
 #define EVENT_LOOP_H
 
 #include "tlb/event_loop.h"
+#include "tlb/private/epoch.h"
+#include "tlb/private/idle.h"
+#include "tlb/private/io.h"
+#include "tlb/private/metrics.h"
+#include "tlb/private/observer.h"
+#include "tlb/private/profile.h"
+#include "tlb/private/rate_limit.h"
+#include "tlb/private/recorder.h"
+#include "tlb/private/strand.h"
+#include "tlb/private/time.h"
+#include "tlb/private/trace.h"
+
+#include <stdatomic.h>
 
 enum tlb_sub_mode {
   TLB_SUB_EDGE = TLB_BIT(1),
+  TLB_SUB_ONESHOT = TLB_BIT(2),      /* Removed after the first event (timers) */
+  TLB_SUB_UNREGISTERED = TLB_BIT(3), /* Migrated here while running, the owner registers it instead of rearming */
+  TLB_SUB_REUSABLE = TLB_BIT(4),     /* Timers that stay subscribed once they fire, see tlb_evl_add_timer_reusable */
+  TLB_SUB_PINNED = TLB_BIT(5),       /* Owned by the library, see tlb_evl_add_fd_pinned */
+  TLB_SUB_BATCH = TLB_BIT(6),        /* Called through callback.on_batch */
+  TLB_SUB_STRAND = TLB_BIT(7),       /* Queued on ext->strand.strand when it fires, see tlb/strand.h */
+};
+
+/* Set in tlb_subscription::events while paused, the rest of the interest set is kept for resuming */
+#define TLB_EV_PAUSED TLB_BIT(7)
+/* Set in tlb_subscription::events while waiting for its rate limit to refill, like TLB_EV_PAUSED */
+#define TLB_EV_THROTTLED TLB_BIT(6)
+/* Set in tlb_evl_event::events for subscriptions taken off the ready queue, which are still claimed. Only trusted while
+ * the subscription's ready.state is TLB_READY_TAKEN, so an event that's dispatched twice (or made up) can't skip the
+ * claim. */
+#define TLB_EV_REQUEUED TLB_BIT(8)
+
+enum tlb_ready_state {
+  TLB_READY_NONE,
+  TLB_READY_QUEUED, /* On the ready queue */
+  TLB_READY_TAKEN,  /* Taken off it by a poll, the dispatch of that event puts it back to NONE and runs it */
 };
 
+/**
+ * SUBBED -> RUNNING:       A thread received an event and took ownership
+ * RUNNING -> REARMING:     The callback finished, the owner is resubscribing
+ * REARMING -> SUBBED:      The owner is done with the subscription
+ * REARMING -> PENDING:     Another thread received an event before the owner was done, the owner runs it instead
+ * PENDING -> RUNNING:      The owner picked up the pending events
+ * RUNNING -> RUNNING:      Another thread received an event while the callback was running, it's added to the pending
+ *                          events and the owner runs it again
+ * SUBBED -> MODIFYING:     The interest set changed while nothing owned the subscription, the modifier rearms it
+ * MODIFYING -> SUBBED:     The modifier is done
+ * RUNNING -> MIGRATING:    Moved to another loop while running, the owner hands it over to the new subscription
+ *                          instead of rearming
+ * SUBBED -> UNSUBBED:      Removed, the remover unsubscribes and frees the slot
+ * RUNNING -> UNSUBBING:    Removed while running, the remover is unsubscribing
+ * UNSUBBING -> UNSUBBED:   The remover is done first, the owner frees the slot once the callback returns
+ * UNSUBBING -> RELEASED:   The owner is done first, the remover frees the slot once it's unsubscribed
+ *
+ * Removal, dispatch and other modifiers wait out REARMING, PENDING and MODIFYING, as those only last for a single rearm
+ * call. Freeing a slot bumps its generation, so events and handles that refer to the old subscription no longer match.
+ * Everything but the owner treats a MIGRATING subscription as removed.
+ */
 enum tlb_sub_state {
   TLB_STATE_SUBBED,
   TLB_STATE_RUNNING,
+  TLB_STATE_REARMING,
+  TLB_STATE_PENDING,
+  TLB_STATE_MODIFYING,
+  TLB_STATE_MIGRATING,
+  TLB_STATE_UNSUBBING,
   TLB_STATE_UNSUBBED,
+  TLB_STATE_RELEASED,
+};
+
+/**
+ * The state word holds the state in the low byte, events handed off while RUNNING or PENDING above it, and the slot's
+ * generation in the top half. Generation 0 means the slot has never been used.
+ */
+#define TLB_SUB_WORD(gen, state, pending) \
+  (((uint64_t)(gen) << 32U) | ((uint64_t)(pending) << 8U) | (uint64_t)(state))
+#define TLB_SUB_STATE(word) ((enum tlb_sub_state)((word)&0xFFU))
+#define TLB_SUB_PENDING(word) ((int)(((word) >> 8U) & 0xFFU))
+#define TLB_SUB_GEN(word) ((uint32_t)((word) >> 32U))
+
+/* Handles are the slot index in the bottom half and the slot's generation in the top half */
+#define TLB_HANDLE(index, gen) (((tlb_handle)(gen) << 32U) | (tlb_handle)(index))
+#define TLB_HANDLE_INDEX(handle) ((uint32_t)(handle))
+#define TLB_HANDLE_GEN(handle) ((uint32_t)((handle) >> 32U))
+
+#define TLB_SUB_CHUNK_SIZE 256U
+
+/* Grows by doubling, old copies are retired */
+struct tlb_sub_chunks {
+  struct tlb_epoch_retired retired; /* Must be first */
+  size_t capacity;
+  struct tlb_subscription *chunks[];
+};
+
+/* Dense table of subscriptions, slots are never freed until the loop is */
+struct tlb_sub_table {
+  _Atomic(struct tlb_sub_chunks *) chunks;
+  _Atomic uint32_t reserved;  /* Number of slots ever handed out */
+  _Atomic uint64_t free_head; /* ABA tag in the top half, index + 1 of the first free slot in the bottom half */
+  mtx_t grow_mtx;             /* Only held while allocating chunks */
 };
 
 struct tlb_event_loop {
   struct tlb_allocator *alloc;
   int fd;
+
+  struct tlb_sub_table subs;
+
+  /* NULL unless tracing is enabled */
+  _Atomic(struct tlb_trace *) trace;
+
+  /* NULL unless hooks are set with tlb_evl_observe */
+  _Atomic(struct tlb_observer *) observer;
+
+  /* How long to run for when handled as a sub-loop, 0 for a single batch */
+  _Atomic uint64_t slice_ns;
+
+  /* Recent cost of a single event in tlb_evl_handle_events_until, used to size its batches */
+  _Atomic uint64_t event_cost_ns;
+
+  /* Created by the first idle timeout */
+  _Atomic(struct tlb_idle_wheel *) idle;
+
+  /* Created by the first operation on a regular file, see tlb/io.h */
+  _Atomic(struct tlb_io *) io;
+  struct tlb_io_watches io_watches;
+
+  /* Published counters, see tlb/metrics.h */
+  struct tlb_metrics_slot metrics;
+
+  /* Subscriptions requeued by their callbacks, still claimed and waiting for the next poll, see tlb_evl_requeue */
+  struct {
+    mtx_t mtx;
+    struct tlb_subscription *head;
+    struct tlb_subscription *tail;
+    _Atomic size_t count; /* Read without the lock, to skip it when empty */
+  } ready;
+
+  /* Memory unlinked from the loop, waiting for its epoch to pass */
+  tlb_epoch_retired_list retired;
+};
+
+/**
+ * What a subscription needs for features most never use, kept out of the slot so the table stays dense. It's allocated
+ * the first time a slot uses one of them and stays with the slot, reset each time it's reused, until the loop is freed.
+ * Threads holding a stale handle can still read it, just like the slot itself.
+ */
+struct tlb_sub_ext {
+  struct tlb_subscription *sub; /* The slot it belongs to */
+
+  /* Inline subscriptions point their userdata at inline_data, which on_release is called with once they're freed */
+  tlb_on_release *on_release;
+  union {
+    max_align_t align;
+    uint8_t bytes[TLB_EVL_INLINE_SIZE];
+  } inline_data;
+
+  /* When a reusable timer is next due, 0 while it's disarmed. Set by any thread, cleared by the owner once it fires. */
+  _Atomic uint64_t deadline_ns;
+
+  /* Where a subscription migrated while running is going, see TLB_STATE_MIGRATING */
+  struct {
+    struct tlb_event_loop *loop;
+    struct tlb_subscription *sub;
+  } migrate;
+
+  /* Idle deadline, see tlb/private/idle.h. The owner stores when each callback starts, the rest is under the wheel's
+   * lock. */
+  struct {
+    _Atomic uint64_t timeout_ns; /* 0 for none */
+    _Atomic uint64_t active_ns;
+    uint32_t seq;
+  } idle;
+
+  /* NULL unless rate limited, see tlb/rate_limit.h. The refill timer is added by the first throttle and set by the
+   * owner each time after that, it's removed along with the slot. */
+  _Atomic(struct tlb_rate_limiter *) limiter;
+  tlb_handle refill;
+
+  /* Subscriptions added through a strand are queued on it instead of being called by the dispatching thread */
+  struct {
+    struct tlb_strand *strand;
+    struct tlb_strand_task task;
+    int events;
+    uint64_t polled_ns;
+  } strand;
 };
 
 struct tlb_subscription {
+  _Atomic uint64_t state; /* TLB_SUB_WORD */
+
   union {
     int fd;
     uintptr_t ident;
   } ident;
 
-  tlb_on_event *on_event;
-  void *userdata;
+  union {
+    tlb_on_event *on_event;
+    tlb_on_batch *on_batch; /* With TLB_SUB_BATCH, see tlb_evl_add_fd_batch */
+  } callback;
+  void *userdata; /* Points at the extension's inline_data for inline subscriptions */
 
-  uint8_t events;         /* enum tlb_events */
-  uint8_t sub_mode;       /* enum tlb_sub_flags */
-  volatile uint8_t state; /* enum tlb_sub_state */
+  const char *name;
 
   /* Reserved for each platform to use */
   union {
     struct tlb_evl_epoll {
-      bool close;             /* Whether this fd should be closed on removal (timers) */
-      tlb_on_event *on_event; /* Some events need to wrap on_event, this keeps track of the original */
+      bool close; /* Whether this fd should be closed on removal (timers) */
     } epoll;
     struct tlb_evl_kqueue {
-      int16_t filters[2];
+      int16_t filters[2]; /* Registered filters, fds keep read in the first and write in the second */
       uintptr_t data;
     } kqueue;
   } platform;
 
-  const char *name;
+  _Atomic(struct tlb_sub_ext *) ext; /* NULL until the slot needs one, see tlb_evl_sub_extend */
+
+  uint32_t index;             /* Slot index in the loop's table */
+  _Atomic uint32_t free_next; /* index + 1 of the next free slot, while free */
+
+  /* Callbacks run so far, only written by the owner, and the count as of the last rebalance. Only the difference
+   * between them matters, so they're free to wrap. */
+  _Atomic uint32_t event_count;
+  uint32_t balanced_count;
+
+  /* requested is set by tlb_evl_requeue and read once the callback returns, both by the owner (checked against the
+   * thread's calling subscriptions). state follows it through the ready queue, next is under the loop's lock. */
+  struct {
+    bool requested;
+    _Atomic uint8_t state; /* enum tlb_ready_state */
+    uint8_t events;        /* Passed to the callback again */
+    uint32_t next;         /* index + 1 of the next queued slot */
+  } ready;
+
+  _Atomic uint8_t events; /* enum tlb_events, TLB_EV_PAUSED and TLB_EV_THROTTLED, may be changed by any thread */
+  uint8_t sub_mode;       /* enum tlb_sub_flags */
 };
 
-#define TLB_LOG_EVENT(sub, text) TLB_LOGF("[%s:%p] %s", ((struct tlb_subscription *)(sub))->name, (void *)(sub), text)
-#define TLB_LOGF_EVENT(sub, format, ...) \
-  TLB_LOGF("[%s:%p] " format, ((struct tlb_subscription *)(sub))->name, (void *)(sub), __VA_ARGS__)
+/* Logging every state change is only for debugging the loop itself, see tlb/observer.h for hooking into it instead. The
+ * if keeps the arguments checked (and used) when it's compiled out. */
+#ifndef TLB_EVENT_LOGGING
+#  define TLB_EVENT_LOGGING 0
+#endif
+#define TLB_LOGF_EVENT(sub, format, ...)                                                                \
+  do {                                                                                                  \
+    if (TLB_EVENT_LOGGING) {                                                                            \
+      TLB_LOGF("[%s:%p] " format, ((struct tlb_subscription *)(sub))->name, (void *)(sub), __VA_ARGS__) \
+    }                                                                                                   \
+  } while (0)
+#define TLB_LOG_EVENT(sub, text) TLB_LOGF_EVENT(sub, "%s", text)
 
 #define TLB_EV_EVENT_BATCH 100U
 
@@ -57,18 +262,101 @@ TLB_EXTERN_C_BEGIN
 /* on_event callback for subloops to process all events */
 tlb_on_event tlb_evl_sub_loop_on_event;
 
-/* Implemented per platform */
-
+/* Initialize/cleanup a loop that's embedded in another structure, a failed init leaves nothing to clean up */
 int tlb_evl_init(struct tlb_event_loop *loop, struct tlb_allocator *alloc);
 void tlb_evl_cleanup(struct tlb_event_loop *loop);
 
-/* Initializes specific types to the loop */
+/* Subscribe through a strand, see tlb/strand.h */
+tlb_handle tlb_evl_add_fd_strand(struct tlb_event_loop *loop, struct tlb_strand *strand, int fd, int events,
+                                 bool edge_trigger, tlb_on_event *on_event, void *userdata);
+tlb_handle tlb_evl_add_timer_strand(struct tlb_event_loop *loop, struct tlb_strand *strand, int timeout,
+                                    tlb_on_event *trigger, void *userdata);
+
+/**
+ * Adds a timer that stays subscribed once it fires, for the loop's own timers that would otherwise need a new one each
+ * time. It starts out disarmed, and each tlb_evl_timer_set arms it to fire once, timeout_ns from then. Any thread may
+ * set it, the latest deadline wins. Always inline, with nothing to release.
+ */
+tlb_handle tlb_evl_add_timer_reusable(struct tlb_event_loop *loop, tlb_on_event *trigger, const void *data,
+                                      size_t size);
+int tlb_evl_timer_set(struct tlb_event_loop *loop, tlb_handle timer, uint64_t timeout_ns);
+
+/**
+ * Adds an inline subscription the library owns (e.g. channels, stop pipes, io watches), which keeps state tied to the
+ * loop it was added to and so is never migrated or rebalanced
+ */
+tlb_handle tlb_evl_add_fd_pinned(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger,
+                                 tlb_on_event *on_event, const void *data, size_t size, tlb_on_release *on_release);
+
+/* Resolves a handle, returns NULL if it's stale or was never valid */
+struct tlb_subscription *tlb_evl_sub_get(struct tlb_event_loop *loop, tlb_handle handle);
+tlb_handle tlb_evl_sub_handle(const struct tlb_subscription *sub);
+
+/* The events the subscription should currently be armed for, none while paused or throttled */
+static inline int tlb_evl_sub_interest(const struct tlb_subscription *sub) {
+  const int events = atomic_load(&sub->events);
+  return (events & (TLB_EV_PAUSED | TLB_EV_THROTTLED)) ? 0 : events;
+}
+
+/* Whether tlb_evl_migrate can move it. Timers, strands and the library's own subscriptions stay on their loop. */
+static inline bool tlb_evl_sub_movable(const struct tlb_subscription *sub) {
+  return !(sub->sub_mode & (TLB_SUB_ONESHOT | TLB_SUB_REUSABLE | TLB_SUB_PINNED | TLB_SUB_STRAND));
+}
+
+/* The slot's extension, or NULL if it never needed one */
+static inline struct tlb_sub_ext *tlb_evl_sub_ext(const struct tlb_subscription *sub) {
+  return atomic_load_explicit(&((struct tlb_subscription *)sub)->ext, memory_order_acquire);
+}
+
+/* Returns the slot's extension, allocating it the first time. Returns NULL with errno set to ENOMEM on failure. */
+struct tlb_sub_ext *tlb_evl_sub_extend(struct tlb_event_loop *loop, struct tlb_subscription *sub);
+
+/* Calls fn on every live subscription, in slot order */
+void tlb_evl_sub_foreach(struct tlb_event_loop *loop, void (*fn)(struct tlb_subscription *sub, void *userdata),
+                         void *userdata);
+
+/* When a poll returned, only read while tracing is enabled */
+static inline uint64_t tlb_evl_poll_time(struct tlb_event_loop *loop) {
+  return atomic_load_explicit(&loop->trace, memory_order_relaxed) ? tlb_time_now_ns() : 0;
+}
+
+/* When set, holds the time the current thread's outermost callback started, or 0 between callbacks */
+extern _Thread_local _Atomic uint64_t *tlb_evl_heartbeat;
+
+/**
+ * Adds a pinned subscription for an fd the caller doesn't own (e.g. tlb/io.h and tlb/sendfile.h operations), leaving
+ * any subscription the fd already has on the loop alone. Where the platform can't share the fd's registration it
+ * registers a duplicate of it, *watch_fd is set to whichever it registers before it can fire, and the caller closes it
+ * on release if it isn't fd. On failure *watch_fd is fd again.
+ */
+tlb_handle tlb_evl_add_fd_shared(struct tlb_event_loop *loop, int fd, int events, tlb_on_event *on_event,
+                                 const void *data, size_t size, tlb_on_release *on_release, int *watch_fd);
+
+/* Runs an event received from the kernel, and rearms or frees the subscription. polled_ns is from tlb_evl_poll_time */
+void tlb_evl_dispatch_event(struct tlb_event_loop *loop, tlb_handle handle, int events, uint64_t polled_ns);
+
+/* Implemented per platform */
+
+int tlb_evl_impl_init(struct tlb_event_loop *loop);
+void tlb_evl_impl_cleanup(struct tlb_event_loop *loop);
+
+/**
+ * Whether subscribing an fd that already has a subscription on the loop fails with EEXIST (epoll), rather than quietly
+ * taking over the existing registration (kqueue, which only keys them by fd and filter)
+ */
+bool tlb_evl_impl_rejects_existing_fd(void);
+
+/* Initializes specific types to the loop. Reusable timers ignore the timeout and start out disarmed. */
 void tlb_evl_impl_fd_init(struct tlb_subscription *sub);
 void tlb_evl_impl_timer_init(struct tlb_subscription *sub, int timeout);
 
 /* All subscribe/unsubscribe implementations are the same */
 int tlb_evl_impl_subscribe(struct tlb_event_loop *loop, struct tlb_subscription *sub);
 int tlb_evl_impl_unsubscribe(struct tlb_event_loop *loop, struct tlb_subscription *sub);
+/* Arms the subscription for its current interest set, reusable timers for their deadline_ns (if there is one) */
+int tlb_evl_impl_rearm(struct tlb_event_loop *loop, struct tlb_subscription *sub);
+/* Polls the kernel, see tlb_evl_poll */
+int tlb_evl_impl_poll(struct tlb_event_loop *loop, struct tlb_evl_event *events, size_t count, int timeout);
 
 TLB_EXTERN_C_END
 
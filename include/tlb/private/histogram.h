@@ -0,0 +1,35 @@
+#ifndef TLB_PRIVATE_HISTOGRAM_H
+#define TLB_PRIVATE_HISTOGRAM_H
+
+#include "tlb/core.h"
+
+#include <stdatomic.h>
+
+/**
+ * Log-linear histogram in the style of HdrHistogram. Values are split into power of 2 ranges, which are each split into
+ * 2^TLB_HISTOGRAM_SUB_BITS linear buckets, so a bucket is never wider than 1/16th of the values in it. Recording is a
+ * couple of relaxed atomic adds, so any thread may record at any time.
+ */
+
+#define TLB_HISTOGRAM_SUB_BITS 4U
+#define TLB_HISTOGRAM_SUB_BUCKETS (1U << TLB_HISTOGRAM_SUB_BITS)
+#define TLB_HISTOGRAM_BUCKETS ((64U - TLB_HISTOGRAM_SUB_BITS + 1U) * TLB_HISTOGRAM_SUB_BUCKETS)
+
+struct tlb_histogram {
+  _Atomic uint64_t count;
+  _Atomic uint64_t min;
+  _Atomic uint64_t max;
+  _Atomic uint64_t buckets[TLB_HISTOGRAM_BUCKETS];
+};
+
+TLB_EXTERN_C_BEGIN
+
+void tlb_histogram_init(struct tlb_histogram *histogram);
+void tlb_histogram_record(struct tlb_histogram *histogram, uint64_t value);
+
+/** The upper bound of the bucket the given percentile (0-100) falls in, or 0 if nothing was recorded */
+uint64_t tlb_histogram_percentile(const struct tlb_histogram *histogram, double percentile);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_HISTOGRAM_H */
@@ -0,0 +1,49 @@
+#ifndef TLB_PRIVATE_IDLE_H
+#define TLB_PRIVATE_IDLE_H
+
+#include "tlb/event_loop.h"
+
+#include "tlb/core.h"
+
+/**
+ * Idle deadlines for a whole loop are kept in a hashed timing wheel, driven by a single reusable timer that's only
+ * set for the next tick with anything in it. Dispatching an event only stores the time on the subscription, the wheel
+ * checks that once the entry's tick comes around and moves it along if it's been active since.
+ */
+
+#define TLB_IDLE_TICK_NS 10000000U
+#define TLB_IDLE_WHEEL_SIZE 512U
+
+struct tlb_subscription;
+
+struct tlb_idle_entry {
+  tlb_handle handle;
+  uint32_t seq; /* Entries from before the timeout last changed are dropped */
+};
+
+struct tlb_idle_bucket {
+  struct tlb_idle_entry *entries;
+  size_t count;
+  size_t capacity;
+};
+
+struct tlb_idle_wheel {
+  mtx_t mtx;
+  uint64_t tick;       /* Next tick to expire */
+  uint64_t timer_tick; /* Tick the timer is set for, UINT64_MAX if it isn't */
+  tlb_handle timer;     /* See tlb_evl_add_timer_reusable, it's never migrated so the handle stays valid */
+  struct tlb_idle_bucket buckets[TLB_IDLE_WHEEL_SIZE];
+  struct tlb_idle_bucket retry; /* Entries that couldn't be moved along for lack of memory, tried again next tick */
+};
+
+TLB_EXTERN_C_BEGIN
+
+/* Sets or clears (timeout_ns of 0) a subscription's idle timeout, creating the loop's wheel if needed */
+int tlb_idle_watch(struct tlb_event_loop *loop, struct tlb_subscription *sub, uint64_t timeout_ns);
+
+/* Frees a loop's wheel, only for loop cleanup */
+void tlb_idle_cleanup(struct tlb_event_loop *loop);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_IDLE_H */
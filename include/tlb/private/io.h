@@ -0,0 +1,51 @@
+#ifndef TLB_PRIVATE_IO_H
+#define TLB_PRIVATE_IO_H
+
+#include "tlb/io.h"
+
+#include "tlb/core.h"
+
+#include <stdatomic.h>
+
+struct tlb_channel;
+struct tlb_io_op;
+struct tlb_io_watch;
+
+/**
+ * Descriptors with operations waiting for them to be ready, each watched by a single subscription for as long as it has
+ * any, so an operation started from the last one's callback (or going the other way) doesn't subscribe it again
+ */
+struct tlb_io_watches {
+  mtx_t mtx;
+  struct tlb_io_watch **by_fd;
+  size_t capacity;
+};
+
+/* Thread pool for operations on regular files, completed operations are passed back to the loop over a channel */
+struct tlb_io {
+  mtx_t mtx;
+  cnd_t cnd;
+  struct tlb_io_op *head; /* Queued for the threads */
+  struct tlb_io_op *tail;
+  bool stopping;
+  size_t threads;
+  size_t idle; /* Threads waiting on cnd */
+  thrd_t workers[TLB_IO_THREADS];
+
+  _Atomic size_t in_flight; /* Up to TLB_IO_MAX_IN_FLIGHT, so completions always fit in the channel */
+  struct tlb_channel *completed;
+  tlb_handle handle;
+};
+
+TLB_EXTERN_C_BEGIN
+
+int tlb_io_init(struct tlb_event_loop *loop);
+/**
+ * Stops a loop's threads and frees anything still in flight, only for loop cleanup. Watched descriptors are freed by
+ * their subscriptions, which are released afterwards.
+ */
+void tlb_io_cleanup(struct tlb_event_loop *loop);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_IO_H */
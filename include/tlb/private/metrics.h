@@ -0,0 +1,73 @@
+#ifndef TLB_PRIVATE_METRICS_H
+#define TLB_PRIVATE_METRICS_H
+
+#include "tlb/metrics.h"
+
+#include "tlb/allocator.h"
+
+#include <stdatomic.h>
+
+/**
+ * Layout of a published file, bump TLB_METRICS_VERSION on any change. The header is written before the magic, so
+ * readers that find the magic see the rest of it. Each record is a seqlock: its writer makes seq odd, stores the
+ * values, then makes it even again, readers retry until they see the same even seq on both sides of their reads.
+ */
+
+#define TLB_METRICS_MAGIC UINT64_C(0x544c424d54524353) /* "TLBMTRCS" */
+#define TLB_METRICS_VERSION 1U
+
+/* Per-thread records of a loop, threads past the last exclusive one share it and add atomically without the seqlock */
+#define TLB_METRICS_SHARDS 64U
+
+struct tlb_metrics_record {
+  _Alignas(64) _Atomic uint64_t seq;
+  _Atomic uint64_t values[TLB_METRIC_COUNT];
+};
+
+struct tlb_metrics_file {
+  _Atomic uint64_t magic;
+  uint32_t version;
+  uint32_t kind;
+  uint32_t record_count;
+  uint32_t record_size;
+  int64_t pid;
+  struct tlb_metrics_record records[];
+};
+
+/* A mapping published by this process */
+struct tlb_metrics {
+  struct tlb_metrics *next;
+  struct tlb_metrics_file *file;
+  size_t size;
+  char *name;
+};
+
+struct tlb_metrics_slot {
+  _Atomic(struct tlb_metrics *) current; /* NULL while disabled */
+  /* Every mapping ever published, replaced ones are kept until cleanup as writers may still be holding them */
+  _Atomic(struct tlb_metrics *) all;
+};
+
+TLB_EXTERN_C_BEGIN
+
+void tlb_metrics_init(struct tlb_metrics_slot *slot);
+/* Creates a mapping with record_count records and makes it the slot's current one */
+int tlb_metrics_publish(struct tlb_metrics_slot *slot, struct tlb_allocator *alloc, const char *name,
+                        enum tlb_metrics_kind kind, size_t record_count);
+/* Removes the name, the mapping stays around until cleanup */
+void tlb_metrics_unpublish(struct tlb_metrics_slot *slot);
+void tlb_metrics_cleanup(struct tlb_metrics_slot *slot, struct tlb_allocator *alloc);
+
+/* The current mapping, if any */
+static inline struct tlb_metrics *tlb_metrics_get(struct tlb_metrics_slot *slot) {
+  return atomic_load_explicit(&slot->current, memory_order_acquire);
+}
+
+/* Adds deltas to a record only the calling thread writes */
+void tlb_metrics_add(struct tlb_metrics *metrics, size_t record, const uint64_t deltas[TLB_METRIC_COUNT]);
+/* Adds deltas to the calling thread's record of a loop */
+void tlb_metrics_add_local(struct tlb_metrics *metrics, const uint64_t deltas[TLB_METRIC_COUNT]);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_METRICS_H */
@@ -0,0 +1,24 @@
+#ifndef TLB_PRIVATE_NOTIFY_H
+#define TLB_PRIVATE_NOTIFY_H
+
+#include "tlb/core.h"
+
+/* A readable fd that can be signalled from any thread, both ends are the same eventfd where there is one */
+struct tlb_notify {
+  int fd_read;
+  int fd_write;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/* Implemented per platform, all of them non-blocking */
+int tlb_notify_open(struct tlb_notify *notify);
+void tlb_notify_close(struct tlb_notify *notify);
+/* Makes fd_read readable, signalling it again while it already is may or may not do anything */
+void tlb_notify_signal(struct tlb_notify *notify);
+/* Consumes any signals, so fd_read isn't readable, and returns whether there were any */
+bool tlb_notify_clear(struct tlb_notify *notify);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_NOTIFY_H */
@@ -0,0 +1,21 @@
+#ifndef TLB_PRIVATE_OBSERVER_H
+#define TLB_PRIVATE_OBSERVER_H
+
+#include "tlb/observer.h"
+
+#include "tlb/private/epoch.h"
+
+/* Swapped out as a whole when the hooks change, old copies are retired */
+struct tlb_observer {
+  struct tlb_epoch_retired retired; /* Must be first */
+  struct tlb_evl_observer hooks;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/* Frees a loop's observer without waiting for readers, only for loop cleanup */
+void tlb_observer_cleanup(struct tlb_event_loop *loop);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_OBSERVER_H */
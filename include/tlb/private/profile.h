@@ -0,0 +1,54 @@
+#ifndef TLB_PRIVATE_PROFILE_H
+#define TLB_PRIVATE_PROFILE_H
+
+#include "tlb/profile.h"
+
+#include <stdatomic.h>
+
+/* Only the owning thread writes a slot, readers may see a call's counters partly added */
+struct tlb_profile_slot {
+  _Atomic(const char *) name; /* NULL until claimed, never changes after that */
+  _Atomic uint64_t calls;
+  _Atomic uint64_t wall_ns;
+  _Atomic uint64_t cpu_ns;
+};
+
+/* Tables belong to a thread's epoch record like recorder rings, and are reused along with it */
+struct tlb_profile_table {
+  struct tlb_profile_slot slots[TLB_PROFILE_NAMES];
+  struct tlb_profile_slot other;
+};
+
+/* A callback being measured, nested ones (e.g. a sub-loop's) take their time out of the one they ran in */
+struct tlb_profile_span {
+  struct tlb_profile_span *parent;
+  int flags; /* 0 if profiling was off when it started */
+  uint64_t wall_ns;
+  uint64_t cpu_ns;
+  uint64_t child_wall_ns;
+  uint64_t child_cpu_ns;
+};
+
+TLB_EXTERN_C_BEGIN
+
+extern _Atomic int tlb_profile_flags;
+
+void tlb_profile_span_start(struct tlb_profile_span *span, int flags);
+void tlb_profile_span_end(struct tlb_profile_span *span, const char *name, uint64_t calls);
+
+static inline void tlb_profile_start(struct tlb_profile_span *span) {
+  span->flags = atomic_load_explicit(&tlb_profile_flags, memory_order_relaxed);
+  if (span->flags) {
+    tlb_profile_span_start(span, span->flags);
+  }
+}
+
+static inline void tlb_profile_end(struct tlb_profile_span *span, const char *name, uint64_t calls) {
+  if (span->flags) {
+    tlb_profile_span_end(span, name, calls);
+  }
+}
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_PROFILE_H */
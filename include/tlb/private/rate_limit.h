@@ -0,0 +1,24 @@
+#ifndef TLB_PRIVATE_RATE_LIMIT_H
+#define TLB_PRIVATE_RATE_LIMIT_H
+
+#include "tlb/rate_limit.h"
+
+#include "tlb/private/epoch.h"
+
+/* Swapped out as a whole when the limit changes, old copies are retired. The buckets are only touched by the owner. */
+struct tlb_rate_limiter {
+  struct tlb_epoch_retired retired; /* Must be first */
+  struct tlb_rate_limit limit;
+  double event_tokens;
+  double byte_tokens; /* May go negative, the debt is paid off before it's rearmed */
+  uint64_t refilled_ns;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/* Takes a token for a callback that just returned, and returns how long to wait before rearming (0 to rearm now) */
+uint64_t tlb_rate_limiter_charge(struct tlb_rate_limiter *limiter, uint64_t now_ns);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_RATE_LIMIT_H */
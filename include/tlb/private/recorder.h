@@ -0,0 +1,67 @@
+#ifndef TLB_PRIVATE_RECORDER_H
+#define TLB_PRIVATE_RECORDER_H
+
+#include "tlb/recorder.h"
+
+#include "tlb/private/time.h"
+
+#include <stdatomic.h>
+
+enum tlb_record_type {
+  TLB_RECORD_POLL_ENTER,      /* subject is the loop, arg the timeout */
+  TLB_RECORD_POLL_EXIT,       /* arg is the number of events */
+  TLB_RECORD_DISPATCH_START,  /* subject is the subscription, arg the events */
+  TLB_RECORD_DISPATCH_END,    /* Same as the start */
+  TLB_RECORD_REARM,           /* subject is the subscription */
+  TLB_RECORD_REMOVE_DEFERRED, /* Removed while running, the owner frees it once the callback returns */
+  TLB_RECORD_REQUEUE,         /* Put on the ready queue instead of being rearmed, arg is the events */
+  TLB_RECORD_THREAD_START,    /* subject is the tlb, arg the worker index */
+  TLB_RECORD_THREAD_STOP,
+};
+
+/* Relaxed atomics, as dumps may read a record while its owner is overwriting it */
+struct tlb_record {
+  _Atomic uint64_t ticks; /* tlb_time_ticks */
+  _Atomic(const void *) subject;
+  _Atomic(const char *) name; /* Must outlive the record, e.g. a subscription's name */
+  _Atomic uint32_t type;      /* enum tlb_record_type */
+  _Atomic uint32_t arg;
+};
+
+/* Rings belong to a thread's epoch record, and are reused along with it */
+struct tlb_recorder_ring {
+  /* Entries ever written, only the owner writes it. Readers treat entries older than head - capacity as gone. */
+  _Alignas(64) _Atomic uint64_t head;
+  struct tlb_record records[TLB_RECORDER_CAPACITY];
+};
+
+TLB_EXTERN_C_BEGIN
+
+extern _Thread_local struct tlb_recorder_ring *tlb_recorder_local;
+
+/* Claims the calling thread's ring, NULL if it couldn't be allocated */
+struct tlb_recorder_ring *tlb_recorder_claim(void);
+
+static inline void tlb_record(enum tlb_record_type type, const void *subject, const char *name, uint32_t arg) {
+  struct tlb_recorder_ring *ring = tlb_recorder_local;
+  if (!ring && !(ring = tlb_recorder_claim())) {
+    return;
+  }
+
+  /* A seqlock with head as the sequence. Dumps may read the slot while it's being overwritten, then check head again
+   * and skip it. The fence orders the last head store before the overwrite's stores, so a dump that sees any of them
+   * (its acquire fence pairing with this one) also sees head past the slot. */
+  const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  struct tlb_record *record = &ring->records[head % TLB_RECORDER_CAPACITY];
+  atomic_store_explicit(&record->ticks, tlb_time_ticks(), memory_order_relaxed);
+  atomic_store_explicit(&record->subject, subject, memory_order_relaxed);
+  atomic_store_explicit(&record->name, name, memory_order_relaxed);
+  atomic_store_explicit(&record->type, (uint32_t)type, memory_order_relaxed);
+  atomic_store_explicit(&record->arg, arg, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_RECORDER_H */
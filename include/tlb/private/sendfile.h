@@ -0,0 +1,34 @@
+#ifndef TLB_PRIVATE_SENDFILE_H
+#define TLB_PRIVATE_SENDFILE_H
+
+#include "tlb/pipe.h"
+#include "tlb/sendfile.h"
+
+struct tlb_sendfile {
+  struct tlb_event_loop *loop;
+  int socket;
+  int watch_fd; /* The socket itself, or a duplicate of it, see tlb_evl_add_fd_shared */
+  int file;
+  int64_t offset;     /* Next byte of the file to send */
+  uint64_t remaining; /* Bytes left to send, from offset */
+  uint64_t sent;
+  tlb_on_sendfile *on_sendfile;
+  void *userdata;
+
+  /* Only opened when splicing, for files sendfile doesn't support */
+  bool splicing;
+  struct tlb_pipe pipe;
+  size_t piped; /* Bytes of the file from offset that are sitting in the pipe */
+};
+
+TLB_EXTERN_C_BEGIN
+
+/**
+ * Implemented per platform. Sends up to count bytes of the file from offset, and returns how many went (0 at the end of
+ * the file), or -1 with errno set, EAGAIN once the socket is full. Doesn't move offset itself.
+ */
+ssize_t tlb_sendfile_impl(struct tlb_sendfile *stream, size_t count);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_SENDFILE_H */
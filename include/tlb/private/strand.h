@@ -0,0 +1,34 @@
+#ifndef TLB_PRIVATE_STRAND_H
+#define TLB_PRIVATE_STRAND_H
+
+#include "tlb/strand.h"
+
+#include <stdatomic.h>
+
+struct tlb_strand;
+
+/* Intrusive run queue entry, subscriptions embed one and dispatched functions are allocated with one */
+struct tlb_strand_task {
+  struct tlb_strand_task *next;
+  void (*run)(struct tlb_strand *strand, struct tlb_strand_task *task);
+};
+
+struct tlb_strand {
+  struct tlb_allocator *alloc;
+  struct tlb_event_loop *loop;
+
+  /* Pushed onto the front, the runner takes the whole list at once and reverses it */
+  _Atomic(struct tlb_strand_task *) queue;
+
+  /* Held by whichever thread is running the queue */
+  atomic_bool running;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/* Queues a task, running the queue on this thread if nothing else is */
+void tlb_strand_schedule(struct tlb_strand *strand, struct tlb_strand_task *task);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_STRAND_H */
@@ -6,6 +6,9 @@
 #include "tlb/event_loop.h"
 
 #include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
 
 TLB_EXTERN_C_BEGIN
 
@@ -22,6 +25,26 @@ static inline struct timespec tlb_timeout_to_timespec(int timeout) {
   return timeout_spec;
 }
 
+static inline uint64_t tlb_time_now_ns(void) {
+  static const uint64_t nanos_per_second = 1000000000;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * nanos_per_second) + (uint64_t)now.tv_nsec;
+}
+
+/* Cheaper than tlb_time_now_ns where there's a cycle counter, only meaningful when calibrated against it */
+static inline uint64_t tlb_time_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return tlb_time_now_ns();
+#endif
+}
+
 TLB_EXTERN_C_END
 
 #endif /* TLB_PRIVATE_TIME_H */
@@ -0,0 +1,29 @@
+#ifndef TLB_PRIVATE_TRACE_H
+#define TLB_PRIVATE_TRACE_H
+
+#include "tlb/trace.h"
+
+#include "tlb/private/epoch.h"
+#include "tlb/private/histogram.h"
+
+/* Swapped out as a whole when tracing is enabled or disabled, old copies are retired */
+struct tlb_trace {
+  struct tlb_epoch_retired retired; /* Must be first */
+  struct tlb_trace_options options;
+  struct tlb_histogram histograms[TLB_TRACE_HISTOGRAM_COUNT];
+};
+
+struct tlb_subscription;
+
+TLB_EXTERN_C_BEGIN
+
+/* Records a callback that started at start_ns, polled_ns is 0 if the callback wasn't run straight out of a poll */
+void tlb_trace_callback(struct tlb_trace *trace, const struct tlb_subscription *sub, tlb_handle handle,
+                        uint64_t polled_ns, uint64_t start_ns);
+
+/* Frees a loop's trace without waiting for readers, only for loop cleanup */
+void tlb_trace_cleanup(struct tlb_event_loop *loop);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PRIVATE_TRACE_H */
@@ -0,0 +1,48 @@
+#ifndef TLB_PROFILE_H
+#define TLB_PROFILE_H
+
+#include "tlb/core.h"
+
+/**
+ * Callback cost attribution. While enabled, every callback's wall time (and optionally the CPU time of the thread that
+ * ran it) is added up by the name of its subscription, see tlb_evl_set_name. Totals are kept in per-thread tables, so
+ * recording is a couple of clock reads and a few stores, and are only summed up across threads when read.
+ *
+ * Times are exclusive: a sub-loop's entry doesn't include the callbacks it ran, they're counted under their own names.
+ * Batches (see tlb_evl_add_fd_batch) are recorded under the first subscription's name, with a call per subscription.
+ */
+
+enum tlb_profile_flags {
+  TLB_PROFILE_WALL = TLB_BIT(0), /* Monotonic time from the callback starting to it returning */
+  TLB_PROFILE_CPU = TLB_BIT(1),  /* CPU time of the thread that ran it, which costs a syscall on some platforms */
+};
+
+/* Names are compared by address when recording, each thread keeps up to this many before counting the rest as other */
+#define TLB_PROFILE_NAMES 128U
+
+/* Totals for names that didn't fit in a thread's table are reported under this name */
+#define TLB_PROFILE_OTHER "(other)"
+
+struct tlb_profile_entry {
+  const char *name;
+  uint64_t calls;
+  uint64_t wall_ns;
+  uint64_t cpu_ns;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/** Starts (or changes what's measured by) profiling every loop's callbacks, flags are from enum tlb_profile_flags */
+void tlb_profile_enable(int flags);
+void tlb_profile_disable(void);
+
+/**
+ * Sums every thread's totals by name (equal strings at different addresses are merged), into entries ordered by wall
+ * time and then CPU time, highest first. Returns the number of names, which may be more than capacity, in which case
+ * only the most expensive ones are filled in. Totals only ever grow, diff two reads for a rate.
+ */
+size_t tlb_profile_read(struct tlb_profile_entry *entries, size_t capacity);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_PROFILE_H */
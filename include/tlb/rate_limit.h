@@ -0,0 +1,33 @@
+#ifndef TLB_RATE_LIMIT_H
+#define TLB_RATE_LIMIT_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Token bucket limits for file descriptor subscriptions. Each callback takes a token, and callbacks may also report the
+ * bytes they handled. Once a subscription runs out of either, it isn't rearmed after its callback returns, and a timer
+ * rearms it once enough has refilled. Whatever is ready in the meantime waits in the kernel, so one busy client can't
+ * keep a worker to itself. Subscriptions without a limit only pay for checking that they don't have one.
+ */
+
+struct tlb_rate_limit {
+  double events_per_second; /* Callbacks, 0 for no limit */
+  double event_burst;       /* Callbacks that may run back to back, defaults to a second's worth */
+  double bytes_per_second;  /* Bytes reported with tlb_evl_rate_consume, 0 for no limit */
+  double byte_burst;        /* Defaults to a second's worth */
+};
+
+TLB_EXTERN_C_BEGIN
+
+/**
+ * Sets (or with NULL, removes) a subscription's limit, starting with full buckets. A subscription that's already
+ * waiting for its buckets to refill stays disarmed until that wait is over. Timers can't be limited (EINVAL).
+ */
+int tlb_evl_set_rate_limit(struct tlb_event_loop *loop, tlb_handle subscription, const struct tlb_rate_limit *limit);
+
+/** Takes bytes from a subscription's byte bucket, may only be called from its own callback */
+int tlb_evl_rate_consume(struct tlb_event_loop *loop, tlb_handle subscription, size_t bytes);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_RATE_LIMIT_H */
@@ -0,0 +1,39 @@
+#ifndef TLB_REBALANCE_H
+#define TLB_REBALANCE_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Spreads load across a set of loops (e.g. sub-loops, or loops that each have their own thread) by moving their busiest
+ * subscriptions with tlb_evl_migrate. Load is the number of callbacks each subscription ran since the last rebalance.
+ * Call it periodically, e.g. from a timer.
+ */
+
+/* Handles change when subscriptions move, this is called with the old and new one for every move */
+typedef void tlb_on_migrate(tlb_handle from_handle, struct tlb_event_loop *from, tlb_handle to_handle,
+                            struct tlb_event_loop *to, void *userdata);
+
+struct tlb_rebalance_options {
+  /* How far above the average a loop's load must be before anything is moved off it, e.g. 0.25 for 25% */
+  double threshold;
+
+  /* Most subscriptions to move per call, 0 for no limit */
+  size_t max_moves;
+
+  /* Required */
+  tlb_on_migrate *on_migrate;
+  void *userdata;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/**
+ * Moves the busiest subscriptions off loops that have been busier than the average since the last call, onto the
+ * quietest, leaving alone any that tlb_evl_migrate can't move. Returns the number of subscriptions moved. Must not run
+ * concurrently with itself on the same loops.
+ */
+int tlb_evl_rebalance(struct tlb_event_loop **loops, size_t count, const struct tlb_rebalance_options *options);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_REBALANCE_H */
@@ -0,0 +1,34 @@
+#ifndef TLB_RECORDER_H
+#define TLB_RECORDER_H
+
+#include "tlb/core.h"
+
+/**
+ * Flight recorder. Every thread that polls or dispatches keeps a fixed-size ring of its most recent scheduling
+ * history: polls, callbacks (with the subscription's name and address), rearms, removes that had to wait for a running
+ * callback, and worker threads starting and stopping. Recording is always on, and costs a cycle counter read and a few
+ * stores per entry.
+ *
+ * The rings can be dumped as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev both open.
+ */
+
+/* Entries kept per thread */
+#define TLB_RECORDER_CAPACITY 16384U
+
+TLB_EXTERN_C_BEGIN
+
+/**
+ * Write every thread's history to fd. It doesn't allocate or take locks, so it's safe to call from a crash handler, or
+ * while the threads are still recording (entries overwritten mid-dump are left out).
+ */
+int tlb_recorder_dump(int fd);
+
+/**
+ * Dump to path on the first SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT, then hand the signal on to the handler that was
+ * installed before (or the default action), which stays installed from then on.
+ */
+int tlb_recorder_dump_on_crash(const char *path);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_RECORDER_H */
@@ -0,0 +1,31 @@
+#ifndef TLB_SENDFILE_H
+#define TLB_SENDFILE_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Streams a range of a file to a socket without copying it through userspace, with sendfile (or splice through a pipe,
+ * for files sendfile won't take). Each transfer is a subscription on the socket that sends as much as it can whenever
+ * the socket is writable, requeuing itself (see tlb_evl_requeue) after each 1MiB so a loop can run any number of them
+ * side by side. The socket should be non-blocking, and like send without MSG_NOSIGNAL, a peer that's gone raises
+ * SIGPIPE unless it's ignored.
+ */
+
+/**
+ * Called with the total bytes sent so far after each callback that sent any, and once more with done set when the
+ * transfer is over, with error 0 or the errno it failed with. A file that ends before the range does ends it early.
+ */
+typedef void tlb_on_sendfile(struct tlb_event_loop *loop, uint64_t sent, bool done, int error, void *userdata);
+
+TLB_EXTERN_C_BEGIN
+
+/**
+ * Starts sending length bytes (0 for the rest of the file) of file from offset to socket, without moving the file's
+ * position. Removing the returned subscription with tlb_evl_remove cancels the transfer without calling on_sendfile.
+ */
+tlb_handle tlb_sendfile_stream(struct tlb_event_loop *loop, int socket, int file, int64_t offset, uint64_t length,
+                               tlb_on_sendfile *on_sendfile, void *userdata);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_SENDFILE_H */
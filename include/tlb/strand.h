@@ -0,0 +1,46 @@
+#ifndef TLB_STRAND_H
+#define TLB_STRAND_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Strands serialize callbacks without a kernel object of their own. Subscriptions added through a strand live in the
+ * strand's loop like any other, but when one fires it's pushed onto the strand's lock-free run queue instead of being
+ * called. Whichever thread finds the strand idle runs the queue until it's empty, so no two of the strand's callbacks
+ * ever run at the same time, and no thread ever waits for another to finish.
+ *
+ * This gives the same guarantee as a sub-loop added with tlb_evl_add_evl, without a second epoll/kqueue fd per group or
+ * the extra poll and rearm for each event.
+ */
+
+struct tlb_strand;
+
+typedef void tlb_strand_fn(void *userdata);
+
+TLB_EXTERN_C_BEGIN
+
+struct tlb_strand *tlb_strand_new(struct tlb_event_loop *loop);
+
+/**
+ * Every subscription must have been removed before destroying a strand. Waits for anything still queued to finish, so
+ * must not be called from one of the strand's own callbacks.
+ */
+void tlb_strand_destroy(struct tlb_strand *strand);
+
+/** Same as tlb_evl_add_fd/tlb_evl_add_timer on the strand's loop, handles are removed with tlb_evl_remove */
+tlb_handle tlb_strand_add_fd(struct tlb_strand *strand, int fd, int events, bool edge_trigger, tlb_on_event *on_event,
+                             void *userdata);
+tlb_handle tlb_strand_add_timer(struct tlb_strand *strand, int timeout, tlb_on_event *trigger, void *userdata);
+
+/**
+ * Runs fn on the strand. If the strand is idle it runs right away on the calling thread, otherwise it's queued behind
+ * whatever is running, and run by that thread once it's done.
+ */
+int tlb_strand_dispatch(struct tlb_strand *strand, tlb_strand_fn *fn, void *userdata);
+
+/** Whether the calling thread is running the strand's queue */
+bool tlb_strand_running_in_this_thread(const struct tlb_strand *strand);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_STRAND_H */
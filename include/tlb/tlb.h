@@ -10,8 +10,36 @@
  */
 struct tlb;
 
+/* Called from the watchdog thread when a worker has been stuck in a single callback for stalled_ms */
+typedef void tlb_on_stall(size_t worker, uint64_t stalled_ms, void *userdata);
+
+/* Called on a worker thread as it starts, before it handles any events, and as it stops, after it's handled its last */
+typedef void tlb_on_thread(struct tlb *tlb, size_t worker, void *userdata);
+
+/* What tlb_current_worker returns outside of a worker */
+#define TLB_WORKER_NONE SIZE_MAX
+
+/* Userdata slots each worker has, see tlb_worker_slot_get */
+#define TLB_WORKER_SLOTS 8U
+
+/* Leaves a dedicated sub-loop's thread to the scheduler, see tlb_add_dedicated_evl */
+#define TLB_CPU_ANY (-1)
+
 struct tlb_options {
   size_t max_thread_count;
+
+  /* Workers stuck in a callback for longer than this are reported, 0 to not run the watchdog */
+  uint32_t stall_threshold_ms;
+  /* Extra workers the watchdog may start to cover for stalled ones, they're stopped again once the stall clears */
+  size_t max_compensating_threads;
+  /* Called for each newly stalled worker, they're logged if this is NULL */
+  tlb_on_stall *on_stall;
+  void *stall_userdata;
+
+  /* Optional, e.g. for setting up per-thread arenas, affinity or metrics shards. Compensating threads get them too. */
+  tlb_on_thread *on_thread_start;
+  tlb_on_thread *on_thread_stop;
+  void *thread_userdata;
 };
 
 TLB_EXTERN_C_BEGIN
@@ -22,9 +50,42 @@ void tlb_destroy(struct tlb *tlb);
 int tlb_start(struct tlb *tlb);
 int tlb_stop(struct tlb *tlb);
 
+/** Number of worker threads currently running, including compensating ones */
+size_t tlb_active_threads(struct tlb *tlb);
+
 /** Gets the event loop that things may be subscribed to */
 struct tlb_event_loop *tlb_get_evl(struct tlb *tlb);
 
+/**
+ * Runs sub_loop on a thread of its own that blocks on it directly, instead of adding it to tlb_get_evl's loop where its
+ * events would wait behind everyone else's. Subscribe to sub_loop as usual, but don't handle its events anywhere else.
+ * The thread is pinned to cpu unless it's TLB_CPU_ANY, and runs while the workers do: it's started by tlb_start (or
+ * right away if they're already running) and stopped by tlb_stop. It isn't a worker, so it has no worker index and
+ * doesn't run on_thread_start/stop. Fails if the thread can't be started or pinned, with ENOTSUP where pinning isn't
+ * supported, and EEXIST if sub_loop already has a thread. sub_loop must outlive tlb, or be removed from it first.
+ */
+int tlb_add_dedicated_evl(struct tlb *tlb, struct tlb_event_loop *sub_loop, int cpu);
+
+/** Stops sub_loop's dedicated thread for good, sub_loop itself and its subscriptions are left as they are */
+int tlb_remove_dedicated_evl(struct tlb *tlb, struct tlb_event_loop *sub_loop);
+
+/**
+ * Index of the worker the calling thread is, from 0 up to tlb_worker_count, or TLB_WORKER_NONE if it isn't one. A
+ * thread keeps its index until it stops, after which it's free to be reused. Compensating threads take the lowest free
+ * index, so while threads come and go the indices in use may have gaps.
+ */
+size_t tlb_current_worker(void);
+
+/** Number of worker indices there may be, including compensating threads */
+size_t tlb_worker_count(const struct tlb *tlb);
+
+/**
+ * Per-worker userdata, TLB_WORKER_SLOTS of them for each worker index. Each slot is meant to be written by its own
+ * worker (e.g. from on_thread_start) and read by anyone, they're kept until the tlb is destroyed.
+ */
+void *tlb_worker_slot_get(struct tlb *tlb, size_t worker, size_t slot);
+int tlb_worker_slot_set(struct tlb *tlb, size_t worker, size_t slot, void *value);
+
 TLB_EXTERN_C_END
 
 #endif /* TLB_TLB_H */
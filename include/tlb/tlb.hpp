@@ -0,0 +1,347 @@
+#ifndef TLB_TLB_HPP
+#define TLB_TLB_HPP
+
+/**
+ * Header only C++ wrapper.
+ *
+ * libtlb::Subscription is a move-only handle that removes its subscription when it's destroyed. Callbacks take the
+ * events that fired, and may be:
+ *  - A member function bound at compile time, i.e. loop.add_fd<&Handler::on_read>(fd, TLB_EV_READ, &handler), which
+ *    calls straight through a generated trampoline with the handler as userdata.
+ *  - Any callable. Trivially copyable callables that fit in TLB_EVL_INLINE_SIZE are stored in the subscription itself,
+ *    anything else is moved to the heap and freed once the subscription is gone.
+ *
+ * The namespace is libtlb rather than tlb, as that's taken by struct tlb.
+ */
+
+#include "tlb/event_loop.h"
+#include "tlb/tlb.h"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace libtlb {
+
+namespace detail {
+
+template <typename F>
+struct FitsInline
+    : std::integral_constant<bool, sizeof(F) <= TLB_EVL_INLINE_SIZE && alignof(F) <= alignof(std::max_align_t) &&
+                                       std::is_trivially_copyable<F>::value> {};
+
+template <typename F>
+void invoke_inline(tlb_handle handle, int events, void *userdata) {
+  (void)handle;
+  (*static_cast<F *>(userdata))(events);
+}
+
+template <typename F>
+void invoke_boxed(tlb_handle handle, int events, void *userdata) {
+  (void)handle;
+  (**static_cast<F **>(userdata))(events);
+}
+
+template <typename F>
+void release_boxed(void *userdata) {
+  delete *static_cast<F **>(userdata);
+}
+
+template <typename Handler, void (Handler::*Method)(int events)>
+void invoke_member(tlb_handle handle, int events, void *userdata) {
+  (void)handle;
+  (static_cast<Handler *>(userdata)->*Method)(events);
+}
+
+template <typename T>
+struct MemberOf;
+
+template <typename Handler>
+struct MemberOf<void (Handler::*)(int events)> {
+  using type = Handler;
+};
+
+}  // namespace detail
+
+/**********************************************************************************************************************
+ * Subscription                                                                                                       *
+ **********************************************************************************************************************/
+
+class Subscription {
+ public:
+  Subscription() noexcept = default;
+  Subscription(tlb_event_loop *loop, tlb_handle handle) noexcept : loop_(loop), handle_(handle) {
+  }
+
+  Subscription(const Subscription &) = delete;
+  Subscription &operator=(const Subscription &) = delete;
+
+  Subscription(Subscription &&other) noexcept : loop_(other.loop_), handle_(other.release()) {
+  }
+  Subscription &operator=(Subscription &&other) noexcept {
+    if (this != &other) {
+      reset();
+      loop_ = other.loop_;
+      handle_ = other.release();
+    }
+    return *this;
+  }
+
+  ~Subscription() {
+    reset();
+  }
+
+  /** Removes the subscription. Timers that already fired are gone, and their stale handle is ignored. */
+  void reset() noexcept {
+    if (handle_ != TLB_HANDLE_INVALID) {
+      tlb_evl_remove(loop_, handle_);
+      handle_ = TLB_HANDLE_INVALID;
+    }
+  }
+
+  /** Stops managing the subscription without removing it */
+  tlb_handle release() noexcept {
+    const tlb_handle handle = handle_;
+    handle_ = TLB_HANDLE_INVALID;
+    return handle;
+  }
+
+  tlb_handle get() const noexcept {
+    return handle_;
+  }
+
+  explicit operator bool() const noexcept {
+    return handle_ != TLB_HANDLE_INVALID;
+  }
+
+  int modify(int events) noexcept {
+    return tlb_evl_modify(loop_, handle_, events);
+  }
+  int pause() noexcept {
+    return tlb_evl_pause(loop_, handle_);
+  }
+  int resume() noexcept {
+    return tlb_evl_resume(loop_, handle_);
+  }
+  int set_idle_timeout(int timeout) noexcept {
+    return tlb_evl_set_idle_timeout(loop_, handle_, timeout);
+  }
+
+ private:
+  tlb_event_loop *loop_ = nullptr;
+  tlb_handle handle_ = TLB_HANDLE_INVALID;
+};
+
+/**********************************************************************************************************************
+ * EventLoop                                                                                                          *
+ **********************************************************************************************************************/
+
+class EventLoop {
+ public:
+  /** Creates and owns a new loop */
+  explicit EventLoop(tlb_allocator *alloc) : loop_(tlb_evl_new(alloc)), owned_(true) {
+  }
+
+  /** Wraps a loop owned by someone else, e.g. a tlb's super loop */
+  static EventLoop borrow(tlb_event_loop *loop) noexcept {
+    return EventLoop(loop);
+  }
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  EventLoop(EventLoop &&other) noexcept : loop_(other.loop_), owned_(other.owned_) {
+    other.loop_ = nullptr;
+    other.owned_ = false;
+  }
+  EventLoop &operator=(EventLoop &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      loop_ = other.loop_;
+      owned_ = other.owned_;
+      other.loop_ = nullptr;
+      other.owned_ = false;
+    }
+    return *this;
+  }
+
+  ~EventLoop() {
+    destroy();
+  }
+
+  tlb_event_loop *get() const noexcept {
+    return loop_;
+  }
+
+  explicit operator bool() const noexcept {
+    return loop_ != nullptr;
+  }
+
+  /** Calls (handler->*Method)(events) */
+  template <typename Handler, void (Handler::*Method)(int events)>
+  Subscription add_fd(int fd, int events, Handler *handler, bool edge_trigger = false) {
+    return Subscription(
+        loop_, tlb_evl_add_fd(loop_, fd, events, edge_trigger, &detail::invoke_member<Handler, Method>, handler));
+  }
+
+#if defined(__cpp_nontype_template_parameter_auto)
+  /** Same as above, deducing the handler type, i.e. add_fd<&Handler::on_read>(fd, events, &handler) */
+  template <auto Method>
+  Subscription add_fd(int fd, int events, typename detail::MemberOf<decltype(Method)>::type *handler,
+                      bool edge_trigger = false) {
+    using Handler = typename detail::MemberOf<decltype(Method)>::type;
+    return add_fd<Handler, Method>(fd, events, handler, edge_trigger);
+  }
+#endif
+
+  /** Calls callable(events) */
+  template <typename F>
+  Subscription add_fd(int fd, int events, F &&callable, bool edge_trigger = false) {
+    using Callable = typename std::decay<F>::type;
+    return add_fd_impl<Callable>(fd, events, edge_trigger, std::forward<F>(callable), detail::FitsInline<Callable>());
+  }
+
+  /** Calls callable(events) once after timeout milliseconds */
+  template <typename F>
+  Subscription add_timer(int timeout, F &&callable) {
+    using Callable = typename std::decay<F>::type;
+    return add_timer_impl<Callable>(timeout, std::forward<F>(callable), detail::FitsInline<Callable>());
+  }
+
+  Subscription add_evl(EventLoop &sub_loop) {
+    return Subscription(loop_, tlb_evl_add_evl(loop_, sub_loop.get()));
+  }
+
+  int handle_events(size_t budget, int timeout) {
+    return tlb_evl_handle_events(loop_, budget, timeout);
+  }
+
+  int handle_events_until(uint64_t deadline_ns, int timeout = TLB_WAIT_NONE) {
+    return tlb_evl_handle_events_until(loop_, deadline_ns, timeout);
+  }
+
+  int fd() const {
+    return tlb_evl_fd(loop_);
+  }
+
+  int poll(tlb_evl_event *events, size_t count, int timeout) {
+    return tlb_evl_poll(loop_, events, count, timeout);
+  }
+
+  void dispatch(const tlb_evl_event *events, size_t count) {
+    tlb_evl_dispatch(loop_, events, count);
+  }
+
+ private:
+  explicit EventLoop(tlb_event_loop *loop) noexcept : loop_(loop), owned_(false) {
+  }
+
+  void destroy() noexcept {
+    if (owned_ && loop_) {
+      tlb_evl_destroy(loop_);
+    }
+    loop_ = nullptr;
+    owned_ = false;
+  }
+
+  template <typename Callable, typename F>
+  Subscription add_fd_impl(int fd, int events, bool edge_trigger, F &&callable, std::true_type /* inline */) {
+    const Callable copy(std::forward<F>(callable));
+    return Subscription(loop_, tlb_evl_add_fd_inline(loop_, fd, events, edge_trigger, &detail::invoke_inline<Callable>,
+                                                     &copy, sizeof(copy), nullptr));
+  }
+
+  template <typename Callable, typename F>
+  Subscription add_fd_impl(int fd, int events, bool edge_trigger, F &&callable, std::false_type /* inline */) {
+    Callable *boxed = new Callable(std::forward<F>(callable));
+    const tlb_handle handle = tlb_evl_add_fd_inline(loop_, fd, events, edge_trigger, &detail::invoke_boxed<Callable>,
+                                                    &boxed, sizeof(boxed), &detail::release_boxed<Callable>);
+    if (handle == TLB_HANDLE_INVALID) {
+      // Never released, as it was never added
+      delete boxed;
+    }
+    return Subscription(loop_, handle);
+  }
+
+  template <typename Callable, typename F>
+  Subscription add_timer_impl(int timeout, F &&callable, std::true_type /* inline */) {
+    const Callable copy(std::forward<F>(callable));
+    return Subscription(loop_, tlb_evl_add_timer_inline(loop_, timeout, &detail::invoke_inline<Callable>, &copy,
+                                                        sizeof(copy), nullptr));
+  }
+
+  template <typename Callable, typename F>
+  Subscription add_timer_impl(int timeout, F &&callable, std::false_type /* inline */) {
+    Callable *boxed = new Callable(std::forward<F>(callable));
+    const tlb_handle handle = tlb_evl_add_timer_inline(loop_, timeout, &detail::invoke_boxed<Callable>, &boxed,
+                                                       sizeof(boxed), &detail::release_boxed<Callable>);
+    if (handle == TLB_HANDLE_INVALID) {
+      delete boxed;
+    }
+    return Subscription(loop_, handle);
+  }
+
+  tlb_event_loop *loop_ = nullptr;
+  bool owned_ = false;
+};
+
+/**********************************************************************************************************************
+ * Tlb                                                                                                                *
+ **********************************************************************************************************************/
+
+class Tlb {
+ public:
+  Tlb(tlb_allocator *alloc, tlb_options options)
+      : tlb_(tlb_new(alloc, options)), loop_(EventLoop::borrow(tlb_ ? tlb_get_evl(tlb_) : nullptr)) {
+  }
+
+  Tlb(const Tlb &) = delete;
+  Tlb &operator=(const Tlb &) = delete;
+
+  ~Tlb() {
+    if (tlb_) {
+      tlb_destroy(tlb_);
+    }
+  }
+
+  tlb *get() const noexcept {
+    return tlb_;
+  }
+
+  explicit operator bool() const noexcept {
+    return tlb_ != nullptr;
+  }
+
+  int start() {
+    return tlb_start(tlb_);
+  }
+  int stop() {
+    return tlb_stop(tlb_);
+  }
+
+  EventLoop &loop() noexcept {
+    return loop_;
+  }
+
+  static size_t current_worker() noexcept {
+    return tlb_current_worker();
+  }
+  size_t worker_count() const noexcept {
+    return tlb_worker_count(tlb_);
+  }
+  void *worker_slot(size_t worker, size_t slot) noexcept {
+    return tlb_worker_slot_get(tlb_, worker, slot);
+  }
+  int set_worker_slot(size_t worker, size_t slot, void *value) noexcept {
+    return tlb_worker_slot_set(tlb_, worker, slot, value);
+  }
+
+ private:
+  tlb *tlb_;
+  EventLoop loop_;
+};
+
+}  // namespace libtlb
+
+#endif /* TLB_TLB_HPP */
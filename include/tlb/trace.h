@@ -0,0 +1,53 @@
+#ifndef TLB_TRACE_H
+#define TLB_TRACE_H
+
+#include "tlb/event_loop.h"
+
+/**
+ * Optional latency tracing for an event loop. While enabled, the time between the poll returning and each callback
+ * starting (queueing behind the rest of the batch) and the time spent in each callback are recorded into histograms.
+ * While disabled the cost is a single branch per batch and per callback.
+ */
+
+typedef void tlb_on_slow_callback(const char *name, tlb_handle handle, uint64_t duration_ns, void *userdata);
+
+struct tlb_trace_options {
+  /* Callbacks that run longer than this are reported, 0 to not report any */
+  uint64_t slow_callback_us;
+
+  /* Called for each slow callback, they're logged if this is NULL */
+  tlb_on_slow_callback *on_slow_callback;
+  void *userdata;
+};
+
+enum tlb_trace_histogram {
+  TLB_TRACE_QUEUE_DELAY,       /* From the poll returning to the callback starting */
+  TLB_TRACE_CALLBACK_DURATION, /* From the callback starting to it returning */
+
+  TLB_TRACE_HISTOGRAM_COUNT,
+};
+
+/* Values are upper bounds of the bucket they fell in, which are within 1/16th of the recorded value */
+struct tlb_trace_summary {
+  uint64_t count;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+};
+
+TLB_EXTERN_C_BEGIN
+
+/** Start tracing a loop, or update its options and clear what's been recorded if it already is */
+int tlb_evl_trace_enable(struct tlb_event_loop *loop, const struct tlb_trace_options *options);
+void tlb_evl_trace_disable(struct tlb_event_loop *loop);
+
+/** Summarizes everything recorded since tracing was enabled, fails with ENOENT if it isn't */
+int tlb_evl_trace_summary(struct tlb_event_loop *loop, enum tlb_trace_histogram histogram,
+                          struct tlb_trace_summary *summary);
+
+TLB_EXTERN_C_END
+
+#endif /* TLB_TRACE_H */
@@ -1,5 +1,7 @@
 #include "tlb/allocator.h"
 
+#include <errno.h>
+#include <stdatomic.h>
 #include <string.h>
 
 void *tlb_malloc(struct tlb_allocator *alloc, size_t size) {
@@ -22,7 +24,9 @@ void *tlb_calloc(struct tlb_allocator *alloc, size_t num, size_t size) {
 
   const size_t alloc_size = num * size;
   void *buffer = alloc->vtable->malloc(alloc->userdata, alloc_size);
-  memset(buffer, 0, alloc_size);
+  if (buffer) {
+    memset(buffer, 0, alloc_size);
+  }
   return buffer;
 }
 
@@ -33,3 +37,162 @@ void tlb_free(struct tlb_allocator *alloc, void *buffer) {
 
   alloc->vtable->free(alloc->userdata, buffer);
 }
+
+/**********************************************************************************************************************
+ * Tracking allocator                                                                                                 *
+ **********************************************************************************************************************/
+
+enum {
+  /* Threads are spread over this many sets of counters */
+  TLB_TRACKING_STRIPES = 16,
+  /* Net bytes a stripe may allocate or free before it's folded into the shared live count */
+  TLB_TRACKING_FLUSH_BYTES = 64 * 1024,
+};
+
+/* Padded out to cache lines so threads on different stripes never share one */
+struct tlb_tracking_stripe {
+  _Alignas(64) _Atomic uint64_t allocations;
+  _Atomic uint64_t frees;
+  _Atomic int64_t pending; /* Net bytes not yet folded into live */
+  _Atomic int64_t high;    /* Highest pending has been since the last fold, for the peak */
+  _Atomic uint64_t size_classes[TLB_MEMORY_SIZE_CLASSES];
+};
+
+struct tlb_tracking_allocator {
+  struct tlb_allocator alloc; /* Must be first, this is what's handed out */
+  struct tlb_allocator *inner;
+
+  _Atomic int64_t live;
+  _Atomic int64_t peak;
+
+  struct tlb_tracking_stripe stripes[TLB_TRACKING_STRIPES];
+};
+
+/* Each allocation is prefixed with its size, padded so the user's pointer stays maximally aligned */
+struct tlb_tracking_header {
+  _Alignas(max_align_t) size_t size;
+};
+
+static atomic_size_t s_next_stripe;
+static _Thread_local size_t s_stripe = SIZE_MAX;
+
+static struct tlb_tracking_stripe *s_stripe_get(struct tlb_tracking_allocator *tracking) {
+  if (s_stripe == SIZE_MAX) {
+    s_stripe = atomic_fetch_add_explicit(&s_next_stripe, 1, memory_order_relaxed) % TLB_TRACKING_STRIPES;
+  }
+  return &tracking->stripes[s_stripe];
+}
+
+static size_t s_size_class(size_t size) {
+  /* Smallest i where size <= 2^i */
+  const size_t size_class = size <= 1 ? 0 : 64U - (size_t)__builtin_clzll((unsigned long long)size - 1);
+  return TLB_MIN(size_class, (size_t)TLB_MEMORY_SIZE_CLASSES - 1);
+}
+
+static void s_tracking_flush(struct tlb_tracking_allocator *tracking, struct tlb_tracking_stripe *stripe) {
+  const int64_t pending = atomic_exchange_explicit(&stripe->pending, 0, memory_order_relaxed);
+  const int64_t high = atomic_exchange_explicit(&stripe->high, 0, memory_order_relaxed);
+  const int64_t before = atomic_fetch_add_explicit(&tracking->live, pending, memory_order_relaxed);
+  const int64_t live = before + TLB_MAX(high, pending);
+
+  int64_t peak = atomic_load_explicit(&tracking->peak, memory_order_relaxed);
+  while (live > peak &&
+         !atomic_compare_exchange_weak_explicit(&tracking->peak, &peak, live, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+static void *s_tracking_record(struct tlb_tracking_allocator *tracking, struct tlb_tracking_header *header,
+                               size_t size) {
+  if (!header) {
+    return NULL;
+  }
+  header->size = size;
+
+  struct tlb_tracking_stripe *stripe = s_stripe_get(tracking);
+  atomic_fetch_add_explicit(&stripe->allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stripe->size_classes[s_size_class(size)], 1, memory_order_relaxed);
+  const int64_t pending =
+      atomic_fetch_add_explicit(&stripe->pending, (int64_t)size, memory_order_relaxed) + (int64_t)size;
+  if (pending >= TLB_TRACKING_FLUSH_BYTES) {
+    s_tracking_flush(tracking, stripe);
+  } else if (pending > atomic_load_explicit(&stripe->high, memory_order_relaxed)) {
+    atomic_store_explicit(&stripe->high, pending, memory_order_relaxed);
+  }
+
+  return header + 1;
+}
+
+static void *s_tracking_malloc(void *userdata, size_t size) {
+  struct tlb_tracking_allocator *tracking = userdata;
+  return s_tracking_record(tracking, tlb_malloc(tracking->inner, sizeof(struct tlb_tracking_header) + size), size);
+}
+
+static void *s_tracking_calloc(void *userdata, size_t num, size_t size) {
+  struct tlb_tracking_allocator *tracking = userdata;
+  return s_tracking_record(tracking, tlb_calloc(tracking->inner, 1, sizeof(struct tlb_tracking_header) + (num * size)),
+                           num * size);
+}
+
+static void s_tracking_free(void *userdata, void *buffer) {
+  struct tlb_tracking_allocator *tracking = userdata;
+  struct tlb_tracking_header *header = (struct tlb_tracking_header *)buffer - 1;
+  const int64_t size = (int64_t)header->size;
+
+  struct tlb_tracking_stripe *stripe = s_stripe_get(tracking);
+  atomic_fetch_add_explicit(&stripe->frees, 1, memory_order_relaxed);
+  if (atomic_fetch_sub_explicit(&stripe->pending, size, memory_order_relaxed) - size <= -TLB_TRACKING_FLUSH_BYTES) {
+    s_tracking_flush(tracking, stripe);
+  }
+
+  tlb_free(tracking->inner, header);
+}
+
+static struct tlb_allocator_vtable s_tracking_vtable = {
+    .malloc = s_tracking_malloc,
+    .calloc = s_tracking_calloc,
+    .free = s_tracking_free,
+};
+
+struct tlb_allocator *tlb_tracking_allocator_new(struct tlb_allocator *inner) {
+  struct tlb_tracking_allocator *tracking =
+      TLB_CHECK(NULL !=, tlb_calloc(inner, 1, sizeof(struct tlb_tracking_allocator)));
+  tracking->alloc.vtable = &s_tracking_vtable;
+  tracking->alloc.userdata = tracking;
+  tracking->inner = inner;
+  return &tracking->alloc;
+}
+
+void tlb_tracking_allocator_destroy(struct tlb_allocator *tracking) {
+  TLB_ASSERT(tracking->vtable == &s_tracking_vtable);
+  struct tlb_tracking_allocator *self = tracking->userdata;
+  tlb_free(self->inner, self);
+}
+
+int tlb_tracking_allocator_stats(struct tlb_allocator *alloc, struct tlb_memory_stats *stats) {
+  if (alloc->vtable != &s_tracking_vtable) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+  struct tlb_tracking_allocator *tracking = alloc->userdata;
+
+  memset(stats, 0, sizeof(*stats));
+  int64_t live = atomic_load_explicit(&tracking->live, memory_order_relaxed);
+  int64_t peak = live;
+  for (size_t ii = 0; ii < TLB_TRACKING_STRIPES; ++ii) {
+    struct tlb_tracking_stripe *stripe = &tracking->stripes[ii];
+    stats->allocations += atomic_load_explicit(&stripe->allocations, memory_order_relaxed);
+    stats->frees += atomic_load_explicit(&stripe->frees, memory_order_relaxed);
+    live += atomic_load_explicit(&stripe->pending, memory_order_relaxed);
+    peak += TLB_MAX(atomic_load_explicit(&stripe->high, memory_order_relaxed), (int64_t)0);
+    for (size_t jj = 0; jj < TLB_MEMORY_SIZE_CLASSES; ++jj) {
+      stats->size_classes[jj] += atomic_load_explicit(&stripe->size_classes[jj], memory_order_relaxed);
+    }
+  }
+
+  live = TLB_MAX(live, (int64_t)0);
+  stats->live_bytes = (size_t)live;
+  peak = TLB_MAX(peak, atomic_load_explicit(&tracking->peak, memory_order_relaxed));
+  stats->peak_bytes = (size_t)TLB_MAX(live, peak);
+  return 0;
+}
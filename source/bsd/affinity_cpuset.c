@@ -0,0 +1,29 @@
+#include "tlb/private/affinity.h"
+
+#include <errno.h>
+
+#if defined(__FreeBSD__)
+#  include <sys/param.h>
+#  include <sys/cpuset.h>
+#endif
+
+int tlb_affinity_pin(int cpu) {
+#if defined(__FreeBSD__)
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  cpuset_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  /* -1 is the calling thread */
+  TLB_CHECK(0 ==, cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(set), &set));
+  return 0;
+#else
+  /* macOS only has affinity hints, and the other BSDs nothing at all */
+  (void)cpu;
+  errno = ENOTSUP;
+  return TLB_FAIL;
+#endif
+}
@@ -37,20 +37,26 @@ static int s_events_from_kevent(const struct kevent *kevent) {
   return ev;
 }
 
+static uint16_t s_kqueue_add_flags(const struct tlb_subscription *sub) {
+  /* All subscriptions are "oneshot" subscriptions */
+  uint16_t flags = EV_ADD | EV_DISPATCH;
+  if (sub->sub_mode & TLB_SUB_EDGE) {
+    flags |= EV_CLEAR;
+  }
+  return flags;
+}
+
 int s_kqueue_change(struct tlb_event_loop *loop, struct tlb_subscription *sub, uint16_t flags) {
   struct kevent cl[2];
   size_t num_changes = 0;
 
   /* Calculate flags */
   if (flags == EV_ADD) {
-    /* All subscriptions are "oneshot" subscriptions */
-    flags |= EV_DISPATCH;
-    if (sub->sub_mode & TLB_SUB_EDGE) {
-      flags |= EV_CLEAR;
-    }
+    flags = s_kqueue_add_flags(sub);
   }
 
   struct tlb_evl_kqueue *kq = &sub->platform.kqueue;
+  void *udata = (void *)(uintptr_t)tlb_evl_sub_handle(sub);
   for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(kq->filters); ++ii) {
     const int16_t filter = kq->filters[ii];
     if (filter) {
@@ -60,7 +66,7 @@ int s_kqueue_change(struct tlb_event_loop *loop, struct tlb_subscription *sub, u
              flags,              /* flags */
              0,                  /* fflags */
              kq->data,           /* data */
-             sub                 /* udata */
+             udata               /* udata */
       );
     }
   }
@@ -68,18 +74,54 @@ int s_kqueue_change(struct tlb_event_loop *loop, struct tlb_subscription *sub, u
   return kevent(loop->fd, cl, num_changes, NULL, 0, NULL);
 }
 
+/* Brings the registered filters of a fd in line with its interest set, adding a filter also enables it */
+int s_kqueue_update(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  static const struct {
+    int event;
+    int16_t filter;
+  } s_filters[] = {
+      {TLB_EV_READ, EVFILT_READ},
+      {TLB_EV_WRITE, EVFILT_WRITE},
+  };
+
+  struct kevent cl[2];
+  size_t num_changes = 0;
+
+  struct tlb_evl_kqueue *kq = &sub->platform.kqueue;
+  void *udata = (void *)(uintptr_t)tlb_evl_sub_handle(sub);
+  const int interest = tlb_evl_sub_interest(sub);
+  const bool paused = atomic_load(&sub->events) & TLB_EV_PAUSED;
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(s_filters); ++ii) {
+    uint16_t flags = 0;
+    if (interest & s_filters[ii].event) {
+      flags = s_kqueue_add_flags(sub);
+      kq->filters[ii] = s_filters[ii].filter;
+    } else if (kq->filters[ii] && paused) {
+      flags = EV_DISABLE;
+    } else if (kq->filters[ii]) {
+      flags = EV_DELETE;
+      kq->filters[ii] = 0;
+    } else {
+      continue;
+    }
+
+    EV_SET(&cl[num_changes++], sub->ident.ident, s_filters[ii].filter, flags, 0, 0, udata);
+  }
+
+  return kevent(loop->fd, cl, num_changes, NULL, 0, NULL);
+}
+
 /**********************************************************************************************************************
  * Event Loop                                                                                                         *
  **********************************************************************************************************************/
 
-int tlb_evl_init(struct tlb_event_loop *loop, struct tlb_allocator *alloc) {
-  loop->alloc = alloc;
+int tlb_evl_impl_init(struct tlb_event_loop *loop) {
   loop->fd = TLB_CHECK(-1 !=, kqueue());
 
   return 0;
 }
 
-void tlb_evl_cleanup(struct tlb_event_loop *loop) {
+void tlb_evl_impl_cleanup(struct tlb_event_loop *loop) {
   if (loop->fd) {
     close(loop->fd);
     loop->fd = 0;
@@ -93,13 +135,11 @@ void tlb_evl_cleanup(struct tlb_event_loop *loop) {
 void tlb_evl_impl_fd_init(struct tlb_subscription *sub) {
   /* kqueue always wants the uintptr_t version, so force a cast. */
   sub->ident.ident = sub->ident.fd;
-  size_t num_filters = 0;
-  if (sub->events & TLB_EV_READ) {
-    sub->platform.kqueue.filters[num_filters++] = EVFILT_READ;
-  }
-  if (sub->events & TLB_EV_WRITE) {
-    sub->platform.kqueue.filters[num_filters++] = EVFILT_WRITE;
-  }
+}
+
+bool tlb_evl_impl_rejects_existing_fd(void) {
+  /* Adding a filter that's already registered for the fd just points it at the new subscription */
+  return false;
 }
 
 /**********************************************************************************************************************
@@ -107,71 +147,83 @@ void tlb_evl_impl_fd_init(struct tlb_subscription *sub) {
  **********************************************************************************************************************/
 
 void tlb_evl_impl_timer_init(struct tlb_subscription *sub, int timeout) {
-  sub->ident.ident = (uintptr_t)sub;
+  sub->ident.ident = (uintptr_t)tlb_evl_sub_handle(sub);
   sub->platform.kqueue.filters[0] = EVFILT_TIMER;
   sub->platform.kqueue.data = timeout;
+  atomic_store_explicit(&sub->events, TLB_EV_READ, memory_order_relaxed);
+  if (!(sub->sub_mode & TLB_SUB_REUSABLE)) {
+    sub->sub_mode |= TLB_SUB_ONESHOT;
+  }
 }
 
 /**********************************************************************************************************************
  * Subscribe/Unsubscribe *
  **********************************************************************************************************************/
 
+static bool s_is_timer(const struct tlb_subscription *sub) {
+  return sub->platform.kqueue.filters[0] == EVFILT_TIMER;
+}
+
+/* Re-adding a timer restarts it with the new period, it's disabled again by the first expiry. Only reusable timers are
+ * set this way, and they're always extended. */
+static int s_kqueue_timer_set(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  static const uint64_t nanos_per_milli = 1000000;
+  const uint64_t deadline_ns = atomic_load(&tlb_evl_sub_ext(sub)->deadline_ns);
+  if (deadline_ns == 0) {
+    return 0;
+  }
+  const uint64_t now_ns = tlb_time_now_ns();
+  sub->platform.kqueue.data = deadline_ns > now_ns ? (deadline_ns - now_ns + nanos_per_milli - 1) / nanos_per_milli : 0;
+  return s_kqueue_change(loop, sub, EV_ADD | EV_ENABLE | EV_DISPATCH);
+}
+
 int tlb_evl_impl_subscribe(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
-  return s_kqueue_change(loop, sub, EV_ADD);
+  if (s_is_timer(sub)) {
+    /* Reusable timers start out disarmed */
+    return s_kqueue_change(loop, sub, (sub->sub_mode & TLB_SUB_REUSABLE) ? EV_ADD | EV_DISABLE : EV_ADD);
+  }
+  return s_kqueue_update(loop, sub);
 }
 
 int tlb_evl_impl_unsubscribe(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
   return s_kqueue_change(loop, sub, EV_DELETE);
 }
 
+int tlb_evl_impl_rearm(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  if (s_is_timer(sub) && (sub->sub_mode & TLB_SUB_REUSABLE)) {
+    return s_kqueue_timer_set(loop, sub);
+  }
+  if (s_is_timer(sub)) {
+    return s_kqueue_change(loop, sub, tlb_evl_sub_interest(sub) ? EV_ENABLE : EV_DISABLE);
+  }
+  /* The interest set may have changed since it was last armed */
+  return s_kqueue_update(loop, sub);
+}
+
 /**********************************************************************************************************************
- * Handle events *
+ * Poll *
  **********************************************************************************************************************/
 
-int tlb_evl_handle_events(struct tlb_event_loop *loop, size_t budget, int timeout) {
-  /* Zero budget means just keep truckin */
-  if (budget == 0) {
-    budget = SIZE_MAX;
-  }
-
-  /* Calculate the maximum number of events to run */
-  int num_events = TLB_MIN(budget, TLB_EV_EVENT_BATCH);
+int tlb_evl_impl_poll(struct tlb_event_loop *loop, struct tlb_evl_event *events, size_t count, int timeout) {
+  const int max_events = (int)TLB_MIN(count, TLB_EV_EVENT_BATCH);
   struct kevent eventlist[TLB_EV_EVENT_BATCH];
 
   struct timespec timeout_spec = tlb_timeout_to_timespec(timeout);
   struct timespec *timeout_ptr = timeout == TLB_WAIT_INDEFINITE ? NULL : &timeout_spec;
 
-  num_events = TLB_CHECK(-1 !=, kevent(loop->fd, NULL, 0, eventlist, num_events, timeout_ptr));
+  tlb_record(TLB_RECORD_POLL_ENTER, loop, NULL, (uint32_t)timeout);
+  const int result = kevent(loop->fd, NULL, 0, eventlist, max_events, timeout_ptr);
+  tlb_record(TLB_RECORD_POLL_EXIT, loop, NULL, result > 0 ? (uint32_t)result : 0);
+  const int num_events = TLB_CHECK(-1 !=, result);
+  const uint64_t polled_ns = tlb_evl_poll_time(loop);
+
   for (int ii = 0; ii < num_events; ii++) {
     const struct kevent *ev = &eventlist[ii];
-    struct tlb_subscription *sub = ev->udata;
-
-    TLB_LOG_EVENT(sub, "Handling");
-
-    /* Cache this off because sub can become invalid during on_event */
-    sub->state = TLB_STATE_RUNNING;
-    sub->on_event(sub, s_events_from_kevent(ev), sub->userdata);
-
-    switch (sub->state) {
-      case TLB_STATE_SUBBED:
-        /* Not possible */
-        TLB_LOG_EVENT(sub, "In bad state!");
-        TLB_ASSERT(false);
-        break;
-
-      case TLB_STATE_RUNNING:
-        /* Resubscribe the event */
-        sub->state = TLB_STATE_SUBBED;
-        TLB_LOG_EVENT(sub, "Set to SUBBED");
-        s_kqueue_change(loop, sub, EV_ENABLE);
-        break;
-
-      case TLB_STATE_UNSUBBED:
-        /* Force-remove the subscription */
-        sub->state = TLB_STATE_SUBBED;
-        tlb_evl_remove(loop, sub);
-        break;
-    }
+    events[ii] = (struct tlb_evl_event){
+        .handle = (tlb_handle)(uintptr_t)ev->udata,
+        .events = s_events_from_kevent(ev),
+        .polled_ns = polled_ns,
+    };
   }
 
   return num_events;
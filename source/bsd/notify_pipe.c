@@ -0,0 +1,34 @@
+#include "tlb/private/notify.h"
+
+#include "tlb/pipe.h"
+
+#include <unistd.h>
+
+int tlb_notify_open(struct tlb_notify *notify) {
+  struct tlb_pipe pipe;
+  TLB_CHECK(0 ==, tlb_pipe_open(&pipe));
+  notify->fd_read = pipe.fd_read;
+  notify->fd_write = pipe.fd_write;
+  return 0;
+}
+
+void tlb_notify_close(struct tlb_notify *notify) {
+  close(notify->fd_read);
+  close(notify->fd_write);
+}
+
+void tlb_notify_signal(struct tlb_notify *notify) {
+  const uint8_t value = 1;
+  /* Only fails if the pipe is full, in which case it's readable anyway */
+  ssize_t written = write(notify->fd_write, &value, sizeof(value));
+  (void)written;
+}
+
+bool tlb_notify_clear(struct tlb_notify *notify) {
+  uint8_t buffer[64];
+  bool cleared = false;
+  while (read(notify->fd_read, buffer, sizeof(buffer)) > 0) {
+    cleared = true;
+  }
+  return cleared;
+}
@@ -0,0 +1,21 @@
+#include "tlb/private/sendfile.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+ssize_t tlb_sendfile_impl(struct tlb_sendfile *stream, size_t count) {
+#if defined(__APPLE__)
+  off_t sent = (off_t)count;
+  const int result = sendfile(stream->file, stream->socket, stream->offset, &sent, NULL, 0);
+#else
+  off_t sent = 0;
+  const int result = sendfile(stream->file, stream->socket, stream->offset, count, NULL, &sent, 0);
+#endif
+  /* A socket that fills up part way through still reports what it took */
+  if (result == -1 && (sent == 0 || (errno != EAGAIN && errno != EINTR))) {
+    return -1;
+  }
+  return (ssize_t)sent;
+}
@@ -0,0 +1,308 @@
+#include "tlb/channel.h"
+
+#include "tlb/allocator.h"
+#include "tlb/private/event_loop.h"
+#include "tlb/private/notify.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+
+/* Where a subscription copies each batch to, sized so it fits on the stack */
+#define TLB_CHANNEL_BATCH_BYTES 4096U
+
+/* Only the producer that moves it out of idle signals the fd, and only a consumer that clears a signal from the fd
+ * makes it idle again, so the fd is never left readable once it's idle */
+enum tlb_channel_signal {
+  TLB_CHANNEL_IDLE,
+  TLB_CHANNEL_SIGNALLING, /* A producer is writing to the fd */
+  TLB_CHANNEL_SIGNALLED,
+};
+
+struct tlb_channel {
+  struct tlb_allocator *alloc;
+  enum tlb_channel_mode mode;
+  size_t mask;
+  size_t message_size;
+  size_t slot_size; /* MPMC slots start with their sequence number */
+  uint8_t *slots;
+  struct tlb_notify notify;
+
+  /* enum tlb_channel_signal */
+  _Alignas(64) _Atomic int signal;
+
+  /* Next position to receive from, and (SPSC only) the consumer's last look at tail */
+  _Alignas(64) _Atomic size_t head;
+  size_t tail_cache;
+
+  /* Next position to send to, and (SPSC only) the producer's last look at head */
+  _Alignas(64) _Atomic size_t tail;
+  size_t head_cache;
+};
+
+/* The inline data of a subscription */
+struct tlb_channel_sub {
+  struct tlb_channel *channel;
+  tlb_on_messages *on_messages;
+  void *userdata;
+  struct tlb_event_loop *loop;
+};
+
+/**********************************************************************************************************************
+ * Life cycle                                                                                                         *
+ **********************************************************************************************************************/
+
+struct tlb_channel *tlb_channel_new(struct tlb_allocator *alloc, enum tlb_channel_mode mode, size_t capacity,
+                                    size_t message_size) {
+  static const size_t max_capacity = (size_t)1 << 30U;
+  if ((mode != TLB_CHANNEL_SPSC && mode != TLB_CHANNEL_MPMC) || capacity == 0 || capacity > max_capacity ||
+      message_size == 0 || message_size > TLB_CHANNEL_MAX_MESSAGE_SIZE) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  struct tlb_channel *channel = TLB_CHECK(NULL !=, tlb_calloc(alloc, 1, sizeof(struct tlb_channel)));
+  channel->alloc = alloc;
+  channel->mode = mode;
+  channel->message_size = message_size;
+
+  size_t slots = 2;
+  while (slots < capacity) {
+    slots <<= 1U;
+  }
+  channel->mask = slots - 1;
+
+  /* Keeps MPMC sequence numbers aligned */
+  static const size_t align = sizeof(size_t);
+  channel->slot_size = (message_size + align - 1) / align * align;
+  if (mode == TLB_CHANNEL_MPMC) {
+    channel->slot_size += sizeof(_Atomic size_t);
+  }
+  channel->slots = TLB_CHECK_GOTO(NULL !=, tlb_calloc(alloc, slots, channel->slot_size), slots_failed);
+  if (mode == TLB_CHANNEL_MPMC) {
+    for (size_t ii = 0; ii < slots; ++ii) {
+      atomic_init((_Atomic size_t *)(void *)(channel->slots + (ii * channel->slot_size)), ii);
+    }
+  }
+
+  TLB_CHECK_GOTO(0 ==, tlb_notify_open(&channel->notify), notify_failed);
+  atomic_init(&channel->signal, TLB_CHANNEL_IDLE);
+  atomic_init(&channel->head, 0);
+  atomic_init(&channel->tail, 0);
+  return channel;
+
+notify_failed:
+  tlb_free(alloc, channel->slots);
+slots_failed:
+  tlb_free(alloc, channel);
+  return NULL;
+}
+
+void tlb_channel_destroy(struct tlb_channel *channel) {
+  tlb_notify_close(&channel->notify);
+  tlb_free(channel->alloc, channel->slots);
+  tlb_free(channel->alloc, channel);
+}
+
+int tlb_channel_fd(const struct tlb_channel *channel) {
+  return channel->notify.fd_read;
+}
+
+/**********************************************************************************************************************
+ * Rings                                                                                                              *
+ **********************************************************************************************************************/
+
+static uint8_t *s_slot(struct tlb_channel *channel, size_t position) {
+  return channel->slots + ((position & channel->mask) * channel->slot_size);
+}
+
+/* The producer only rereads head when its cached copy says it's full, and the consumer tail when it says it's empty */
+static size_t s_spsc_send(struct tlb_channel *channel, const uint8_t *messages, size_t count) {
+  const size_t tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+  const size_t capacity = channel->mask + 1;
+  if (tail - channel->head_cache + count > capacity) {
+    channel->head_cache = atomic_load_explicit(&channel->head, memory_order_acquire);
+  }
+  const size_t sent = TLB_MIN(count, capacity - (tail - channel->head_cache));
+  for (size_t ii = 0; ii < sent; ++ii) {
+    memcpy(s_slot(channel, tail + ii), messages + (ii * channel->message_size), channel->message_size);
+  }
+  if (sent) {
+    atomic_store_explicit(&channel->tail, tail + sent, memory_order_release);
+  }
+  return sent;
+}
+
+static size_t s_spsc_receive(struct tlb_channel *channel, uint8_t *messages, size_t count) {
+  const size_t head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+  if (channel->tail_cache - head < count) {
+    channel->tail_cache = atomic_load_explicit(&channel->tail, memory_order_acquire);
+  }
+  const size_t received = TLB_MIN(count, channel->tail_cache - head);
+  for (size_t ii = 0; ii < received; ++ii) {
+    memcpy(messages + (ii * channel->message_size), s_slot(channel, head + ii), channel->message_size);
+  }
+  if (received) {
+    atomic_store_explicit(&channel->head, head + received, memory_order_release);
+  }
+  return received;
+}
+
+/* Bounded MPMC queue after Dmitry Vyukov's, each slot's sequence says whose turn it is */
+static bool s_mpmc_send(struct tlb_channel *channel, const uint8_t *message) {
+  size_t position = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+  for (;;) {
+    uint8_t *slot = s_slot(channel, position);
+    const size_t sequence = atomic_load_explicit((_Atomic size_t *)(void *)slot, memory_order_acquire);
+    const intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&channel->tail, &position, position + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        memcpy(slot + sizeof(_Atomic size_t), message, channel->message_size);
+        atomic_store_explicit((_Atomic size_t *)(void *)slot, position + 1, memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      /* Still holding a message from the last time around */
+      return false;
+    } else {
+      position = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    }
+  }
+}
+
+static bool s_mpmc_receive(struct tlb_channel *channel, uint8_t *message) {
+  size_t position = atomic_load_explicit(&channel->head, memory_order_relaxed);
+  for (;;) {
+    uint8_t *slot = s_slot(channel, position);
+    const size_t sequence = atomic_load_explicit((_Atomic size_t *)(void *)slot, memory_order_acquire);
+    const intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&channel->head, &position, position + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        memcpy(message, slot + sizeof(_Atomic size_t), channel->message_size);
+        atomic_store_explicit((_Atomic size_t *)(void *)slot, position + channel->mask + 1, memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      /* Not sent yet */
+      return false;
+    } else {
+      position = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    }
+  }
+}
+
+static size_t s_receive(struct tlb_channel *channel, uint8_t *messages, size_t count) {
+  if (channel->mode == TLB_CHANNEL_SPSC) {
+    return s_spsc_receive(channel, messages, count);
+  }
+  size_t received = 0;
+  while (received < count && s_mpmc_receive(channel, messages + (received * channel->message_size))) {
+    received++;
+  }
+  return received;
+}
+
+/**********************************************************************************************************************
+ * Send/Receive                                                                                                       *
+ **********************************************************************************************************************/
+
+/* Pairs with the consumer's clear in tlb_channel_receive: either it sees what was just sent, or it's idle again */
+static void s_signal(struct tlb_channel *channel) {
+  atomic_thread_fence(memory_order_seq_cst);
+  int signal = atomic_load_explicit(&channel->signal, memory_order_relaxed);
+  if (signal == TLB_CHANNEL_IDLE &&
+      atomic_compare_exchange_strong(&channel->signal, &signal, TLB_CHANNEL_SIGNALLING)) {
+    tlb_notify_signal(&channel->notify);
+    /* A consumer may already have cleared it and gone idle */
+    signal = TLB_CHANNEL_SIGNALLING;
+    atomic_compare_exchange_strong(&channel->signal, &signal, TLB_CHANNEL_SIGNALLED);
+  }
+}
+
+size_t tlb_channel_send_batch(struct tlb_channel *channel, const void *messages, size_t count) {
+  size_t sent = 0;
+  if (channel->mode == TLB_CHANNEL_SPSC) {
+    sent = s_spsc_send(channel, messages, count);
+  } else {
+    const uint8_t *bytes = messages;
+    while (sent < count && s_mpmc_send(channel, bytes + (sent * channel->message_size))) {
+      sent++;
+    }
+  }
+  if (sent) {
+    s_signal(channel);
+  }
+  return sent;
+}
+
+int tlb_channel_send(struct tlb_channel *channel, const void *message) {
+  if (tlb_channel_send_batch(channel, message, 1) == 0) {
+    errno = EAGAIN;
+    return TLB_FAIL;
+  }
+  return 0;
+}
+
+size_t tlb_channel_receive(struct tlb_channel *channel, void *messages, size_t count) {
+  size_t received = s_receive(channel, messages, count);
+  if (received || count == 0 || atomic_load_explicit(&channel->signal, memory_order_acquire) == TLB_CHANNEL_IDLE) {
+    return received;
+  }
+
+  /* Found it empty, so the next send has to signal. If the signal hasn't reached the fd yet it will soon, and the
+   * wakeup that follows clears it instead. */
+  if (!tlb_notify_clear(&channel->notify)) {
+    return 0;
+  }
+  /* Producers don't signal again until it's idle, so looking again afterwards picks up anything sent in between */
+  int signal = atomic_load(&channel->signal);
+  while (signal != TLB_CHANNEL_IDLE && !atomic_compare_exchange_weak(&channel->signal, &signal, TLB_CHANNEL_IDLE)) {
+  }
+  atomic_thread_fence(memory_order_seq_cst);
+  return s_receive(channel, messages, count);
+}
+
+/**********************************************************************************************************************
+ * Subscriptions                                                                                                      *
+ **********************************************************************************************************************/
+
+static void s_on_event(tlb_handle handle, int events, void *userdata) {
+  (void)events;
+  const struct tlb_channel_sub *sub = userdata;
+  struct tlb_channel *channel = sub->channel;
+
+  _Alignas(max_align_t) uint8_t buffer[TLB_CHANNEL_BATCH_BYTES];
+  const size_t batch = sizeof(buffer) / channel->message_size;
+  const size_t limit = channel->mask + 1;
+  size_t handled = 0;
+  while (handled < limit) {
+    const size_t received = tlb_channel_receive(channel, buffer, TLB_MIN(batch, limit - handled));
+    if (received == 0) {
+      return;
+    }
+    sub->on_messages(buffer, received, sub->userdata);
+    handled += received;
+  }
+
+  /* There may be more, come back to it after the loop's other subscriptions have had a turn */
+  if (tlb_evl_requeue(sub->loop, handle) != 0) {
+    s_signal(channel);
+  }
+}
+
+tlb_handle tlb_channel_subscribe(struct tlb_event_loop *loop, struct tlb_channel *channel,
+                                 tlb_on_messages *on_messages, void *userdata) {
+  const struct tlb_channel_sub sub = {
+      .channel = channel,
+      .on_messages = on_messages,
+      .userdata = userdata,
+      .loop = loop,
+  };
+  const tlb_handle handle =
+      tlb_evl_add_fd_pinned(loop, channel->notify.fd_read, TLB_EV_READ, false, s_on_event, &sub, sizeof(sub), NULL);
+  if (handle != TLB_HANDLE_INVALID) {
+    tlb_evl_set_name(loop, handle, "channel");
+  }
+  return handle;
+}
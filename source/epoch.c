@@ -0,0 +1,155 @@
+#include "tlb/private/epoch.h"
+
+#include <stdatomic.h>
+
+/* Records are padded out to a cache line so pinning doesn't bounce lines between threads */
+struct tlb_epoch_record {
+  _Alignas(64) atomic_uint_fast64_t epoch; /* 0 when not pinned */
+  atomic_bool in_use;
+  size_t nesting; /* Only touched by the owning thread */
+};
+
+static struct tlb_epoch_record s_records[TLB_EPOCH_MAX_THREADS];
+static atomic_size_t s_record_count;
+static atomic_uint_fast64_t s_global_epoch = 1;
+
+static _Thread_local struct tlb_epoch_record *s_record;
+static tss_t s_record_key;
+static once_flag s_record_key_once = ONCE_FLAG_INIT;
+
+/**********************************************************************************************************************
+ * Thread records                                                                                                     *
+ **********************************************************************************************************************/
+
+static void s_record_release(void *arg) {
+  struct tlb_epoch_record *record = arg;
+  TLB_ASSERT(record->nesting == 0);
+  atomic_store_explicit(&record->in_use, false, memory_order_release);
+}
+
+static void s_record_key_init(void) {
+  TLB_CHECK_ASSERT(thrd_success ==, tss_create(&s_record_key, s_record_release));
+}
+
+static struct tlb_epoch_record *s_record_acquire(void) {
+  for (;;) {
+    /* Reuse a record left behind by an exited thread */
+    const size_t count = atomic_load_explicit(&s_record_count, memory_order_acquire);
+    for (size_t ii = 0; ii < count; ++ii) {
+      bool in_use = false;
+      if (atomic_compare_exchange_strong(&s_records[ii].in_use, &in_use, true)) {
+        return &s_records[ii];
+      }
+    }
+
+    /* Otherwise claim a fresh one */
+    size_t expected = count;
+    if (count < TLB_EPOCH_MAX_THREADS && atomic_compare_exchange_strong(&s_record_count, &expected, count + 1)) {
+      atomic_store(&s_records[count].in_use, true);
+      return &s_records[count];
+    }
+    TLB_ASSERT(count < TLB_EPOCH_MAX_THREADS);
+  }
+}
+
+static struct tlb_epoch_record *s_record_get(void) {
+  if (s_record == NULL) {
+    call_once(&s_record_key_once, s_record_key_init);
+    s_record = s_record_acquire();
+    tss_set(s_record_key, s_record);
+  }
+  return s_record;
+}
+
+size_t tlb_epoch_thread_index(void) {
+  return (size_t)(s_record_get() - s_records);
+}
+
+/**********************************************************************************************************************
+ * Pinning                                                                                                            *
+ **********************************************************************************************************************/
+
+void tlb_epoch_pin(void) {
+  struct tlb_epoch_record *record = s_record_get();
+  if (record->nesting++ == 0) {
+    atomic_store(&record->epoch, atomic_load(&s_global_epoch));
+    atomic_thread_fence(memory_order_seq_cst);
+  }
+}
+
+void tlb_epoch_unpin(void) {
+  struct tlb_epoch_record *record = s_record;
+  TLB_ASSERT(record && record->nesting > 0);
+  if (--record->nesting == 0) {
+    atomic_store_explicit(&record->epoch, 0, memory_order_release);
+  }
+}
+
+/**********************************************************************************************************************
+ * Advancing                                                                                                          *
+ **********************************************************************************************************************/
+
+uint64_t tlb_epoch_current(void) {
+  atomic_thread_fence(memory_order_seq_cst);
+  return atomic_load(&s_global_epoch);
+}
+
+uint64_t tlb_epoch_advance(void) {
+  uint64_t epoch = atomic_load(&s_global_epoch);
+
+  /* The epoch may only move forward once every pinned thread has observed it */
+  const size_t count = atomic_load_explicit(&s_record_count, memory_order_acquire);
+  for (size_t ii = 0; ii < count; ++ii) {
+    const uint64_t pinned = atomic_load(&s_records[ii].epoch);
+    if (pinned != 0 && pinned != epoch) {
+      return epoch;
+    }
+  }
+
+  if (atomic_compare_exchange_strong(&s_global_epoch, &epoch, epoch + 1)) {
+    return epoch + 1;
+  }
+  /* Someone else advanced it */
+  return epoch;
+}
+
+/**********************************************************************************************************************
+ * Retiring                                                                                                           *
+ **********************************************************************************************************************/
+
+void tlb_epoch_retire(tlb_epoch_retired_list *list, struct tlb_epoch_retired *retired) {
+  retired->epoch = tlb_epoch_current();
+  retired->next = atomic_load_explicit(list, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak(list, &retired->next, retired)) {
+  }
+}
+
+void tlb_epoch_reclaim(tlb_epoch_retired_list *list, struct tlb_allocator *alloc, bool force) {
+  if (atomic_load_explicit(list, memory_order_relaxed) == NULL) {
+    return;
+  }
+
+  struct tlb_epoch_retired *retired = atomic_exchange(list, NULL);
+  const uint64_t epoch = tlb_epoch_advance();
+
+  struct tlb_epoch_retired *keep_head = NULL;
+  struct tlb_epoch_retired *keep_tail = NULL;
+  while (retired) {
+    struct tlb_epoch_retired *next = retired->next;
+    if (force || tlb_epoch_is_safe(retired->epoch, epoch)) {
+      tlb_free(alloc, retired);
+    } else {
+      retired->next = keep_head;
+      keep_head = retired;
+      keep_tail = keep_tail ? keep_tail : retired;
+    }
+    retired = next;
+  }
+
+  /* Put back anything that's still visible */
+  if (keep_head) {
+    keep_tail->next = atomic_load_explicit(list, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak(list, &keep_tail->next, keep_head)) {
+    }
+  }
+}
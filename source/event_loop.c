@@ -1,8 +1,13 @@
 #include "tlb/private/event_loop.h"
 
 #include "tlb/event_loop.h"
+#include "tlb/private/epoch.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
 
 /**********************************************************************************************************************
  * Life cycle                                                                                                         *
@@ -11,12 +16,13 @@
 struct tlb_event_loop *tlb_evl_new(struct tlb_allocator *alloc) {
   struct tlb_event_loop *loop = TLB_CHECK(NULL !=, tlb_calloc(alloc, 1, sizeof(struct tlb_event_loop)));
 
-  TLB_CHECK_GOTO(0 ==, tlb_evl_init(loop, alloc), cleanup);
+  TLB_CHECK_GOTO(0 ==, tlb_evl_init(loop, alloc), init_failed);
 
   return loop;
 
-cleanup:
-  tlb_evl_destroy(loop);
+init_failed:
+  /* tlb_evl_init already undid whatever it got through */
+  tlb_free(alloc, loop);
   return NULL;
 }
 
@@ -26,54 +32,717 @@ void tlb_evl_destroy(struct tlb_event_loop *loop) {
   tlb_free(loop->alloc, loop);
 }
 
+int tlb_evl_init(struct tlb_event_loop *loop, struct tlb_allocator *alloc) {
+  loop->alloc = alloc;
+  atomic_init(&loop->retired, NULL);
+  atomic_init(&loop->trace, NULL);
+  atomic_init(&loop->observer, NULL);
+  atomic_init(&loop->slice_ns, 0);
+  atomic_init(&loop->event_cost_ns, 0);
+  atomic_init(&loop->idle, NULL);
+  atomic_init(&loop->io, NULL);
+  tlb_metrics_init(&loop->metrics);
+  loop->ready.head = NULL;
+  loop->ready.tail = NULL;
+  atomic_init(&loop->ready.count, 0);
+  atomic_init(&loop->subs.chunks, NULL);
+  atomic_init(&loop->subs.reserved, 0);
+  atomic_init(&loop->subs.free_head, 0);
+
+  TLB_CHECK_GOTO(0 ==, tlb_io_init(loop), io_init_failed);
+  TLB_CHECK_GOTO(thrd_success ==, mtx_init(&loop->ready.mtx, mtx_plain), ready_mtx_init_failed);
+  TLB_CHECK_GOTO(thrd_success ==, mtx_init(&loop->subs.grow_mtx, mtx_plain), grow_mtx_init_failed);
+  TLB_CHECK_GOTO(0 ==, tlb_evl_impl_init(loop), impl_init_failed);
+
+  return 0;
+
+impl_init_failed:
+  mtx_destroy(&loop->subs.grow_mtx);
+grow_mtx_init_failed:
+  mtx_destroy(&loop->ready.mtx);
+ready_mtx_init_failed:
+  tlb_io_cleanup(loop);
+io_init_failed:
+  return TLB_FAIL;
+}
+
+/* Limiters may still be read by the owner, or by a call racing with removal */
+static void s_sub_retire_limiter(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  struct tlb_rate_limiter *limiter = ext ? atomic_exchange(&ext->limiter, NULL) : NULL;
+  if (limiter) {
+    tlb_epoch_retire(&loop->retired, &limiter->retired);
+  }
+}
+
+static void s_sub_cleanup(struct tlb_subscription *sub, void *userdata) {
+  tlb_evl_impl_unsubscribe(userdata, sub);
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  if (ext && ext->on_release) {
+    ext->on_release(sub->userdata);
+  }
+  s_sub_retire_limiter(userdata, sub);
+}
+
+void tlb_evl_cleanup(struct tlb_event_loop *loop) {
+  /* Waits for operations the threads are running, which complete over one of the loop's subscriptions */
+  tlb_io_cleanup(loop);
+
+  /* Nothing may be handling events anymore, release anything that's still subscribed (i.e. timerfds) */
+  tlb_evl_sub_foreach(loop, s_sub_cleanup, loop);
+
+  tlb_evl_impl_cleanup(loop);
+
+  struct tlb_sub_chunks *chunks = atomic_load(&loop->subs.chunks);
+  if (chunks) {
+    for (size_t ii = 0; ii < chunks->capacity; ++ii) {
+      struct tlb_subscription *slots = atomic_load(&chunks->chunks[ii]);
+      for (size_t jj = 0; slots && jj < TLB_SUB_CHUNK_SIZE; ++jj) {
+        struct tlb_sub_ext *ext = atomic_load(&slots[jj].ext);
+        if (ext) {
+          tlb_free(loop->alloc, ext);
+        }
+      }
+      if (slots) {
+        tlb_free(loop->alloc, slots);
+      }
+    }
+    tlb_free(loop->alloc, chunks);
+    atomic_store(&loop->subs.chunks, NULL);
+  }
+  mtx_destroy(&loop->subs.grow_mtx);
+  /* Anything still queued was released along with the rest */
+  mtx_destroy(&loop->ready.mtx);
+
+  tlb_trace_cleanup(loop);
+  tlb_observer_cleanup(loop);
+  tlb_idle_cleanup(loop);
+  tlb_metrics_cleanup(&loop->metrics, loop->alloc);
+  tlb_epoch_reclaim(&loop->retired, loop->alloc, true);
+}
+
+/**********************************************************************************************************************
+ * Subscription table                                                                                                 *
+ **********************************************************************************************************************/
+
+/* Counts a single occurrence outside of a dispatched batch */
+static void s_metrics_count(struct tlb_event_loop *loop, enum tlb_metric metric) {
+  struct tlb_metrics *metrics = tlb_metrics_get(&loop->metrics);
+  if (metrics) {
+    uint64_t deltas[TLB_METRIC_COUNT] = {0};
+    deltas[metric] = 1;
+    tlb_metrics_add_local(metrics, deltas);
+  }
+}
+
+static uint32_t s_next_gen(uint32_t gen) {
+  /* 0 is reserved for slots that have never been used */
+  return gen + 1 == 0 ? 1 : gen + 1;
+}
+
+static struct tlb_subscription *s_slot(struct tlb_event_loop *loop, uint32_t index) {
+  /* Old copies of the chunk list are retired, so stay pinned while reading it */
+  tlb_epoch_pin();
+  struct tlb_sub_chunks *chunks = atomic_load_explicit(&loop->subs.chunks, memory_order_acquire);
+  const size_t chunk = index / TLB_SUB_CHUNK_SIZE;
+  struct tlb_subscription *sub = NULL;
+  if (chunks && chunk < chunks->capacity) {
+    struct tlb_subscription *slots = atomic_load_explicit(&chunks->chunks[chunk], memory_order_acquire);
+    sub = slots ? &slots[index % TLB_SUB_CHUNK_SIZE] : NULL;
+  }
+  tlb_epoch_unpin();
+
+  return sub;
+}
+
+static int s_table_grow(struct tlb_event_loop *loop, uint32_t index) {
+  struct tlb_sub_table *table = &loop->subs;
+  const size_t chunk = index / TLB_SUB_CHUNK_SIZE;
+  if (s_slot(loop, index)) {
+    return 0;
+  }
+
+  int result = 0;
+  mtx_lock(&table->grow_mtx);
+
+  struct tlb_sub_chunks *chunks = atomic_load(&table->chunks);
+  if (!chunks || chunk >= chunks->capacity) {
+    const size_t capacity = TLB_MAX(chunk + 1, chunks ? chunks->capacity * 2 : 4);
+    struct tlb_sub_chunks *grown =
+        tlb_calloc(loop->alloc, 1, sizeof(struct tlb_sub_chunks) + (capacity * sizeof(grown->chunks[0])));
+    if (!grown) {
+      result = TLB_FAIL;
+      goto unlock;
+    }
+    grown->capacity = capacity;
+    for (size_t ii = 0; chunks && ii < chunks->capacity; ++ii) {
+      atomic_init(&grown->chunks[ii], atomic_load(&chunks->chunks[ii]));
+    }
+
+    /* Readers may still be looking at the old list */
+    atomic_store_explicit(&table->chunks, grown, memory_order_release);
+    if (chunks) {
+      tlb_epoch_retire(&loop->retired, &chunks->retired);
+    }
+    chunks = grown;
+  }
+
+  if (!atomic_load(&chunks->chunks[chunk])) {
+    struct tlb_subscription *slots = tlb_calloc(loop->alloc, TLB_SUB_CHUNK_SIZE, sizeof(struct tlb_subscription));
+    if (!slots) {
+      result = TLB_FAIL;
+      goto unlock;
+    }
+    for (size_t ii = 0; ii < TLB_SUB_CHUNK_SIZE; ++ii) {
+      slots[ii].index = (chunk * TLB_SUB_CHUNK_SIZE) + ii;
+    }
+    atomic_store_explicit(&chunks->chunks[chunk], slots, memory_order_release);
+  }
+
+unlock:
+  mtx_unlock(&table->grow_mtx);
+  return result;
+}
+
+static struct tlb_subscription *s_slot_alloc(struct tlb_event_loop *loop) {
+  struct tlb_sub_table *table = &loop->subs;
+
+  /* Reuse a free slot, the tag in the top half guards against ABA */
+  uint64_t head = atomic_load(&table->free_head);
+  while ((uint32_t)head != 0) {
+    struct tlb_subscription *sub = s_slot(loop, (uint32_t)head - 1);
+    const uint64_t next = ((((head >> 32U) + 1) << 32U) | atomic_load(&sub->free_next));
+    if (atomic_compare_exchange_weak(&table->free_head, &head, next)) {
+      return sub;
+    }
+  }
+
+  /* Otherwise take a fresh one, only allocating a new chunk takes the lock */
+  const uint32_t index = atomic_fetch_add(&table->reserved, 1);
+  TLB_CHECK_RETURN(0 ==, s_table_grow(loop, index), NULL);
+  return s_slot(loop, index);
+}
+
+static void s_slot_free(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  struct tlb_sub_table *table = &loop->subs;
+
+  /* Nothing can be running the callback anymore */
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  if (ext) {
+    if (ext->on_release) {
+      ext->on_release(sub->userdata);
+      ext->on_release = NULL;
+    }
+    s_sub_retire_limiter(loop, sub);
+    if (ext->refill != TLB_HANDLE_INVALID) {
+      tlb_evl_remove(loop, ext->refill);
+      ext->refill = TLB_HANDLE_INVALID;
+    }
+  }
+
+  /* Invalidate any outstanding handles and events */
+  const uint64_t word = atomic_load(&sub->state);
+  atomic_store(&sub->state, TLB_SUB_WORD(s_next_gen(TLB_SUB_GEN(word)), TLB_STATE_UNSUBBED, 0));
+  s_metrics_count(loop, TLB_METRIC_UNSUBSCRIBED);
+
+  uint64_t head = atomic_load(&table->free_head);
+  do {
+    atomic_store_explicit(&sub->free_next, (uint32_t)head, memory_order_relaxed);
+  } while (!atomic_compare_exchange_weak(&table->free_head, &head,
+                                         (((head >> 32U) + 1) << 32U) | (uint64_t)(sub->index + 1)));
+}
+
+static bool s_state_is_live(enum tlb_sub_state state) {
+  return state == TLB_STATE_SUBBED || state == TLB_STATE_RUNNING || state == TLB_STATE_REARMING ||
+         state == TLB_STATE_PENDING || state == TLB_STATE_MODIFYING;
+}
+
+struct tlb_subscription *tlb_evl_sub_get(struct tlb_event_loop *loop, tlb_handle handle) {
+  if (handle == TLB_HANDLE_INVALID) {
+    return NULL;
+  }
+
+  struct tlb_subscription *sub = s_slot(loop, TLB_HANDLE_INDEX(handle));
+  if (!sub) {
+    return NULL;
+  }
+
+  const uint64_t word = atomic_load(&sub->state);
+  if (TLB_SUB_GEN(word) != TLB_HANDLE_GEN(handle) || !s_state_is_live(TLB_SUB_STATE(word))) {
+    return NULL;
+  }
+  return sub;
+}
+
+tlb_handle tlb_evl_sub_handle(const struct tlb_subscription *sub) {
+  return TLB_HANDLE(sub->index, TLB_SUB_GEN(atomic_load_explicit(&sub->state, memory_order_relaxed)));
+}
+
+void tlb_evl_sub_foreach(struct tlb_event_loop *loop, void (*fn)(struct tlb_subscription *sub, void *userdata),
+                         void *userdata) {
+  tlb_epoch_pin();
+  struct tlb_sub_chunks *chunks = atomic_load_explicit(&loop->subs.chunks, memory_order_acquire);
+  for (size_t chunk = 0; chunks && chunk < chunks->capacity; ++chunk) {
+    struct tlb_subscription *slots = atomic_load_explicit(&chunks->chunks[chunk], memory_order_acquire);
+    for (size_t ii = 0; slots && ii < TLB_SUB_CHUNK_SIZE; ++ii) {
+      const uint64_t word = atomic_load_explicit(&slots[ii].state, memory_order_acquire);
+      if (TLB_SUB_GEN(word) != 0 && s_state_is_live(TLB_SUB_STATE(word))) {
+        fn(&slots[ii], userdata);
+      }
+    }
+  }
+  tlb_epoch_unpin();
+}
+
+struct tlb_sub_ext *tlb_evl_sub_extend(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  if (ext) {
+    return ext;
+  }
+
+  ext = TLB_CHECK(NULL !=, tlb_calloc(loop->alloc, 1, sizeof(struct tlb_sub_ext)));
+  ext->sub = sub;
+  atomic_init(&ext->deadline_ns, 0);
+  atomic_init(&ext->idle.timeout_ns, 0);
+  atomic_init(&ext->idle.active_ns, 0);
+  atomic_init(&ext->limiter, NULL);
+  ext->refill = TLB_HANDLE_INVALID;
+
+  /* Usually only the owner extends a slot, but rate limits and idle timeouts can be set from anywhere */
+  struct tlb_sub_ext *existing = NULL;
+  if (!atomic_compare_exchange_strong_explicit(&sub->ext, &existing, ext, memory_order_acq_rel,
+                                               memory_order_acquire)) {
+    tlb_free(loop->alloc, ext);
+    return existing;
+  }
+  return ext;
+}
+
+/**********************************************************************************************************************
+ * Memory usage                                                                                                       *
+ **********************************************************************************************************************/
+
+static void s_count_live(struct tlb_subscription *sub, void *userdata) {
+  (void)sub;
+  ++*(size_t *)userdata;
+}
+
+int tlb_evl_memory_usage(struct tlb_event_loop *loop, struct tlb_evl_memory *usage) {
+  memset(usage, 0, sizeof(*usage));
+  usage->loop_bytes = sizeof(struct tlb_event_loop);
+  usage->slot_bytes = sizeof(struct tlb_subscription);
+
+  tlb_epoch_pin();
+  struct tlb_sub_chunks *chunks = atomic_load_explicit(&loop->subs.chunks, memory_order_acquire);
+  if (chunks) {
+    usage->loop_bytes += sizeof(struct tlb_sub_chunks) + (chunks->capacity * sizeof(chunks->chunks[0]));
+    for (size_t chunk = 0; chunk < chunks->capacity; ++chunk) {
+      struct tlb_subscription *slots = atomic_load_explicit(&chunks->chunks[chunk], memory_order_acquire);
+      if (slots) {
+        usage->slots_reserved += TLB_SUB_CHUNK_SIZE;
+      }
+      for (size_t ii = 0; slots && ii < TLB_SUB_CHUNK_SIZE; ++ii) {
+        usage->slots_extended += tlb_evl_sub_ext(&slots[ii]) ? 1 : 0;
+      }
+    }
+  }
+  if (atomic_load_explicit(&loop->trace, memory_order_acquire)) {
+    usage->loop_bytes += sizeof(struct tlb_trace);
+  }
+  if (atomic_load_explicit(&loop->observer, memory_order_acquire)) {
+    usage->loop_bytes += sizeof(struct tlb_observer);
+  }
+  tlb_epoch_unpin();
+
+  usage->loop_bytes += usage->slots_reserved * usage->slot_bytes;
+  usage->loop_bytes += usage->slots_extended * sizeof(struct tlb_sub_ext);
+  tlb_evl_sub_foreach(loop, s_count_live, &usage->slots_live);
+
+  usage->allocator_tracked = tlb_tracking_allocator_stats(loop->alloc, &usage->allocator) == 0;
+  return 0;
+}
+
 static struct tlb_subscription *s_sub_new(struct tlb_event_loop *loop, tlb_on_event *on_event, void *userdata,
                                           const char *name) {
-  struct tlb_subscription *sub = TLB_CHECK(NULL !=, tlb_malloc(loop->alloc, sizeof(struct tlb_subscription)));
-  *sub = (struct tlb_subscription){
-      .on_event = on_event,
-      .userdata = userdata,
-      .name = name,
-  };
+  struct tlb_subscription *sub = TLB_CHECK(NULL !=, s_slot_alloc(loop));
+  sub->ident.ident = 0;
+  sub->callback.on_event = on_event;
+  sub->userdata = userdata;
+  atomic_store_explicit(&sub->events, 0, memory_order_relaxed);
+  sub->sub_mode = 0;
+  memset(&sub->platform, 0, sizeof(sub->platform));
+  sub->name = name;
+  sub->ready.requested = false;
+  atomic_store_explicit(&sub->ready.state, TLB_READY_NONE, memory_order_relaxed);
+  atomic_store_explicit(&sub->event_count, 0, memory_order_relaxed);
+  sub->balanced_count = 0;
+
+  /* Clear what a previous use of the slot left in its extension. The idle sequence keeps counting, so entries still
+   * filed for the old use stay stale. */
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  if (ext) {
+    ext->on_release = NULL;
+    atomic_store_explicit(&ext->deadline_ns, 0, memory_order_relaxed);
+    ext->migrate.loop = NULL;
+    ext->migrate.sub = NULL;
+    atomic_store_explicit(&ext->idle.timeout_ns, 0, memory_order_relaxed);
+    s_sub_retire_limiter(loop, sub);
+    ext->refill = TLB_HANDLE_INVALID;
+    ext->strand.strand = NULL;
+  }
+
+  /* Nothing can refer to the new generation yet, so it's safe to publish before subscribing */
+  const uint64_t word = atomic_load(&sub->state);
+  const uint32_t gen = TLB_SUB_GEN(word) == 0 ? 1 : TLB_SUB_GEN(word);
+  atomic_store_explicit(&sub->state, TLB_SUB_WORD(gen, TLB_STATE_SUBBED, 0), memory_order_release);
+  s_metrics_count(loop, TLB_METRIC_SUBSCRIBED);
 
   return sub;
 }
 
+static int s_sub_set_inline(struct tlb_event_loop *loop, struct tlb_subscription *sub, const void *data, size_t size,
+                            tlb_on_release *on_release) {
+  TLB_ASSERT(size <= TLB_EVL_INLINE_SIZE);
+  struct tlb_sub_ext *ext = TLB_CHECK_RETURN(NULL !=, tlb_evl_sub_extend(loop, sub), TLB_FAIL);
+  memcpy(ext->inline_data.bytes, data, size);
+  sub->userdata = ext->inline_data.bytes;
+  ext->on_release = on_release;
+  return 0;
+}
+
+/* Queues the subscription's events on a strand instead of calling it from the dispatching thread */
+static int s_sub_set_strand(struct tlb_event_loop *loop, struct tlb_subscription *sub, struct tlb_strand *strand) {
+  struct tlb_sub_ext *ext = TLB_CHECK_RETURN(NULL !=, tlb_evl_sub_extend(loop, sub), TLB_FAIL);
+  ext->strand.strand = strand;
+  sub->sub_mode |= TLB_SUB_STRAND;
+  return 0;
+}
+
+/* Frees a slot that was never subscribed, without releasing inline data, which still belongs to the caller */
+static void s_add_failed(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  if (ext) {
+    ext->on_release = NULL;
+  }
+  s_slot_free(loop, sub);
+}
+
 /**********************************************************************************************************************
  * File descriptor                                                                                                    *
  **********************************************************************************************************************/
 
-tlb_handle tlb_evl_add_fd(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger, tlb_on_event *on_event,
-                          void *userdata) {
-  struct tlb_subscription *sub = TLB_CHECK(NULL !=, s_sub_new(loop, on_event, userdata, "fd"));
+static tlb_handle s_add_fd(struct tlb_event_loop *loop, struct tlb_strand *strand, int fd, int events,
+                           uint8_t sub_mode, tlb_on_event *on_event, tlb_on_batch *on_batch, void *userdata,
+                           const void *data, size_t size, tlb_on_release *on_release) {
+  struct tlb_subscription *sub = s_sub_new(loop, on_event, userdata, "fd");
+  TLB_CHECK_RETURN(NULL !=, sub, TLB_HANDLE_INVALID);
   sub->ident.fd = fd;
-  sub->events = events;
-  if (edge_trigger) {
-    sub->sub_mode |= TLB_SUB_EDGE;
+  atomic_store_explicit(&sub->events, events, memory_order_relaxed);
+  sub->sub_mode = sub_mode;
+  if (on_batch) {
+    sub->callback.on_batch = on_batch;
+    sub->sub_mode |= TLB_SUB_BATCH;
+  }
+  if (strand) {
+    TLB_CHECK_GOTO(0 ==, s_sub_set_strand(loop, sub, strand), sub_failed);
+  }
+  if (data) {
+    TLB_CHECK_GOTO(0 ==, s_sub_set_inline(loop, sub, data, size, on_release), sub_failed);
   }
 
   tlb_evl_impl_fd_init(sub);
   TLB_CHECK_GOTO(0 ==, tlb_evl_impl_subscribe(loop, sub), sub_failed);
 
-  return sub;
+  return tlb_evl_sub_handle(sub);
 
 sub_failed:
-  tlb_free(loop->alloc, sub);
-  return NULL;
+  s_add_failed(loop, sub);
+  return TLB_HANDLE_INVALID;
+}
+
+static uint8_t s_fd_mode(bool edge_trigger) {
+  return edge_trigger ? TLB_SUB_EDGE : 0;
+}
+
+tlb_handle tlb_evl_add_fd(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger, tlb_on_event *on_event,
+                          void *userdata) {
+  return s_add_fd(loop, NULL, fd, events, s_fd_mode(edge_trigger), on_event, NULL, userdata, NULL, 0, NULL);
+}
+
+tlb_handle tlb_evl_add_fd_batch(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger,
+                                tlb_on_batch *on_batch, void *userdata) {
+  return s_add_fd(loop, NULL, fd, events, s_fd_mode(edge_trigger), NULL, on_batch, userdata, NULL, 0, NULL);
+}
+
+tlb_handle tlb_evl_add_fd_strand(struct tlb_event_loop *loop, struct tlb_strand *strand, int fd, int events,
+                                 bool edge_trigger, tlb_on_event *on_event, void *userdata) {
+  return s_add_fd(loop, strand, fd, events, s_fd_mode(edge_trigger), on_event, NULL, userdata, NULL, 0, NULL);
+}
+
+tlb_handle tlb_evl_add_fd_inline(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger,
+                                 tlb_on_event *on_event, const void *data, size_t size, tlb_on_release *on_release) {
+  if (size > TLB_EVL_INLINE_SIZE) {
+    errno = EINVAL;
+    return TLB_HANDLE_INVALID;
+  }
+  return s_add_fd(loop, NULL, fd, events, s_fd_mode(edge_trigger), on_event, NULL, NULL, data, size, on_release);
+}
+
+tlb_handle tlb_evl_add_fd_pinned(struct tlb_event_loop *loop, int fd, int events, bool edge_trigger,
+                                 tlb_on_event *on_event, const void *data, size_t size, tlb_on_release *on_release) {
+  TLB_ASSERT(size <= TLB_EVL_INLINE_SIZE);
+  return s_add_fd(loop, NULL, fd, events, s_fd_mode(edge_trigger) | TLB_SUB_PINNED, on_event, NULL, NULL, data, size,
+                  on_release);
+}
+
+tlb_handle tlb_evl_add_fd_shared(struct tlb_event_loop *loop, int fd, int events, tlb_on_event *on_event,
+                                 const void *data, size_t size, tlb_on_release *on_release, int *watch_fd) {
+  *watch_fd = fd;
+  if (tlb_evl_impl_rejects_existing_fd()) {
+    const tlb_handle handle = tlb_evl_add_fd_pinned(loop, fd, events, false, on_event, data, size, on_release);
+    if (handle != TLB_HANDLE_INVALID || errno != EEXIST) {
+      return handle;
+    }
+  }
+
+  /* A duplicate of the fd is a registration of its own */
+  const int duplicate = TLB_CHECK_RETURN(-1 !=, fcntl(fd, F_DUPFD_CLOEXEC, 0), TLB_HANDLE_INVALID);
+  *watch_fd = duplicate;
+  const tlb_handle handle = tlb_evl_add_fd_pinned(loop, duplicate, events, false, on_event, data, size, on_release);
+  if (handle == TLB_HANDLE_INVALID) {
+    const int error = errno;
+    *watch_fd = fd;
+    close(duplicate);
+    errno = error;
+  }
+  return handle;
 }
 
 /**********************************************************************************************************************
  * Timer                                                                                                              *
  **********************************************************************************************************************/
 
-tlb_handle tlb_evl_add_timer(struct tlb_event_loop *loop, int timeout, tlb_on_event *trigger, void *userdata) {
-  struct tlb_subscription *sub = TLB_CHECK(NULL !=, s_sub_new(loop, trigger, userdata, "timer"));
+static tlb_handle s_add_timer(struct tlb_event_loop *loop, struct tlb_strand *strand, int timeout, uint8_t sub_mode,
+                              tlb_on_event *trigger, void *userdata, const void *data, size_t size,
+                              tlb_on_release *on_release) {
+  struct tlb_subscription *sub = s_sub_new(loop, trigger, userdata, "timer");
+  TLB_CHECK_RETURN(NULL !=, sub, TLB_HANDLE_INVALID);
+  sub->sub_mode = sub_mode;
+  if (sub_mode & TLB_SUB_REUSABLE) {
+    TLB_CHECK_GOTO(NULL !=, tlb_evl_sub_extend(loop, sub), sub_failed);
+  }
+  if (strand) {
+    TLB_CHECK_GOTO(0 ==, s_sub_set_strand(loop, sub, strand), sub_failed);
+  }
+  if (data) {
+    TLB_CHECK_GOTO(0 ==, s_sub_set_inline(loop, sub, data, size, on_release), sub_failed);
+  }
   tlb_evl_impl_timer_init(sub, timeout);
   TLB_CHECK_GOTO(0 ==, tlb_evl_impl_subscribe(loop, sub), sub_failed);
-  return sub;
+  return tlb_evl_sub_handle(sub);
 
 sub_failed:
-  tlb_free(loop->alloc, sub);
-  return NULL;
+  s_add_failed(loop, sub);
+  return TLB_HANDLE_INVALID;
+}
+
+tlb_handle tlb_evl_add_timer(struct tlb_event_loop *loop, int timeout, tlb_on_event *trigger, void *userdata) {
+  return s_add_timer(loop, NULL, timeout, 0, trigger, userdata, NULL, 0, NULL);
+}
+
+tlb_handle tlb_evl_add_timer_strand(struct tlb_event_loop *loop, struct tlb_strand *strand, int timeout,
+                                    tlb_on_event *trigger, void *userdata) {
+  return s_add_timer(loop, strand, timeout, 0, trigger, userdata, NULL, 0, NULL);
+}
+
+tlb_handle tlb_evl_add_timer_inline(struct tlb_event_loop *loop, int timeout, tlb_on_event *trigger, const void *data,
+                                    size_t size, tlb_on_release *on_release) {
+  if (size > TLB_EVL_INLINE_SIZE) {
+    errno = EINVAL;
+    return TLB_HANDLE_INVALID;
+  }
+  return s_add_timer(loop, NULL, timeout, 0, trigger, NULL, data, size, on_release);
+}
+
+tlb_handle tlb_evl_add_timer_reusable(struct tlb_event_loop *loop, tlb_on_event *trigger, const void *data,
+                                      size_t size) {
+  if (size > TLB_EVL_INLINE_SIZE) {
+    errno = EINVAL;
+    return TLB_HANDLE_INVALID;
+  }
+  return s_add_timer(loop, NULL, 0, TLB_SUB_REUSABLE, trigger, NULL, data, size, NULL);
+}
+
+static int s_sub_apply(struct tlb_event_loop *loop, struct tlb_subscription *sub, uint32_t gen);
+
+/* Reusable timers are extended when they're added, for their deadline */
+static struct tlb_sub_ext *s_timer_ext(struct tlb_subscription *sub) {
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  TLB_ASSERT(ext);
+  return ext;
+}
+
+int tlb_evl_timer_set(struct tlb_event_loop *loop, tlb_handle timer, uint64_t timeout_ns) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, timer);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+  if (!(sub->sub_mode & TLB_SUB_REUSABLE)) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  /* Rearmed like any other change to the interest set, by the owner if it's running */
+  atomic_store(&s_timer_ext(sub)->deadline_ns, tlb_time_now_ns() + TLB_MIN(timeout_ns, UINT64_MAX / 2));
+  return s_sub_apply(loop, sub, TLB_HANDLE_GEN(timer));
+}
+
+/* Clears a reusable timer's deadline once it's passed, returns false if it's been set for later since it fired */
+static bool s_timer_fired(struct tlb_subscription *sub) {
+  struct tlb_sub_ext *ext = s_timer_ext(sub);
+  uint64_t deadline_ns = atomic_load(&ext->deadline_ns);
+  if (deadline_ns > tlb_time_now_ns()) {
+    return false;
+  }
+  /* Fails if it was just set again, which is kept for the rearm */
+  atomic_compare_exchange_strong(&ext->deadline_ns, &deadline_ns, 0);
+  return true;
+}
+
+/**********************************************************************************************************************
+ * Deadlines                                                                                                          *
+ **********************************************************************************************************************/
+
+uint64_t tlb_evl_now_ns(void) {
+  return tlb_time_now_ns();
+}
+
+/* Rounded up, so a wait for less than a millisecond doesn't turn into a busy loop */
+static int s_wait_ms(uint64_t remaining_ns, int timeout) {
+  static const uint64_t nanos_per_milli = 1000000;
+  const uint64_t remaining_ms = TLB_MIN((remaining_ns + nanos_per_milli - 1) / nanos_per_milli, (uint64_t)INT_MAX);
+  return timeout == TLB_WAIT_INDEFINITE ? (int)remaining_ms : TLB_MIN(timeout, (int)remaining_ms);
+}
+
+int tlb_evl_handle_events_until(struct tlb_event_loop *loop, uint64_t deadline_ns, int timeout) {
+  int handled = 0;
+  int wait = timeout;
+  uint64_t now_ns = tlb_time_now_ns();
+  while (now_ns < deadline_ns) {
+    /* Events claimed from the kernel have to be run, so only claim as many as there's time left for. Until the cost is
+     * known, a single one is claimed to measure it. */
+    const uint64_t remaining_ns = deadline_ns - now_ns;
+    const uint64_t cost_ns = atomic_load_explicit(&loop->event_cost_ns, memory_order_relaxed);
+    const size_t budget =
+        cost_ns ? (size_t)TLB_MAX(TLB_MIN(remaining_ns / cost_ns, (uint64_t)TLB_EV_EVENT_BATCH), (uint64_t)1) : 1;
+
+    wait = s_wait_ms(remaining_ns, wait);
+    const int result = tlb_evl_handle_events(loop, budget, wait);
+    if (result < 0) {
+      return TLB_FAIL;
+    }
+    if (result == 0) {
+      break;
+    }
+    handled += result;
+
+    const uint64_t polled_ns = now_ns;
+    now_ns = tlb_time_now_ns();
+    if (wait == TLB_WAIT_NONE) {
+      /* Time spent waiting isn't part of the cost, so only polls that didn't wait are measured */
+      const uint64_t sample_ns = TLB_MAX((now_ns - polled_ns) / (uint64_t)result, (uint64_t)1);
+      atomic_store_explicit(&loop->event_cost_ns, cost_ns ? (cost_ns * 3 + sample_ns) / 4 : sample_ns,
+                            memory_order_relaxed);
+    }
+    wait = TLB_WAIT_NONE;
+  }
+  return handled;
+}
+
+void tlb_evl_set_time_slice(struct tlb_event_loop *sub_loop, uint64_t slice_ns) {
+  atomic_store_explicit(&sub_loop->slice_ns, slice_ns, memory_order_relaxed);
+}
+
+/**********************************************************************************************************************
+ * Ready queue                                                                                                        *
+ **********************************************************************************************************************/
+
+static void s_ready_push(struct tlb_event_loop *loop, struct tlb_subscription *sub, int events) {
+  TLB_LOG_EVENT(sub, "Requeued");
+  tlb_record(TLB_RECORD_REQUEUE, sub, sub->name, (uint32_t)events);
+  sub->ready.events = (uint8_t)events;
+  sub->ready.next = 0;
+  atomic_store_explicit(&sub->ready.state, TLB_READY_QUEUED, memory_order_relaxed);
+
+  mtx_lock(&loop->ready.mtx);
+  if (loop->ready.tail) {
+    loop->ready.tail->ready.next = sub->index + 1;
+  } else {
+    loop->ready.head = sub;
+  }
+  loop->ready.tail = sub;
+  atomic_fetch_add_explicit(&loop->ready.count, 1, memory_order_relaxed);
+  mtx_unlock(&loop->ready.mtx);
+}
+
+/* Takes up to count requeued subscriptions, in the order they were requeued */
+static size_t s_ready_pop(struct tlb_event_loop *loop, struct tlb_evl_event *events, size_t count) {
+  if (atomic_load_explicit(&loop->ready.count, memory_order_relaxed) == 0) {
+    return 0;
+  }
+
+  size_t popped = 0;
+  mtx_lock(&loop->ready.mtx);
+  while (popped < count && loop->ready.head) {
+    struct tlb_subscription *sub = loop->ready.head;
+    loop->ready.head = sub->ready.next ? s_slot(loop, sub->ready.next - 1) : NULL;
+    atomic_store_explicit(&sub->ready.state, TLB_READY_TAKEN, memory_order_release);
+    /* Still claimed, so the generation can't have moved on */
+    events[popped++] = (struct tlb_evl_event){
+        .handle = tlb_evl_sub_handle(sub),
+        .events = sub->ready.events | TLB_EV_REQUEUED,
+        .polled_ns = 0,
+    };
+  }
+  if (!loop->ready.head) {
+    loop->ready.tail = NULL;
+  }
+  atomic_fetch_sub_explicit(&loop->ready.count, popped, memory_order_relaxed);
+  mtx_unlock(&loop->ready.mtx);
+  return popped;
+}
+
+/* The callbacks the current thread is running, innermost first. Sub-loops nest them, a batch runs several at once. */
+struct tlb_calling {
+  struct tlb_calling *outer;
+  struct tlb_subscription *sub;             /* The on_event one, or a batch subscription dispatched on its own */
+  const struct tlb_evl_batch_claim *claims; /* Or the batch's */
+  size_t claim_count;
+};
+static _Thread_local struct tlb_calling *s_calling;
+
+/* Whether the current thread is inside sub's callback, which makes it the owner */
+static bool s_sub_calling(const struct tlb_subscription *sub);
+
+int tlb_evl_requeue(struct tlb_event_loop *loop, tlb_handle subscription) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, subscription);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+  /* Only the owner may ask, from the callback, a strand's queue is what keeps its subscriptions exclusive */
+  if ((sub->sub_mode & (TLB_SUB_ONESHOT | TLB_SUB_STRAND)) || !s_sub_calling(sub)) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  sub->ready.requested = true;
+  return 0;
+}
+
+size_t tlb_evl_requeued_count(const struct tlb_event_loop *loop) {
+  return atomic_load_explicit(&loop->ready.count, memory_order_relaxed);
 }
 
 /**********************************************************************************************************************
@@ -81,12 +750,12 @@ sub_failed:
  **********************************************************************************************************************/
 
 tlb_handle tlb_evl_add_evl(struct tlb_event_loop *loop, struct tlb_event_loop *sub_loop) {
-  struct tlb_subscription *sub =
-      tlb_evl_add_fd(loop, sub_loop->fd, TLB_EV_READ, false, tlb_evl_sub_loop_on_event, sub_loop);
+  tlb_handle handle = tlb_evl_add_fd(loop, sub_loop->fd, TLB_EV_READ, false, tlb_evl_sub_loop_on_event, sub_loop);
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, handle);
   if (sub) {
     sub->name = "sub-loop";
   }
-  return sub;
+  return handle;
 }
 
 void tlb_evl_sub_loop_on_event(tlb_handle subscription, int events, void *userdata) {
@@ -94,13 +763,571 @@ void tlb_evl_sub_loop_on_event(tlb_handle subscription, int events, void *userda
   (void)events;
   struct tlb_event_loop *sub_loop = userdata;
 
-  int handled = tlb_evl_handle_events(sub_loop, TLB_EV_EVENT_BATCH, 0);
-  if (handled > 0) {
-    TLB_LOGF_EVENT(subscription, "Handled %d events", handled);
-  } else if (handled < 0) {
-    TLB_LOGF_EVENT(subscription, "Event handler failed with error: %s", strerror(errno));
+  const uint64_t slice_ns = atomic_load_explicit(&sub_loop->slice_ns, memory_order_relaxed);
+  int handled = slice_ns ? tlb_evl_handle_events_until(sub_loop, tlb_time_now_ns() + slice_ns, TLB_WAIT_NONE)
+                         : tlb_evl_handle_events(sub_loop, TLB_EV_EVENT_BATCH, 0);
+  /* Its requeued subscriptions don't make its fd readable, so have the parent run it again instead */
+  if (tlb_evl_requeued_count(sub_loop) && s_calling && s_calling->sub) {
+    s_calling->sub->ready.requested = true;
+  }
+  if (handled < 0) {
+    TLB_LOGF("[sub-loop:%#" PRIx64 "] Event handler failed with error: %s", subscription, strerror(errno));
     TLB_ASSERT(false);
+  } else if (TLB_EVENT_LOGGING && handled > 0) {
+    TLB_LOGF("[sub-loop:%#" PRIx64 "] Handled %d events", subscription, handled);
+  }
+}
+
+/**********************************************************************************************************************
+ * Dispatch                                                                                                           *
+ **********************************************************************************************************************/
+
+_Thread_local _Atomic uint64_t *tlb_evl_heartbeat;
+
+/* Bookkeeping around a callback, shared by single and batched ones */
+struct tlb_call {
+  struct tlb_trace *trace;
+  _Atomic uint64_t *heartbeat;
+  struct tlb_observer *observer;
+  uint64_t start_ns;
+  bool beat;
+  struct tlb_profile_span profile;
+};
+
+static void s_call_start(struct tlb_event_loop *loop, struct tlb_call *call) {
+  /* The caller is pinned, so the trace can't be freed under us */
+  call->trace = atomic_load_explicit(&loop->trace, memory_order_acquire);
+  call->observer = atomic_load_explicit(&loop->observer, memory_order_acquire);
+  call->heartbeat = tlb_evl_heartbeat;
+  call->start_ns = (call->trace || call->heartbeat) ? tlb_time_now_ns() : 0;
+
+  /* Sub-loop callbacks leave the outermost callback's start in place */
+  call->beat = call->heartbeat && atomic_load_explicit(call->heartbeat, memory_order_relaxed) == 0;
+  if (call->beat) {
+    atomic_store_explicit(call->heartbeat, call->start_ns, memory_order_relaxed);
+  }
+  tlb_profile_start(&call->profile);
+}
+
+/* Profiled under name, as calls callbacks (more than one for a batch) */
+static void s_call_end(struct tlb_call *call, const char *name, uint64_t calls) {
+  tlb_profile_end(&call->profile, name, calls);
+  if (call->beat) {
+    atomic_store_explicit(call->heartbeat, 0, memory_order_relaxed);
+  }
+}
+
+/* Anything that's dispatched counts as activity, including the timeout itself */
+static void s_sub_touch(struct tlb_subscription *sub, struct tlb_call *call) {
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  if (ext && atomic_load_explicit(&ext->idle.timeout_ns, memory_order_relaxed)) {
+    if (!call->start_ns) {
+      call->start_ns = tlb_time_now_ns();
+    }
+    atomic_store_explicit(&ext->idle.active_ns, call->start_ns, memory_order_relaxed);
+  }
+}
+
+/* Only the owner writes it, so there's no need for an atomic add */
+static void s_sub_counted(struct tlb_subscription *sub) {
+  atomic_store_explicit(&sub->event_count, atomic_load_explicit(&sub->event_count, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+}
+
+static void s_sub_call(struct tlb_event_loop *loop, struct tlb_subscription *sub, tlb_handle handle, int events,
+                       uint64_t polled_ns) {
+  TLB_LOG_EVENT(sub, "Handling");
+  struct tlb_call call;
+  s_call_start(loop, &call);
+  s_sub_touch(sub, &call);
+
+  tlb_record(TLB_RECORD_DISPATCH_START, sub, sub->name, (uint32_t)events);
+  if (call.observer && call.observer->hooks.on_dispatch_start) {
+    call.observer->hooks.on_dispatch_start(loop, handle, sub->name, events, call.observer->hooks.userdata);
+  }
+  struct tlb_calling calling = {.outer = s_calling, .sub = sub};
+  s_calling = &calling;
+  if (sub->sub_mode & TLB_SUB_BATCH) {
+    /* Batch subscriptions dispatched on their own, e.g. pending events or idle timeouts, get a batch of one */
+    const struct tlb_evl_batch_item item = {.handle = handle, .events = events, .userdata = sub->userdata};
+    sub->callback.on_batch(&item, 1);
+  } else {
+    sub->callback.on_event(handle, events, sub->userdata);
+  }
+  /* Sub-loops nest, so put the outer one back afterwards */
+  s_calling = calling.outer;
+  if (call.observer && call.observer->hooks.on_dispatch_end) {
+    call.observer->hooks.on_dispatch_end(loop, handle, sub->name, events, call.observer->hooks.userdata);
+  }
+  tlb_record(TLB_RECORD_DISPATCH_END, sub, sub->name, (uint32_t)events);
+  s_sub_counted(sub);
+
+  s_call_end(&call, sub->name, 1);
+  if (call.trace) {
+    tlb_trace_callback(call.trace, sub, handle, polled_ns, call.start_ns);
+  }
+}
+
+static bool s_sub_claim(struct tlb_subscription *sub, uint32_t gen, int events) {
+  uint64_t word = atomic_load(&sub->state);
+  for (;;) {
+    /* If the generation doesn't match it's been removed since the kernel handed out the event */
+    if (TLB_SUB_GEN(word) != gen) {
+      return false;
+    }
+
+    switch (TLB_SUB_STATE(word)) {
+      case TLB_STATE_SUBBED:
+        if (atomic_compare_exchange_weak(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_RUNNING, 0))) {
+          return true;
+        }
+        break;
+
+      case TLB_STATE_RUNNING:
+        /* Armed again by a modify while the callback was running, have the owner run it again */
+        if (atomic_compare_exchange_weak(&sub->state, &word,
+                                         TLB_SUB_WORD(gen, TLB_STATE_RUNNING, TLB_SUB_PENDING(word) | events))) {
+          TLB_LOG_EVENT(sub, "Handed off to running owner");
+          return false;
+        }
+        break;
+
+      case TLB_STATE_REARMING:
+      case TLB_STATE_PENDING:
+        /* The owner hasn't finished rearming yet, hand the events off to it */
+        if (atomic_compare_exchange_weak(&sub->state, &word,
+                                         TLB_SUB_WORD(gen, TLB_STATE_PENDING, TLB_SUB_PENDING(word) | events))) {
+          TLB_LOG_EVENT(sub, "Handed off to owner");
+          return false;
+        }
+        break;
+
+      case TLB_STATE_MODIFYING:
+        /* The event came from the old interest set, the modifier is only making a single rearm call */
+        thrd_yield();
+        word = atomic_load(&sub->state);
+        break;
+
+      case TLB_STATE_MIGRATING:
+        /* It'll be registered with its new loop once the owner is done, which reports anything still ready */
+      case TLB_STATE_UNSUBBING:
+      case TLB_STATE_UNSUBBED:
+      case TLB_STATE_RELEASED:
+        return false;
+    }
+  }
+}
+
+/* Hands a subscription claimed by its owner over to the one it's migrating to, and frees it */
+static void s_sub_handover(struct tlb_event_loop *loop, struct tlb_subscription *sub,
+                           struct tlb_event_loop *target_loop, struct tlb_subscription *target) {
+  atomic_store_explicit(&target->event_count, atomic_load_explicit(&sub->event_count, memory_order_relaxed),
+                        memory_order_relaxed);
+  target->balanced_count = sub->balanced_count;
+  atomic_fetch_and(&target->events, (uint8_t)~TLB_EV_THROTTLED);
+
+  /* tlb_evl_migrate already extended the target if the source was, so this only allocates for a rate limit or idle
+   * timeout set since, which are dropped if it fails */
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  struct tlb_sub_ext *target_ext = ext ? tlb_evl_sub_extend(target_loop, target) : NULL;
+  if (target_ext) {
+    if (sub->userdata == ext->inline_data.bytes) {
+      memcpy(target_ext->inline_data.bytes, ext->inline_data.bytes, sizeof(target_ext->inline_data.bytes));
+      target->userdata = target_ext->inline_data.bytes;
+    }
+    /* The refill timer goes with the old slot, so the new one starts out armed */
+    atomic_store(&target_ext->limiter, atomic_exchange(&ext->limiter, NULL));
+    /* Idle deadlines start over in the new loop's wheel */
+    const uint64_t idle_timeout_ns = atomic_load_explicit(&ext->idle.timeout_ns, memory_order_relaxed);
+    if (idle_timeout_ns) {
+      tlb_idle_watch(target_loop, target, idle_timeout_ns);
+    }
+  }
+
+  /* Unsubscribe before the target is registered, so the two never run at the same time */
+  tlb_evl_impl_unsubscribe(loop, sub);
+  if (target_ext) {
+    target_ext->on_release = ext->on_release;
+    ext->on_release = NULL;
+  }
+  s_slot_free(loop, sub);
+}
+
+static int s_sub_update(struct tlb_event_loop *loop, tlb_handle subscription, int clear, int set);
+
+struct tlb_sub_refill {
+  struct tlb_event_loop *loop;
+  tlb_handle handle;
+};
+
+static void s_sub_on_refill(tlb_handle timer, int events, void *userdata) {
+  (void)timer;
+  (void)events;
+  const struct tlb_sub_refill *refill = userdata;
+  /* Fails if it's been removed or migrated since, neither needs rearming anymore */
+  s_sub_update(refill->loop, refill->handle, TLB_EV_THROTTLED, 0);
+}
+
+/* Charges a rate limited subscription for the callback that just ran, it's left disarmed if that emptied its buckets */
+static void s_sub_throttle(struct tlb_event_loop *loop, struct tlb_subscription *sub, tlb_handle handle) {
+  /* Only called once the subscription has a limiter, so it's extended */
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  struct tlb_rate_limiter *limiter = atomic_load_explicit(&ext->limiter, memory_order_acquire);
+  const uint64_t wait_ns = limiter ? tlb_rate_limiter_charge(limiter, tlb_time_now_ns()) : 0;
+  if (wait_ns == 0) {
+    return;
+  }
+
+  TLB_LOGF_EVENT(sub, "Throttled for %" PRIu64 "ns", wait_ns);
+  atomic_fetch_or(&sub->events, TLB_EV_THROTTLED);
+  if (ext->refill == TLB_HANDLE_INVALID) {
+    const struct tlb_sub_refill refill = {.loop = loop, .handle = handle};
+    ext->refill = tlb_evl_add_timer_reusable(loop, s_sub_on_refill, &refill, sizeof(refill));
+    if (ext->refill != TLB_HANDLE_INVALID) {
+      tlb_evl_set_name(loop, ext->refill, "refill");
+    }
+  }
+  if (ext->refill == TLB_HANDLE_INVALID || tlb_evl_timer_set(loop, ext->refill, wait_ns) != 0) {
+    /* Better to run over the limit than to never rearm it */
+    atomic_fetch_and(&sub->events, (uint8_t)~TLB_EV_THROTTLED);
+  }
+}
+
+/* Paused subscriptions only see errors and hangups, those are held back until it's resumed. Ones removed while queued
+ * on a strand never started, so don't start them now. */
+static bool s_sub_callable(struct tlb_subscription *sub) {
+  return !(atomic_load(&sub->events) & TLB_EV_PAUSED) && TLB_SUB_STATE(atomic_load(&sub->state)) == TLB_STATE_RUNNING;
+}
+
+/* What's left of a callback once it's returned, before rearming */
+static void s_sub_called(struct tlb_event_loop *loop, struct tlb_subscription *sub, tlb_handle handle) {
+  if (sub->sub_mode & TLB_SUB_ONESHOT) {
+    tlb_evl_remove(loop, handle);
+  } else {
+    struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+    if (ext && atomic_load_explicit(&ext->limiter, memory_order_relaxed)) {
+      s_sub_throttle(loop, sub, handle);
+    }
+  }
+}
+
+/* Runs the callback for a claimed subscription unless call is false, and rearms or frees it afterwards */
+static void s_sub_run(struct tlb_event_loop *loop, struct tlb_subscription *sub, tlb_handle handle, int events,
+                      uint64_t polled_ns, bool call) {
+  uint32_t gen = TLB_HANDLE_GEN(handle);
+  for (;;) {
+    /* Reusable timers that have been set for later since they fired just get rearmed */
+    if (call && s_sub_callable(sub) && (!(sub->sub_mode & TLB_SUB_REUSABLE) || s_timer_fired(sub))) {
+      s_sub_call(loop, sub, handle, events, polled_ns);
+      s_sub_called(loop, sub, handle);
+    }
+    call = true;
+
+    /* Requeued by the callback, it stays claimed until the next poll takes it off the ready queue. Ones that were
+     * paused or throttled in the meantime, or removed or migrated, carry on as usual. */
+    if (sub->ready.requested) {
+      sub->ready.requested = false;
+      if (tlb_evl_sub_interest(sub) && TLB_SUB_STATE(atomic_load(&sub->state)) == TLB_STATE_RUNNING) {
+        s_ready_push(loop, sub, events);
+        return;
+      }
+    }
+
+    /* Resubscribe the event, picking up anything that changed the interest set while running */
+    uint64_t word = TLB_SUB_WORD(gen, TLB_STATE_RUNNING, 0);
+    if (atomic_compare_exchange_strong(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_REARMING, 0))) {
+      /* Left disarmed while paused, resuming rearms it. Subscriptions that migrated here aren't registered yet. */
+      if (sub->sub_mode & TLB_SUB_UNREGISTERED) {
+        sub->sub_mode &= (uint8_t)~TLB_SUB_UNREGISTERED;
+        tlb_evl_impl_subscribe(loop, sub);
+      } else if (tlb_evl_sub_interest(sub)) {
+        tlb_evl_impl_rearm(loop, sub);
+        tlb_record(TLB_RECORD_REARM, sub, sub->name, 0);
+        s_metrics_count(loop, TLB_METRIC_REARMS);
+        struct tlb_observer *observer = atomic_load_explicit(&loop->observer, memory_order_acquire);
+        if (observer && observer->hooks.on_rearm) {
+          observer->hooks.on_rearm(loop, handle, sub->name, tlb_evl_sub_interest(sub), observer->hooks.userdata);
+        }
+      }
+
+      word = TLB_SUB_WORD(gen, TLB_STATE_REARMING, 0);
+      if (atomic_compare_exchange_strong(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_SUBBED, 0))) {
+        TLB_LOG_EVENT(sub, "Set to SUBBED");
+        return;
+      }
+    }
+
+    /* Events came in while running or rearming, run them here to keep exclusivity */
+    if ((TLB_SUB_STATE(word) == TLB_STATE_PENDING || TLB_SUB_STATE(word) == TLB_STATE_RUNNING) &&
+        atomic_compare_exchange_strong(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_RUNNING, 0))) {
+      events = TLB_SUB_PENDING(word);
+      /* Handed off events didn't come straight from this poll, don't count them as queued */
+      polled_ns = 0;
+      continue;
+    }
+
+    /* Migrated while running, finish off as the owner of the new subscription by registering it */
+    if (TLB_SUB_STATE(word) == TLB_STATE_MIGRATING) {
+      TLB_LOG_EVENT(sub, "Handing over to migrated subscription");
+      /* tlb_evl_migrate extended it to say where it's going */
+      const struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+      struct tlb_event_loop *target_loop = ext->migrate.loop;
+      struct tlb_subscription *target = ext->migrate.sub;
+      s_sub_handover(loop, sub, target_loop, target);
+
+      loop = target_loop;
+      sub = target;
+      handle = tlb_evl_sub_handle(target);
+      gen = TLB_HANDLE_GEN(handle);
+      call = false;
+      continue;
+    }
+
+    /* Removed while running, let the remover know we're done if it's still unsubscribing */
+    if (TLB_SUB_STATE(word) == TLB_STATE_UNSUBBING &&
+        atomic_compare_exchange_strong(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_RELEASED, 0))) {
+      return;
+    }
+
+    TLB_ASSERT(TLB_SUB_STATE(word) == TLB_STATE_UNSUBBED);
+    s_slot_free(loop, sub);
+    return;
+  }
+}
+
+static void s_sub_strand_run(struct tlb_strand *strand, struct tlb_strand_task *task) {
+  struct tlb_sub_ext *ext = TLB_CONTAINER_OF(task, struct tlb_sub_ext, strand.task);
+  struct tlb_subscription *sub = ext->sub;
+  /* Still claimed, so the generation can't have moved on. May be run outside of a poll, e.g. by a strand dispatch. */
+  tlb_epoch_pin();
+  s_sub_run(strand->loop, sub, tlb_evl_sub_handle(sub), ext->strand.events, ext->strand.polled_ns, true);
+  tlb_epoch_unpin();
+}
+
+struct tlb_evl_batch_claim {
+  struct tlb_subscription *sub;
+  uint64_t polled_ns;
+};
+
+/* Batch subscriptions claimed by a dispatch, waiting for their handlers to be called. Items are what the handlers are
+ * passed, claims hold the rest. */
+struct tlb_evl_batch {
+  size_t count;
+  struct tlb_evl_batch_item items[TLB_EV_EVENT_BATCH];
+  struct tlb_evl_batch_claim claims[TLB_EV_EVENT_BATCH];
+};
+
+/* Calls a handler once for the claims in [start, end), then rearms each of them */
+static void s_batch_call(struct tlb_event_loop *loop, struct tlb_evl_batch *batch, size_t start, size_t end) {
+  struct tlb_subscription *first = batch->claims[start].sub;
+  TLB_LOGF_EVENT(first, "Handling batch of %zu", end - start);
+  struct tlb_call call;
+  s_call_start(loop, &call);
+  for (size_t ii = start; ii < end; ++ii) {
+    s_sub_touch(batch->claims[ii].sub, &call);
+  }
+
+  const struct tlb_evl_batch_item *item = &batch->items[start];
+  const struct tlb_evl_observer *hooks = call.observer ? &call.observer->hooks : NULL;
+  tlb_record(TLB_RECORD_DISPATCH_START, first, "batch", (uint32_t)(end - start));
+  if (hooks && hooks->on_dispatch_start) {
+    hooks->on_dispatch_start(loop, item->handle, first->name, item->events, hooks->userdata);
+  }
+  struct tlb_calling calling = {.outer = s_calling, .claims = &batch->claims[start], .claim_count = end - start};
+  s_calling = &calling;
+  first->callback.on_batch(item, end - start);
+  s_calling = calling.outer;
+  if (hooks && hooks->on_dispatch_end) {
+    hooks->on_dispatch_end(loop, item->handle, first->name, item->events, hooks->userdata);
+  }
+  tlb_record(TLB_RECORD_DISPATCH_END, first, "batch", (uint32_t)(end - start));
+  for (size_t ii = start; ii < end; ++ii) {
+    s_sub_counted(batch->claims[ii].sub);
+  }
+
+  s_call_end(&call, first->name, end - start);
+  /* Traced as a single callback, under the first subscription */
+  if (call.trace) {
+    tlb_trace_callback(call.trace, first, batch->items[start].handle, batch->claims[start].polled_ns, call.start_ns);
+  }
+
+  for (size_t ii = start; ii < end; ++ii) {
+    struct tlb_evl_batch_item *item = &batch->items[ii];
+    s_sub_called(loop, batch->claims[ii].sub, item->handle);
+    s_sub_run(loop, batch->claims[ii].sub, item->handle, item->events, 0, false);
+  }
+}
+
+static bool s_sub_calling(const struct tlb_subscription *sub) {
+  for (const struct tlb_calling *calling = s_calling; calling; calling = calling->outer) {
+    if (calling->sub == sub) {
+      return true;
+    }
+    for (size_t ii = 0; ii < calling->claim_count; ++ii) {
+      if (calling->claims[ii].sub == sub) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static void s_batch_flush(struct tlb_event_loop *loop, struct tlb_evl_batch *batch) {
+  /* Claims for the same handler are moved up behind the first one, keeping their order */
+  size_t start = 0;
+  while (start < batch->count) {
+    tlb_on_batch *on_batch = batch->claims[start].sub->callback.on_batch;
+    size_t end = start + 1;
+    for (size_t ii = end; ii < batch->count; ++ii) {
+      if (batch->claims[ii].sub->callback.on_batch != on_batch) {
+        continue;
+      }
+      if (ii != end) {
+        const struct tlb_evl_batch_item item = batch->items[ii];
+        batch->items[ii] = batch->items[end];
+        batch->items[end] = item;
+        const struct tlb_evl_batch_claim claim = batch->claims[ii];
+        batch->claims[ii] = batch->claims[end];
+        batch->claims[end] = claim;
+      }
+      ++end;
+    }
+    s_batch_call(loop, batch, start, end);
+    start = end;
+  }
+  batch->count = 0;
+}
+
+/* Claimed batch subscriptions are left in batch when there is one, to be called along with the rest of the poll */
+static void s_dispatch_event(struct tlb_event_loop *loop, struct tlb_evl_batch *batch, tlb_handle handle, int events,
+                             uint64_t polled_ns) {
+  struct tlb_subscription *sub = s_slot(loop, TLB_HANDLE_INDEX(handle));
+  if (!sub) {
+    return;
+  }
+  /* Requeued subscriptions were never given up, but only the dispatch that takes them off the queue owns them */
+  if (events & TLB_EV_REQUEUED) {
+    events &= ~TLB_EV_REQUEUED;
+    uint8_t taken = TLB_READY_TAKEN;
+    if (TLB_SUB_GEN(atomic_load(&sub->state)) != TLB_HANDLE_GEN(handle) ||
+        !atomic_compare_exchange_strong_explicit(&sub->ready.state, &taken, TLB_READY_NONE, memory_order_acquire,
+                                                 memory_order_relaxed)) {
+      return;
+    }
+  } else if (!s_sub_claim(sub, TLB_HANDLE_GEN(handle), events)) {
+    return;
+  }
+
+  /* The claim is handed to the strand, it stays disarmed until the strand gets to it */
+  if (sub->sub_mode & TLB_SUB_STRAND) {
+    struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+    ext->strand.events = events;
+    ext->strand.polled_ns = polled_ns;
+    ext->strand.task.run = s_sub_strand_run;
+    tlb_strand_schedule(ext->strand.strand, &ext->strand.task);
+    return;
+  }
+
+  if (batch && (sub->sub_mode & TLB_SUB_BATCH) && s_sub_callable(sub)) {
+    if (batch->count == TLB_ARRAY_LENGTH(batch->items)) {
+      s_batch_flush(loop, batch);
+    }
+    batch->items[batch->count].handle = handle;
+    batch->items[batch->count].events = events;
+    batch->items[batch->count].userdata = sub->userdata;
+    batch->claims[batch->count].sub = sub;
+    batch->claims[batch->count].polled_ns = polled_ns;
+    ++batch->count;
+    return;
+  }
+
+  s_sub_run(loop, sub, handle, events, polled_ns, true);
+}
+
+void tlb_evl_dispatch_event(struct tlb_event_loop *loop, tlb_handle handle, int events, uint64_t polled_ns) {
+  s_dispatch_event(loop, NULL, handle, events, polled_ns);
+}
+
+void tlb_evl_dispatch(struct tlb_event_loop *loop, const struct tlb_evl_event *events, size_t count) {
+  struct tlb_metrics *metrics = count ? tlb_metrics_get(&loop->metrics) : NULL;
+  const uint64_t start_ns = metrics ? tlb_time_now_ns() : 0;
+
+  /* Pin once for the whole batch rather than per lookup */
+  tlb_epoch_pin();
+  struct tlb_evl_batch batch;
+  batch.count = 0;
+  for (size_t ii = 0; ii < count; ii++) {
+    s_dispatch_event(loop, &batch, events[ii].handle, events[ii].events, events[ii].polled_ns);
+  }
+  s_batch_flush(loop, &batch);
+  tlb_epoch_unpin();
+
+  if (metrics) {
+    uint64_t deltas[TLB_METRIC_COUNT] = {0};
+    deltas[TLB_METRIC_DISPATCHES] = count;
+    deltas[TLB_METRIC_WAKEUPS] = 1;
+    deltas[TLB_METRIC_BUSY_NS] = tlb_time_now_ns() - start_ns;
+    tlb_metrics_add_local(metrics, deltas);
+  }
+
+  tlb_epoch_reclaim(&loop->retired, loop->alloc, false);
+}
+
+static int s_poll(struct tlb_event_loop *loop, struct tlb_evl_event *events, size_t count, int timeout) {
+  /* Requeued subscriptions go first, but only take up half the batch so the kernel's events aren't starved */
+  const size_t ready = s_ready_pop(loop, events, count > 1 ? count / 2 : count);
+  if (ready == count) {
+    return (int)ready;
+  }
+
+  const int polled = tlb_evl_impl_poll(loop, events + ready, count - ready, ready ? TLB_WAIT_NONE : timeout);
+  if (polled < 0) {
+    /* The requeued ones are already claimed, so they have to be handed out regardless */
+    return ready ? (int)ready : TLB_FAIL;
   }
+  return (int)ready + polled;
+}
+
+/* Pinned only while the hook runs, not across the poll */
+static void s_observe_poll(struct tlb_event_loop *loop, bool start, int value) {
+  tlb_epoch_pin();
+  struct tlb_observer *observer = atomic_load_explicit(&loop->observer, memory_order_acquire);
+  tlb_observe_poll *hook = observer ? (start ? observer->hooks.on_poll_start : observer->hooks.on_poll_end) : NULL;
+  if (hook) {
+    hook(loop, value, observer->hooks.userdata);
+  }
+  tlb_epoch_unpin();
+}
+
+int tlb_evl_poll(struct tlb_event_loop *loop, struct tlb_evl_event *events, size_t count, int timeout) {
+  if (!atomic_load_explicit(&loop->observer, memory_order_relaxed)) {
+    return s_poll(loop, events, count, timeout);
+  }
+
+  s_observe_poll(loop, true, timeout);
+  const int result = s_poll(loop, events, count, timeout);
+  /* Keep the poll's errno for the caller, whatever the hook does */
+  const int error = errno;
+  s_observe_poll(loop, false, result);
+  errno = error;
+  return result;
+}
+
+int tlb_evl_handle_events(struct tlb_event_loop *loop, size_t budget, int timeout) {
+  /* Zero budget means just keep truckin */
+  if (budget == 0) {
+    budget = SIZE_MAX;
+  }
+
+  struct tlb_evl_event events[TLB_EV_EVENT_BATCH];
+  const int num_events = TLB_CHECK(-1 !=, tlb_evl_poll(loop, events, TLB_MIN(budget, TLB_EV_EVENT_BATCH), timeout));
+  tlb_evl_dispatch(loop, events, (size_t)num_events);
+
+  return num_events;
+}
+
+int tlb_evl_fd(const struct tlb_event_loop *loop) {
+  return loop->fd;
 }
 
 /**********************************************************************************************************************
@@ -108,26 +1335,260 @@ void tlb_evl_sub_loop_on_event(tlb_handle subscription, int events, void *userda
  **********************************************************************************************************************/
 
 int tlb_evl_remove(struct tlb_event_loop *loop, tlb_handle subscription) {
-  struct tlb_subscription *sub = subscription;
-  int result = 0;
+  struct tlb_subscription *sub = s_slot(loop, TLB_HANDLE_INDEX(subscription));
+  const uint32_t gen = TLB_HANDLE_GEN(subscription);
+  if (!sub || gen == 0) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
 
-  TLB_LOG_EVENT(sub, "Unsubbing:");
-  switch ((enum tlb_sub_state)sub->state) {
-    case TLB_STATE_SUBBED:
-      TLB_LOG_EVENT(sub, "  SUBBED, unsubbing and freeing");
-      result = tlb_evl_impl_unsubscribe(loop, sub);
-      tlb_free(loop->alloc, sub);
-      break;
+  uint64_t word = atomic_load(&sub->state);
+  for (;;) {
+    /* Stale handles and double removes */
+    if (TLB_SUB_GEN(word) != gen) {
+      errno = ENOENT;
+      return TLB_FAIL;
+    }
 
-    case TLB_STATE_RUNNING:
-      TLB_LOG_EVENT(sub, "  RUNNING, Setting state");
-      sub->state = TLB_STATE_UNSUBBED;
-      break;
+    switch (TLB_SUB_STATE(word)) {
+      case TLB_STATE_SUBBED:
+        if (atomic_compare_exchange_weak(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_UNSUBBED, 0))) {
+          TLB_LOG_EVENT(sub, "Unsubbing: SUBBED, unsubbing and freeing");
+          const int result = tlb_evl_impl_unsubscribe(loop, sub);
+          s_slot_free(loop, sub);
+          return result;
+        }
+        break;
 
-    case TLB_STATE_UNSUBBED:
-      /* no-op */
-      break;
+      case TLB_STATE_RUNNING:
+        if (atomic_compare_exchange_weak(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_UNSUBBING, 0))) {
+          TLB_LOG_EVENT(sub, "Unsubbing: RUNNING, Setting state");
+          tlb_record(TLB_RECORD_REMOVE_DEFERRED, sub, sub->name, 0);
+          /* Migrated here and not handed over yet, there's nothing to unsubscribe */
+          const int result = (sub->sub_mode & TLB_SUB_UNREGISTERED) ? 0 : tlb_evl_impl_unsubscribe(loop, sub);
+
+          /* Whoever finishes last frees the slot */
+          word = TLB_SUB_WORD(gen, TLB_STATE_UNSUBBING, 0);
+          if (!atomic_compare_exchange_strong(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_UNSUBBED, 0))) {
+            TLB_ASSERT(TLB_SUB_STATE(word) == TLB_STATE_RELEASED);
+            s_slot_free(loop, sub);
+          }
+          return result;
+        }
+        break;
+
+      case TLB_STATE_REARMING:
+      case TLB_STATE_PENDING:
+      case TLB_STATE_MODIFYING:
+        /* Someone is in the middle of a single rearm call, unsubscribing under it could resurrect the fd */
+        thrd_yield();
+        word = atomic_load(&sub->state);
+        break;
+
+      case TLB_STATE_MIGRATING:
+      case TLB_STATE_UNSUBBING:
+      case TLB_STATE_UNSUBBED:
+      case TLB_STATE_RELEASED:
+        errno = ENOENT;
+        return TLB_FAIL;
+    }
   }
+}
 
-  return result;
+/**********************************************************************************************************************
+ * Migrate                                                                                                            *
+ **********************************************************************************************************************/
+
+/* Frees a migration target that was never handed anything */
+static void s_sub_discard(struct tlb_event_loop *loop, struct tlb_subscription *target) {
+  s_add_failed(loop, target);
+}
+
+tlb_handle tlb_evl_migrate(tlb_handle subscription, struct tlb_event_loop *from, struct tlb_event_loop *to) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(from, subscription);
+  const uint32_t gen = TLB_HANDLE_GEN(subscription);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_HANDLE_INVALID;
+  }
+  if (!tlb_evl_sub_movable(sub)) {
+    errno = EINVAL;
+    return TLB_HANDLE_INVALID;
+  }
+  if (from == to) {
+    return subscription;
+  }
+
+  /* Nothing can see the target until its handle is returned, or it's registered */
+  struct tlb_subscription *target = s_sub_new(to, NULL, sub->userdata, sub->name);
+  TLB_CHECK_RETURN(NULL !=, target, TLB_HANDLE_INVALID);
+  target->callback = sub->callback;
+  target->ident = sub->ident;
+  target->sub_mode = sub->sub_mode & (TLB_SUB_EDGE | TLB_SUB_BATCH);
+  tlb_evl_impl_fd_init(target);
+  /* Extended up front if the source is, so handing it over can't fail */
+  if (tlb_evl_sub_ext(sub) && !tlb_evl_sub_extend(to, target)) {
+    s_sub_discard(to, target);
+    return TLB_HANDLE_INVALID;
+  }
+  const uint32_t target_gen = TLB_SUB_GEN(atomic_load(&target->state));
+
+  uint64_t word = atomic_load(&sub->state);
+  for (;;) {
+    if (TLB_SUB_GEN(word) != gen) {
+      s_sub_discard(to, target);
+      errno = ENOENT;
+      return TLB_HANDLE_INVALID;
+    }
+
+    switch (TLB_SUB_STATE(word)) {
+      case TLB_STATE_SUBBED:
+        if (atomic_compare_exchange_weak(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_MODIFYING, 0))) {
+          TLB_LOG_EVENT(sub, "Migrating: SUBBED, moving now");
+          atomic_store(&target->state, TLB_SUB_WORD(target_gen, TLB_STATE_MODIFYING, 0));
+          atomic_store(&target->events, atomic_load(&sub->events));
+          target->sub_mode &= (uint8_t)~TLB_SUB_UNREGISTERED;
+          s_sub_handover(from, sub, to, target);
+
+          const int result = tlb_evl_impl_subscribe(to, target);
+          atomic_store(&target->state, TLB_SUB_WORD(target_gen, TLB_STATE_SUBBED, 0));
+          if (result != 0) {
+            /* It's already gone from the old loop, so it's removed entirely */
+            const int error = errno;
+            tlb_evl_remove(to, tlb_evl_sub_handle(target));
+            errno = error;
+            return TLB_HANDLE_INVALID;
+          }
+          return tlb_evl_sub_handle(target);
+        }
+        break;
+
+      case TLB_STATE_RUNNING: {
+        /* The owner registers it once the callback returns, until then it's running as far as anyone else can tell */
+        struct tlb_sub_ext *ext = tlb_evl_sub_extend(from, sub);
+        if (!ext) {
+          s_sub_discard(to, target);
+          return TLB_HANDLE_INVALID;
+        }
+        atomic_store(&target->state, TLB_SUB_WORD(target_gen, TLB_STATE_RUNNING, 0));
+        target->sub_mode |= TLB_SUB_UNREGISTERED;
+        ext->migrate.loop = to;
+        ext->migrate.sub = target;
+        /* The owner may register the target as soon as it sees MIGRATING, so the interest set must be in place first */
+        atomic_store(&target->events, atomic_load(&sub->events));
+        if (atomic_compare_exchange_weak(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_MIGRATING, 0))) {
+          TLB_LOG_EVENT(sub, "Migrating: RUNNING, handing over to owner");
+          return tlb_evl_sub_handle(target);
+        }
+        break;
+      }
+
+      case TLB_STATE_REARMING:
+      case TLB_STATE_PENDING:
+      case TLB_STATE_MODIFYING:
+        /* Only lasts for a single rearm call */
+        thrd_yield();
+        word = atomic_load(&sub->state);
+        break;
+
+      case TLB_STATE_MIGRATING:
+      case TLB_STATE_UNSUBBING:
+      case TLB_STATE_UNSUBBED:
+      case TLB_STATE_RELEASED:
+        s_sub_discard(to, target);
+        errno = ENOENT;
+        return TLB_HANDLE_INVALID;
+    }
+  }
+}
+
+/**********************************************************************************************************************
+ * Modify                                                                                                             *
+ **********************************************************************************************************************/
+
+static int s_sub_apply(struct tlb_event_loop *loop, struct tlb_subscription *sub, uint32_t gen) {
+  uint64_t word = atomic_load(&sub->state);
+  for (;;) {
+    if (TLB_SUB_GEN(word) != gen) {
+      errno = ENOENT;
+      return TLB_FAIL;
+    }
+
+    switch (TLB_SUB_STATE(word)) {
+      case TLB_STATE_SUBBED:
+        if (atomic_compare_exchange_weak(&sub->state, &word, TLB_SUB_WORD(gen, TLB_STATE_MODIFYING, 0))) {
+          TLB_LOG_EVENT(sub, "Modifying: SUBBED, rearming");
+          const int result = tlb_evl_impl_rearm(loop, sub);
+
+          /* Everyone else waits MODIFYING out, so nothing can have changed it */
+          atomic_store(&sub->state, TLB_SUB_WORD(gen, TLB_STATE_SUBBED, 0));
+          return result;
+        }
+        break;
+
+      case TLB_STATE_RUNNING:
+        /* The owner hasn't started rearming yet, so it'll see the new interest set */
+        return 0;
+
+      case TLB_STATE_REARMING:
+      case TLB_STATE_PENDING:
+      case TLB_STATE_MODIFYING:
+        /* The rearm in flight may have missed the change, apply it again once it's done */
+        thrd_yield();
+        word = atomic_load(&sub->state);
+        break;
+
+      case TLB_STATE_MIGRATING:
+      case TLB_STATE_UNSUBBING:
+      case TLB_STATE_UNSUBBED:
+      case TLB_STATE_RELEASED:
+        errno = ENOENT;
+        return TLB_FAIL;
+    }
+  }
+}
+
+static int s_sub_update(struct tlb_event_loop *loop, tlb_handle subscription, int clear, int set) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, subscription);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+
+  uint8_t events = atomic_load(&sub->events);
+  while (!atomic_compare_exchange_weak(&sub->events, &events, (uint8_t)((events & ~clear) | set))) {
+  }
+
+  return s_sub_apply(loop, sub, TLB_HANDLE_GEN(subscription));
+}
+
+int tlb_evl_modify(struct tlb_event_loop *loop, tlb_handle subscription, int events) {
+  if (events & ~(TLB_EV_READ | TLB_EV_WRITE)) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+  return s_sub_update(loop, subscription, TLB_EV_READ | TLB_EV_WRITE, events);
+}
+
+int tlb_evl_pause(struct tlb_event_loop *loop, tlb_handle subscription) {
+  return s_sub_update(loop, subscription, 0, TLB_EV_PAUSED);
+}
+
+int tlb_evl_resume(struct tlb_event_loop *loop, tlb_handle subscription) {
+  return s_sub_update(loop, subscription, TLB_EV_PAUSED, 0);
+}
+
+int tlb_evl_set_name(struct tlb_event_loop *loop, tlb_handle subscription, const char *name) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, subscription);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+  if (!name) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  sub->name = name;
+  return 0;
 }
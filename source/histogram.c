@@ -0,0 +1,70 @@
+#include "tlb/private/histogram.h"
+
+static size_t s_bucket_index(uint64_t value) {
+  if (value < TLB_HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+
+  /* The top SUB_BITS + 1 bits pick the bucket, the rest are precision we don't keep */
+  const unsigned msb = 63U - (unsigned)__builtin_clzll(value);
+  const unsigned shift = msb - TLB_HISTOGRAM_SUB_BITS;
+  return ((shift + 1) * TLB_HISTOGRAM_SUB_BUCKETS) + ((value >> shift) & (TLB_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static uint64_t s_bucket_upper_bound(size_t index) {
+  if (index < TLB_HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+
+  const unsigned shift = (index / TLB_HISTOGRAM_SUB_BUCKETS) - 1;
+  const uint64_t sub_bucket = TLB_HISTOGRAM_SUB_BUCKETS + (index % TLB_HISTOGRAM_SUB_BUCKETS);
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+void tlb_histogram_init(struct tlb_histogram *histogram) {
+  atomic_init(&histogram->count, 0);
+  atomic_init(&histogram->min, UINT64_MAX);
+  atomic_init(&histogram->max, 0);
+  for (size_t ii = 0; ii < TLB_HISTOGRAM_BUCKETS; ++ii) {
+    atomic_init(&histogram->buckets[ii], 0);
+  }
+}
+
+void tlb_histogram_record(struct tlb_histogram *histogram, uint64_t value) {
+  atomic_fetch_add_explicit(&histogram->buckets[s_bucket_index(value)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+
+  /* Extremes rarely change, so these are almost always a single load */
+  uint64_t min = atomic_load_explicit(&histogram->min, memory_order_relaxed);
+  while (value < min &&
+         !atomic_compare_exchange_weak_explicit(&histogram->min, &min, value, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+  uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  while (value > max &&
+         !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+uint64_t tlb_histogram_percentile(const struct tlb_histogram *histogram, double percentile) {
+  /* Sum the buckets rather than trusting count, other threads may be recording */
+  uint64_t total = 0;
+  for (size_t ii = 0; ii < TLB_HISTOGRAM_BUCKETS; ++ii) {
+    total += atomic_load_explicit(&histogram->buckets[ii], memory_order_relaxed);
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t target = (uint64_t)((percentile / 100.0) * (double)total + 0.5);
+  target = TLB_MAX(target, (uint64_t)1);
+  uint64_t seen = 0;
+  for (size_t ii = 0; ii < TLB_HISTOGRAM_BUCKETS; ++ii) {
+    seen += atomic_load_explicit(&histogram->buckets[ii], memory_order_relaxed);
+    if (seen >= target) {
+      return s_bucket_upper_bound(ii);
+    }
+  }
+  return s_bucket_upper_bound(TLB_HISTOGRAM_BUCKETS - 1);
+}
@@ -0,0 +1,264 @@
+#include "tlb/private/idle.h"
+
+#include "tlb/private/event_loop.h"
+
+#include <errno.h>
+
+static void s_on_tick(tlb_handle timer, int events, void *userdata);
+
+/**********************************************************************************************************************
+ * Wheel                                                                                                              *
+ **********************************************************************************************************************/
+
+static uint64_t s_tick(uint64_t time_ns) {
+  return time_ns / TLB_IDLE_TICK_NS;
+}
+
+static int s_bucket_push(struct tlb_event_loop *loop, struct tlb_idle_bucket *bucket, struct tlb_idle_entry entry) {
+  if (bucket->count == bucket->capacity) {
+    const size_t capacity = TLB_MAX(bucket->capacity * 2, (size_t)8);
+    struct tlb_idle_entry *entries =
+        TLB_CHECK_RETURN(NULL !=, tlb_malloc(loop->alloc, capacity * sizeof(struct tlb_idle_entry)), TLB_FAIL);
+    if (bucket->entries) {
+      memcpy(entries, bucket->entries, bucket->count * sizeof(struct tlb_idle_entry));
+      tlb_free(loop->alloc, bucket->entries);
+    }
+    bucket->entries = entries;
+    bucket->capacity = capacity;
+  }
+  bucket->entries[bucket->count++] = entry;
+  return 0;
+}
+
+/* Files an entry under the tick its deadline falls in, or the next one to expire if that's already gone */
+static int s_insert(struct tlb_event_loop *loop, struct tlb_idle_wheel *wheel, struct tlb_idle_entry entry,
+                    uint64_t deadline_ns) {
+  const uint64_t tick = TLB_MAX(s_tick(deadline_ns), wheel->tick);
+  return s_bucket_push(loop, &wheel->buckets[tick % TLB_IDLE_WHEEL_SIZE], entry);
+}
+
+/* Makes sure the timer is set for the first tick with anything in it */
+static void s_schedule(struct tlb_event_loop *loop, struct tlb_idle_wheel *wheel, uint64_t now_ns) {
+  uint64_t first = UINT64_MAX;
+  if (wheel->retry.count) {
+    /* Ran out of memory, give it a tick before trying again */
+    first = s_tick(now_ns) + 1;
+  } else {
+    for (uint64_t tick = wheel->tick; tick < wheel->tick + TLB_IDLE_WHEEL_SIZE; ++tick) {
+      if (wheel->buckets[tick % TLB_IDLE_WHEEL_SIZE].count) {
+        first = tick;
+        break;
+      }
+    }
+  }
+  if (first >= wheel->timer_tick) {
+    return;
+  }
+
+  /* Rounded up to the end of the tick */
+  const uint64_t fire_ns = (first + 1) * TLB_IDLE_TICK_NS;
+  if (tlb_evl_timer_set(loop, wheel->timer, fire_ns > now_ns ? fire_ns - now_ns : 0) == 0) {
+    wheel->timer_tick = first;
+  }
+}
+
+/**********************************************************************************************************************
+ * Expiry                                                                                                             *
+ **********************************************************************************************************************/
+
+/**
+ * Moves an entry along if its subscription has been active since it was filed, or adds it to expired and files it
+ * again a full timeout later. Fails, leaving everything as it was, if there's no memory to do either.
+ */
+static int s_expire(struct tlb_event_loop *loop, struct tlb_idle_wheel *wheel, struct tlb_idle_entry entry,
+                    uint64_t now_ns, struct tlb_idle_bucket *expired) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, entry.handle);
+  struct tlb_sub_ext *ext = sub ? tlb_evl_sub_ext(sub) : NULL;
+  const uint64_t timeout_ns = ext ? atomic_load_explicit(&ext->idle.timeout_ns, memory_order_relaxed) : 0;
+  if (!ext || ext->idle.seq != entry.seq || timeout_ns == 0) {
+    return 0;
+  }
+
+  const uint64_t deadline_ns = atomic_load_explicit(&ext->idle.active_ns, memory_order_relaxed) + timeout_ns;
+  if (deadline_ns > now_ns) {
+    return s_insert(loop, wheel, entry, deadline_ns);
+  }
+
+  TLB_CHECK(0 ==, s_bucket_push(loop, expired, entry));
+  if (s_insert(loop, wheel, entry, now_ns + timeout_ns) != 0) {
+    expired->count--;
+    return TLB_FAIL;
+  }
+  /* Counts as activity, so it's reported again a full timeout later if it stays idle */
+  atomic_store_explicit(&ext->idle.active_ns, now_ns, memory_order_relaxed);
+  return 0;
+}
+
+/**
+ * Expires a bucket taken off the wheel, then hands its storage back to home if that's still empty. Entries that fail
+ * are kept in the wheel's retry bucket instead, which must be empty, returns false if there were any.
+ */
+static bool s_expire_bucket(struct tlb_event_loop *loop, struct tlb_idle_wheel *wheel, struct tlb_idle_bucket *bucket,
+                            struct tlb_idle_bucket *home, uint64_t now_ns, struct tlb_idle_bucket *expired) {
+  size_t kept = 0;
+  for (size_t ii = 0; ii < bucket->count; ++ii) {
+    if (s_expire(loop, wheel, bucket->entries[ii], now_ns, expired) != 0) {
+      bucket->entries[kept++] = bucket->entries[ii];
+    }
+  }
+  bucket->count = kept;
+
+  if (kept) {
+    TLB_ASSERT(wheel->retry.count == 0 && !wheel->retry.entries);
+    wheel->retry = *bucket;
+  } else if (!home->entries) {
+    *home = *bucket;
+  } else if (bucket->entries) {
+    tlb_free(loop->alloc, bucket->entries);
+  }
+  return kept == 0;
+}
+
+static void s_on_tick(tlb_handle timer, int events, void *userdata) {
+  (void)timer;
+  (void)events;
+  struct tlb_event_loop *loop = *(struct tlb_event_loop **)userdata;
+  struct tlb_idle_wheel *wheel = atomic_load(&loop->idle);
+
+  struct tlb_idle_bucket expired = {0};
+  const uint64_t now_ns = tlb_time_now_ns();
+  const uint64_t now_tick = s_tick(now_ns);
+
+  mtx_lock(&wheel->mtx);
+  /* It only fires once per set */
+  wheel->timer_tick = UINT64_MAX;
+
+  /* Anything left over from running out of memory goes first, then each bucket that's due up to the first failure */
+  bool done = true;
+  if (wheel->retry.count) {
+    struct tlb_idle_bucket retry = wheel->retry;
+    wheel->retry = (struct tlb_idle_bucket){0};
+    done = s_expire_bucket(loop, wheel, &retry, &wheel->retry, now_ns, &expired);
+  }
+  /* Every bucket is due when it's a whole turn behind */
+  if (now_tick >= wheel->tick + TLB_IDLE_WHEEL_SIZE) {
+    wheel->tick = now_tick + 1 - TLB_IDLE_WHEEL_SIZE;
+  }
+  while (done && wheel->tick <= now_tick) {
+    /* Taken off first, entries filed while it's expiring are a whole turn out and go in afresh */
+    struct tlb_idle_bucket *home = &wheel->buckets[wheel->tick % TLB_IDLE_WHEEL_SIZE];
+    struct tlb_idle_bucket due = *home;
+    *home = (struct tlb_idle_bucket){0};
+    wheel->tick++;
+    done = s_expire_bucket(loop, wheel, &due, home, now_ns, &expired);
+  }
+  s_schedule(loop, wheel, now_ns);
+  mtx_unlock(&wheel->mtx);
+
+  /* Dispatched like any other event, so it waits for a running callback rather than overlapping it */
+  for (size_t ii = 0; ii < expired.count; ++ii) {
+    tlb_evl_dispatch_event(loop, expired.entries[ii].handle, TLB_EV_TIMEOUT, 0);
+  }
+
+  if (expired.entries) {
+    tlb_free(loop->alloc, expired.entries);
+  }
+}
+
+/**********************************************************************************************************************
+ * API                                                                                                                *
+ **********************************************************************************************************************/
+
+static struct tlb_idle_wheel *s_wheel(struct tlb_event_loop *loop) {
+  struct tlb_idle_wheel *wheel = atomic_load(&loop->idle);
+  if (wheel) {
+    return wheel;
+  }
+
+  wheel = TLB_CHECK(NULL !=, tlb_calloc(loop->alloc, 1, sizeof(struct tlb_idle_wheel)));
+  if (mtx_init(&wheel->mtx, mtx_plain) != thrd_success) {
+    tlb_free(loop->alloc, wheel);
+    return NULL;
+  }
+  wheel->tick = s_tick(tlb_time_now_ns());
+  wheel->timer_tick = UINT64_MAX;
+  wheel->timer = tlb_evl_add_timer_reusable(loop, s_on_tick, &loop, sizeof(loop));
+  if (wheel->timer == TLB_HANDLE_INVALID) {
+    mtx_destroy(&wheel->mtx);
+    tlb_free(loop->alloc, wheel);
+    return NULL;
+  }
+  tlb_evl_set_name(loop, wheel->timer, "idle-wheel");
+
+  struct tlb_idle_wheel *expected = NULL;
+  if (!atomic_compare_exchange_strong(&loop->idle, &expected, wheel)) {
+    /* Someone else got there first */
+    tlb_evl_remove(loop, wheel->timer);
+    mtx_destroy(&wheel->mtx);
+    tlb_free(loop->alloc, wheel);
+    return expected;
+  }
+  return wheel;
+}
+
+int tlb_idle_watch(struct tlb_event_loop *loop, struct tlb_subscription *sub, uint64_t timeout_ns) {
+  /* Subscriptions that never had a timeout have nothing to clear */
+  if (!timeout_ns && !tlb_evl_sub_ext(sub)) {
+    return 0;
+  }
+  struct tlb_sub_ext *ext = TLB_CHECK_RETURN(NULL !=, tlb_evl_sub_extend(loop, sub), TLB_FAIL);
+  struct tlb_idle_wheel *wheel = TLB_CHECK_RETURN(NULL !=, s_wheel(loop), TLB_FAIL);
+  const uint64_t now_ns = tlb_time_now_ns();
+
+  mtx_lock(&wheel->mtx);
+  /* Whatever was filed under the old timeout is dropped when it comes around */
+  ext->idle.seq++;
+  atomic_store_explicit(&ext->idle.timeout_ns, timeout_ns, memory_order_relaxed);
+  atomic_store_explicit(&ext->idle.active_ns, now_ns, memory_order_relaxed);
+
+  int result = 0;
+  if (timeout_ns) {
+    const struct tlb_idle_entry entry = {.handle = tlb_evl_sub_handle(sub), .seq = ext->idle.seq};
+    result = s_insert(loop, wheel, entry, now_ns + timeout_ns);
+    if (result != 0) {
+      /* Nothing was filed, so it's left without one */
+      atomic_store_explicit(&ext->idle.timeout_ns, 0, memory_order_relaxed);
+    }
+    s_schedule(loop, wheel, now_ns);
+  }
+  mtx_unlock(&wheel->mtx);
+  return result;
+}
+
+void tlb_idle_cleanup(struct tlb_event_loop *loop) {
+  struct tlb_idle_wheel *wheel = atomic_exchange(&loop->idle, NULL);
+  if (!wheel) {
+    return;
+  }
+  /* The timer was released along with the rest of the loop's subscriptions */
+  for (size_t ii = 0; ii < TLB_IDLE_WHEEL_SIZE; ++ii) {
+    if (wheel->buckets[ii].entries) {
+      tlb_free(loop->alloc, wheel->buckets[ii].entries);
+    }
+  }
+  if (wheel->retry.entries) {
+    tlb_free(loop->alloc, wheel->retry.entries);
+  }
+  mtx_destroy(&wheel->mtx);
+  tlb_free(loop->alloc, wheel);
+}
+
+int tlb_evl_set_idle_timeout(struct tlb_event_loop *loop, tlb_handle subscription, int timeout) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, subscription);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+  if ((sub->sub_mode & TLB_SUB_ONESHOT) || timeout < 0) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  static const uint64_t nanos_per_milli = 1000000;
+  return tlb_idle_watch(loop, sub, (uint64_t)timeout * nanos_per_milli);
+}
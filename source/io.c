@@ -0,0 +1,477 @@
+#if defined(__linux__)
+#define _GNU_SOURCE /* accept4 */
+#endif
+
+#include "tlb/private/io.h"
+
+#include "tlb/channel.h"
+#include "tlb/private/event_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum tlb_io_kind {
+  TLB_IO_READ,
+  TLB_IO_WRITE,
+  TLB_IO_RECV,
+  TLB_IO_SEND,
+  TLB_IO_ACCEPT,
+};
+
+struct tlb_io_op {
+  struct tlb_io_op *next; /* Queued for the threads */
+  struct tlb_event_loop *loop;
+  enum tlb_io_kind kind;
+  int fd;
+  int flags;
+  union {
+    void *read;
+    const void *write;
+  } buffer;
+  size_t size;
+  int64_t offset;
+  ssize_t result;
+  tlb_on_io *on_io;
+  void *userdata;
+};
+
+static struct tlb_io_op *s_op_new(struct tlb_event_loop *loop, enum tlb_io_kind kind, int fd, tlb_on_io *on_io,
+                                  void *userdata) {
+  if (fd < 0 || !on_io) {
+    errno = EINVAL;
+    return NULL;
+  }
+  struct tlb_io_op *op = TLB_CHECK(NULL !=, tlb_calloc(loop->alloc, 1, sizeof(struct tlb_io_op)));
+  op->loop = loop;
+  op->kind = kind;
+  op->fd = fd;
+  op->offset = TLB_IO_POSITION;
+  op->on_io = on_io;
+  op->userdata = userdata;
+  return op;
+}
+
+static void s_op_free(struct tlb_io_op *op) {
+  tlb_free(op->loop->alloc, op);
+}
+
+static int s_accept(int fd) {
+#if defined(__linux__)
+  return accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  const int accepted = accept(fd, NULL, NULL);
+  if (accepted != -1 && (fcntl(accepted, F_SETFL, fcntl(accepted, F_GETFL) | O_NONBLOCK) == -1 ||
+                         fcntl(accepted, F_SETFD, FD_CLOEXEC) == -1)) {
+    const int error = errno;
+    close(accepted);
+    errno = error;
+    return -1;
+  }
+  return accepted;
+#endif
+}
+
+/* Runs the system call, returning -errno on failure */
+static ssize_t s_perform(const struct tlb_io_op *op) {
+  ssize_t result = -1;
+  switch (op->kind) {
+    case TLB_IO_READ:
+      result = op->offset == TLB_IO_POSITION ? read(op->fd, op->buffer.read, op->size)
+                                             : pread(op->fd, op->buffer.read, op->size, (off_t)op->offset);
+      break;
+    case TLB_IO_WRITE:
+      result = op->offset == TLB_IO_POSITION ? write(op->fd, op->buffer.write, op->size)
+                                             : pwrite(op->fd, op->buffer.write, op->size, (off_t)op->offset);
+      break;
+    case TLB_IO_RECV:
+      result = recv(op->fd, op->buffer.read, op->size, op->flags);
+      break;
+    case TLB_IO_SEND:
+      result = send(op->fd, op->buffer.write, op->size, op->flags);
+      break;
+    case TLB_IO_ACCEPT:
+      result = s_accept(op->fd);
+      break;
+  }
+  return result < 0 ? -(ssize_t)errno : result;
+}
+
+/**********************************************************************************************************************
+ * Readiness                                                                                                          *
+ **********************************************************************************************************************/
+
+enum tlb_io_direction {
+  TLB_IO_IN,  /* read, recv and accept */
+  TLB_IO_OUT, /* write and send */
+};
+
+struct tlb_io_watch {
+  struct tlb_event_loop *loop;
+  int fd;
+  int watch_fd; /* The fd itself, or a duplicate of it, see tlb_evl_add_fd_shared */
+  /* Under the loop's io_watches.mtx, only the subscription's callback takes an operation out */
+  tlb_handle handle;
+  struct tlb_io_op *ops[2]; /* By direction */
+};
+
+static const int s_direction_events[] = {TLB_EV_READ, TLB_EV_WRITE};
+
+int tlb_io_init(struct tlb_event_loop *loop) {
+  struct tlb_io_watches *watches = &loop->io_watches;
+  watches->by_fd = NULL;
+  watches->capacity = 0;
+  return mtx_init(&watches->mtx, mtx_plain) == thrd_success ? 0 : TLB_FAIL;
+}
+
+static int s_watch_interest(const struct tlb_io_watch *watch) {
+  int interest = 0;
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(watch->ops); ++ii) {
+    if (watch->ops[ii]) {
+      interest |= s_direction_events[ii];
+    }
+  }
+  return interest;
+}
+
+/* Makes room for fd in the table, which only ever grows. Called with the lock held. */
+static int s_watches_reserve(struct tlb_event_loop *loop, int fd) {
+  struct tlb_io_watches *watches = &loop->io_watches;
+  if ((size_t)fd < watches->capacity) {
+    return 0;
+  }
+  static const size_t min_capacity = 64;
+  size_t capacity = TLB_MAX(watches->capacity * 2, min_capacity);
+  while (capacity <= (size_t)fd) {
+    capacity *= 2;
+  }
+  struct tlb_io_watch **by_fd =
+      TLB_CHECK_RETURN(NULL !=, tlb_calloc(loop->alloc, capacity, sizeof(struct tlb_io_watch *)), TLB_FAIL);
+  if (watches->by_fd) {
+    memcpy(by_fd, watches->by_fd, watches->capacity * sizeof(struct tlb_io_watch *));
+    tlb_free(loop->alloc, watches->by_fd);
+  }
+  watches->by_fd = by_fd;
+  watches->capacity = capacity;
+  return 0;
+}
+
+static void s_watch_free(struct tlb_io_watch *watch) {
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(watch->ops); ++ii) {
+    if (watch->ops[ii]) {
+      s_op_free(watch->ops[ii]);
+    }
+  }
+  if (watch->watch_fd != watch->fd) {
+    close(watch->watch_fd);
+  }
+  tlb_free(watch->loop->alloc, watch);
+}
+
+/* Subscriptions hold a pointer to their watch inline, which is freed along with them */
+static void s_on_release(void *userdata) {
+  s_watch_free(*(struct tlb_io_watch **)userdata);
+}
+
+/* Runs whichever operations are ready, and stays subscribed for as long as there are more */
+static void s_on_ready(tlb_handle handle, int events, void *userdata) {
+  struct tlb_io_watch *watch = *(struct tlb_io_watch **)userdata;
+  struct tlb_event_loop *loop = watch->loop;
+  struct tlb_io_watches *watches = &loop->io_watches;
+
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(watch->ops); ++ii) {
+    if (!(events & (s_direction_events[ii] | TLB_EV_ERROR | TLB_EV_CLOSE))) {
+      continue;
+    }
+    mtx_lock(&watches->mtx);
+    struct tlb_io_op *op = watch->ops[ii];
+    mtx_unlock(&watches->mtx);
+    if (!op) {
+      continue;
+    }
+    const ssize_t result = s_perform(op);
+    if (result == -EAGAIN || result == -EWOULDBLOCK || result == -EINTR) {
+      /* Rearmed for the next time it's ready */
+      continue;
+    }
+
+    /* The callback may start the next operation in the same direction */
+    mtx_lock(&watches->mtx);
+    watch->ops[ii] = NULL;
+    mtx_unlock(&watches->mtx);
+    op->on_io(loop, result, op->userdata);
+    s_op_free(op);
+  }
+
+  /* Rearmed for what's left, including anything started since (from any thread), or removed if there's nothing */
+  mtx_lock(&watches->mtx);
+  const int interest = s_watch_interest(watch);
+  if (interest) {
+    tlb_evl_modify(loop, handle, interest);
+  } else {
+    watches->by_fd[watch->fd] = NULL;
+    tlb_evl_remove(loop, handle);
+  }
+  mtx_unlock(&watches->mtx);
+}
+
+static int s_watch(struct tlb_io_op *op, enum tlb_io_direction direction) {
+  struct tlb_event_loop *loop = op->loop;
+  struct tlb_io_watches *watches = &loop->io_watches;
+  mtx_lock(&watches->mtx);
+  TLB_CHECK_GOTO(0 ==, s_watches_reserve(loop, op->fd), failed);
+
+  struct tlb_io_watch *watch = watches->by_fd[op->fd];
+  if (watch) {
+    if (watch->ops[direction]) {
+      errno = EBUSY;
+      goto failed;
+    }
+    /* Already subscribed, and only its own callback removes it, which has to take the lock first */
+    watch->ops[direction] = op;
+    if (tlb_evl_modify(loop, watch->handle, s_watch_interest(watch)) != 0) {
+      watch->ops[direction] = NULL;
+      goto failed;
+    }
+    mtx_unlock(&watches->mtx);
+    return 0;
+  }
+
+  watch = TLB_CHECK_GOTO(NULL !=, tlb_calloc(loop->alloc, 1, sizeof(struct tlb_io_watch)), failed);
+  watch->loop = loop;
+  watch->fd = op->fd;
+  watch->ops[direction] = op;
+  /* Its callback may run as soon as it's added, but it has to wait for the lock */
+  watch->handle = tlb_evl_add_fd_shared(loop, op->fd, s_direction_events[direction], s_on_ready, &watch,
+                                        sizeof(watch), s_on_release, &watch->watch_fd);
+  if (watch->handle == TLB_HANDLE_INVALID) {
+    /* Never added, so never released */
+    tlb_free(loop->alloc, watch);
+    goto failed;
+  }
+  tlb_evl_set_name(loop, watch->handle, "io");
+  watches->by_fd[op->fd] = watch;
+  mtx_unlock(&watches->mtx);
+  return 0;
+
+failed:;
+  const int error = errno;
+  mtx_unlock(&watches->mtx);
+  s_op_free(op);
+  errno = error;
+  return TLB_FAIL;
+}
+
+/**********************************************************************************************************************
+ * Thread pool                                                                                                        *
+ **********************************************************************************************************************/
+
+static int s_worker(void *arg) {
+  struct tlb_io *io = arg;
+  mtx_lock(&io->mtx);
+  while (true) {
+    while (!io->head && !io->stopping) {
+      io->idle++;
+      cnd_wait(&io->cnd, &io->mtx);
+      io->idle--;
+    }
+    if (!io->head) {
+      break;
+    }
+    struct tlb_io_op *op = io->head;
+    io->head = op->next;
+    if (!io->head) {
+      io->tail = NULL;
+    }
+    mtx_unlock(&io->mtx);
+
+    op->result = s_perform(op);
+    /* Can't be full, as in_flight is never more than its capacity */
+    tlb_channel_send(io->completed, &op);
+
+    mtx_lock(&io->mtx);
+  }
+  mtx_unlock(&io->mtx);
+  return 0;
+}
+
+static void s_on_completed(const void *messages, size_t count, void *userdata) {
+  struct tlb_io *io = userdata;
+  struct tlb_io_op *const *ops = messages;
+  for (size_t ii = 0; ii < count; ++ii) {
+    struct tlb_io_op *op = ops[ii];
+    atomic_fetch_sub_explicit(&io->in_flight, 1, memory_order_relaxed);
+    op->on_io(op->loop, op->result, op->userdata);
+    s_op_free(op);
+  }
+}
+
+static void s_io_free(struct tlb_event_loop *loop, struct tlb_io *io) {
+  if (io->handle != TLB_HANDLE_INVALID) {
+    tlb_evl_remove(loop, io->handle);
+  }
+  if (io->completed) {
+    tlb_channel_destroy(io->completed);
+  }
+  cnd_destroy(&io->cnd);
+  mtx_destroy(&io->mtx);
+  tlb_free(loop->alloc, io);
+}
+
+static struct tlb_io *s_io(struct tlb_event_loop *loop) {
+  struct tlb_io *io = atomic_load(&loop->io);
+  if (io) {
+    return io;
+  }
+
+  io = TLB_CHECK(NULL !=, tlb_calloc(loop->alloc, 1, sizeof(struct tlb_io)));
+  io->handle = TLB_HANDLE_INVALID;
+  if (mtx_init(&io->mtx, mtx_plain) != thrd_success) {
+    tlb_free(loop->alloc, io);
+    return NULL;
+  }
+  if (cnd_init(&io->cnd) != thrd_success) {
+    mtx_destroy(&io->mtx);
+    tlb_free(loop->alloc, io);
+    return NULL;
+  }
+  io->completed = TLB_CHECK_GOTO(NULL !=,
+                                 tlb_channel_new(loop->alloc, TLB_CHANNEL_MPMC, TLB_IO_MAX_IN_FLIGHT,
+                                                 sizeof(struct tlb_io_op *)),
+                                 failed);
+  io->handle = TLB_CHECK_GOTO(TLB_HANDLE_INVALID !=, tlb_channel_subscribe(loop, io->completed, s_on_completed, io),
+                              failed);
+  tlb_evl_set_name(loop, io->handle, "io");
+
+  struct tlb_io *expected = NULL;
+  if (!atomic_compare_exchange_strong(&loop->io, &expected, io)) {
+    /* Someone else got there first, nothing can have been sent to this one */
+    s_io_free(loop, io);
+    return expected;
+  }
+  return io;
+
+failed:
+  s_io_free(loop, io);
+  return NULL;
+}
+
+static int s_submit(struct tlb_io_op *op) {
+  struct tlb_event_loop *loop = op->loop;
+  struct tlb_io *io = TLB_CHECK_GOTO(NULL !=, s_io(loop), failed);
+  if (atomic_fetch_add_explicit(&io->in_flight, 1, memory_order_relaxed) >= TLB_IO_MAX_IN_FLIGHT) {
+    atomic_fetch_sub_explicit(&io->in_flight, 1, memory_order_relaxed);
+    errno = EAGAIN;
+    goto failed;
+  }
+
+  mtx_lock(&io->mtx);
+  if (io->tail) {
+    io->tail->next = op;
+  } else {
+    io->head = op;
+  }
+  io->tail = op;
+  /* Only start another thread when none are waiting, and keep the ones that are already going */
+  if (io->idle == 0 && io->threads < TLB_IO_THREADS &&
+      thrd_create(&io->workers[io->threads], s_worker, io) == thrd_success) {
+    io->threads++;
+  } else {
+    cnd_signal(&io->cnd);
+  }
+  mtx_unlock(&io->mtx);
+  return 0;
+
+failed:;
+  const int error = errno;
+  s_op_free(op);
+  errno = error;
+  return -1;
+}
+
+/* Whether an fd has to go to the threads, as it's always reported ready */
+static bool s_is_file(int fd) {
+  struct stat stat_buf;
+  return fstat(fd, &stat_buf) == 0 && (S_ISREG(stat_buf.st_mode) || S_ISBLK(stat_buf.st_mode));
+}
+
+void tlb_io_cleanup(struct tlb_event_loop *loop) {
+  struct tlb_io_watches *watches = &loop->io_watches;
+  if (watches->by_fd) {
+    tlb_free(loop->alloc, watches->by_fd);
+  }
+  watches->by_fd = NULL;
+  watches->capacity = 0;
+  mtx_destroy(&watches->mtx);
+
+  struct tlb_io *io = atomic_exchange(&loop->io, NULL);
+  if (!io) {
+    return;
+  }
+
+  /* Let the threads finish what they're running, then drop whatever they didn't get to or wasn't handled */
+  mtx_lock(&io->mtx);
+  io->stopping = true;
+  cnd_broadcast(&io->cnd);
+  mtx_unlock(&io->mtx);
+  for (size_t ii = 0; ii < io->threads; ++ii) {
+    thrd_join(io->workers[ii], NULL);
+  }
+  while (io->head) {
+    struct tlb_io_op *op = io->head;
+    io->head = op->next;
+    s_op_free(op);
+  }
+  struct tlb_io_op *op = NULL;
+  while (tlb_channel_receive(io->completed, &op, 1) == 1) {
+    s_op_free(op);
+  }
+  s_io_free(loop, io);
+}
+
+/**********************************************************************************************************************
+ * API                                                                                                                *
+ **********************************************************************************************************************/
+
+int tlb_evl_read(struct tlb_event_loop *loop, int fd, void *buffer, size_t size, int64_t offset, tlb_on_io *on_io,
+                 void *userdata) {
+  struct tlb_io_op *op = TLB_CHECK_RETURN(NULL !=, s_op_new(loop, TLB_IO_READ, fd, on_io, userdata), TLB_FAIL);
+  op->buffer.read = buffer;
+  op->size = size;
+  op->offset = offset;
+  return s_is_file(fd) ? s_submit(op) : s_watch(op, TLB_IO_IN);
+}
+
+int tlb_evl_write(struct tlb_event_loop *loop, int fd, const void *buffer, size_t size, int64_t offset,
+                  tlb_on_io *on_io, void *userdata) {
+  struct tlb_io_op *op = TLB_CHECK_RETURN(NULL !=, s_op_new(loop, TLB_IO_WRITE, fd, on_io, userdata), TLB_FAIL);
+  op->buffer.write = buffer;
+  op->size = size;
+  op->offset = offset;
+  return s_is_file(fd) ? s_submit(op) : s_watch(op, TLB_IO_OUT);
+}
+
+int tlb_evl_recv(struct tlb_event_loop *loop, int fd, void *buffer, size_t size, int flags, tlb_on_io *on_io,
+                 void *userdata) {
+  struct tlb_io_op *op = TLB_CHECK_RETURN(NULL !=, s_op_new(loop, TLB_IO_RECV, fd, on_io, userdata), TLB_FAIL);
+  op->buffer.read = buffer;
+  op->size = size;
+  op->flags = flags;
+  return s_watch(op, TLB_IO_IN);
+}
+
+int tlb_evl_send(struct tlb_event_loop *loop, int fd, const void *buffer, size_t size, int flags, tlb_on_io *on_io,
+                 void *userdata) {
+  struct tlb_io_op *op = TLB_CHECK_RETURN(NULL !=, s_op_new(loop, TLB_IO_SEND, fd, on_io, userdata), TLB_FAIL);
+  op->buffer.write = buffer;
+  op->size = size;
+  op->flags = flags;
+  return s_watch(op, TLB_IO_OUT);
+}
+
+int tlb_evl_accept(struct tlb_event_loop *loop, int fd, tlb_on_io *on_io, void *userdata) {
+  struct tlb_io_op *op = TLB_CHECK_RETURN(NULL !=, s_op_new(loop, TLB_IO_ACCEPT, fd, on_io, userdata), TLB_FAIL);
+  return s_watch(op, TLB_IO_IN);
+}
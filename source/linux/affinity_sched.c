@@ -0,0 +1,21 @@
+/* For the CPU_SET macros */
+#define _GNU_SOURCE
+
+#include "tlb/private/affinity.h"
+
+#include <errno.h>
+#include <sched.h>
+
+int tlb_affinity_pin(int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  /* 0 is the calling thread */
+  TLB_CHECK(0 ==, sched_setaffinity(0, sizeof(set), &set));
+  return 0;
+}
@@ -42,11 +42,12 @@ static int s_events_from_epoll(const struct epoll_event *event) {
 
 uint32_t s_events_to_epoll(struct tlb_subscription *sub) {
   uint32_t epoll_events = 0;
+  const int events = tlb_evl_sub_interest(sub);
 
-  if (sub->events & TLB_EV_READ) {
+  if (events & TLB_EV_READ) {
     epoll_events |= EPOLLIN;
   }
-  if (sub->events & TLB_EV_WRITE) {
+  if (events & TLB_EV_WRITE) {
     epoll_events |= EPOLLOUT;
   }
 
@@ -64,7 +65,7 @@ int s_epoll_change(struct tlb_event_loop *loop, struct tlb_subscription *sub, in
 
   /* Calculate flags */
   change.events = s_events_to_epoll(sub);
-  change.data.ptr = sub;
+  change.data.u64 = tlb_evl_sub_handle(sub);
 
   return epoll_ctl(loop->fd, operation, sub->ident.fd, &change);
 }
@@ -73,14 +74,13 @@ int s_epoll_change(struct tlb_event_loop *loop, struct tlb_subscription *sub, in
  * Event Loop                                                                                                         *
  **********************************************************************************************************************/
 
-int tlb_evl_init(struct tlb_event_loop *loop, struct tlb_allocator *alloc) {
-  loop->alloc = alloc;
+int tlb_evl_impl_init(struct tlb_event_loop *loop) {
   loop->fd = TLB_CHECK(-1 !=, epoll_create1(EPOLL_CLOEXEC));
 
   return 0;
 }
 
-void tlb_evl_cleanup(struct tlb_event_loop *loop) {
+void tlb_evl_impl_cleanup(struct tlb_event_loop *loop) {
   if (loop->fd) {
     close(loop->fd);
     loop->fd = 0;
@@ -95,35 +95,46 @@ void tlb_evl_impl_fd_init(struct tlb_subscription *sub) {
   (void)sub;
 }
 
+bool tlb_evl_impl_rejects_existing_fd(void) {
+  return true;
+}
+
 /**********************************************************************************************************************
  * Timers *
  **********************************************************************************************************************/
 
-static tlb_on_event s_timer_on_event;
-
 void tlb_evl_impl_timer_init(struct tlb_subscription *sub, int timeout) {
   int timerfd = TLB_CHECK_ASSERT(-1 !=, timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
-  const struct itimerspec timeout_spec = {
-      .it_value = tlb_timeout_to_timespec(timeout),
-  };
-  TLB_CHECK_ASSERT(-1 !=, timerfd_settime(timerfd, 0, &timeout_spec, NULL));
-
   sub->ident.fd = timerfd;
-  sub->events = TLB_EV_READ;
+  atomic_store_explicit(&sub->events, TLB_EV_READ, memory_order_relaxed);
   sub->sub_mode |= TLB_SUB_EDGE;
-
   sub->platform.epoll.close = true;
-  sub->platform.epoll.on_event = sub->on_event;
-  sub->on_event = s_timer_on_event;
-}
-
-static void s_timer_on_event(tlb_handle subscription, int events, void *userdata) {
-  struct tlb_subscription *sub = subscription;
+  if (sub->sub_mode & TLB_SUB_REUSABLE) {
+    return;
+  }
 
-  sub->platform.epoll.on_event(subscription, events, userdata);
+  struct itimerspec timeout_spec = {
+      .it_value = tlb_timeout_to_timespec(timeout),
+  };
+  /* A zero value disarms a timerfd, but a zero timeout should fire as soon as possible */
+  if (timeout_spec.it_value.tv_sec == 0 && timeout_spec.it_value.tv_nsec == 0) {
+    timeout_spec.it_value.tv_nsec = 1;
+  }
+  TLB_CHECK_ASSERT(-1 !=, timerfd_settime(timerfd, 0, &timeout_spec, NULL));
+  sub->sub_mode |= TLB_SUB_ONESHOT;
+}
 
-  /* Clean up after the timer */
-  sub->state = TLB_STATE_UNSUBBED;
+/* Setting a timerfd also resets its expirations, so one that fired and was never set again can't fire twice */
+static int s_timer_set(struct tlb_subscription *sub, uint64_t deadline_ns) {
+  static const uint64_t nanos_per_second = 1000000000;
+  const struct itimerspec deadline_spec = {
+      .it_value =
+          {
+              .tv_sec = (time_t)(deadline_ns / nanos_per_second),
+              .tv_nsec = (long)(deadline_ns % nanos_per_second),
+          },
+  };
+  return timerfd_settime(sub->ident.fd, TFD_TIMER_ABSTIME, &deadline_spec, NULL);
 }
 
 /**********************************************************************************************************************
@@ -144,52 +155,39 @@ int tlb_evl_impl_unsubscribe(struct tlb_event_loop *loop, struct tlb_subscriptio
   return 0;
 }
 
+int tlb_evl_impl_rearm(struct tlb_event_loop *loop, struct tlb_subscription *sub) {
+  if (sub->sub_mode & TLB_SUB_REUSABLE) {
+    /* Left disarmed until it's set again, reusable timers are always extended */
+    const uint64_t deadline_ns = atomic_load(&tlb_evl_sub_ext(sub)->deadline_ns);
+    if (deadline_ns == 0) {
+      return 0;
+    }
+    TLB_CHECK(0 ==, s_timer_set(sub, deadline_ns));
+  }
+  return s_epoll_change(loop, sub, EPOLL_CTL_MOD);
+}
+
 /**********************************************************************************************************************
- * Handle events *
+ * Poll *
  **********************************************************************************************************************/
 
-int tlb_evl_handle_events(struct tlb_event_loop *loop, size_t budget, int timeout) {
-  /* Zero budget means just keep truckin */
-  if (budget == 0) {
-    budget = SIZE_MAX;
-  }
-
-  /* Calculate the maximum number of events to run */
-  int num_events = TLB_MIN(budget, TLB_EV_EVENT_BATCH);
+int tlb_evl_impl_poll(struct tlb_event_loop *loop, struct tlb_evl_event *events, size_t count, int timeout) {
+  const int max_events = (int)TLB_MIN(count, TLB_EV_EVENT_BATCH);
   struct epoll_event eventlist[TLB_EV_EVENT_BATCH];
 
-  num_events = TLB_CHECK(-1 !=, epoll_wait(loop->fd, eventlist, num_events, timeout));
+  tlb_record(TLB_RECORD_POLL_ENTER, loop, NULL, (uint32_t)timeout);
+  const int result = epoll_wait(loop->fd, eventlist, max_events, timeout);
+  tlb_record(TLB_RECORD_POLL_EXIT, loop, NULL, result > 0 ? (uint32_t)result : 0);
+  const int num_events = TLB_CHECK(-1 !=, result);
+  const uint64_t polled_ns = tlb_evl_poll_time(loop);
+
   for (int ii = 0; ii < num_events; ii++) {
     const struct epoll_event *event = &eventlist[ii];
-    struct tlb_subscription *sub = event->data.ptr;
-
-    TLB_LOG_EVENT(sub, "Handling");
-
-    /* Cache this off because sub can become invalid during on_event */
-    sub->state = TLB_STATE_RUNNING;
-    sub->on_event(sub, s_events_from_epoll(event), sub->userdata);
-
-    switch ((enum tlb_sub_state)sub->state) {
-      case TLB_STATE_SUBBED:
-        /* Not possible */
-        TLB_LOG_EVENT(sub, "In bad state!");
-        TLB_ASSERT(false);
-        break;
-
-      case TLB_STATE_RUNNING:
-        /* Resubscribe the event */
-        sub->state = TLB_STATE_SUBBED;
-        TLB_LOG_EVENT(sub, "Set to SUBBED");
-        /* This line needs to be last here to prevent race conditions */
-        s_epoll_change(loop, sub, EPOLL_CTL_MOD);
-        break;
-
-      case TLB_STATE_UNSUBBED:
-        /* Force-remove the subscription */
-        sub->state = TLB_STATE_SUBBED;
-        tlb_evl_remove(loop, sub);
-        break;
-    }
+    events[ii] = (struct tlb_evl_event){
+        .handle = event->data.u64,
+        .events = s_events_from_epoll(event),
+        .polled_ns = polled_ns,
+    };
   }
 
   return num_events;
@@ -0,0 +1,28 @@
+#include "tlb/private/notify.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+int tlb_notify_open(struct tlb_notify *notify) {
+  const int fd = TLB_CHECK(-1 !=, eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  notify->fd_read = fd;
+  notify->fd_write = fd;
+  return 0;
+}
+
+void tlb_notify_close(struct tlb_notify *notify) {
+  close(notify->fd_read);
+}
+
+void tlb_notify_signal(struct tlb_notify *notify) {
+  const uint64_t value = 1;
+  /* Only fails if the counter would overflow, in which case it's readable anyway */
+  ssize_t written = write(notify->fd_write, &value, sizeof(value));
+  (void)written;
+}
+
+bool tlb_notify_clear(struct tlb_notify *notify) {
+  uint64_t value;
+  /* Reads (and resets) the whole counter, fails with EAGAIN if it was already 0 */
+  return read(notify->fd_read, &value, sizeof(value)) == sizeof(value);
+}
@@ -0,0 +1,42 @@
+#define _GNU_SOURCE /* splice */
+
+#include "tlb/private/sendfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+
+/* Fills the pipe from the file when it's empty, then empties as much of it into the socket as will go */
+static ssize_t s_splice(struct tlb_sendfile *stream, size_t count) {
+  if (stream->piped == 0) {
+    loff_t offset = stream->offset;
+    const ssize_t filled =
+        splice(stream->file, &offset, stream->pipe.fd_write, NULL, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (filled <= 0) {
+      return filled;
+    }
+    stream->piped = (size_t)filled;
+  }
+
+  const ssize_t sent = splice(stream->pipe.fd_read, NULL, stream->socket, NULL, TLB_MIN(stream->piped, count),
+                              SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (sent > 0) {
+    stream->piped -= (size_t)sent;
+  }
+  return sent;
+}
+
+ssize_t tlb_sendfile_impl(struct tlb_sendfile *stream, size_t count) {
+  if (!stream->splicing) {
+    off_t offset = stream->offset;
+    const ssize_t sent = sendfile(stream->socket, stream->file, &offset, count);
+    if (sent != -1 || (errno != EINVAL && errno != ENOSYS)) {
+      return sent;
+    }
+
+    /* The file doesn't support it (e.g. it can't be mapped), but it might still splice */
+    TLB_CHECK(0 ==, tlb_pipe_open(&stream->pipe));
+    stream->splicing = true;
+  }
+  return s_splice(stream, count);
+}
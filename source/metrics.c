@@ -0,0 +1,279 @@
+#include "tlb/private/metrics.h"
+
+#include "tlb/private/epoch.h"
+#include "tlb/private/event_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Readers give up rather than spin forever on a record whose writer died mid-update */
+#define TLB_METRICS_READ_RETRIES 1000U
+
+/**********************************************************************************************************************
+ * Publishing                                                                                                         *
+ **********************************************************************************************************************/
+
+void tlb_metrics_init(struct tlb_metrics_slot *slot) {
+  atomic_init(&slot->current, NULL);
+  atomic_init(&slot->all, NULL);
+}
+
+/**
+ * Unlinks name if it was published by a process that has since exited without unpublishing it, or fails with EEXIST if
+ * its publisher may still be running, or it isn't ours to take over.
+ */
+static int s_file_reclaim(const char *name) {
+  const int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1) {
+    /* Unpublished since, so it's free */
+    return errno == ENOENT ? 0 : TLB_FAIL;
+  }
+
+  struct stat stat;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &stat) == 0 && (size_t)stat.st_size >= sizeof(struct tlb_metrics_file)) {
+    map = mmap(NULL, sizeof(struct tlb_metrics_file), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    errno = EEXIST;
+    return TLB_FAIL;
+  }
+
+  /* Anything still being created, or that kill can't rule out (EPERM means it's alive), is left alone */
+  const struct tlb_metrics_file *file = map;
+  const bool abandoned = atomic_load_explicit(&file->magic, memory_order_acquire) == TLB_METRICS_MAGIC &&
+                         file->pid > 0 && kill((pid_t)file->pid, 0) == -1 && errno == ESRCH;
+  munmap(map, sizeof(struct tlb_metrics_file));
+  if (!abandoned) {
+    errno = EEXIST;
+    return TLB_FAIL;
+  }
+  return shm_unlink(name) == 0 || errno == ENOENT ? 0 : TLB_FAIL;
+}
+
+static struct tlb_metrics_file *s_file_create(const char *name, size_t size) {
+  /* Only readable by the same user */
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd == -1 && errno == EEXIST) {
+    TLB_CHECK_RETURN(0 ==, s_file_reclaim(name), NULL);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  if (fd == -1) {
+    return NULL;
+  }
+
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+
+  const int error = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name);
+    errno = error;
+    return NULL;
+  }
+  return map;
+}
+
+int tlb_metrics_publish(struct tlb_metrics_slot *slot, struct tlb_allocator *alloc, const char *name,
+                        enum tlb_metrics_kind kind, size_t record_count) {
+  const size_t name_size = strlen(name) + 1;
+  struct tlb_metrics *metrics =
+      TLB_CHECK_RETURN(NULL !=, tlb_malloc(alloc, sizeof(struct tlb_metrics) + name_size), TLB_FAIL);
+  metrics->name = (char *)(metrics + 1);
+  memcpy(metrics->name, name, name_size);
+  metrics->size = sizeof(struct tlb_metrics_file) + (record_count * sizeof(struct tlb_metrics_record));
+
+  /* The old one may have the same name, which is ours to replace */
+  tlb_metrics_unpublish(slot);
+  metrics->file = s_file_create(name, metrics->size);
+  if (!metrics->file) {
+    tlb_free(alloc, metrics);
+    return TLB_FAIL;
+  }
+
+  /* The mapping starts out zeroed, so the records are ready as they are */
+  struct tlb_metrics_file *file = metrics->file;
+  file->version = TLB_METRICS_VERSION;
+  file->kind = (uint32_t)kind;
+  file->record_count = (uint32_t)record_count;
+  file->record_size = (uint32_t)sizeof(struct tlb_metrics_record);
+  file->pid = (int64_t)getpid();
+  atomic_store_explicit(&file->magic, TLB_METRICS_MAGIC, memory_order_release);
+
+  struct tlb_metrics *head = atomic_load(&slot->all);
+  do {
+    metrics->next = head;
+  } while (!atomic_compare_exchange_weak(&slot->all, &head, metrics));
+
+  atomic_store_explicit(&slot->current, metrics, memory_order_release);
+  return 0;
+}
+
+void tlb_metrics_unpublish(struct tlb_metrics_slot *slot) {
+  struct tlb_metrics *old = atomic_exchange(&slot->current, NULL);
+  if (old) {
+    shm_unlink(old->name);
+  }
+}
+
+void tlb_metrics_cleanup(struct tlb_metrics_slot *slot, struct tlb_allocator *alloc) {
+  tlb_metrics_unpublish(slot);
+
+  struct tlb_metrics *metrics = atomic_exchange(&slot->all, NULL);
+  while (metrics) {
+    struct tlb_metrics *next = metrics->next;
+    munmap(metrics->file, metrics->size);
+    tlb_free(alloc, metrics);
+    metrics = next;
+  }
+}
+
+int tlb_evl_metrics_enable(struct tlb_event_loop *loop, const char *name) {
+  return tlb_metrics_publish(&loop->metrics, loop->alloc, name, TLB_METRICS_LOOP, TLB_METRICS_SHARDS);
+}
+
+void tlb_evl_metrics_disable(struct tlb_event_loop *loop) {
+  tlb_metrics_unpublish(&loop->metrics);
+}
+
+/**********************************************************************************************************************
+ * Writing                                                                                                            *
+ **********************************************************************************************************************/
+
+void tlb_metrics_add(struct tlb_metrics *metrics, size_t record, const uint64_t deltas[TLB_METRIC_COUNT]) {
+  struct tlb_metrics_file *file = metrics->file;
+  if (record >= file->record_count) {
+    return;
+  }
+
+  /* Nobody else writes the record, so plain loads and stores are enough, the fences order them for readers */
+  struct tlb_metrics_record *target = &file->records[record];
+  const uint64_t seq = atomic_load_explicit(&target->seq, memory_order_relaxed);
+  atomic_store_explicit(&target->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  for (size_t ii = 0; ii < TLB_METRIC_COUNT; ++ii) {
+    if (deltas[ii]) {
+      const uint64_t value = atomic_load_explicit(&target->values[ii], memory_order_relaxed);
+      atomic_store_explicit(&target->values[ii], value + deltas[ii], memory_order_relaxed);
+    }
+  }
+  atomic_store_explicit(&target->seq, seq + 2, memory_order_release);
+}
+
+void tlb_metrics_add_local(struct tlb_metrics *metrics, const uint64_t deltas[TLB_METRIC_COUNT]) {
+  const size_t shared = TLB_METRICS_SHARDS - 1;
+  const size_t record = tlb_epoch_thread_index();
+  if (record < shared) {
+    tlb_metrics_add(metrics, record, deltas);
+    return;
+  }
+
+  /* Only once there are more threads than shards, readers may see these mid-update */
+  struct tlb_metrics_record *target = &metrics->file->records[shared];
+  for (size_t ii = 0; ii < TLB_METRIC_COUNT; ++ii) {
+    if (deltas[ii]) {
+      atomic_fetch_add_explicit(&target->values[ii], deltas[ii], memory_order_relaxed);
+    }
+  }
+}
+
+/**********************************************************************************************************************
+ * Reading                                                                                                            *
+ **********************************************************************************************************************/
+
+static int s_record_read(const struct tlb_metrics_record *record, struct tlb_metrics_values *values) {
+  for (size_t attempt = 0; attempt < TLB_METRICS_READ_RETRIES; ++attempt) {
+    const uint64_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+    if (seq & 1U) {
+      thrd_yield();
+      continue;
+    }
+    for (size_t ii = 0; ii < TLB_METRIC_COUNT; ++ii) {
+      values->values[ii] = atomic_load_explicit(&record->values[ii], memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&record->seq, memory_order_relaxed) == seq) {
+      return 0;
+    }
+  }
+  errno = EAGAIN;
+  return TLB_FAIL;
+}
+
+static int s_file_read(const struct tlb_metrics_file *file, size_t size, struct tlb_metrics_info *info,
+                       struct tlb_metrics_values *total, struct tlb_metrics_values *records, size_t capacity) {
+  const uint64_t magic = atomic_load_explicit(&file->magic, memory_order_acquire);
+  if (magic == 0) {
+    /* Still being created */
+    errno = EAGAIN;
+    return TLB_FAIL;
+  }
+  if (magic != TLB_METRICS_MAGIC || file->version != TLB_METRICS_VERSION ||
+      file->record_size != sizeof(struct tlb_metrics_record) ||
+      size < sizeof(struct tlb_metrics_file) + ((size_t)file->record_count * sizeof(struct tlb_metrics_record))) {
+    errno = EPROTO;
+    return TLB_FAIL;
+  }
+
+  if (info) {
+    info->kind = (enum tlb_metrics_kind)file->kind;
+    info->pid = file->pid;
+    info->record_count = file->record_count;
+  }
+  if (total) {
+    memset(total, 0, sizeof(*total));
+  }
+  for (size_t record = 0; record < file->record_count; ++record) {
+    struct tlb_metrics_values values;
+    TLB_CHECK_RETURN(0 ==, s_record_read(&file->records[record], &values), TLB_FAIL);
+    if (record < capacity && records) {
+      records[record] = values;
+    }
+    for (size_t ii = 0; total && ii < TLB_METRIC_COUNT; ++ii) {
+      total->values[ii] += values.values[ii];
+    }
+  }
+  return 0;
+}
+
+int tlb_metrics_read(const char *name, struct tlb_metrics_info *info, struct tlb_metrics_values *total,
+                     struct tlb_metrics_values *records, size_t capacity) {
+  const int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1) {
+    return TLB_FAIL;
+  }
+
+  struct stat stat;
+  void *map = MAP_FAILED;
+  size_t size = 0;
+  if (fstat(fd, &stat) == 0) {
+    size = (size_t)stat.st_size;
+    /* Created but not sized yet */
+    if (size < sizeof(struct tlb_metrics_file)) {
+      close(fd);
+      errno = EAGAIN;
+      return TLB_FAIL;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  const int error = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    errno = error;
+    return TLB_FAIL;
+  }
+
+  const int result = s_file_read(map, size, info, total, records, capacity);
+  const int read_error = errno;
+  munmap(map, size);
+  errno = read_error;
+  return result;
+}
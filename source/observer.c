@@ -0,0 +1,25 @@
+#include "tlb/private/observer.h"
+
+#include "tlb/private/event_loop.h"
+
+int tlb_evl_observe(struct tlb_event_loop *loop, const struct tlb_evl_observer *observer) {
+  struct tlb_observer *copy = NULL;
+  if (observer) {
+    copy = TLB_CHECK_RETURN(NULL !=, tlb_malloc(loop->alloc, sizeof(struct tlb_observer)), TLB_FAIL);
+    copy->hooks = *observer;
+  }
+
+  /* Threads in the middle of a poll or batch may still be calling the old one */
+  struct tlb_observer *old = atomic_exchange(&loop->observer, copy);
+  if (old) {
+    tlb_epoch_retire(&loop->retired, &old->retired);
+  }
+  return 0;
+}
+
+void tlb_observer_cleanup(struct tlb_event_loop *loop) {
+  struct tlb_observer *observer = atomic_exchange(&loop->observer, NULL);
+  if (observer) {
+    tlb_free(loop->alloc, observer);
+  }
+}
@@ -0,0 +1,188 @@
+#include "tlb/private/profile.h"
+
+#include "tlb/private/epoch.h"
+#include "tlb/private/time.h"
+
+#include <errno.h>
+
+_Atomic int tlb_profile_flags;
+
+/* Indexed by epoch record, never freed so reads can always walk them */
+static _Atomic(struct tlb_profile_table *) s_tables[TLB_EPOCH_MAX_THREADS];
+
+static _Thread_local struct tlb_profile_table *s_local;
+/* Innermost span being measured on this thread */
+static _Thread_local struct tlb_profile_span *s_current;
+
+/**********************************************************************************************************************
+ * Enable/Disable                                                                                                     *
+ **********************************************************************************************************************/
+
+void tlb_profile_enable(int flags) {
+  atomic_store_explicit(&tlb_profile_flags, flags & (TLB_PROFILE_WALL | TLB_PROFILE_CPU), memory_order_relaxed);
+}
+
+void tlb_profile_disable(void) {
+  atomic_store_explicit(&tlb_profile_flags, 0, memory_order_relaxed);
+}
+
+/**********************************************************************************************************************
+ * Recording                                                                                                          *
+ **********************************************************************************************************************/
+
+static uint64_t s_cpu_now_ns(void) {
+  static const uint64_t nanos_per_second = 1000000000;
+  struct timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+    return 0;
+  }
+  return ((uint64_t)now.tv_sec * nanos_per_second) + (uint64_t)now.tv_nsec;
+}
+
+static struct tlb_profile_table *s_table_claim(void) {
+  /* Threads that took over an exited thread's epoch record carry on adding to its totals */
+  _Atomic(struct tlb_profile_table *) *slot = &s_tables[tlb_epoch_thread_index()];
+  struct tlb_profile_table *table = atomic_load_explicit(slot, memory_order_acquire);
+  if (!table) {
+    /* Recording happens on paths that set errno for their caller */
+    const int error = errno;
+    table = calloc(1, sizeof(struct tlb_profile_table));
+    errno = error;
+    if (!table) {
+      return NULL;
+    }
+    atomic_store_explicit(&table->other.name, TLB_PROFILE_OTHER, memory_order_relaxed);
+    atomic_store_explicit(slot, table, memory_order_release);
+  }
+
+  s_local = table;
+  return table;
+}
+
+/* Open addressing by the name's address, names are never removed so probing stops at the first free slot */
+static struct tlb_profile_slot *s_slot_find(struct tlb_profile_table *table, const char *name) {
+  static const uint64_t golden = 0x9E3779B97F4A7C15ULL;
+  const size_t start = (size_t)((((uintptr_t)name >> 3U) * golden) >> 32U) % TLB_PROFILE_NAMES;
+  for (size_t ii = 0; ii < TLB_PROFILE_NAMES; ++ii) {
+    struct tlb_profile_slot *slot = &table->slots[(start + ii) % TLB_PROFILE_NAMES];
+    const char *slot_name = atomic_load_explicit(&slot->name, memory_order_relaxed);
+    if (slot_name == name) {
+      return slot;
+    }
+    if (!slot_name) {
+      atomic_store_explicit(&slot->name, name, memory_order_release);
+      return slot;
+    }
+  }
+  return &table->other;
+}
+
+/* Only the owner writes it, so there's no need for an atomic add */
+static void s_add(_Atomic uint64_t *counter, uint64_t value) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void tlb_profile_span_start(struct tlb_profile_span *span, int flags) {
+  span->parent = s_current;
+  span->child_wall_ns = 0;
+  span->child_cpu_ns = 0;
+  span->wall_ns = (flags & TLB_PROFILE_WALL) ? tlb_time_now_ns() : 0;
+  span->cpu_ns = (flags & TLB_PROFILE_CPU) ? s_cpu_now_ns() : 0;
+  s_current = span;
+}
+
+void tlb_profile_span_end(struct tlb_profile_span *span, const char *name, uint64_t calls) {
+  const uint64_t wall_ns = (span->flags & TLB_PROFILE_WALL) ? tlb_time_now_ns() - span->wall_ns : 0;
+  const uint64_t cpu_ns = (span->flags & TLB_PROFILE_CPU) ? s_cpu_now_ns() - span->cpu_ns : 0;
+  s_current = span->parent;
+  if (span->parent) {
+    span->parent->child_wall_ns += wall_ns;
+    span->parent->child_cpu_ns += cpu_ns;
+  }
+
+  struct tlb_profile_table *table = s_local;
+  if (!table && !(table = s_table_claim())) {
+    return;
+  }
+  struct tlb_profile_slot *slot = s_slot_find(table, name);
+  s_add(&slot->calls, calls);
+  s_add(&slot->wall_ns, wall_ns - TLB_MIN(wall_ns, span->child_wall_ns));
+  s_add(&slot->cpu_ns, cpu_ns - TLB_MIN(cpu_ns, span->child_cpu_ns));
+}
+
+/**********************************************************************************************************************
+ * Reading                                                                                                            *
+ **********************************************************************************************************************/
+
+/* Walks every claimed slot of every table in a fixed order */
+struct tlb_profile_cursor {
+  size_t table;
+  size_t slot; /* TLB_PROFILE_NAMES is the table's other slot */
+};
+
+static const struct tlb_profile_slot *s_cursor_next(struct tlb_profile_cursor *cursor, const char **name) {
+  for (; cursor->table < TLB_ARRAY_LENGTH(s_tables); ++cursor->table, cursor->slot = 0) {
+    struct tlb_profile_table *table = atomic_load_explicit(&s_tables[cursor->table], memory_order_acquire);
+    for (; table && cursor->slot <= TLB_PROFILE_NAMES; ++cursor->slot) {
+      const struct tlb_profile_slot *slot =
+          cursor->slot < TLB_PROFILE_NAMES ? &table->slots[cursor->slot] : &table->other;
+      *name = atomic_load_explicit(&slot->name, memory_order_acquire);
+      if (*name) {
+        cursor->slot++;
+        return slot;
+      }
+    }
+  }
+  return NULL;
+}
+
+static bool s_entry_before(const struct tlb_profile_entry *lhs, const struct tlb_profile_entry *rhs) {
+  return lhs->wall_ns != rhs->wall_ns ? lhs->wall_ns > rhs->wall_ns : lhs->cpu_ns > rhs->cpu_ns;
+}
+
+size_t tlb_profile_read(struct tlb_profile_entry *entries, size_t capacity) {
+  /* Doesn't allocate, each name is totalled at its first slot (quadratic, but there are rarely many) */
+  size_t count = 0;
+  struct tlb_profile_cursor cursor = {0};
+  const struct tlb_profile_slot *slot;
+  const char *name;
+  while ((slot = s_cursor_next(&cursor, &name))) {
+    struct tlb_profile_cursor other = {0};
+    const struct tlb_profile_slot *other_slot;
+    const char *other_name = NULL;
+    bool seen = false;
+    while (!seen && (other_slot = s_cursor_next(&other, &other_name)) && other_slot != slot) {
+      seen = other_name == name || strcmp(other_name, name) == 0;
+    }
+    if (seen) {
+      continue;
+    }
+
+    struct tlb_profile_entry entry = {.name = name};
+    for (other = cursor, other_slot = slot; other_slot; other_slot = s_cursor_next(&other, &other_name)) {
+      if (other_slot == slot || other_name == name || strcmp(other_name, name) == 0) {
+        entry.calls += atomic_load_explicit(&other_slot->calls, memory_order_relaxed);
+        entry.wall_ns += atomic_load_explicit(&other_slot->wall_ns, memory_order_relaxed);
+        entry.cpu_ns += atomic_load_explicit(&other_slot->cpu_ns, memory_order_relaxed);
+      }
+    }
+    /* Unused other slots, or a name claimed by a call that hasn't been added yet */
+    if (entry.calls == 0) {
+      continue;
+    }
+
+    /* Insertion into the most expensive capacity entries */
+    size_t index = TLB_MIN(count, capacity);
+    while (index > 0 && s_entry_before(&entry, &entries[index - 1])) {
+      if (index < capacity) {
+        entries[index] = entries[index - 1];
+      }
+      index--;
+    }
+    if (index < capacity) {
+      entries[index] = entry;
+    }
+    count++;
+  }
+  return count;
+}
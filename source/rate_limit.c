@@ -0,0 +1,97 @@
+#include "tlb/private/rate_limit.h"
+
+#include "tlb/private/event_loop.h"
+
+#include <errno.h>
+
+static const double s_nanos_per_second = 1e9;
+
+/**********************************************************************************************************************
+ * Buckets                                                                                                            *
+ **********************************************************************************************************************/
+
+static double s_burst(double rate, double burst) {
+  return burst > 0 ? burst : TLB_MAX(rate, 1.0);
+}
+
+static double s_refill(double tokens, double rate, double burst, uint64_t elapsed_ns) {
+  return TLB_MIN(tokens + (rate * (double)elapsed_ns / s_nanos_per_second), s_burst(rate, burst));
+}
+
+/* Time until a bucket holds a whole token again */
+static uint64_t s_wait_ns(double tokens, double rate) {
+  return tokens >= 1 ? 0 : (uint64_t)((1 - tokens) / rate * s_nanos_per_second);
+}
+
+uint64_t tlb_rate_limiter_charge(struct tlb_rate_limiter *limiter, uint64_t now_ns) {
+  const struct tlb_rate_limit *limit = &limiter->limit;
+  const uint64_t elapsed_ns = now_ns > limiter->refilled_ns ? now_ns - limiter->refilled_ns : 0;
+  limiter->refilled_ns = now_ns;
+
+  uint64_t wait_ns = 0;
+  if (limit->events_per_second > 0) {
+    limiter->event_tokens =
+        s_refill(limiter->event_tokens, limit->events_per_second, limit->event_burst, elapsed_ns) - 1;
+    wait_ns = s_wait_ns(limiter->event_tokens, limit->events_per_second);
+  }
+  if (limit->bytes_per_second > 0) {
+    limiter->byte_tokens = s_refill(limiter->byte_tokens, limit->bytes_per_second, limit->byte_burst, elapsed_ns);
+    wait_ns = TLB_MAX(wait_ns, s_wait_ns(limiter->byte_tokens, limit->bytes_per_second));
+  }
+  return wait_ns;
+}
+
+/**********************************************************************************************************************
+ * API                                                                                                                *
+ **********************************************************************************************************************/
+
+int tlb_evl_set_rate_limit(struct tlb_event_loop *loop, tlb_handle subscription, const struct tlb_rate_limit *limit) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, subscription);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+  if ((sub->sub_mode & TLB_SUB_ONESHOT) ||
+      (limit && (limit->events_per_second < 0 || limit->bytes_per_second < 0))) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  /* Subscriptions that were never limited have nothing to clear */
+  if (!limit && !tlb_evl_sub_ext(sub)) {
+    return 0;
+  }
+  struct tlb_sub_ext *ext = TLB_CHECK_RETURN(NULL !=, tlb_evl_sub_extend(loop, sub), TLB_FAIL);
+
+  struct tlb_rate_limiter *limiter = NULL;
+  if (limit) {
+    limiter = TLB_CHECK_RETURN(NULL !=, tlb_malloc(loop->alloc, sizeof(struct tlb_rate_limiter)), TLB_FAIL);
+    limiter->limit = *limit;
+    limiter->event_tokens = s_burst(limit->events_per_second, limit->event_burst);
+    limiter->byte_tokens = s_burst(limit->bytes_per_second, limit->byte_burst);
+    limiter->refilled_ns = tlb_time_now_ns();
+  }
+
+  /* The owner may be charging the old one, so it has to outlive the callback that's running */
+  struct tlb_rate_limiter *old = atomic_exchange(&ext->limiter, limiter);
+  if (old) {
+    tlb_epoch_retire(&loop->retired, &old->retired);
+  }
+  return 0;
+}
+
+int tlb_evl_rate_consume(struct tlb_event_loop *loop, tlb_handle subscription, size_t bytes) {
+  struct tlb_subscription *sub = tlb_evl_sub_get(loop, subscription);
+  if (!sub) {
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+
+  /* Only the owner touches the buckets, and it's pinned while running the callback */
+  struct tlb_sub_ext *ext = tlb_evl_sub_ext(sub);
+  struct tlb_rate_limiter *limiter = ext ? atomic_load_explicit(&ext->limiter, memory_order_acquire) : NULL;
+  if (limiter) {
+    limiter->byte_tokens -= (double)bytes;
+  }
+  return 0;
+}
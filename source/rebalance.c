@@ -0,0 +1,153 @@
+#include "tlb/rebalance.h"
+
+#include "tlb/private/event_loop.h"
+
+#include <errno.h>
+
+struct tlb_rebalance_candidate {
+  tlb_handle handle; /* TLB_HANDLE_INVALID once it's been moved or given up on */
+  uint64_t load;
+};
+
+struct tlb_rebalance_loop {
+  struct tlb_event_loop *loop;
+  uint64_t load;
+  bool done; /* Nothing left that can be moved off it */
+
+  /* Busiest first */
+  struct tlb_rebalance_candidate *candidates;
+  size_t candidate_count;
+  size_t candidate_capacity;
+  bool failed;
+};
+
+/**********************************************************************************************************************
+ * Load                                                                                                               *
+ **********************************************************************************************************************/
+
+static void s_collect(struct tlb_subscription *sub, void *userdata) {
+  struct tlb_rebalance_loop *state = userdata;
+
+  /* Wraps along with the counts */
+  const uint32_t count = atomic_load_explicit(&sub->event_count, memory_order_relaxed);
+  const uint64_t load = (uint32_t)(count - sub->balanced_count);
+  sub->balanced_count = count;
+  state->load += load;
+
+  if (load == 0 || !tlb_evl_sub_movable(sub) || state->failed) {
+    return;
+  }
+
+  if (state->candidate_count == state->candidate_capacity) {
+    const size_t capacity = TLB_MAX(state->candidate_capacity * 2, (size_t)16);
+    struct tlb_rebalance_candidate *candidates =
+        tlb_malloc(state->loop->alloc, capacity * sizeof(struct tlb_rebalance_candidate));
+    if (!candidates) {
+      state->failed = true;
+      return;
+    }
+    if (state->candidates) {
+      memcpy(candidates, state->candidates, state->candidate_count * sizeof(struct tlb_rebalance_candidate));
+      tlb_free(state->loop->alloc, state->candidates);
+    }
+    state->candidates = candidates;
+    state->candidate_capacity = capacity;
+  }
+
+  state->candidates[state->candidate_count++] = (struct tlb_rebalance_candidate){
+      .handle = tlb_evl_sub_handle(sub),
+      .load = load,
+  };
+}
+
+static int s_candidate_compare(const void *lhs, const void *rhs) {
+  const uint64_t lhs_load = ((const struct tlb_rebalance_candidate *)lhs)->load;
+  const uint64_t rhs_load = ((const struct tlb_rebalance_candidate *)rhs)->load;
+  return (lhs_load < rhs_load) - (lhs_load > rhs_load);
+}
+
+/**********************************************************************************************************************
+ * Rebalance                                                                                                          *
+ **********************************************************************************************************************/
+
+static struct tlb_rebalance_candidate *s_pick(struct tlb_rebalance_loop *busiest, uint64_t gap) {
+  /* The busiest subscription that moves load off without just moving the hot spot */
+  for (size_t ii = 0; ii < busiest->candidate_count; ++ii) {
+    struct tlb_rebalance_candidate *candidate = &busiest->candidates[ii];
+    if (candidate->handle != TLB_HANDLE_INVALID && candidate->load < gap) {
+      return candidate;
+    }
+  }
+  return NULL;
+}
+
+int tlb_evl_rebalance(struct tlb_event_loop **loops, size_t count, const struct tlb_rebalance_options *options) {
+  if (count == 0 || !options->on_migrate) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  struct tlb_allocator *alloc = loops[0]->alloc;
+  struct tlb_rebalance_loop *states =
+      TLB_CHECK_RETURN(NULL !=, tlb_calloc(alloc, count, sizeof(struct tlb_rebalance_loop)), TLB_FAIL);
+
+  int result = 0;
+  uint64_t total = 0;
+  for (size_t ii = 0; ii < count; ++ii) {
+    states[ii].loop = loops[ii];
+    tlb_evl_sub_foreach(loops[ii], s_collect, &states[ii]);
+    if (states[ii].failed) {
+      errno = ENOMEM;
+      result = TLB_FAIL;
+      goto cleanup;
+    }
+    if (states[ii].candidates) {
+      qsort(states[ii].candidates, states[ii].candidate_count, sizeof(struct tlb_rebalance_candidate),
+            s_candidate_compare);
+    }
+    total += states[ii].load;
+  }
+
+  const double limit = ((double)total / (double)count) * (1.0 + options->threshold);
+  while (options->max_moves == 0 || (size_t)result < options->max_moves) {
+    struct tlb_rebalance_loop *busiest = NULL;
+    struct tlb_rebalance_loop *quietest = &states[0];
+    for (size_t ii = 0; ii < count; ++ii) {
+      if (!states[ii].done && (!busiest || states[ii].load > busiest->load)) {
+        busiest = &states[ii];
+      }
+      quietest = states[ii].load < quietest->load ? &states[ii] : quietest;
+    }
+    if (!busiest || busiest == quietest || (double)busiest->load <= limit) {
+      break;
+    }
+
+    struct tlb_rebalance_candidate *candidate = s_pick(busiest, busiest->load - quietest->load);
+    if (!candidate) {
+      busiest->done = true;
+      continue;
+    }
+
+    const tlb_handle from_handle = candidate->handle;
+    candidate->handle = TLB_HANDLE_INVALID;
+    const tlb_handle to_handle = tlb_evl_migrate(from_handle, busiest->loop, quietest->loop);
+    if (to_handle == TLB_HANDLE_INVALID) {
+      /* Removed since it was counted */
+      continue;
+    }
+
+    busiest->load -= candidate->load;
+    quietest->load += candidate->load;
+    ++result;
+    options->on_migrate(from_handle, busiest->loop, to_handle, quietest->loop, options->userdata);
+  }
+
+cleanup:
+  for (size_t ii = 0; ii < count; ++ii) {
+    if (states[ii].candidates) {
+      tlb_free(states[ii].loop->alloc, states[ii].candidates);
+    }
+  }
+  tlb_free(alloc, states);
+  return result;
+}
@@ -0,0 +1,370 @@
+#include "tlb/private/recorder.h"
+
+#include "tlb/private/epoch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+_Thread_local struct tlb_recorder_ring *tlb_recorder_local;
+
+/* Indexed by epoch record, never freed so dumps can always walk them */
+static _Atomic(struct tlb_recorder_ring *) s_rings[TLB_EPOCH_MAX_THREADS];
+
+/* Taken when the first ring is, to turn ticks into times */
+static struct {
+  uint64_t ticks;
+  uint64_t ns;
+} s_calibration;
+static once_flag s_calibration_once = ONCE_FLAG_INIT;
+
+/* Where tlb_recorder_dump_on_crash writes to, copied as the handler can't rely on the caller's copy */
+static char s_crash_path[4096];
+
+/* Signals dumped on, and whatever handled them before, which takes over once the dump is written */
+static const int s_crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+static struct sigaction s_crash_previous[TLB_ARRAY_LENGTH(s_crash_signals)];
+
+/**********************************************************************************************************************
+ * Recording                                                                                                          *
+ **********************************************************************************************************************/
+
+static void s_calibrate(void) {
+  s_calibration.ticks = tlb_time_ticks();
+  s_calibration.ns = tlb_time_now_ns();
+}
+
+struct tlb_recorder_ring *tlb_recorder_claim(void) {
+  call_once(&s_calibration_once, s_calibrate);
+
+  /* Threads that took over an exited thread's epoch record carry on in its ring, after its last entries */
+  _Atomic(struct tlb_recorder_ring *) *slot = &s_rings[tlb_epoch_thread_index()];
+  struct tlb_recorder_ring *ring = atomic_load_explicit(slot, memory_order_acquire);
+  if (!ring) {
+    /* Recording happens on paths that set errno for their caller */
+    const int error = errno;
+    ring = calloc(1, sizeof(struct tlb_recorder_ring));
+    errno = error;
+    if (!ring) {
+      return NULL;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_store_explicit(slot, ring, memory_order_release);
+  }
+
+  tlb_recorder_local = ring;
+  return ring;
+}
+
+/**********************************************************************************************************************
+ * Dumping                                                                                                            *
+ **********************************************************************************************************************/
+
+/* Buffered writes to an fd, without allocating */
+struct tlb_json_writer {
+  int fd;
+  bool failed;
+  size_t length;
+  char buffer[4096];
+};
+
+static void s_flush(struct tlb_json_writer *writer) {
+  size_t written = 0;
+  while (!writer->failed && written < writer->length) {
+    const ssize_t result = write(writer->fd, writer->buffer + written, writer->length - written);
+    if (result > 0) {
+      written += (size_t)result;
+    } else if (result == -1 && errno != EINTR) {
+      writer->failed = true;
+    }
+  }
+  writer->length = 0;
+}
+
+static void s_write(struct tlb_json_writer *writer, const char *text, size_t length) {
+  for (size_t ii = 0; ii < length; ++ii) {
+    if (writer->length == sizeof(writer->buffer)) {
+      s_flush(writer);
+    }
+    writer->buffer[writer->length++] = text[ii];
+  }
+}
+
+static void s_puts(struct tlb_json_writer *writer, const char *text) {
+  s_write(writer, text, strlen(text));
+}
+
+/* Integers are formatted by hand, as the printf family isn't async-signal-safe */
+static void s_write_uint(struct tlb_json_writer *writer, uint64_t value) {
+  char digits[20];
+  size_t length = 0;
+  do {
+    digits[sizeof(digits) - ++length] = (char)('0' + (value % 10));
+    value /= 10;
+  } while (value);
+  s_write(writer, digits + sizeof(digits) - length, length);
+}
+
+static void s_write_int(struct tlb_json_writer *writer, int64_t value) {
+  if (value < 0) {
+    s_puts(writer, "-");
+    s_write_uint(writer, -(uint64_t)value);
+  } else {
+    s_write_uint(writer, (uint64_t)value);
+  }
+}
+
+static void s_write_pointer(struct tlb_json_writer *writer, const void *pointer) {
+  static const char hex[] = "0123456789abcdef";
+  char digits[2 * sizeof(uintptr_t)];
+  size_t length = 0;
+  uintptr_t value = (uintptr_t)pointer;
+  do {
+    digits[sizeof(digits) - ++length] = hex[value & 0xfU];
+    value >>= 4U;
+  } while (value);
+  s_puts(writer, "0x");
+  s_write(writer, digits + sizeof(digits) - length, length);
+}
+
+/* Microseconds with 3 decimal places, from nanoseconds */
+static void s_write_micros(struct tlb_json_writer *writer, int64_t ns) {
+  static const uint64_t nanos_per_micro = 1000;
+  uint64_t magnitude = (uint64_t)ns;
+  if (ns < 0) {
+    s_puts(writer, "-");
+    magnitude = -(uint64_t)ns;
+  }
+  s_write_uint(writer, magnitude / nanos_per_micro);
+  const uint64_t fraction = magnitude % nanos_per_micro;
+  const char decimals[] = {'.', (char)('0' + (fraction / 100)), (char)('0' + (fraction / 10 % 10)),
+                           (char)('0' + (fraction % 10))};
+  s_write(writer, decimals, sizeof(decimals));
+}
+
+/* Names are C strings, only quotes, backslashes and control characters need anything done to them */
+static void s_write_name(struct tlb_json_writer *writer, const char *name) {
+  s_puts(writer, "\"");
+  for (const char *next = name ? name : "?"; *next; ++next) {
+    if (*next == '"' || *next == '\\') {
+      s_puts(writer, "\\");
+      s_write(writer, next, 1);
+    } else if ((unsigned char)*next >= ' ') {
+      s_write(writer, next, 1);
+    }
+  }
+  s_puts(writer, "\"");
+}
+
+struct tlb_dump_clock {
+  uint64_t ticks;
+  double ns_per_tick;
+  int pid;
+};
+
+/* Plain arithmetic is fine in a signal handler, it's only formatting doubles that isn't */
+static int64_t s_nanos(const struct tlb_dump_clock *clock, uint64_t ticks) {
+  return (int64_t)((double)(int64_t)(ticks - clock->ticks) * clock->ns_per_tick);
+}
+
+/* A record as it was read, while it still matched head */
+struct tlb_record_copy {
+  uint64_t ticks;
+  const void *subject;
+  const char *name;
+  uint32_t type;
+  uint32_t arg;
+};
+
+static void s_write_record(struct tlb_json_writer *writer, const struct tlb_dump_clock *clock, size_t thread,
+                           const struct tlb_record_copy *record) {
+  const char *phase = "i";
+  const char *name = record->name;
+  const char *arg_name = NULL;
+  switch ((enum tlb_record_type)record->type) {
+    case TLB_RECORD_POLL_ENTER:
+      phase = "B";
+      name = "poll";
+      arg_name = "timeout";
+      break;
+    case TLB_RECORD_POLL_EXIT:
+      phase = "E";
+      name = "poll";
+      arg_name = "events";
+      break;
+    case TLB_RECORD_DISPATCH_START:
+      phase = "B";
+      arg_name = "events";
+      break;
+    case TLB_RECORD_DISPATCH_END:
+      phase = "E";
+      arg_name = "events";
+      break;
+    case TLB_RECORD_REARM:
+      name = "rearm";
+      break;
+    case TLB_RECORD_REMOVE_DEFERRED:
+      name = "remove deferred";
+      break;
+    case TLB_RECORD_REQUEUE:
+      name = "requeue";
+      arg_name = "events";
+      break;
+    case TLB_RECORD_THREAD_START:
+      name = "thread start";
+      arg_name = "worker";
+      break;
+    case TLB_RECORD_THREAD_STOP:
+      name = "thread stop";
+      arg_name = "worker";
+      break;
+  }
+
+  s_puts(writer, ",\n{\"name\":");
+  s_write_name(writer, name);
+  s_puts(writer, ",\"ph\":\"");
+  s_puts(writer, phase);
+  s_puts(writer, "\",\"ts\":");
+  s_write_micros(writer, s_nanos(clock, record->ticks));
+  s_puts(writer, ",\"pid\":");
+  s_write_int(writer, clock->pid);
+  s_puts(writer, ",\"tid\":");
+  s_write_uint(writer, thread);
+  s_puts(writer, ",\"args\":{\"subject\":\"");
+  s_write_pointer(writer, record->subject);
+  s_puts(writer, "\"");
+  if (record->type == TLB_RECORD_REARM || record->type == TLB_RECORD_REMOVE_DEFERRED ||
+      record->type == TLB_RECORD_REQUEUE) {
+    s_puts(writer, ",\"subscription\":");
+    s_write_name(writer, record->name);
+  }
+  if (arg_name) {
+    s_puts(writer, ",\"");
+    s_puts(writer, arg_name);
+    s_puts(writer, "\":");
+    /* Timeouts are ints, e.g. TLB_WAIT_INDEFINITE */
+    if (record->type == TLB_RECORD_POLL_ENTER) {
+      s_write_int(writer, (int32_t)record->arg);
+    } else {
+      s_write_uint(writer, record->arg);
+    }
+  }
+  s_puts(writer, "}");
+  if (*phase == 'i') {
+    s_puts(writer, ",\"s\":\"t\"");
+  }
+  s_puts(writer, "}");
+}
+
+static void s_write_ring(struct tlb_json_writer *writer, const struct tlb_dump_clock *clock, size_t thread,
+                         struct tlb_recorder_ring *ring) {
+  s_puts(writer, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+  s_write_int(writer, clock->pid);
+  s_puts(writer, ",\"tid\":");
+  s_write_uint(writer, thread);
+  s_puts(writer, ",\"args\":{\"name\":\"tlb ");
+  s_write_uint(writer, thread);
+  s_puts(writer, "\"}}");
+
+  const uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  const uint64_t start = head > TLB_RECORDER_CAPACITY ? head - TLB_RECORDER_CAPACITY : 0;
+  for (uint64_t index = start; index < head; ++index) {
+    const struct tlb_record *slot = &ring->records[index % TLB_RECORDER_CAPACITY];
+    const struct tlb_record_copy record = {
+        .ticks = atomic_load_explicit(&slot->ticks, memory_order_relaxed),
+        .subject = atomic_load_explicit(&slot->subject, memory_order_relaxed),
+        .name = atomic_load_explicit(&slot->name, memory_order_relaxed),
+        .type = atomic_load_explicit(&slot->type, memory_order_relaxed),
+        .arg = atomic_load_explicit(&slot->arg, memory_order_relaxed),
+    };
+    atomic_thread_fence(memory_order_acquire);
+    /* The owner may have lapped us while we were reading it */
+    if (index + TLB_RECORDER_CAPACITY <= atomic_load_explicit(&ring->head, memory_order_relaxed)) {
+      continue;
+    }
+    s_write_record(writer, clock, thread, &record);
+  }
+}
+
+int tlb_recorder_dump(int fd) {
+  struct tlb_json_writer writer = {.fd = fd};
+  struct tlb_dump_clock clock = {.ticks = s_calibration.ticks, .ns_per_tick = 1.0, .pid = (int)getpid()};
+  const uint64_t now_ticks = tlb_time_ticks();
+  const uint64_t now_ns = tlb_time_now_ns();
+  if (now_ticks > s_calibration.ticks && now_ns > s_calibration.ns) {
+    clock.ns_per_tick = (double)(now_ns - s_calibration.ns) / (double)(now_ticks - s_calibration.ticks);
+  }
+
+  /* Starts with a metadata event so every record can lead with a comma */
+  s_puts(&writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+  s_write_int(&writer, clock.pid);
+  s_puts(&writer, ",\"args\":{\"name\":\"tlb\"}}");
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(s_rings); ++ii) {
+    struct tlb_recorder_ring *ring = atomic_load_explicit(&s_rings[ii], memory_order_acquire);
+    if (ring) {
+      s_write_ring(&writer, &clock, ii, ring);
+    }
+  }
+  s_puts(&writer, "\n]}\n");
+  s_flush(&writer);
+
+  if (writer.failed) {
+    return TLB_FAIL;
+  }
+  return 0;
+}
+
+/**********************************************************************************************************************
+ * Crash handler                                                                                                      *
+ **********************************************************************************************************************/
+
+static void s_on_crash(int signal, siginfo_t *info, void *context) {
+  const int error = errno;
+  const int fd = open(s_crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd != -1) {
+    tlb_recorder_dump(fd);
+    close(fd);
+  }
+  errno = error;
+
+  /* Hand the signal on to whatever had it before, with the original siginfo if it wants it */
+  struct sigaction previous = {.sa_handler = SIG_DFL};
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(s_crash_signals); ++ii) {
+    if (s_crash_signals[ii] == signal) {
+      previous = s_crash_previous[ii];
+    }
+  }
+  sigaction(signal, &previous, NULL);
+  if (previous.sa_flags & SA_SIGINFO) {
+    previous.sa_sigaction(signal, info, context);
+  } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+    previous.sa_handler(signal);
+  } else {
+    raise(signal);
+  }
+}
+
+int tlb_recorder_dump_on_crash(const char *path) {
+  if (strlen(path) >= sizeof(s_crash_path)) {
+    errno = ENAMETOOLONG;
+    return TLB_FAIL;
+  }
+  strcpy(s_crash_path, path);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = s_on_crash;
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(s_crash_signals); ++ii) {
+    struct sigaction previous;
+    TLB_CHECK(0 ==, sigaction(s_crash_signals[ii], &action, &previous));
+    /* Calling this again only changes the path, rather than chaining to ourselves */
+    if (!(previous.sa_flags & SA_SIGINFO) || previous.sa_sigaction != s_on_crash) {
+      s_crash_previous[ii] = previous;
+    }
+  }
+  return 0;
+}
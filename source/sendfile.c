@@ -0,0 +1,110 @@
+#include "tlb/private/sendfile.h"
+
+#include "tlb/allocator.h"
+#include "tlb/private/event_loop.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Most a transfer sends per callback before it's requeued, so one fast reader can't hold up the rest of the loop */
+#define TLB_SENDFILE_SLICE_BYTES (1U << 20U)
+
+static void s_free(struct tlb_sendfile *stream) {
+  if (stream->watch_fd != stream->socket) {
+    close(stream->watch_fd);
+  }
+  if (stream->splicing) {
+    tlb_pipe_close(&stream->pipe);
+  }
+  tlb_free(stream->loop->alloc, stream);
+}
+
+/* Subscriptions hold a pointer to their stream inline, which is freed along with them */
+static void s_on_release(void *userdata) {
+  s_free(*(struct tlb_sendfile **)userdata);
+}
+
+static void s_on_writable(tlb_handle handle, int events, void *userdata) {
+  (void)events;
+  struct tlb_sendfile *stream = *(struct tlb_sendfile **)userdata;
+  struct tlb_event_loop *loop = stream->loop;
+
+  uint64_t sent = 0;
+  bool done = false;
+  int error = 0;
+  while (stream->remaining && sent < TLB_SENDFILE_SLICE_BYTES) {
+    const size_t count = (size_t)TLB_MIN(stream->remaining, TLB_SENDFILE_SLICE_BYTES - sent);
+    const ssize_t result = tlb_sendfile_impl(stream, count);
+    if (result > 0) {
+      stream->offset += result;
+      stream->remaining -= (uint64_t)result;
+      stream->sent += (uint64_t)result;
+      sent += (uint64_t)result;
+    } else if (result == 0) {
+      /* The file ended before the range did */
+      done = true;
+      break;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      /* Rearmed for when the socket drains */
+      break;
+    } else if (errno != EINTR) {
+      error = errno;
+      done = true;
+      break;
+    }
+  }
+
+  if (done || stream->remaining == 0) {
+    tlb_evl_remove(loop, handle);
+    stream->on_sendfile(loop, stream->sent, true, error, stream->userdata);
+    return;
+  }
+  if (sent) {
+    stream->on_sendfile(loop, stream->sent, false, 0, stream->userdata);
+  }
+  if (sent == TLB_SENDFILE_SLICE_BYTES) {
+    /* The socket may well take more straight away, but the loop's other subscriptions get a turn first */
+    tlb_evl_requeue(loop, handle);
+  }
+}
+
+tlb_handle tlb_sendfile_stream(struct tlb_event_loop *loop, int socket, int file, int64_t offset, uint64_t length,
+                               tlb_on_sendfile *on_sendfile, void *userdata) {
+  if (socket < 0 || file < 0 || offset < 0 || !on_sendfile) {
+    errno = EINVAL;
+    return TLB_HANDLE_INVALID;
+  }
+  if (length == 0) {
+    struct stat stat_buf;
+    TLB_CHECK_RETURN(0 ==, fstat(file, &stat_buf), TLB_HANDLE_INVALID);
+    length = stat_buf.st_size > offset ? (uint64_t)(stat_buf.st_size - offset) : 0;
+  }
+
+  const struct tlb_sendfile init = {
+      .loop = loop,
+      .socket = socket,
+      .watch_fd = socket,
+      .file = file,
+      .offset = offset,
+      .remaining = length,
+      .on_sendfile = on_sendfile,
+      .userdata = userdata,
+  };
+  struct tlb_sendfile *stream =
+      TLB_CHECK_RETURN(NULL !=, tlb_malloc(loop->alloc, sizeof(struct tlb_sendfile)), TLB_HANDLE_INVALID);
+  *stream = init;
+
+  const tlb_handle handle = tlb_evl_add_fd_shared(loop, socket, TLB_EV_WRITE, s_on_writable, &stream, sizeof(stream),
+                                                  s_on_release, &stream->watch_fd);
+  if (handle == TLB_HANDLE_INVALID) {
+    /* Never added, so never released */
+    const int error = errno;
+    s_free(stream);
+    errno = error;
+    return TLB_HANDLE_INVALID;
+  }
+
+  tlb_evl_set_name(loop, handle, "sendfile");
+  return handle;
+}
@@ -0,0 +1,132 @@
+#include "tlb/private/strand.h"
+
+#include "tlb/private/event_loop.h"
+
+#include <errno.h>
+
+/* Innermost strand being run by this thread */
+static _Thread_local const struct tlb_strand *s_current;
+
+/**********************************************************************************************************************
+ * Life cycle                                                                                                         *
+ **********************************************************************************************************************/
+
+struct tlb_strand *tlb_strand_new(struct tlb_event_loop *loop) {
+  struct tlb_strand *strand = TLB_CHECK(NULL !=, tlb_calloc(loop->alloc, 1, sizeof(struct tlb_strand)));
+  strand->alloc = loop->alloc;
+  strand->loop = loop;
+  atomic_init(&strand->queue, NULL);
+  atomic_init(&strand->running, false);
+  return strand;
+}
+
+void tlb_strand_destroy(struct tlb_strand *strand) {
+  TLB_ASSERT(s_current != strand);
+
+  /* Removed subscriptions may still be queued, their runs finish freeing them */
+  while (atomic_load(&strand->running) || atomic_load(&strand->queue)) {
+    thrd_yield();
+  }
+  tlb_free(strand->alloc, strand);
+}
+
+/**********************************************************************************************************************
+ * Run queue                                                                                                          *
+ **********************************************************************************************************************/
+
+static void s_strand_run(struct tlb_strand *strand) {
+  const struct tlb_strand *outer = s_current;
+  s_current = strand;
+
+  do {
+    /* Restore push order */
+    struct tlb_strand_task *task = atomic_exchange(&strand->queue, NULL);
+    struct tlb_strand_task *ordered = NULL;
+    while (task) {
+      struct tlb_strand_task *next = task->next;
+      task->next = ordered;
+      ordered = task;
+      task = next;
+    }
+
+    while (ordered) {
+      /* Running a subscription may free it, and its slot may be queued again straight away */
+      struct tlb_strand_task *next = ordered->next;
+      ordered->run(strand, ordered);
+      ordered = next;
+    }
+
+    atomic_store(&strand->running, false);
+
+    /* Anything pushed while running was left for us, unless someone else has picked it up since */
+  } while (atomic_load(&strand->queue) && !atomic_exchange(&strand->running, true));
+
+  s_current = outer;
+}
+
+void tlb_strand_schedule(struct tlb_strand *strand, struct tlb_strand_task *task) {
+  task->next = atomic_load_explicit(&strand->queue, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak(&strand->queue, &task->next, task)) {
+  }
+
+  if (!atomic_exchange(&strand->running, true)) {
+    s_strand_run(strand);
+  }
+}
+
+/**********************************************************************************************************************
+ * Subscriptions                                                                                                      *
+ **********************************************************************************************************************/
+
+tlb_handle tlb_strand_add_fd(struct tlb_strand *strand, int fd, int events, bool edge_trigger, tlb_on_event *on_event,
+                             void *userdata) {
+  return tlb_evl_add_fd_strand(strand->loop, strand, fd, events, edge_trigger, on_event, userdata);
+}
+
+tlb_handle tlb_strand_add_timer(struct tlb_strand *strand, int timeout, tlb_on_event *trigger, void *userdata) {
+  return tlb_evl_add_timer_strand(strand->loop, strand, timeout, trigger, userdata);
+}
+
+/**********************************************************************************************************************
+ * Dispatch                                                                                                           *
+ **********************************************************************************************************************/
+
+struct tlb_strand_call {
+  struct tlb_strand_task task; /* Must be first */
+  tlb_strand_fn *fn;
+  void *userdata;
+};
+
+static void s_call_run(struct tlb_strand *strand, struct tlb_strand_task *task) {
+  struct tlb_strand_call *call = (struct tlb_strand_call *)task;
+  call->fn(call->userdata);
+  tlb_free(strand->alloc, call);
+}
+
+int tlb_strand_dispatch(struct tlb_strand *strand, tlb_strand_fn *fn, void *userdata) {
+  /* Idle strands run it straight away, without queueing */
+  if (!atomic_exchange(&strand->running, true)) {
+    const struct tlb_strand *outer = s_current;
+    s_current = strand;
+    fn(userdata);
+    s_current = outer;
+
+    atomic_store(&strand->running, false);
+    if (atomic_load(&strand->queue) && !atomic_exchange(&strand->running, true)) {
+      s_strand_run(strand);
+    }
+    return 0;
+  }
+
+  struct tlb_strand_call *call =
+      TLB_CHECK_RETURN(NULL !=, tlb_malloc(strand->alloc, sizeof(struct tlb_strand_call)), TLB_FAIL);
+  call->task.run = s_call_run;
+  call->fn = fn;
+  call->userdata = userdata;
+  tlb_strand_schedule(strand, &call->task);
+  return 0;
+}
+
+bool tlb_strand_running_in_this_thread(const struct tlb_strand *strand) {
+  return s_current == strand;
+}
@@ -4,14 +4,54 @@
 
 #include "tlb/allocator.h"
 #include "tlb/pipe.h"
+#include "tlb/private/affinity.h"
 #include "tlb/private/event_loop.h"
+#include "tlb/private/metrics.h"
+#include "tlb/private/time.h"
 
+#include <errno.h>
+#include <inttypes.h>
 #include <stdatomic.h>
 
 enum {
   TLB_MAX_THREADS = 128,
 };
 
+enum tlb_worker_state {
+  TLB_WORKER_UNUSED,
+  TLB_WORKER_RUNNING,
+  TLB_WORKER_EXITED, /* Waiting to be joined */
+};
+
+struct tlb_worker {
+  /* Written by the worker on every callback, padded so the watchdog reading it doesn't slow anyone else down */
+  _Alignas(64) _Atomic uint64_t heartbeat;
+  _Atomic int state; /* enum tlb_worker_state */
+  struct tlb *tlb;
+  size_t index;
+  thrd_t thread;
+  bool stalled; /* Only touched by the watchdog */
+  _Atomic(void *) slots[TLB_WORKER_SLOTS];
+};
+
+/* A sub-loop run by a thread of its own, see tlb_add_dedicated_evl */
+struct tlb_dedicated {
+  struct tlb_dedicated *next;
+  struct tlb *tlb;
+  struct tlb_event_loop *loop;
+  int cpu;
+
+  /* Subscribed to the sub-loop, a write stops the thread */
+  struct tlb_pipe stop_pipe;
+  tlb_handle stop_sub;
+
+  thrd_t thread;
+  bool running;
+  /* Handshake with whoever started the thread, under the tlb's lock */
+  bool started;
+  int error;
+};
+
 struct tlb {
   struct tlb_allocator *alloc;
   struct tlb_options options;
@@ -19,54 +59,92 @@ struct tlb {
   struct tlb_event_loop super_loop;
 
   struct tlb_pipe thread_stop_pipe;
-  struct tlb_subscription thread_stop_sub;
+  tlb_handle thread_stop_sub;
 
   atomic_size_t active_threads;
 
+  /* Per-worker counters, see tlb/metrics.h */
+  struct tlb_metrics_slot metrics;
+
+  /* Sub-loops with threads of their own, they run whenever the workers do */
+  struct tlb_dedicated *dedicated;
+  bool started;
+
   /* Used to sync the start and stop routines */
   mtx_t mtx;
   cnd_t cnd;
 
-  thrd_t threads[];
+  /* Only used if the stall threshold is set */
+  struct {
+    thrd_t thread;
+    mtx_t mtx;
+    cnd_t cnd;
+    bool running;
+    bool stop;
+    size_t retiring_from; /* active_threads when a compensating thread was asked to stop, 0 if none are */
+  } watchdog;
+
+  /* max_thread_count regular workers, followed by max_compensating_threads extras */
+  size_t worker_count;
+  struct tlb_worker workers[];
 };
 
 static _Thread_local bool s_should_stop;
+static _Thread_local struct tlb_worker *s_current_worker;
 static const uint64_t s_thread_stop_value = 0xBADC0FFEE;
 
 static int s_thread_start(void *arg);
 static tlb_on_event s_thread_stop;
+static int s_watchdog_start(void *arg);
+static int s_dedicated_spawn(struct tlb_dedicated *dedicated);
+static void s_dedicated_join(struct tlb_dedicated *dedicated);
+static void s_dedicated_free(struct tlb_dedicated *dedicated);
 
 struct tlb *tlb_new(struct tlb_allocator *alloc, struct tlb_options options) {
-  const size_t alloc_size = sizeof(struct tlb) + (options.max_thread_count * sizeof(thrd_t));
+  const size_t compensating = options.stall_threshold_ms ? options.max_compensating_threads : 0;
+  const size_t worker_count = options.max_thread_count + compensating;
+  const size_t alloc_size = sizeof(struct tlb) + (worker_count * sizeof(struct tlb_worker));
   struct tlb *tlb = TLB_CHECK(NULL !=, tlb_calloc(alloc, 1, alloc_size));
   tlb->alloc = alloc;
   tlb->options = options;
+  tlb->worker_count = worker_count;
+  for (size_t ii = 0; ii < worker_count; ++ii) {
+    tlb->workers[ii].tlb = tlb;
+    tlb->workers[ii].index = ii;
+    for (size_t slot = 0; slot < TLB_WORKER_SLOTS; ++slot) {
+      atomic_init(&tlb->workers[ii].slots[slot], NULL);
+    }
+    atomic_init(&tlb->workers[ii].heartbeat, 0);
+    atomic_init(&tlb->workers[ii].state, TLB_WORKER_UNUSED);
+  }
 
   TLB_CHECK_GOTO(0 ==, tlb_evl_init(&tlb->super_loop, alloc), evl_init_failed);
 
   /* Setup the pipe used to stop threads. */
   TLB_CHECK_GOTO(0 ==, tlb_pipe_open(&tlb->thread_stop_pipe), pipe_open_failed);
-  tlb->thread_stop_sub = (struct tlb_subscription){
-      .ident = {.fd = tlb->thread_stop_pipe.fd_read},
-      .on_event = s_thread_stop,
-      .userdata = tlb,
-      .events = TLB_EV_READ,
-      .sub_mode = TLB_SUB_EDGE,
-      .name = "tlb_thread_stop_pipe",
-  };
-  tlb_evl_impl_fd_init(&tlb->thread_stop_sub);
-  TLB_CHECK_GOTO(0 ==, tlb_evl_impl_subscribe(&tlb->super_loop, &tlb->thread_stop_sub), thread_stop_sub_failed);
+  tlb->thread_stop_sub =
+      tlb_evl_add_fd_pinned(&tlb->super_loop, tlb->thread_stop_pipe.fd_read, TLB_EV_READ, true, s_thread_stop, &tlb,
+                            sizeof(tlb), NULL);
+  TLB_CHECK_GOTO(TLB_HANDLE_INVALID !=, tlb->thread_stop_sub, thread_stop_sub_failed);
+  tlb_evl_sub_get(&tlb->super_loop, tlb->thread_stop_sub)->name = "tlb_thread_stop_pipe";
 
   TLB_CHECK_GOTO(thrd_success ==, mtx_init(&tlb->mtx, mtx_plain), mtx_init_failed);
   TLB_CHECK_GOTO(thrd_success ==, cnd_init(&tlb->cnd), cnd_init_failed);
+  TLB_CHECK_GOTO(thrd_success ==, mtx_init(&tlb->watchdog.mtx, mtx_plain), watchdog_mtx_init_failed);
+  TLB_CHECK_GOTO(thrd_success ==, cnd_init(&tlb->watchdog.cnd), watchdog_cnd_init_failed);
   atomic_init(&tlb->active_threads, 0);
+  tlb_metrics_init(&tlb->metrics);
 
   return tlb;
 
+watchdog_cnd_init_failed:
+  mtx_destroy(&tlb->watchdog.mtx);
+watchdog_mtx_init_failed:
+  cnd_destroy(&tlb->cnd);
 cnd_init_failed:
   mtx_destroy(&tlb->mtx);
 mtx_init_failed:
-  tlb_evl_impl_unsubscribe(&tlb->super_loop, &tlb->thread_stop_sub);
+  tlb_evl_remove(&tlb->super_loop, tlb->thread_stop_sub);
 thread_stop_sub_failed:
   tlb_pipe_close(&tlb->thread_stop_pipe);
 pipe_open_failed:
@@ -79,21 +157,57 @@ evl_init_failed:
 void tlb_destroy(struct tlb *tlb) {
   /* Stop all of the threads */
   tlb_stop(tlb);
+  while (tlb->dedicated) {
+    struct tlb_dedicated *next = tlb->dedicated->next;
+    s_dedicated_free(tlb->dedicated);
+    tlb->dedicated = next;
+  }
 
+  cnd_destroy(&tlb->watchdog.cnd);
+  mtx_destroy(&tlb->watchdog.mtx);
   cnd_destroy(&tlb->cnd);
   mtx_destroy(&tlb->mtx);
 
   tlb_evl_cleanup(&tlb->super_loop);
+  tlb_pipe_close(&tlb->thread_stop_pipe);
+  tlb_metrics_cleanup(&tlb->metrics, tlb->alloc);
 
   tlb_free(tlb->alloc, tlb);
 }
 
+static int s_worker_spawn(struct tlb_worker *worker) {
+  atomic_store(&worker->heartbeat, 0);
+  atomic_store(&worker->state, TLB_WORKER_RUNNING);
+  return thrd_create(&worker->thread, s_thread_start, worker);
+}
+
+static void s_worker_join(struct tlb_worker *worker) {
+  int result = 0;
+  thrd_join(worker->thread, &result);
+  TLB_ASSERT(thrd_success == result);
+  worker->stalled = false;
+  atomic_store(&worker->state, TLB_WORKER_UNUSED);
+}
+
 int tlb_start(struct tlb *tlb) {
+  /* Dedicated threads can fail to be pinned, so they go first to not leave the workers half started */
+  for (struct tlb_dedicated *dedicated = tlb->dedicated; dedicated; dedicated = dedicated->next) {
+    if (s_dedicated_spawn(dedicated) != 0) {
+      const int error = errno;
+      for (struct tlb_dedicated *started = tlb->dedicated; started != dedicated; started = started->next) {
+        s_dedicated_join(started);
+      }
+      errno = error;
+      return TLB_FAIL;
+    }
+  }
+  tlb->started = true;
+
   mtx_lock(&tlb->mtx);
 
   const size_t target_threads = tlb->options.max_thread_count;
   for (size_t ii = 0; ii < target_threads; ++ii) {
-    thrd_create(&tlb->threads[ii], s_thread_start, tlb);
+    s_worker_spawn(&tlb->workers[ii]);
     cnd_wait(&tlb->cnd, &tlb->mtx);
   }
 
@@ -101,10 +215,26 @@ int tlb_start(struct tlb *tlb) {
 
   TLB_ASSERT(atomic_load(&tlb->active_threads) == target_threads);
 
+  if (tlb->options.stall_threshold_ms) {
+    tlb->watchdog.stop = false;
+    tlb->watchdog.retiring_from = 0;
+    tlb->watchdog.running = thrd_success == thrd_create(&tlb->watchdog.thread, s_watchdog_start, tlb);
+  }
+
   return 0;
 }
 
 int tlb_stop(struct tlb *tlb) {
+  /* Stop the watchdog first so it can't start or stop threads underneath us */
+  if (tlb->watchdog.running) {
+    mtx_lock(&tlb->watchdog.mtx);
+    tlb->watchdog.stop = true;
+    cnd_signal(&tlb->watchdog.cnd);
+    mtx_unlock(&tlb->watchdog.mtx);
+    thrd_join(tlb->watchdog.thread, NULL);
+    tlb->watchdog.running = false;
+  }
+
   mtx_lock(&tlb->mtx);
 
   const size_t active_threads = tlb->active_threads;
@@ -124,21 +254,62 @@ int tlb_stop(struct tlb *tlb) {
     }
   }
 
-  for (size_t ii = 0; ii < active_threads; ++ii) {
-    /* Join the threads */
-    int result = 0;
-    thrd_join(tlb->threads[ii], &result);
-    TLB_ASSERT(thrd_success == result);
+  /* Join the threads, including compensating threads the watchdog stopped but didn't get around to joining */
+  for (size_t ii = 0; ii < tlb->worker_count; ++ii) {
+    if (atomic_load(&tlb->workers[ii].state) != TLB_WORKER_UNUSED) {
+      s_worker_join(&tlb->workers[ii]);
+    }
   }
 
   mtx_unlock(&tlb->mtx);
 
+  for (struct tlb_dedicated *dedicated = tlb->dedicated; dedicated; dedicated = dedicated->next) {
+    s_dedicated_join(dedicated);
+  }
+  tlb->started = false;
+
   return 0;
 }
 
+size_t tlb_active_threads(struct tlb *tlb) {
+  return atomic_load(&tlb->active_threads);
+}
+
+/* tlb_evl_handle_events, timing the dispatch for the worker's metrics when they're published */
+static void s_worker_handle_events(struct tlb_worker *worker) {
+  struct tlb *tlb = worker->tlb;
+  struct tlb_evl_event events[TLB_EV_EVENT_BATCH];
+  const int count = tlb_evl_poll(&tlb->super_loop, events, TLB_EV_EVENT_BATCH, TLB_WAIT_INDEFINITE);
+  if (count <= 0) {
+    return;
+  }
+
+  struct tlb_metrics *metrics = tlb_metrics_get(&tlb->metrics);
+  const uint64_t start_ns = metrics ? tlb_time_now_ns() : 0;
+  tlb_evl_dispatch(&tlb->super_loop, events, (size_t)count);
+
+  if (metrics) {
+    uint64_t deltas[TLB_METRIC_COUNT] = {0};
+    deltas[TLB_METRIC_DISPATCHES] = (uint64_t)count;
+    deltas[TLB_METRIC_WAKEUPS] = 1;
+    deltas[TLB_METRIC_BUSY_NS] = tlb_time_now_ns() - start_ns;
+    tlb_metrics_add(metrics, worker->index, deltas);
+  }
+}
+
 static int s_thread_start(void *arg) {
-  struct tlb *tlb = arg;
+  struct tlb_worker *worker = arg;
+  struct tlb *tlb = worker->tlb;
   s_should_stop = false;
+  s_current_worker = worker;
+  if (tlb->options.stall_threshold_ms) {
+    tlb_evl_heartbeat = &worker->heartbeat;
+  }
+  tlb_record(TLB_RECORD_THREAD_START, tlb, "worker", (uint32_t)worker->index);
+  /* Before tlb_start returns, so everything is set up by the time anything can be subscribed */
+  if (tlb->options.on_thread_start) {
+    tlb->options.on_thread_start(tlb, worker->index, tlb->options.thread_userdata);
+  }
 
   atomic_fetch_add(&tlb->active_threads, 1);
 
@@ -149,9 +320,16 @@ static int s_thread_start(void *arg) {
 
   /* Wait for events */
   while (!s_should_stop) {
-    tlb_evl_handle_events(&tlb->super_loop, 0, TLB_WAIT_INDEFINITE);
+    s_worker_handle_events(worker);
   }
 
+  if (tlb->options.on_thread_stop) {
+    tlb->options.on_thread_stop(tlb, worker->index, tlb->options.thread_userdata);
+  }
+  tlb_record(TLB_RECORD_THREAD_STOP, tlb, "worker", (uint32_t)worker->index);
+  tlb_evl_heartbeat = NULL;
+  s_current_worker = NULL;
+  atomic_store(&worker->state, TLB_WORKER_EXITED);
   atomic_fetch_sub(&tlb->active_threads, 1);
 
   /* Acquire the lock so we know the stop thread is waiting */
@@ -166,7 +344,7 @@ static void s_thread_stop(tlb_handle subscription, int events, void *userdata) {
   (void)subscription;
   (void)events;
 
-  struct tlb *tlb = userdata;
+  struct tlb *tlb = *(struct tlb **)userdata;
 
   s_should_stop = true;
 
@@ -176,6 +354,276 @@ static void s_thread_stop(tlb_handle subscription, int events, void *userdata) {
   TLB_ASSERT(value == s_thread_stop_value);
 }
 
+/**********************************************************************************************************************
+ * Watchdog                                                                                                           *
+ **********************************************************************************************************************/
+
+static void s_watchdog_report(struct tlb *tlb, size_t worker, uint64_t stalled_ms) {
+  if (tlb->options.on_stall) {
+    tlb->options.on_stall(worker, stalled_ms, tlb->options.stall_userdata);
+  } else {
+    TLB_LOGF("Worker %zu has been stuck in a callback for %" PRIu64 "ms", worker, stalled_ms);
+  }
+}
+
+static void s_watchdog_check(struct tlb *tlb) {
+  static const uint64_t nanos_per_milli = 1000000;
+  const uint64_t threshold_ns = tlb->options.stall_threshold_ms * nanos_per_milli;
+  const uint64_t now = tlb_time_now_ns();
+
+  size_t stalled = 0;
+  struct tlb_worker *unused = NULL;
+  for (size_t ii = 0; ii < tlb->worker_count; ++ii) {
+    struct tlb_worker *worker = &tlb->workers[ii];
+    switch (atomic_load(&worker->state)) {
+      case TLB_WORKER_RUNNING: {
+        const uint64_t heartbeat = atomic_load_explicit(&worker->heartbeat, memory_order_relaxed);
+        const bool is_stalled = heartbeat != 0 && now > heartbeat && now - heartbeat >= threshold_ns;
+        if (is_stalled && !worker->stalled) {
+          s_watchdog_report(tlb, ii, (now - heartbeat) / nanos_per_milli);
+        }
+        worker->stalled = is_stalled;
+        stalled += is_stalled;
+        break;
+      }
+
+      case TLB_WORKER_EXITED:
+        s_worker_join(worker);
+        /* fallthrough */
+      case TLB_WORKER_UNUSED:
+        unused = unused ? unused : worker;
+        break;
+    }
+  }
+
+  /* A compensating thread is on its way out, don't make any decisions until it's gone */
+  const size_t active = atomic_load(&tlb->active_threads);
+  if (tlb->watchdog.retiring_from) {
+    if (active >= tlb->watchdog.retiring_from) {
+      return;
+    }
+    tlb->watchdog.retiring_from = 0;
+  }
+
+  const size_t regular = tlb->options.max_thread_count;
+  const size_t compensating = active > regular ? active - regular : 0;
+  if (stalled > compensating && unused) {
+    TLB_LOGF("Starting a compensating thread for %zu stalled workers", stalled);
+    s_worker_spawn(unused);
+  } else if (stalled == 0 && compensating > 0) {
+    /* Whichever thread picks this up exits, the pool just needs to get back to its normal size */
+    TLB_LOG("Stall cleared, stopping a compensating thread");
+    tlb->watchdog.retiring_from = active;
+    tlb_pipe_write(&tlb->thread_stop_pipe, s_thread_stop_value);
+  }
+}
+
+static int s_watchdog_start(void *arg) {
+  struct tlb *tlb = arg;
+
+  /* Check often enough to catch a stall within a quarter of the threshold */
+  static const long nanos_per_milli = 1000000;
+  static const long nanos_per_second = 1000000000;
+  const long interval_ns = TLB_MAX((long)tlb->options.stall_threshold_ms * nanos_per_milli / 4, nanos_per_milli);
+
+  mtx_lock(&tlb->watchdog.mtx);
+  /* Don't leave until a stopping compensating thread is gone, or tlb_stop would count it as still running */
+  while (!tlb->watchdog.stop || tlb->watchdog.retiring_from) {
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += interval_ns;
+    deadline.tv_sec += deadline.tv_nsec / nanos_per_second;
+    deadline.tv_nsec %= nanos_per_second;
+    cnd_timedwait(&tlb->watchdog.cnd, &tlb->watchdog.mtx, &deadline);
+
+    if (tlb->watchdog.stop) {
+      if (tlb->watchdog.retiring_from && atomic_load(&tlb->active_threads) < tlb->watchdog.retiring_from) {
+        tlb->watchdog.retiring_from = 0;
+      }
+      continue;
+    }
+    s_watchdog_check(tlb);
+  }
+  mtx_unlock(&tlb->watchdog.mtx);
+
+  return thrd_success;
+}
+
 struct tlb_event_loop *tlb_get_evl(struct tlb *tlb) {
   return &tlb->super_loop;
 }
+
+int tlb_metrics_enable(struct tlb *tlb, const char *name) {
+  return tlb_metrics_publish(&tlb->metrics, tlb->alloc, name, TLB_METRICS_WORKERS, tlb->worker_count);
+}
+
+void tlb_metrics_disable(struct tlb *tlb) {
+  tlb_metrics_unpublish(&tlb->metrics);
+}
+
+/**********************************************************************************************************************
+ * Workers                                                                                                            *
+ **********************************************************************************************************************/
+
+size_t tlb_current_worker(void) {
+  return s_current_worker ? s_current_worker->index : TLB_WORKER_NONE;
+}
+
+size_t tlb_worker_count(const struct tlb *tlb) {
+  return tlb->worker_count;
+}
+
+void *tlb_worker_slot_get(struct tlb *tlb, size_t worker, size_t slot) {
+  if (worker >= tlb->worker_count || slot >= TLB_WORKER_SLOTS) {
+    return NULL;
+  }
+  return atomic_load_explicit(&tlb->workers[worker].slots[slot], memory_order_acquire);
+}
+
+int tlb_worker_slot_set(struct tlb *tlb, size_t worker, size_t slot, void *value) {
+  if (worker >= tlb->worker_count || slot >= TLB_WORKER_SLOTS) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+  atomic_store_explicit(&tlb->workers[worker].slots[slot], value, memory_order_release);
+  return 0;
+}
+
+/**********************************************************************************************************************
+ * Dedicated sub-loops                                                                                                *
+ **********************************************************************************************************************/
+
+static void s_dedicated_stop(tlb_handle subscription, int events, void *userdata) {
+  (void)subscription;
+  (void)events;
+  struct tlb_dedicated *dedicated = *(struct tlb_dedicated **)userdata;
+
+  s_should_stop = true;
+
+  uint64_t value = 0;
+  tlb_pipe_read(&dedicated->stop_pipe, &value);
+  TLB_ASSERT(value == s_thread_stop_value);
+}
+
+static int s_dedicated_start(void *arg) {
+  struct tlb_dedicated *dedicated = arg;
+  struct tlb *tlb = dedicated->tlb;
+  s_should_stop = false;
+  const int error = (dedicated->cpu == TLB_CPU_ANY || tlb_affinity_pin(dedicated->cpu) == 0) ? 0 : errno;
+
+  mtx_lock(&tlb->mtx);
+  dedicated->error = error;
+  dedicated->started = true;
+  cnd_broadcast(&tlb->cnd);
+  mtx_unlock(&tlb->mtx);
+  if (error) {
+    return thrd_error;
+  }
+
+  tlb_record(TLB_RECORD_THREAD_START, tlb, "dedicated", (uint32_t)dedicated->cpu);
+  while (!s_should_stop) {
+    tlb_evl_handle_events(dedicated->loop, TLB_EV_EVENT_BATCH, TLB_WAIT_INDEFINITE);
+  }
+  tlb_record(TLB_RECORD_THREAD_STOP, tlb, "dedicated", (uint32_t)dedicated->cpu);
+
+  return thrd_success;
+}
+
+/* Starts the thread and waits for it to be pinned */
+static int s_dedicated_spawn(struct tlb_dedicated *dedicated) {
+  struct tlb *tlb = dedicated->tlb;
+  mtx_lock(&tlb->mtx);
+  dedicated->started = false;
+  if (thrd_create(&dedicated->thread, s_dedicated_start, dedicated) != thrd_success) {
+    mtx_unlock(&tlb->mtx);
+    errno = EAGAIN;
+    return TLB_FAIL;
+  }
+  while (!dedicated->started) {
+    cnd_wait(&tlb->cnd, &tlb->mtx);
+  }
+  mtx_unlock(&tlb->mtx);
+
+  if (dedicated->error) {
+    thrd_join(dedicated->thread, NULL);
+    errno = dedicated->error;
+    return TLB_FAIL;
+  }
+  dedicated->running = true;
+  return 0;
+}
+
+static void s_dedicated_join(struct tlb_dedicated *dedicated) {
+  if (!dedicated->running) {
+    return;
+  }
+  tlb_pipe_write(&dedicated->stop_pipe, s_thread_stop_value);
+  int result = 0;
+  thrd_join(dedicated->thread, &result);
+  TLB_ASSERT(thrd_success == result);
+  dedicated->running = false;
+}
+
+static void s_dedicated_free(struct tlb_dedicated *dedicated) {
+  s_dedicated_join(dedicated);
+  tlb_evl_remove(dedicated->loop, dedicated->stop_sub);
+  tlb_pipe_close(&dedicated->stop_pipe);
+  tlb_free(dedicated->tlb->alloc, dedicated);
+}
+
+int tlb_add_dedicated_evl(struct tlb *tlb, struct tlb_event_loop *sub_loop, int cpu) {
+  if (cpu < TLB_CPU_ANY) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+  for (struct tlb_dedicated *existing = tlb->dedicated; existing; existing = existing->next) {
+    if (existing->loop == sub_loop) {
+      errno = EEXIST;
+      return TLB_FAIL;
+    }
+  }
+
+  struct tlb_dedicated *dedicated =
+      TLB_CHECK_RETURN(NULL !=, tlb_calloc(tlb->alloc, 1, sizeof(struct tlb_dedicated)), TLB_FAIL);
+  dedicated->tlb = tlb;
+  dedicated->loop = sub_loop;
+  dedicated->cpu = cpu;
+  TLB_CHECK_GOTO(0 ==, tlb_pipe_open(&dedicated->stop_pipe), pipe_open_failed);
+  dedicated->stop_sub =
+      tlb_evl_add_fd_pinned(sub_loop, dedicated->stop_pipe.fd_read, TLB_EV_READ, true, s_dedicated_stop, &dedicated,
+                            sizeof(dedicated), NULL);
+  TLB_CHECK_GOTO(TLB_HANDLE_INVALID !=, dedicated->stop_sub, stop_sub_failed);
+  tlb_evl_sub_get(sub_loop, dedicated->stop_sub)->name = "tlb_dedicated_stop_pipe";
+
+  /* Joins the workers if they're already running */
+  if (tlb->started) {
+    TLB_CHECK_GOTO(0 ==, s_dedicated_spawn(dedicated), spawn_failed);
+  }
+
+  dedicated->next = tlb->dedicated;
+  tlb->dedicated = dedicated;
+  return 0;
+
+spawn_failed:;
+  const int error = errno;
+  tlb_evl_remove(sub_loop, dedicated->stop_sub);
+  errno = error;
+stop_sub_failed:
+  tlb_pipe_close(&dedicated->stop_pipe);
+pipe_open_failed:
+  tlb_free(tlb->alloc, dedicated);
+  return TLB_FAIL;
+}
+
+int tlb_remove_dedicated_evl(struct tlb *tlb, struct tlb_event_loop *sub_loop) {
+  for (struct tlb_dedicated **next = &tlb->dedicated; *next; next = &(*next)->next) {
+    struct tlb_dedicated *dedicated = *next;
+    if (dedicated->loop == sub_loop) {
+      *next = dedicated->next;
+      s_dedicated_free(dedicated);
+      return 0;
+    }
+  }
+  errno = ENOENT;
+  return TLB_FAIL;
+}
@@ -0,0 +1,99 @@
+#include "tlb/private/trace.h"
+
+#include "tlb/private/event_loop.h"
+#include "tlb/private/time.h"
+
+#include <errno.h>
+#include <inttypes.h>
+
+/**********************************************************************************************************************
+ * Enable/Disable                                                                                                     *
+ **********************************************************************************************************************/
+
+int tlb_evl_trace_enable(struct tlb_event_loop *loop, const struct tlb_trace_options *options) {
+  struct tlb_trace *trace = TLB_CHECK_RETURN(NULL !=, tlb_malloc(loop->alloc, sizeof(struct tlb_trace)), TLB_FAIL);
+  trace->options = *options;
+  for (size_t ii = 0; ii < TLB_ARRAY_LENGTH(trace->histograms); ++ii) {
+    tlb_histogram_init(&trace->histograms[ii]);
+  }
+
+  /* Threads in the middle of a batch may still be recording into the old one */
+  struct tlb_trace *old = atomic_exchange(&loop->trace, trace);
+  if (old) {
+    tlb_epoch_retire(&loop->retired, &old->retired);
+  }
+  return 0;
+}
+
+void tlb_evl_trace_disable(struct tlb_event_loop *loop) {
+  struct tlb_trace *old = atomic_exchange(&loop->trace, NULL);
+  if (old) {
+    tlb_epoch_retire(&loop->retired, &old->retired);
+  }
+}
+
+void tlb_trace_cleanup(struct tlb_event_loop *loop) {
+  struct tlb_trace *trace = atomic_exchange(&loop->trace, NULL);
+  if (trace) {
+    tlb_free(loop->alloc, trace);
+  }
+}
+
+/**********************************************************************************************************************
+ * Recording                                                                                                          *
+ **********************************************************************************************************************/
+
+void tlb_trace_callback(struct tlb_trace *trace, const struct tlb_subscription *sub, tlb_handle handle,
+                        uint64_t polled_ns, uint64_t start_ns) {
+  const uint64_t end_ns = tlb_time_now_ns();
+  const uint64_t duration_ns = end_ns - start_ns;
+
+  if (polled_ns) {
+    tlb_histogram_record(&trace->histograms[TLB_TRACE_QUEUE_DELAY], start_ns - polled_ns);
+  }
+  tlb_histogram_record(&trace->histograms[TLB_TRACE_CALLBACK_DURATION], duration_ns);
+
+  static const uint64_t nanos_per_micro = 1000;
+  const struct tlb_trace_options *options = &trace->options;
+  if (options->slow_callback_us == 0 || duration_ns <= options->slow_callback_us * nanos_per_micro) {
+    return;
+  }
+
+  if (options->on_slow_callback) {
+    options->on_slow_callback(sub->name, handle, duration_ns, options->userdata);
+  } else {
+    TLB_LOGF("[%s:%#" PRIx64 "] Slow callback took %" PRIu64 "us", sub->name, handle, duration_ns / nanos_per_micro);
+  }
+}
+
+/**********************************************************************************************************************
+ * Reading                                                                                                            *
+ **********************************************************************************************************************/
+
+int tlb_evl_trace_summary(struct tlb_event_loop *loop, enum tlb_trace_histogram histogram,
+                          struct tlb_trace_summary *summary) {
+  if (histogram >= TLB_TRACE_HISTOGRAM_COUNT) {
+    errno = EINVAL;
+    return TLB_FAIL;
+  }
+
+  tlb_epoch_pin();
+  struct tlb_trace *trace = atomic_load(&loop->trace);
+  if (!trace) {
+    tlb_epoch_unpin();
+    errno = ENOENT;
+    return TLB_FAIL;
+  }
+
+  const struct tlb_histogram *hist = &trace->histograms[histogram];
+  summary->count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+  summary->min_ns = summary->count ? atomic_load_explicit(&hist->min, memory_order_relaxed) : 0;
+  summary->max_ns = atomic_load_explicit(&hist->max, memory_order_relaxed);
+  summary->p50_ns = tlb_histogram_percentile(hist, 50.0);
+  summary->p90_ns = tlb_histogram_percentile(hist, 90.0);
+  summary->p99_ns = tlb_histogram_percentile(hist, 99.0);
+  summary->p999_ns = tlb_histogram_percentile(hist, 99.9);
+  tlb_epoch_unpin();
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.h"
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kPipes = 50;
+
+class BatchTest : public LoopTest {
+ public:
+  BatchTest() : LoopTest(kPipes) {
+  }
+
+  // Handlers only get a pointer and a count, so the calls they see are kept here
+  static std::vector<size_t> s_batches;
+  static std::vector<size_t> s_other_batches;
+  static size_t s_events;
+  static tlb_event_loop *s_loop;
+  static std::vector<tlb_handle> s_remove;
+
+  static void Read(Counter *conn) {
+    uint64_t value;
+    EXPECT_EQ((ssize_t)sizeof(value), tlb_pipe_read(conn->pipe, &value));
+    EXPECT_EQ(s_test_value, value);
+    conn->reads++;
+  }
+
+  static void OnBatch(const tlb_evl_batch_item *items, size_t count) {
+    s_batches.push_back(count);
+    for (size_t ii = 0; ii < count; ++ii) {
+      EXPECT_EQ(TLB_EV_READ, items[ii].events);
+      Read(static_cast<Counter *>(items[ii].userdata));
+    }
+    for (tlb_handle handle : s_remove) {
+      EXPECT_EQ(0, tlb_evl_remove(s_loop, handle));
+    }
+    s_remove.clear();
+  }
+
+  static void OnOtherBatch(const tlb_evl_batch_item *items, size_t count) {
+    s_other_batches.push_back(count);
+    for (size_t ii = 0; ii < count; ++ii) {
+      Read(static_cast<Counter *>(items[ii].userdata));
+    }
+  }
+
+  static void OnEvent(tlb_handle handle, int events, void *userdata) {
+    s_events++;
+    Read(static_cast<Counter *>(userdata));
+  }
+
+  void SetUp() override {
+    s_batches.clear();
+    s_other_batches.clear();
+    s_events = 0;
+    s_remove.clear();
+
+    LoopTest::SetUp();
+    s_loop = loop;
+    conns.resize(kPipes);
+    for (size_t ii = 0; ii < kPipes; ++ii) {
+      conns[ii].pipe = &pipes[ii];
+    }
+  }
+
+  tlb_handle Add(size_t pipe, tlb_on_batch *on_batch) {
+    return tlb_evl_add_fd_batch(loop, pipes[pipe].fd_read, TLB_EV_READ, false, on_batch, &conns[pipe]);
+  }
+
+  size_t Reads() {
+    size_t reads = 0;
+    for (const Counter &conn : conns) {
+      reads += conn.reads;
+    }
+    return reads;
+  }
+
+  std::vector<Counter> conns;
+};
+
+std::vector<size_t> BatchTest::s_batches;
+std::vector<size_t> BatchTest::s_other_batches;
+size_t BatchTest::s_events;
+tlb_event_loop *BatchTest::s_loop;
+std::vector<tlb_handle> BatchTest::s_remove;
+
+TEST_F(BatchTest, SingleCall) {
+  std::vector<tlb_handle> subs;
+  for (size_t ii = 0; ii < kPipes; ++ii) {
+    subs.push_back(Add(ii, OnBatch));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+  }
+
+  // Everything that's ready is passed to one call, and each one is rearmed afterwards
+  for (size_t round = 1; round <= 3; ++round) {
+    WriteAll();
+    EXPECT_EQ(kPipes, tlb_evl_handle_events(loop, 0, 1000));
+    ASSERT_EQ(round, s_batches.size());
+    EXPECT_EQ(kPipes, s_batches.back());
+    EXPECT_EQ(kPipes * round, Reads());
+  }
+
+  for (tlb_handle sub : subs) {
+    EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  }
+}
+
+TEST_F(BatchTest, GroupedByHandler) {
+  // Interleaved, so grouping has to move them around
+  for (size_t ii = 0; ii < kPipes; ++ii) {
+    tlb_handle sub = ii % 3 == 0   ? tlb_evl_add_fd(loop, pipes[ii].fd_read, TLB_EV_READ, false, OnEvent, &conns[ii])
+                     : ii % 3 == 1 ? Add(ii, OnBatch)
+                                   : Add(ii, OnOtherBatch);
+    ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  }
+
+  WriteAll();
+  EXPECT_EQ(kPipes, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(kPipes, Reads());
+  EXPECT_EQ((kPipes + 2) / 3, s_events);
+  ASSERT_EQ(1U, s_batches.size());
+  EXPECT_EQ((kPipes + 1) / 3, s_batches[0]);
+  ASSERT_EQ(1U, s_other_batches.size());
+  EXPECT_EQ(kPipes / 3, s_other_batches[0]);
+}
+
+TEST_F(BatchTest, RemoveInBatch) {
+  std::vector<tlb_handle> subs;
+  for (size_t ii = 0; ii < kPipes; ++ii) {
+    subs.push_back(Add(ii, OnBatch));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+  }
+
+  // Removing any of them while the batch is running is deferred until it's returned, the same as from on_event
+  s_remove = subs;
+  WriteAll();
+  EXPECT_EQ(kPipes, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(kPipes, Reads());
+
+  tlb_evl_memory usage;
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(0U, usage.slots_live);
+  for (tlb_handle sub : subs) {
+    EXPECT_EQ(-1, tlb_evl_remove(loop, sub));
+  }
+
+  WriteAll();
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+  EXPECT_EQ(1U, s_batches.size());
+}
+
+TEST_F(BatchTest, Paused) {
+  tlb_handle sub = Add(0, OnBatch);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  ASSERT_EQ(0, tlb_evl_pause(loop, sub));
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+  EXPECT_EQ(0U, s_batches.size());
+
+  ASSERT_EQ(0, tlb_evl_resume(loop, sub));
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  ASSERT_EQ(1U, s_batches.size());
+  EXPECT_EQ(1U, s_batches[0]);
+  EXPECT_EQ(1U, conns[0].reads);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(BatchTest, Migrated) {
+  tlb_event_loop *other = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, other);
+  tlb_handle sub = Add(0, OnBatch);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  // Still a batch subscription on the new loop
+  tlb_handle moved = tlb_evl_migrate(sub, loop, other);
+  ASSERT_NE(TLB_HANDLE_INVALID, moved);
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(other, 0, 1000));
+  EXPECT_EQ(1U, s_batches.size());
+  EXPECT_EQ(1U, conns[0].reads);
+
+  EXPECT_EQ(0, tlb_evl_remove(other, moved));
+  tlb_evl_destroy(other);
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,191 @@
+#include "tlb/channel.h"
+
+#include "tlb/event_loop.h"
+
+#include <gtest/gtest.h>
+#include <poll.h>
+
+#include "test_helpers.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kCapacity = 64;
+
+class ChannelTest : public ::testing::TestWithParam<tlb_channel_mode> {
+ public:
+  struct Received {
+    std::vector<uint64_t> values;
+    size_t calls = 0;
+  };
+
+  static void OnMessages(const void *messages, size_t count, void *userdata) {
+    Received *received = static_cast<Received *>(userdata);
+    const uint64_t *values = static_cast<const uint64_t *>(messages);
+    received->values.insert(received->values.end(), values, values + count);
+    received->calls++;
+  }
+
+  void SetUp() override {
+    channel = tlb_channel_new(test_allocator(), GetParam(), kCapacity, sizeof(uint64_t));
+    ASSERT_NE(nullptr, channel);
+    loop = tlb_evl_new(test_allocator());
+    ASSERT_NE(nullptr, loop);
+  }
+
+  void TearDown() override {
+    tlb_evl_destroy(loop);
+    tlb_channel_destroy(channel);
+  }
+
+  bool Readable() {
+    pollfd fd = {tlb_channel_fd(channel), POLLIN, 0};
+    return poll(&fd, 1, 0) == 1;
+  }
+
+  tlb_channel *channel = nullptr;
+  tlb_event_loop *loop = nullptr;
+};
+
+TEST_P(ChannelTest, SendReceive) {
+  EXPECT_FALSE(Readable());
+  for (uint64_t ii = 0; ii < kCapacity; ++ii) {
+    ASSERT_EQ(0, tlb_channel_send(channel, &ii));
+  }
+  const uint64_t extra = kCapacity;
+  EXPECT_EQ(-1, tlb_channel_send(channel, &extra));
+  EXPECT_EQ(EAGAIN, errno);
+  EXPECT_TRUE(Readable());
+
+  // In order, and only cleared once it's been found empty
+  uint64_t values[kCapacity];
+  ASSERT_EQ(kCapacity, tlb_channel_receive(channel, values, kCapacity));
+  for (uint64_t ii = 0; ii < kCapacity; ++ii) {
+    EXPECT_EQ(ii, values[ii]);
+  }
+  EXPECT_TRUE(Readable());
+  EXPECT_EQ(0U, tlb_channel_receive(channel, values, kCapacity));
+  EXPECT_FALSE(Readable());
+
+  // Wraps around
+  ASSERT_EQ(0, tlb_channel_send(channel, &extra));
+  EXPECT_TRUE(Readable());
+  ASSERT_EQ(1U, tlb_channel_receive(channel, values, kCapacity));
+  EXPECT_EQ(extra, values[0]);
+}
+
+TEST_P(ChannelTest, Batch) {
+  std::vector<uint64_t> values(kCapacity * 2);
+  for (uint64_t ii = 0; ii < values.size(); ++ii) {
+    values[ii] = ii;
+  }
+  EXPECT_EQ(kCapacity, tlb_channel_send_batch(channel, values.data(), values.size()));
+  EXPECT_EQ(0U, tlb_channel_send_batch(channel, values.data(), values.size()));
+
+  std::vector<uint64_t> received(kCapacity);
+  EXPECT_EQ(kCapacity / 2, tlb_channel_receive(channel, received.data(), kCapacity / 2));
+  EXPECT_EQ(kCapacity / 2, tlb_channel_send_batch(channel, values.data() + kCapacity, values.size()));
+  EXPECT_EQ(kCapacity, tlb_channel_receive(channel, received.data(), kCapacity));
+  for (uint64_t ii = 0; ii < kCapacity; ++ii) {
+    EXPECT_EQ(ii + kCapacity / 2, received[ii]);
+  }
+}
+
+TEST_P(ChannelTest, Subscribe) {
+  Received received;
+  tlb_handle sub = tlb_channel_subscribe(loop, channel, OnMessages, &received);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+
+  // Drained in a single batch
+  for (uint64_t ii = 0; ii < kCapacity / 2; ++ii) {
+    ASSERT_EQ(0, tlb_channel_send(channel, &ii));
+  }
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(1U, received.calls);
+  ASSERT_EQ(kCapacity / 2, received.values.size());
+  for (uint64_t ii = 0; ii < kCapacity / 2; ++ii) {
+    EXPECT_EQ(ii, received.values[ii]);
+  }
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_P(ChannelTest, Requeued) {
+  Received received;
+  tlb_handle sub = tlb_channel_subscribe(loop, channel, OnMessages, &received);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  // A full channel's worth is as much as a single call handles, then it goes back on the ready queue
+  std::vector<uint64_t> values(kCapacity, 1);
+  ASSERT_EQ(kCapacity, tlb_channel_send_batch(channel, values.data(), values.size()));
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(kCapacity, received.values.size());
+  EXPECT_EQ(1U, tlb_evl_requeued_count(loop));
+
+  ASSERT_EQ(2U, tlb_channel_send_batch(channel, values.data(), 2));
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, TLB_WAIT_NONE));
+  EXPECT_EQ(kCapacity + 2, received.values.size());
+  EXPECT_EQ(0U, tlb_evl_requeued_count(loop));
+  EXPECT_FALSE(Readable());
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_P(ChannelTest, Threads) {
+  const size_t producers = GetParam() == TLB_CHANNEL_SPSC ? 1 : 4;
+  constexpr uint64_t kMessages = 50000;
+  Received received;
+  tlb_handle sub = tlb_channel_subscribe(loop, channel, OnMessages, &received);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  std::vector<std::thread> threads;
+  for (size_t producer = 0; producer < producers; ++producer) {
+    threads.emplace_back([this, producer]() {
+      for (uint64_t ii = 0; ii < kMessages;) {
+        const uint64_t value = (producer << 32U) | ii;
+        if (tlb_channel_send(channel, &value) == 0) {
+          ii++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Each producer's messages arrive in order, and the consumer never misses a wakeup
+  while (received.values.size() < producers * kMessages) {
+    ASSERT_LE(0, tlb_evl_handle_events(loop, 0, 1000));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  std::vector<uint64_t> next(producers, 0);
+  for (uint64_t value : received.values) {
+    const size_t producer = value >> 32U;
+    ASSERT_LT(producer, producers);
+    ASSERT_EQ(next[producer], value & 0xFFFFFFFFU);
+    next[producer]++;
+  }
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+INSTANTIATE_TEST_SUITE_P(Spsc, ChannelTest, ::testing::Values(TLB_CHANNEL_SPSC));
+INSTANTIATE_TEST_SUITE_P(Mpmc, ChannelTest, ::testing::Values(TLB_CHANNEL_MPMC));
+
+TEST(ChannelInvalidTest, Invalid) {
+  EXPECT_EQ(nullptr, tlb_channel_new(test_allocator(), TLB_CHANNEL_MPMC, 0, sizeof(void *)));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(nullptr, tlb_channel_new(test_allocator(), TLB_CHANNEL_MPMC, kCapacity, 0));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(nullptr,
+            tlb_channel_new(test_allocator(), TLB_CHANNEL_SPSC, kCapacity, TLB_CHANNEL_MAX_MESSAGE_SIZE + 1));
+  EXPECT_EQ(EINVAL, errno);
+}
+
+}  // namespace
+}  // namespace tlb_test
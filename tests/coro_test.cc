@@ -0,0 +1,126 @@
+#include "tlb/coro.hpp"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.h"
+
+#ifdef TLB_HAS_CORO
+
+namespace tlb_test {
+namespace {
+
+class CoroTest : public TlbTest {
+ public:
+  void SetUp() override {
+    TlbTest::SetUp();
+
+    ASSERT_EQ(0, tlb_pipe_open(&pipe));
+  }
+
+  void TearDown() override {
+    TlbTest::TearDown();
+
+    tlb_pipe_close(&pipe);
+  }
+
+  void Done(int &counter) {
+    auto lock = this->lock();
+    counter++;
+    notify();
+  }
+
+  tlb_pipe pipe;
+};
+
+TEST_P(CoroTest, Readable) {
+  static constexpr size_t kReadCount = 10;
+  int done = 0;
+
+  auto reader = [](CoroTest *test, int *done) -> libtlb::coro::Task {
+    for (size_t ii = 0; ii < kReadCount; ++ii) {
+      const int events = co_await libtlb::coro::readable(test->loop(), test->pipe.fd_read);
+      EXPECT_TRUE(events & TLB_EV_READ);
+
+      uint64_t value = 0;
+      tlb_pipe_read(&test->pipe, &value);
+      EXPECT_EQ(ii, value);
+
+      if (ii + 1 < kReadCount) {
+        const uint64_t next = ii + 1;
+        tlb_pipe_write(&test->pipe, next);
+      }
+    }
+    test->Done(*done);
+  };
+  reader(this, &done);
+
+  const uint64_t first = 0;
+  tlb_pipe_write(&pipe, first);
+  wait([&]() { return done == 1; });
+}
+
+TEST_P(CoroTest, Writable) {
+  int done = 0;
+
+  auto writer = [](CoroTest *test, int *done) -> libtlb::coro::Task {
+    const int events = co_await libtlb::coro::writable(test->loop(), test->pipe.fd_write);
+    EXPECT_TRUE(events & TLB_EV_WRITE);
+    tlb_pipe_write(&test->pipe, s_test_value);
+    test->Done(*done);
+  };
+  writer(this, &done);
+
+  wait([&]() { return done == 1; });
+  uint64_t value = 0;
+  tlb_pipe_read(&pipe, &value);
+  EXPECT_EQ(s_test_value, value);
+}
+
+TEST_P(CoroTest, SleepFor) {
+  static constexpr int kSleepMs = 20;
+  int done = 0;
+
+  auto sleeper = [](CoroTest *test, int *done) -> libtlb::coro::Task {
+    const auto start = std::chrono::steady_clock::now();
+    co_await libtlb::coro::sleep_for(test->loop(), kSleepMs);
+    EXPECT_LE(std::chrono::milliseconds(kSleepMs), std::chrono::steady_clock::now() - start);
+
+    // A zero timeout still comes back around
+    co_await libtlb::coro::sleep_for(test->loop(), 0);
+    test->Done(*done);
+  };
+  sleeper(this, &done);
+
+  wait([&]() { return done == 1; });
+}
+
+TEST_P(CoroTest, ResumeOnSubLoop) {
+  int done = 0;
+  tlb_event_loop *sub_loop = tlb_evl_new(alloc());
+  ASSERT_NE(nullptr, sub_loop);
+  tlb_handle sub = tlb_evl_add_evl(loop(), sub_loop);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  auto mover = [](CoroTest *test, tlb_event_loop *sub_loop, int *done) -> libtlb::coro::Task {
+    co_await libtlb::coro::resume_on(sub_loop);
+    test->Done(*done);
+  };
+  mover(this, sub_loop, &done);
+
+  wait([&]() { return done == 1; });
+
+  Stop();
+  EXPECT_EQ(0, tlb_evl_remove(loop(), sub));
+  tlb_evl_destroy(sub_loop);
+  Restart();
+}
+
+TLB_INSTANTIATE_TEST(CoroTest);
+
+}  // namespace
+}  // namespace tlb_test
+
+#endif /* TLB_HAS_CORO */
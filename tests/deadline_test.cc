@@ -0,0 +1,129 @@
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kPipes = 200;
+constexpr uint64_t kNanosPerMilli = 1000000;
+constexpr uint64_t kSlice = 20 * kNanosPerMilli;
+// Claiming a full batch of the slow callbacks below would overshoot by 100ms
+constexpr uint64_t kOvershoot = 40 * kNanosPerMilli;
+
+class DeadlineTest : public LoopTest {
+ public:
+  DeadlineTest() : LoopTest(kPipes) {
+  }
+
+  // Every pipe stays readable, so each one fires on every poll
+  void SubscribeAll(tlb_event_loop *target, tlb_on_event *on_event, void *userdata) {
+    for (tlb_pipe &pipe : pipes) {
+      tlb_pipe_write(&pipe, s_test_value);
+      ASSERT_NE(TLB_HANDLE_INVALID, tlb_evl_add_fd(target, pipe.fd_read, TLB_EV_READ, false, on_event, userdata));
+    }
+  }
+};
+
+void Count(tlb_handle handle, int events, void *userdata) {
+  (*static_cast<size_t *>(userdata))++;
+}
+
+TEST_F(DeadlineTest, StopsWhenIdle) {
+  struct TestState {
+    tlb_pipe *pipe = nullptr;
+    size_t fired = 0;
+  } state;
+  state.pipe = &pipes[0];
+
+  tlb_handle sub = tlb_evl_add_fd(
+      loop, pipes[0].fd_read, TLB_EV_READ, false,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        uint64_t value;
+        tlb_pipe_read(state->pipe, &value);
+        state->fired++;
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  // Nothing is ready yet, so it gives up without waiting out the deadline
+  const uint64_t deadline_ns = tlb_evl_now_ns() + 10 * 1000 * kNanosPerMilli;
+  EXPECT_EQ(0, tlb_evl_handle_events_until(loop, deadline_ns, TLB_WAIT_NONE));
+
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events_until(loop, deadline_ns, TLB_WAIT_NONE));
+  EXPECT_EQ(1U, state.fired);
+  EXPECT_GT(deadline_ns, tlb_evl_now_ns());
+
+  // The first poll may wait for something to arrive
+  std::thread writer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    tlb_pipe_write(&pipes[0], s_test_value);
+  });
+  EXPECT_EQ(1, tlb_evl_handle_events_until(loop, deadline_ns, TLB_WAIT_INDEFINITE));
+  writer.join();
+  EXPECT_EQ(2U, state.fired);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(DeadlineTest, Deadline) {
+  size_t fired = 0;
+  SubscribeAll(
+      loop,
+      +[](tlb_handle handle, int events, void *userdata) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        Count(handle, events, userdata);
+      },
+      &fired);
+
+  // Always something ready, so it only stops at the deadline
+  const uint64_t deadline_ns = tlb_evl_now_ns() + kSlice;
+  const int handled = tlb_evl_handle_events_until(loop, deadline_ns, TLB_WAIT_NONE);
+  const uint64_t end_ns = tlb_evl_now_ns();
+
+  EXPECT_EQ(static_cast<size_t>(handled), fired);
+  EXPECT_LT(0, handled);
+  EXPECT_GT(static_cast<int>(kPipes), handled);
+  EXPECT_LE(deadline_ns, end_ns);
+  EXPECT_GT(deadline_ns + kOvershoot, end_ns);
+
+  // Past deadlines don't handle anything
+  EXPECT_EQ(0, tlb_evl_handle_events_until(loop, end_ns, TLB_WAIT_NONE));
+  EXPECT_EQ(static_cast<size_t>(handled), fired);
+}
+
+TEST_F(DeadlineTest, SubLoopSlice) {
+  tlb_event_loop *sub_loop = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, sub_loop);
+  size_t fired = 0;
+  SubscribeAll(sub_loop, Count, &fired);
+  tlb_handle sub = tlb_evl_add_evl(loop, sub_loop);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  // By default the parent only hands the sub-loop a single batch each time
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 1, TLB_WAIT_INDEFINITE));
+  EXPECT_LT(0U, fired);
+  EXPECT_GE(kPipes, fired);
+
+  // With a slice it keeps going until that's used up, however many batches that is
+  fired = 0;
+  tlb_evl_set_time_slice(sub_loop, kSlice);
+  const uint64_t start_ns = tlb_evl_now_ns();
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 1, TLB_WAIT_INDEFINITE));
+  EXPECT_LE(start_ns + kSlice, tlb_evl_now_ns());
+  EXPECT_LT(kPipes, fired);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  tlb_evl_destroy(sub_loop);
+}
+
+}  // namespace
+}  // namespace tlb_test
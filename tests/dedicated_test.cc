@@ -0,0 +1,168 @@
+#include "tlb/tlb.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#ifdef __linux__
+#  include <sched.h>
+#endif
+
+#include "test_helpers.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kThreads = 2;
+constexpr auto kWait = std::chrono::seconds(10);
+
+class DedicatedTest : public ::testing::Test {
+ public:
+  struct Calls {
+    std::mutex mtx;
+    std::condition_variable cnd;
+    size_t count = 0;
+    size_t worker = 0;
+    std::thread::id thread;
+    int cpu = -1;
+    tlb_pipe *pipe = nullptr;
+  };
+
+  static void OnRead(tlb_handle handle, int events, void *userdata) {
+    Calls *calls = static_cast<Calls *>(userdata);
+    uint64_t value;
+    tlb_pipe_read(calls->pipe, &value);
+    std::lock_guard<std::mutex> lock(calls->mtx);
+    calls->count++;
+    calls->worker = tlb_current_worker();
+    calls->thread = std::this_thread::get_id();
+#ifdef __linux__
+    calls->cpu = sched_getcpu();
+#endif
+    calls->cnd.notify_all();
+  }
+
+  void SetUp() override {
+    tlb_options options = {};
+    options.max_thread_count = kThreads;
+    tlb_inst = tlb_new(TlbTest::alloc(), options);
+    ASSERT_NE(nullptr, tlb_inst);
+    sub_loop = tlb_evl_new(TlbTest::alloc());
+    ASSERT_NE(nullptr, sub_loop);
+    ASSERT_EQ(0, tlb_pipe_open(&pipe));
+    calls.pipe = &pipe;
+    sub = tlb_evl_add_fd(sub_loop, pipe.fd_read, TLB_EV_READ, false, OnRead, &calls);
+    ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  }
+
+  void TearDown() override {
+    // The thread has to be gone before its loop
+    tlb_destroy(tlb_inst);
+    tlb_evl_remove(sub_loop, sub);
+    tlb_evl_destroy(sub_loop);
+    tlb_pipe_close(&pipe);
+  }
+
+  bool WaitFor(size_t count) {
+    std::unique_lock<std::mutex> lock(calls.mtx);
+    return calls.cnd.wait_for(lock, kWait, [&]() { return calls.count >= count; });
+  }
+
+  tlb *tlb_inst = nullptr;
+  tlb_event_loop *sub_loop = nullptr;
+  tlb_pipe pipe;
+  tlb_handle sub = TLB_HANDLE_INVALID;
+  Calls calls;
+};
+
+TEST_F(DedicatedTest, OwnThread) {
+  ASSERT_EQ(0, tlb_add_dedicated_evl(tlb_inst, sub_loop, TLB_CPU_ANY));
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+
+  tlb_pipe_write(&pipe, s_test_value);
+  ASSERT_TRUE(WaitFor(1));
+  tlb_pipe_write(&pipe, s_test_value);
+  ASSERT_TRUE(WaitFor(2));
+
+  std::lock_guard<std::mutex> lock(calls.mtx);
+  EXPECT_EQ(TLB_WORKER_NONE, calls.worker);
+  EXPECT_NE(std::this_thread::get_id(), calls.thread);
+  // Only the workers count as active threads
+  EXPECT_EQ(kThreads, tlb_active_threads(tlb_inst));
+}
+
+TEST_F(DedicatedTest, StopAndRestart) {
+  ASSERT_EQ(0, tlb_add_dedicated_evl(tlb_inst, sub_loop, TLB_CPU_ANY));
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+  tlb_pipe_write(&pipe, s_test_value);
+  ASSERT_TRUE(WaitFor(1));
+
+  // Events wait in the loop while it's stopped
+  ASSERT_EQ(0, tlb_stop(tlb_inst));
+  tlb_pipe_write(&pipe, s_test_value);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(1U, calls.count);
+
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+  ASSERT_TRUE(WaitFor(2));
+}
+
+TEST_F(DedicatedTest, AddAndRemoveWhileRunning) {
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+  ASSERT_EQ(0, tlb_add_dedicated_evl(tlb_inst, sub_loop, TLB_CPU_ANY));
+  tlb_pipe_write(&pipe, s_test_value);
+  ASSERT_TRUE(WaitFor(1));
+
+  // The loop and its subscriptions are left alone, and can be run by hand again
+  ASSERT_EQ(0, tlb_remove_dedicated_evl(tlb_inst, sub_loop));
+  tlb_pipe_write(&pipe, s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(sub_loop, 0, 1000));
+  EXPECT_EQ(2U, calls.count);
+  EXPECT_EQ(std::this_thread::get_id(), calls.thread);
+}
+
+#ifdef __linux__
+TEST_F(DedicatedTest, Pinned) {
+  const int cpu = sched_getcpu();
+  ASSERT_LE(0, cpu);
+  ASSERT_EQ(0, tlb_add_dedicated_evl(tlb_inst, sub_loop, cpu));
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+
+  tlb_pipe_write(&pipe, s_test_value);
+  ASSERT_TRUE(WaitFor(1));
+  std::lock_guard<std::mutex> lock(calls.mtx);
+  EXPECT_EQ(cpu, calls.cpu);
+}
+
+TEST_F(DedicatedTest, PinFailed) {
+  // Not started yet, so it fails when it is
+  ASSERT_EQ(0, tlb_add_dedicated_evl(tlb_inst, sub_loop, CPU_SETSIZE));
+  EXPECT_EQ(-1, tlb_start(tlb_inst));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(0U, tlb_active_threads(tlb_inst));
+  ASSERT_EQ(0, tlb_remove_dedicated_evl(tlb_inst, sub_loop));
+
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+  EXPECT_EQ(-1, tlb_add_dedicated_evl(tlb_inst, sub_loop, CPU_SETSIZE));
+  EXPECT_EQ(EINVAL, errno);
+}
+#endif
+
+TEST_F(DedicatedTest, Invalid) {
+  EXPECT_EQ(-1, tlb_add_dedicated_evl(tlb_inst, sub_loop, -2));
+  EXPECT_EQ(EINVAL, errno);
+
+  ASSERT_EQ(0, tlb_add_dedicated_evl(tlb_inst, sub_loop, TLB_CPU_ANY));
+  EXPECT_EQ(-1, tlb_add_dedicated_evl(tlb_inst, sub_loop, TLB_CPU_ANY));
+  EXPECT_EQ(EEXIST, errno);
+
+  ASSERT_EQ(0, tlb_remove_dedicated_evl(tlb_inst, sub_loop));
+  EXPECT_EQ(-1, tlb_remove_dedicated_evl(tlb_inst, sub_loop));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+}  // namespace
+}  // namespace tlb_test
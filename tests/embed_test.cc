@@ -0,0 +1,104 @@
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <array>
+#include <thread>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kEvents = 8;
+
+class EmbedTest : public LoopTest {
+ public:
+  EmbedTest() : LoopTest(1) {
+  }
+
+  // What a host's own poller would do with the loop's fd
+  bool HostReadable(int timeout) {
+    struct pollfd host = {};
+    host.fd = tlb_evl_fd(loop);
+    host.events = POLLIN;
+    return ::poll(&host, 1, timeout) == 1 && (host.revents & POLLIN);
+  }
+};
+
+struct Calls {
+  size_t count = 0;
+  std::thread::id thread;
+};
+
+void Record(tlb_handle handle, int events, void *userdata) {
+  Calls *calls = static_cast<Calls *>(userdata);
+  calls->count++;
+  calls->thread = std::this_thread::get_id();
+}
+
+TEST_F(EmbedTest, PollThenDispatch) {
+  Calls calls;
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, Record, &calls);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  EXPECT_FALSE(HostReadable(0));
+
+  // Never drained, so it's reported again every time it's rearmed
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_TRUE(HostReadable(1000));
+
+  std::array<tlb_evl_event, kEvents> events;
+  ASSERT_EQ(1, tlb_evl_poll(loop, events.data(), events.size(), TLB_WAIT_NONE));
+  EXPECT_EQ(sub, events[0].handle);
+  EXPECT_EQ(TLB_EV_READ, events[0].events);
+  EXPECT_EQ(0U, calls.count);
+
+  // Disarmed until it's dispatched
+  EXPECT_FALSE(HostReadable(0));
+  EXPECT_EQ(0, tlb_evl_poll(loop, events.data() + 1, events.size() - 1, TLB_WAIT_NONE));
+
+  tlb_evl_dispatch(loop, events.data(), 1);
+  EXPECT_EQ(1U, calls.count);
+  EXPECT_TRUE(HostReadable(0));
+  ASSERT_EQ(1, tlb_evl_poll(loop, events.data(), events.size(), TLB_WAIT_NONE));
+  tlb_evl_dispatch(loop, events.data(), 1);
+  EXPECT_EQ(2U, calls.count);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(EmbedTest, DispatchOnAnotherThread) {
+  Calls calls;
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, Record, &calls);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  tlb_pipe_write(&pipes[0], s_test_value);
+
+  std::array<tlb_evl_event, kEvents> events;
+  ASSERT_EQ(1, tlb_evl_poll(loop, events.data(), events.size(), TLB_WAIT_INDEFINITE));
+  std::thread dispatcher([&]() { tlb_evl_dispatch(loop, events.data(), 1); });
+  const std::thread::id dispatcher_id = dispatcher.get_id();
+  dispatcher.join();
+
+  EXPECT_EQ(1U, calls.count);
+  EXPECT_EQ(dispatcher_id, calls.thread);
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(EmbedTest, RemovedBeforeDispatch) {
+  Calls calls;
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, Record, &calls);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  tlb_pipe_write(&pipes[0], s_test_value);
+
+  std::array<tlb_evl_event, kEvents> events;
+  ASSERT_EQ(1, tlb_evl_poll(loop, events.data(), events.size(), TLB_WAIT_INDEFINITE));
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+
+  // The handle is stale by the time it's dispatched, so it's dropped
+  tlb_evl_dispatch(loop, events.data(), 1);
+  EXPECT_EQ(0U, calls.count);
+}
+
+}  // namespace
+}  // namespace tlb_test
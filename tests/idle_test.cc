@@ -0,0 +1,210 @@
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+#include "tlb/rebalance.h"
+#include "tlb/strand.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kPipes = 100;
+constexpr int kTimeout = 50;
+// The wheel ticks every 10ms, and the loop only gets around to it once the timer fires
+constexpr auto kSlack = std::chrono::milliseconds(40);
+
+class IdleTest : public LoopTest {
+ public:
+  IdleTest() : LoopTest(kPipes) {
+  }
+};
+
+TEST_F(IdleTest, Expires) {
+  Counter counter;
+  tlb_handle sub = Add(0, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  const auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, sub, kTimeout));
+  while (counter.timeouts == 0 && std::chrono::steady_clock::now() < start + std::chrono::seconds(10)) {
+    Run(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(1U, counter.timeouts);
+  EXPECT_LE(start + std::chrono::milliseconds(kTimeout), counter.last_timeout);
+  EXPECT_GT(start + std::chrono::milliseconds(kTimeout) + kSlack, counter.last_timeout);
+
+  // Still idle, so it's reported again each timeout
+  Run(std::chrono::milliseconds(kTimeout * 3));
+  EXPECT_LE(3U, counter.timeouts);
+  EXPECT_GE(4U, counter.timeouts);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(IdleTest, ActivityResets) {
+  Counter counter;
+  tlb_handle sub = Add(0, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, sub, kTimeout));
+
+  for (size_t ii = 0; ii < 10; ++ii) {
+    tlb_pipe_write(&pipes[0], s_test_value);
+    Run(std::chrono::milliseconds(kTimeout / 5));
+  }
+  EXPECT_EQ(10U, counter.reads);
+  EXPECT_EQ(0U, counter.timeouts);
+
+  Run(std::chrono::milliseconds(kTimeout) + kSlack);
+  EXPECT_EQ(1U, counter.timeouts);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(IdleTest, Cleared) {
+  Counter counter;
+  tlb_handle sub = Add(0, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, sub, kTimeout));
+  ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, sub, 0));
+  Run(std::chrono::milliseconds(kTimeout * 2));
+  EXPECT_EQ(0U, counter.timeouts);
+
+  // Removed subscriptions are dropped from the wheel too
+  ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, sub, kTimeout));
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  Run(std::chrono::milliseconds(kTimeout * 2));
+  EXPECT_EQ(0U, counter.timeouts);
+}
+
+TEST_F(IdleTest, SharedTimer) {
+  std::vector<Counter> counters(kPipes);
+  std::vector<tlb_handle> subs;
+  for (size_t ii = 0; ii < kPipes; ++ii) {
+    subs.push_back(Add(ii, &counters[ii]));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+    ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, subs.back(), kTimeout));
+  }
+
+  // Every subscription shares the wheel's one timer
+  EXPECT_EQ(kPipes + 1, LiveSubscriptions());
+
+  Run(std::chrono::milliseconds(kTimeout) + kSlack);
+  for (const Counter &counter : counters) {
+    EXPECT_EQ(1U, counter.timeouts);
+  }
+  // And keeps it, rather than adding one for each tick
+  EXPECT_EQ(kPipes + 1, LiveSubscriptions());
+
+  for (tlb_handle sub : subs) {
+    EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  }
+}
+
+TEST_F(IdleTest, Rebalance) {
+  // Strand subscriptions never move, so all the rebalancer can pick is the wheel's timer
+  tlb_strand *strand = tlb_strand_new(loop);
+  ASSERT_NE(nullptr, strand);
+  Counter busy;
+  busy.pipe = &pipes[0];
+  busy.drain = false;
+  tlb_pipe_write(&pipes[0], s_test_value);
+  tlb_handle busy_sub = tlb_strand_add_fd(strand, pipes[0].fd_read, TLB_EV_READ, false, Counter::Count, &busy);
+  ASSERT_NE(TLB_HANDLE_INVALID, busy_sub);
+  Counter counter;
+  counter.pipe = &pipes[1];
+  tlb_handle sub = tlb_strand_add_fd(strand, pipes[1].fd_read, TLB_EV_READ, false, Counter::Count, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, sub, kTimeout));
+
+  const auto start = std::chrono::steady_clock::now();
+  while (counter.timeouts == 0 && std::chrono::steady_clock::now() < start + std::chrono::seconds(10)) {
+    Run(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(1U, counter.timeouts);
+
+  tlb_event_loop *other = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, other);
+  std::array<tlb_event_loop *, 2> loops = {loop, other};
+  tlb_rebalance_options options = {};
+  options.on_migrate = +[](tlb_handle from_handle, tlb_event_loop *from, tlb_handle to_handle, tlb_event_loop *to,
+                           void *userdata) { ADD_FAILURE() << "Moved " << from_handle; };
+  EXPECT_EQ(0, tlb_evl_rebalance(loops.data(), loops.size(), &options));
+
+  // The wheel is still there to report it again each timeout
+  Run(std::chrono::milliseconds(kTimeout * 3));
+  EXPECT_LE(3U, counter.timeouts);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(0, tlb_evl_remove(loop, busy_sub));
+  tlb_strand_destroy(strand);
+  tlb_evl_destroy(other);
+}
+
+// Fails every allocation while failing is set
+struct FailingAllocator {
+  static void *Malloc(void *userdata, size_t size) {
+    return static_cast<FailingAllocator *>(userdata)->failing ? nullptr : malloc(size);
+  }
+
+  static void Free(void *userdata, void *buffer) {
+    free(buffer);
+  }
+
+  tlb_allocator::tlb_allocator_vtable vtable = {Malloc, nullptr, Free};
+  tlb_allocator alloc = {&vtable, this};
+  std::atomic<bool> failing = {false};
+};
+
+TEST_F(IdleTest, OutOfMemory) {
+  FailingAllocator failing;
+  tlb_event_loop *failing_loop = tlb_evl_new(&failing.alloc);
+  ASSERT_NE(nullptr, failing_loop);
+  std::swap(loop, failing_loop);
+
+  Counter counter;
+  tlb_handle sub = Add(0, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_idle_timeout(loop, sub, kTimeout));
+
+  // Filing a timeout under a tick that's never been used fails outright
+  Counter other;
+  tlb_handle other_sub = Add(1, &other);
+  ASSERT_NE(TLB_HANDLE_INVALID, other_sub);
+  failing.failing = true;
+  EXPECT_EQ(-1, tlb_evl_set_idle_timeout(loop, other_sub, kTimeout * 3));
+
+  // Expiring needs memory too, so it's held back rather than lost
+  Run(std::chrono::milliseconds(kTimeout) + kSlack);
+  EXPECT_EQ(0U, counter.timeouts);
+  failing.failing = false;
+  Run(kSlack);
+  EXPECT_EQ(1U, counter.timeouts);
+  EXPECT_EQ(0U, other.timeouts);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(0, tlb_evl_remove(loop, other_sub));
+  std::swap(loop, failing_loop);
+  tlb_evl_destroy(failing_loop);
+}
+
+TEST_F(IdleTest, Invalid) {
+  tlb_handle timer = tlb_evl_add_timer(
+      loop, 60 * 1000, +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
+  EXPECT_EQ(-1, tlb_evl_set_idle_timeout(loop, timer, kTimeout));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(0, tlb_evl_remove(loop, timer));
+
+  EXPECT_EQ(-1, tlb_evl_set_idle_timeout(loop, timer, kTimeout));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,266 @@
+#include "tlb/io.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/metrics.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+
+class IoTest : public LoopTest {
+ public:
+  struct Completed {
+    std::vector<ssize_t> results;
+    std::thread::id thread;
+  };
+
+  static void OnIo(tlb_event_loop *loop, ssize_t result, void *userdata) {
+    Completed *completed = static_cast<Completed *>(userdata);
+    completed->results.push_back(result);
+    completed->thread = std::this_thread::get_id();
+  }
+
+  // Handles events until count operations have completed
+  void Wait(const Completed &completed, size_t count) {
+    for (int ii = 0; ii < 100 && completed.results.size() < count; ++ii) {
+      ASSERT_LE(0, tlb_evl_handle_events(loop, 0, 100));
+    }
+    ASSERT_EQ(count, completed.results.size());
+  }
+};
+
+TEST_F(IoTest, Socket) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+
+  // Nothing happens until there's something to receive, and a send in the other direction doesn't get in the way
+  Completed received;
+  char buffer[16] = {};
+  ASSERT_EQ(0, tlb_evl_recv(loop, fds[0], buffer, sizeof(buffer), 0, OnIo, &received));
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+  Completed sent;
+  ASSERT_EQ(0, tlb_evl_send(loop, fds[0], "ping", 4, 0, OnIo, &sent));
+  Wait(sent, 1);
+  EXPECT_EQ(4, sent.results[0]);
+  EXPECT_TRUE(received.results.empty());
+  char ping[4];
+  ASSERT_EQ(4, read(fds[1], ping, sizeof(ping)));
+
+  ASSERT_EQ(5, write(fds[1], "hello", 5));
+  Wait(received, 1);
+  EXPECT_EQ(5, received.results[0]);
+  EXPECT_EQ("hello", std::string(buffer));
+  EXPECT_EQ(std::this_thread::get_id(), received.thread);
+
+  // Completes once, and end of stream is a result like any other
+  close(fds[1]);
+  ASSERT_EQ(0, tlb_evl_read(loop, fds[0], buffer, sizeof(buffer), TLB_IO_POSITION, OnIo, &received));
+  Wait(received, 2);
+  EXPECT_EQ(0, received.results[1]);
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+  close(fds[0]);
+}
+
+TEST_F(IoTest, Chained) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+
+  const std::string name = "/tlb_test." + std::to_string(getpid()) + ".io";
+  ASSERT_EQ(0, tlb_evl_metrics_enable(loop, name.c_str()));
+
+  // Each receive starts the next from its callback, and the fd stays subscribed throughout rather than being added and
+  // removed again for every one of them
+  constexpr size_t kReceives = 100;
+  struct TestState {
+    static void OnReceived(tlb_event_loop *loop, ssize_t result, void *userdata) {
+      TestState *state = static_cast<TestState *>(userdata);
+      ASSERT_EQ(1, result);
+      if (++state->received < kReceives) {
+        ASSERT_EQ(0, tlb_evl_recv(loop, state->fd, state->buffer, sizeof(state->buffer), 0, OnReceived, state));
+      }
+    }
+
+    int fd;
+    char buffer[1];
+    size_t received = 0;
+  } state = {fds[0]};
+  ASSERT_EQ(0, tlb_evl_recv(loop, fds[0], state.buffer, sizeof(state.buffer), 0, TestState::OnReceived, &state));
+  EXPECT_EQ(1U, LiveSubscriptions());
+
+  // Going the other way shares it too, and only one operation may go each way at a time
+  Completed sent;
+  ASSERT_EQ(0, tlb_evl_send(loop, fds[0], "x", 1, 0, OnIo, &sent));
+  EXPECT_EQ(1U, LiveSubscriptions());
+  EXPECT_EQ(-1, tlb_evl_recv(loop, fds[0], state.buffer, sizeof(state.buffer), 0, OnIo, &sent));
+  EXPECT_EQ(EBUSY, errno);
+  Wait(sent, 1);
+  EXPECT_EQ(1, sent.results[0]);
+
+  const std::string data(kReceives, 'x');
+  ASSERT_EQ(static_cast<ssize_t>(data.size()), write(fds[1], data.data(), data.size()));
+  for (int ii = 0; ii < 1000 && state.received < kReceives; ++ii) {
+    ASSERT_LE(0, tlb_evl_handle_events(loop, 0, 100));
+    EXPECT_GE(1U, LiveSubscriptions());
+  }
+  EXPECT_EQ(kReceives, state.received);
+  // Removed once there's nothing left to do
+  EXPECT_EQ(0U, LiveSubscriptions());
+  tlb_metrics_values total = {};
+  ASSERT_EQ(0, tlb_metrics_read(name.c_str(), nullptr, &total, nullptr, 0));
+  EXPECT_EQ(1U, total.values[TLB_METRIC_SUBSCRIBED]);
+  tlb_evl_metrics_disable(loop);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(IoTest, AlreadySubscribed) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+
+  // Operations run alongside the fd's own subscription, which still gets its events afterwards
+  Counter reader = {loop};
+  reader.drain = false;
+  tlb_handle sub = tlb_evl_add_fd(loop, fds[0], TLB_EV_READ, false, Counter::Count, &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  Completed received;
+  char buffer[16] = {};
+  ASSERT_EQ(0, tlb_evl_recv(loop, fds[0], buffer, sizeof(buffer), 0, OnIo, &received));
+  ASSERT_EQ(5, write(fds[1], "hello", 5));
+  Wait(received, 1);
+  EXPECT_EQ(5, received.results[0]);
+
+  ASSERT_EQ(5, write(fds[1], "again", 5));
+  for (int ii = 0; ii < 100 && reader.calls == 0; ++ii) {
+    ASSERT_LE(0, tlb_evl_handle_events(loop, 0, 10));
+  }
+  EXPECT_LT(0U, reader.calls);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(IoTest, Accept) {
+  int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  ASSERT_NE(-1, listener);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len = sizeof(addr);
+  ASSERT_EQ(0, bind(listener, reinterpret_cast<sockaddr *>(&addr), addr_len));
+  ASSERT_EQ(0, listen(listener, 1));
+  ASSERT_EQ(0, getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &addr_len));
+
+  Completed accepted;
+  ASSERT_EQ(0, tlb_evl_accept(loop, listener, OnIo, &accepted));
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(0, connect(client, reinterpret_cast<sockaddr *>(&addr), addr_len));
+  Wait(accepted, 1);
+  ASSERT_LE(0, accepted.results[0]);
+  const int fd = static_cast<int>(accepted.results[0]);
+  EXPECT_TRUE(fcntl(fd, F_GETFL) & O_NONBLOCK);
+  EXPECT_TRUE(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+
+  close(fd);
+  close(client);
+  close(listener);
+}
+
+TEST_F(IoTest, File) {
+  FILE *file = tmpfile();
+  ASSERT_NE(nullptr, file);
+  const int fd = fileno(file);
+
+  // Run by the loop's threads, but completed by whoever handles it
+  Completed written;
+  const std::string data = "0123456789";
+  ASSERT_EQ(0, tlb_evl_write(loop, fd, data.data(), data.size(), 0, OnIo, &written));
+  Wait(written, 1);
+  EXPECT_EQ(std::this_thread::get_id(), written.thread);
+  ASSERT_EQ(0, tlb_evl_write(loop, fd, "ab", 2, 4, OnIo, &written));
+  Wait(written, 2);
+  EXPECT_EQ(2, written.results[1]);
+
+  Completed read;
+  char buffer[16] = {};
+  ASSERT_EQ(0, tlb_evl_read(loop, fd, buffer, sizeof(buffer), 0, OnIo, &read));
+  Wait(read, 1);
+  ASSERT_EQ(static_cast<ssize_t>(data.size()), read.results[0]);
+  EXPECT_EQ("0123ab6789", std::string(buffer));
+  ASSERT_EQ(0, tlb_evl_read(loop, fd, buffer, sizeof(buffer), data.size(), OnIo, &read));
+  Wait(read, 2);
+  EXPECT_EQ(0, read.results[1]);
+
+  // Failures are passed as -errno
+  ASSERT_EQ(0, tlb_evl_read(loop, fd, buffer, sizeof(buffer), -2, OnIo, &read));
+  Wait(read, 3);
+  EXPECT_EQ(-EINVAL, read.results[2]);
+
+  fclose(file);
+}
+
+TEST_F(IoTest, ManyFiles) {
+  FILE *file = tmpfile();
+  ASSERT_NE(nullptr, file);
+  const int fd = fileno(file);
+  ASSERT_EQ(1, write(fd, "x", 1));
+
+  // More than there are threads, all in flight at once
+  constexpr size_t kReads = 64;
+  Completed read;
+  std::vector<char> buffers(kReads);
+  for (size_t ii = 0; ii < kReads; ++ii) {
+    ASSERT_EQ(0, tlb_evl_read(loop, fd, &buffers[ii], 1, 0, OnIo, &read));
+  }
+  Wait(read, kReads);
+  for (size_t ii = 0; ii < kReads; ++ii) {
+    EXPECT_EQ(1, read.results[ii]);
+    EXPECT_EQ('x', buffers[ii]);
+  }
+
+  fclose(file);
+}
+
+TEST_F(IoTest, Destroyed) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+  FILE *file = tmpfile();
+  ASSERT_NE(nullptr, file);
+
+  // Dropped without their callbacks
+  Completed completed;
+  char buffer[16];
+  ASSERT_EQ(0, tlb_evl_recv(loop, fds[0], buffer, sizeof(buffer), 0, OnIo, &completed));
+  ASSERT_EQ(0, tlb_evl_read(loop, fileno(file), buffer, sizeof(buffer), 0, OnIo, &completed));
+  tlb_evl_destroy(loop);
+  loop = tlb_evl_new(test_allocator());
+  EXPECT_TRUE(completed.results.empty());
+
+  fclose(file);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(IoTest, Invalid) {
+  Completed completed;
+  char buffer[16];
+  EXPECT_EQ(-1, tlb_evl_read(loop, -1, buffer, sizeof(buffer), TLB_IO_POSITION, OnIo, &completed));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(-1, tlb_evl_recv(loop, 0, buffer, sizeof(buffer), 0, nullptr, &completed));
+  EXPECT_EQ(EINVAL, errno);
+}
+
+}  // namespace
+}  // namespace tlb_test
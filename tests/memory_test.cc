@@ -0,0 +1,185 @@
+#include "tlb/allocator.h"
+#include "tlb/event_loop.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <thread>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kThreads = 8;
+constexpr size_t kAllocations = 1000;
+constexpr size_t kTimers = 300;
+
+class MemoryTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    tracking = tlb_tracking_allocator_new(test_allocator());
+    ASSERT_NE(nullptr, tracking);
+  }
+
+  void TearDown() override {
+    tlb_tracking_allocator_destroy(tracking);
+  }
+
+  tlb_memory_stats Stats() {
+    tlb_memory_stats stats;
+    EXPECT_EQ(0, tlb_tracking_allocator_stats(tracking, &stats));
+    return stats;
+  }
+
+  tlb_allocator *tracking = nullptr;
+};
+
+TEST_F(MemoryTest, NotTracking) {
+  tlb_memory_stats stats;
+  EXPECT_EQ(-1, tlb_tracking_allocator_stats(test_allocator(), &stats));
+  EXPECT_EQ(EINVAL, errno);
+}
+
+TEST_F(MemoryTest, Counts) {
+  void *small = tlb_malloc(tracking, 24);
+  void *large = tlb_calloc(tracking, 10, 100);
+  ASSERT_NE(nullptr, small);
+  ASSERT_NE(nullptr, large);
+  EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(large) % alignof(std::max_align_t));
+  EXPECT_EQ(0, memcmp(large, std::vector<uint8_t>(1000).data(), 1000));
+
+  tlb_memory_stats stats = Stats();
+  EXPECT_EQ(1024U, stats.live_bytes);
+  EXPECT_EQ(1024U, stats.peak_bytes);
+  EXPECT_EQ(2U, stats.allocations);
+  EXPECT_EQ(0U, stats.frees);
+  EXPECT_EQ(1U, stats.size_classes[5]);   // 24 <= 32
+  EXPECT_EQ(1U, stats.size_classes[10]); // 1000 <= 1024
+
+  tlb_free(tracking, large);
+  tlb_free(tracking, small);
+
+  stats = Stats();
+  EXPECT_EQ(0U, stats.live_bytes);
+  EXPECT_EQ(1024U, stats.peak_bytes);
+  EXPECT_EQ(2U, stats.frees);
+}
+
+TEST_F(MemoryTest, Threads) {
+  std::vector<std::thread> threads;
+  for (size_t ii = 0; ii < kThreads; ++ii) {
+    threads.emplace_back([this]() {
+      std::vector<void *> buffers;
+      for (size_t jj = 0; jj < kAllocations; ++jj) {
+        buffers.push_back(tlb_malloc(tracking, 128));
+      }
+      // Leave half of them for another thread to free
+      for (size_t jj = 0; jj < kAllocations / 2; ++jj) {
+        tlb_free(tracking, buffers[jj]);
+      }
+      buffers.erase(buffers.begin(), buffers.begin() + kAllocations / 2);
+      std::thread([&]() {
+        for (void *buffer : buffers) {
+          tlb_free(tracking, buffer);
+        }
+      }).join();
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  const tlb_memory_stats stats = Stats();
+  EXPECT_EQ(0U, stats.live_bytes);
+  EXPECT_LE(kAllocations * 128, stats.peak_bytes);
+  EXPECT_EQ(kThreads * kAllocations, stats.allocations);
+  EXPECT_EQ(kThreads * kAllocations, stats.frees);
+  EXPECT_EQ(kThreads * kAllocations, stats.size_classes[7]);
+}
+
+TEST_F(MemoryTest, LoopUsage) {
+  tlb_event_loop *loop = tlb_evl_new(tracking);
+  ASSERT_NE(nullptr, loop);
+
+  tlb_evl_memory usage;
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(0U, usage.slots_reserved);
+  EXPECT_EQ(0U, usage.slots_live);
+  EXPECT_TRUE(usage.allocator_tracked);
+  EXPECT_LE(usage.loop_bytes, usage.allocator.live_bytes);
+  const size_t empty_bytes = usage.loop_bytes;
+
+  std::vector<tlb_handle> timers;
+  for (size_t ii = 0; ii < kTimers; ++ii) {
+    timers.push_back(tlb_evl_add_timer(
+        loop, 60 * 1000, +[](tlb_handle handle, int events, void *userdata) {}, nullptr));
+    ASSERT_NE(TLB_HANDLE_INVALID, timers.back());
+  }
+
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(kTimers, usage.slots_live);
+  EXPECT_LE(kTimers, usage.slots_reserved);
+  EXPECT_EQ(0U, usage.slots_extended);
+  EXPECT_LE(empty_bytes + (usage.slots_reserved * usage.slot_bytes), usage.loop_bytes);
+  EXPECT_LE(usage.loop_bytes, usage.allocator.live_bytes);
+
+  for (tlb_handle timer : timers) {
+    EXPECT_EQ(0, tlb_evl_remove(loop, timer));
+  }
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(0U, usage.slots_live);
+  EXPECT_LE(kTimers, usage.slots_reserved);
+
+  tlb_evl_destroy(loop);
+  EXPECT_EQ(0U, Stats().live_bytes);
+}
+
+TEST_F(MemoryTest, Extended) {
+  tlb_event_loop *loop = tlb_evl_new(tracking);
+  ASSERT_NE(nullptr, loop);
+
+  tlb_evl_memory usage;
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  // Slots only hold what every subscription needs
+  EXPECT_GE(128U, usage.slot_bytes);
+
+  const tlb_handle plain = tlb_evl_add_timer(
+      loop, 60 * 1000, +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, plain);
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(0U, usage.slots_extended);
+  const size_t plain_bytes = usage.loop_bytes;
+
+  const uint64_t data = 42;
+  const tlb_handle inlined = tlb_evl_add_timer_inline(
+      loop, 60 * 1000, +[](tlb_handle handle, int events, void *userdata) {}, &data, sizeof(data), nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, inlined);
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(1U, usage.slots_extended);
+  EXPECT_LT(plain_bytes, usage.loop_bytes);
+  EXPECT_LE(usage.loop_bytes, usage.allocator.live_bytes);
+
+  // Kept for the slot's next use
+  EXPECT_EQ(0, tlb_evl_remove(loop, inlined));
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(1U, usage.slots_extended);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, plain));
+  tlb_evl_destroy(loop);
+  EXPECT_EQ(0U, Stats().live_bytes);
+}
+
+TEST_F(MemoryTest, Untracked) {
+  tlb_event_loop *loop = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, loop);
+
+  tlb_evl_memory usage;
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_FALSE(usage.allocator_tracked);
+  EXPECT_LE(sizeof(void *), usage.loop_bytes);
+
+  tlb_evl_destroy(loop);
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,240 @@
+#include "tlb/metrics.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+#include "tlb/tlb.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kPipes = 8;
+constexpr size_t kThreads = 4;
+constexpr size_t kRounds = 100;
+
+// Unique per process, as tests run in parallel
+std::string MetricsName(const char *suffix) {
+  return "/tlb_test." + std::to_string(getpid()) + "." + suffix;
+}
+
+class MetricsTest : public LoopTest {
+ public:
+  MetricsTest() : LoopTest(kPipes) {
+  }
+
+  tlb_metrics_values Read(const std::string &name, tlb_metrics_info *info = nullptr) {
+    tlb_metrics_values total = {};
+    EXPECT_EQ(0, tlb_metrics_read(name.c_str(), info, &total, nullptr, 0)) << strerror(errno);
+    return total;
+  }
+
+  int64_t Publisher(const std::string &name) {
+    tlb_metrics_info info = {};
+    Read(name, &info);
+    return info.pid;
+  }
+
+  std::atomic<size_t> fired = {0};
+};
+
+// Always readable, so every pipe fires on every poll
+void Count(tlb_handle handle, int events, void *userdata) {
+  static_cast<std::atomic<size_t> *>(userdata)->fetch_add(1);
+}
+
+TEST_F(MetricsTest, Loop) {
+  const std::string name = MetricsName("loop");
+  ASSERT_EQ(0, tlb_evl_metrics_enable(loop, name.c_str()));
+
+  tlb_metrics_info info = {};
+  tlb_metrics_values total = Read(name, &info);
+  EXPECT_EQ(TLB_METRICS_LOOP, info.kind);
+  EXPECT_EQ(static_cast<int64_t>(getpid()), info.pid);
+  EXPECT_LT(0U, info.record_count);
+  for (uint64_t value : total.values) {
+    EXPECT_EQ(0U, value);
+  }
+
+  std::vector<tlb_handle> subs;
+  for (tlb_pipe &pipe : pipes) {
+    tlb_pipe_write(&pipe, s_test_value);
+    subs.push_back(tlb_evl_add_fd(loop, pipe.fd_read, TLB_EV_READ, false, Count, &fired));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+  }
+  for (size_t ii = 0; ii < kRounds; ++ii) {
+    EXPECT_EQ(static_cast<int>(kPipes), tlb_evl_handle_events(loop, 0, TLB_WAIT_NONE));
+  }
+
+  total = Read(name);
+  EXPECT_EQ(fired.load(), total.values[TLB_METRIC_DISPATCHES]);
+  EXPECT_EQ(fired.load(), total.values[TLB_METRIC_REARMS]);
+  EXPECT_EQ(kRounds, total.values[TLB_METRIC_WAKEUPS]);
+  EXPECT_EQ(kPipes, total.values[TLB_METRIC_SUBSCRIBED] - total.values[TLB_METRIC_UNSUBSCRIBED]);
+  EXPECT_LT(0U, total.values[TLB_METRIC_BUSY_NS]);
+
+  for (tlb_handle sub : subs) {
+    EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  }
+  total = Read(name);
+  EXPECT_EQ(kPipes, total.values[TLB_METRIC_UNSUBSCRIBED]);
+
+  tlb_evl_metrics_disable(loop);
+  EXPECT_EQ(-1, tlb_metrics_read(name.c_str(), nullptr, nullptr, nullptr, 0));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_F(MetricsTest, Threads) {
+  const std::string name = MetricsName("threads");
+  ASSERT_EQ(0, tlb_evl_metrics_enable(loop, name.c_str()));
+
+  std::vector<tlb_handle> subs;
+  for (tlb_pipe &pipe : pipes) {
+    tlb_pipe_write(&pipe, s_test_value);
+    subs.push_back(tlb_evl_add_fd(loop, pipe.fd_read, TLB_EV_READ, false, Count, &fired));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+  }
+
+  // A reader racing the writers only ever sees counts that go up
+  std::atomic<bool> running = {true};
+  std::thread reader([&]() {
+    uint64_t last = 0;
+    while (running) {
+      tlb_metrics_values total = {};
+      ASSERT_EQ(0, tlb_metrics_read(name.c_str(), nullptr, &total, nullptr, 0));
+      EXPECT_LE(last, total.values[TLB_METRIC_DISPATCHES]);
+      last = total.values[TLB_METRIC_DISPATCHES];
+    }
+  });
+
+  std::vector<std::thread> threads;
+  for (size_t ii = 0; ii < kThreads; ++ii) {
+    threads.emplace_back([&]() {
+      for (size_t round = 0; round < kRounds; ++round) {
+        tlb_evl_handle_events(loop, 0, 1);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  running = false;
+  reader.join();
+
+  // Each thread only wrote its own record, and none of them were lost
+  const tlb_metrics_values total = Read(name);
+  EXPECT_EQ(fired.load(), total.values[TLB_METRIC_DISPATCHES]);
+  EXPECT_EQ(fired.load(), total.values[TLB_METRIC_REARMS]);
+
+  for (tlb_handle sub : subs) {
+    EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  }
+}
+
+TEST_F(MetricsTest, Workers) {
+  tlb_options options = {};
+  options.max_thread_count = kThreads;
+  tlb *tlb_inst = tlb_new(TlbTest::alloc(), options);
+  ASSERT_NE(nullptr, tlb_inst);
+  const std::string name = MetricsName("workers");
+  ASSERT_EQ(0, tlb_metrics_enable(tlb_inst, name.c_str()));
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+
+  tlb_handle sub = tlb_evl_add_fd(
+      tlb_get_evl(tlb_inst), pipes[0].fd_read, TLB_EV_READ, false,
+      +[](tlb_handle handle, int events, void *userdata) {
+        MetricsTest *test = static_cast<MetricsTest *>(userdata);
+        uint64_t value;
+        tlb_pipe_read(&test->pipes[0], &value);
+        Count(handle, events, &test->fired);
+      },
+      this);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  for (size_t ii = 0; ii < kRounds; ++ii) {
+    tlb_pipe_write(&pipes[0], s_test_value);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (fired == ii && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+  }
+  ASSERT_EQ(kRounds, fired.load());
+  ASSERT_EQ(0, tlb_stop(tlb_inst));
+
+  tlb_metrics_info info = {};
+  std::array<tlb_metrics_values, kThreads> records;
+  tlb_metrics_values total = {};
+  ASSERT_EQ(0, tlb_metrics_read(name.c_str(), &info, &total, records.data(), records.size()));
+  EXPECT_EQ(TLB_METRICS_WORKERS, info.kind);
+  EXPECT_EQ(kThreads, info.record_count);
+  // Stopping each thread was an event of its own
+  EXPECT_EQ(kRounds + kThreads, total.values[TLB_METRIC_DISPATCHES]);
+  EXPECT_EQ(total.values[TLB_METRIC_DISPATCHES], total.values[TLB_METRIC_WAKEUPS]);
+  for (const tlb_metrics_values &record : records) {
+    EXPECT_LE(1U, record.values[TLB_METRIC_WAKEUPS]);
+  }
+
+  tlb_destroy(tlb_inst);
+  // Destroying it takes the name with it
+  EXPECT_EQ(-1, tlb_metrics_read(name.c_str(), nullptr, nullptr, nullptr, 0));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_F(MetricsTest, Invalid) {
+  EXPECT_EQ(-1, tlb_evl_metrics_enable(loop, "no/slashes/allowed"));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(-1, tlb_metrics_read(MetricsName("missing").c_str(), nullptr, nullptr, nullptr, 0));
+  EXPECT_EQ(ENOENT, errno);
+
+  // Republishing under the same name starts over
+  const std::string name = MetricsName("again");
+  ASSERT_EQ(0, tlb_evl_metrics_enable(loop, name.c_str()));
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, Count, &fired);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  EXPECT_EQ(1U, Read(name).values[TLB_METRIC_SUBSCRIBED]);
+  ASSERT_EQ(0, tlb_evl_metrics_enable(loop, name.c_str()));
+  EXPECT_EQ(0U, Read(name).values[TLB_METRIC_SUBSCRIBED]);
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(MetricsTest, Taken) {
+  const std::string name = MetricsName("taken");
+  ASSERT_EQ(0, tlb_evl_metrics_enable(loop, name.c_str()));
+
+  // Another loop can't take a name that's in use
+  tlb_event_loop *other = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, other);
+  EXPECT_EQ(-1, tlb_evl_metrics_enable(other, name.c_str()));
+  EXPECT_EQ(EEXIST, errno);
+  EXPECT_EQ(static_cast<int64_t>(getpid()), Publisher(name));
+  tlb_evl_metrics_disable(loop);
+
+  // But it can take over one left behind by a process that exited without unpublishing it
+  const pid_t child = fork();
+  ASSERT_NE(-1, child);
+  if (child == 0) {
+    tlb_event_loop *orphan = tlb_evl_new(test_allocator());
+    _exit(orphan && tlb_evl_metrics_enable(orphan, name.c_str()) == 0 ? 0 : 1);
+  }
+  int status = 0;
+  ASSERT_EQ(child, waitpid(child, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+  EXPECT_EQ(static_cast<int64_t>(child), Publisher(name));
+
+  ASSERT_EQ(0, tlb_evl_metrics_enable(other, name.c_str()));
+  EXPECT_EQ(static_cast<int64_t>(getpid()), Publisher(name));
+  tlb_evl_destroy(other);
+}
+
+}  // namespace
+}  // namespace tlb_test
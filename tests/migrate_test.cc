@@ -0,0 +1,263 @@
+#include "tlb/channel.h"
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+#include "tlb/rebalance.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kLoops = 3;
+constexpr size_t kPipes = 4;
+constexpr size_t kMigrations = 500;
+
+class MigrateTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    for (tlb_event_loop *&loop : loops) {
+      loop = tlb_evl_new(test_allocator());
+      ASSERT_NE(nullptr, loop);
+    }
+    for (tlb_pipe &pipe : pipes) {
+      ASSERT_EQ(0, tlb_pipe_open(&pipe));
+    }
+  }
+
+  void TearDown() override {
+    for (tlb_event_loop *loop : loops) {
+      tlb_evl_destroy(loop);
+    }
+    for (tlb_pipe &pipe : pipes) {
+      tlb_pipe_close(&pipe);
+    }
+  }
+
+  size_t LiveSubscriptions(tlb_event_loop *loop) {
+    tlb_evl_memory usage;
+    EXPECT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+    return usage.slots_live;
+  }
+
+  std::array<tlb_event_loop *, kLoops> loops;
+  std::array<tlb_pipe, kPipes> pipes;
+};
+
+TEST_F(MigrateTest, Idle) {
+  Counter counter;
+  counter.pipe = &pipes[0];
+  tlb_handle sub = tlb_evl_add_fd(loops[0], pipes[0].fd_read, TLB_EV_READ, false, Counter::Count, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  // The write lands before the move, but it's only reported by the new loop
+  tlb_pipe_write(&pipes[0], s_test_value);
+  tlb_handle moved = tlb_evl_migrate(sub, loops[0], loops[1]);
+  ASSERT_NE(TLB_HANDLE_INVALID, moved);
+
+  EXPECT_EQ(0, tlb_evl_handle_events(loops[0], 100, 0));
+  EXPECT_EQ(0U, counter.calls);
+  EXPECT_EQ(1, tlb_evl_handle_events(loops[1], 100, 0));
+  EXPECT_EQ(1U, counter.calls);
+
+  EXPECT_EQ(0U, LiveSubscriptions(loops[0]));
+  EXPECT_EQ(1U, LiveSubscriptions(loops[1]));
+  EXPECT_EQ(-1, tlb_evl_remove(loops[0], sub));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(0, tlb_evl_remove(loops[1], moved));
+}
+
+TEST_F(MigrateTest, FromCallback) {
+  struct TestState {
+    MigrateTest *test = nullptr;
+    tlb_handle moved = TLB_HANDLE_INVALID;
+    Counter counter;
+  } state;
+  state.test = this;
+  state.counter.pipe = &pipes[0];
+  state.counter.drain = false;
+
+  tlb_handle sub = tlb_evl_add_fd(
+      loops[0], pipes[0].fd_read, TLB_EV_READ, false,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        Counter::Count(handle, events, &state->counter);
+        if (state->moved == TLB_HANDLE_INVALID) {
+          // Move while running, and leave the byte in the pipe for the new loop to see
+          state->moved = tlb_evl_migrate(handle, state->test->loops[0], state->test->loops[1]);
+          EXPECT_NE(TLB_HANDLE_INVALID, state->moved);
+          EXPECT_EQ(-1, tlb_evl_modify(state->test->loops[0], handle, TLB_EV_READ));
+        } else {
+          state->counter.drain = true;
+        }
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(loops[0], 100, 0));
+  EXPECT_EQ(1U, state.counter.calls);
+  ASSERT_NE(TLB_HANDLE_INVALID, state.moved);
+  EXPECT_EQ(0U, LiveSubscriptions(loops[0]));
+
+  EXPECT_EQ(1, tlb_evl_handle_events(loops[1], 100, 0));
+  EXPECT_EQ(2U, state.counter.calls);
+  EXPECT_EQ(0, tlb_evl_remove(loops[1], state.moved));
+}
+
+TEST_F(MigrateTest, InlineData) {
+  struct Inline {
+    size_t *released;
+    uint64_t value;
+  };
+  size_t released = 0;
+  const Inline data = {&released, s_test_value};
+
+  tlb_handle sub = tlb_evl_add_fd_inline(
+      loops[0], pipes[0].fd_read, TLB_EV_READ, false,
+      +[](tlb_handle handle, int events, void *userdata) {
+        EXPECT_EQ(s_test_value, static_cast<Inline *>(userdata)->value);
+      },
+      &data, sizeof(data), +[](void *userdata) { (*static_cast<Inline *>(userdata)->released)++; });
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  tlb_handle moved = tlb_evl_migrate(sub, loops[0], loops[1]);
+  ASSERT_NE(TLB_HANDLE_INVALID, moved);
+  EXPECT_EQ(0U, released);
+
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(loops[1], 100, 0));
+
+  EXPECT_EQ(0, tlb_evl_remove(loops[1], moved));
+  EXPECT_EQ(1U, released);
+}
+
+TEST_F(MigrateTest, Invalid) {
+  tlb_handle timer = tlb_evl_add_timer(
+      loops[0], 60 * 1000, +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
+  EXPECT_EQ(TLB_HANDLE_INVALID, tlb_evl_migrate(timer, loops[0], loops[1]));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(0, tlb_evl_remove(loops[0], timer));
+
+  EXPECT_EQ(TLB_HANDLE_INVALID, tlb_evl_migrate(timer, loops[0], loops[1]));
+  EXPECT_EQ(ENOENT, errno);
+
+  // The library's own subscriptions stay where they were added
+  tlb_channel *channel = tlb_channel_new(test_allocator(), TLB_CHANNEL_SPSC, 16, sizeof(uint64_t));
+  ASSERT_NE(nullptr, channel);
+  tlb_handle consumer = tlb_channel_subscribe(
+      loops[0], channel, +[](const void *messages, size_t count, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, consumer);
+  EXPECT_EQ(TLB_HANDLE_INVALID, tlb_evl_migrate(consumer, loops[0], loops[1]));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(0, tlb_evl_remove(loops[0], consumer));
+  tlb_channel_destroy(channel);
+}
+
+TEST_F(MigrateTest, WhileRunning) {
+  struct TestState {
+    std::atomic<bool> inside = {false};
+    std::atomic<size_t> fired = {0};
+  } state;
+
+  // Always readable, so it fires on whichever loop it's on as often as it can
+  tlb_pipe_write(&pipes[0], s_test_value);
+  std::atomic<tlb_handle> sub = {tlb_evl_add_fd(
+      loops[0], pipes[0].fd_read, TLB_EV_READ, false,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        EXPECT_FALSE(state->inside.exchange(true));
+        std::this_thread::yield();
+        state->inside = false;
+        state->fired++;
+      },
+      &state)};
+  ASSERT_NE(TLB_HANDLE_INVALID, sub.load());
+
+  std::atomic<bool> running = {true};
+  std::vector<std::thread> threads;
+  for (size_t ii = 0; ii < 2; ++ii) {
+    for (tlb_event_loop *loop : {loops[0], loops[1]}) {
+      threads.emplace_back([&, loop]() {
+        while (running) {
+          tlb_evl_handle_events(loop, 100, 1);
+        }
+      });
+    }
+  }
+
+  // Each move waits for the last one to fire on its new loop, so plenty of them race a callback
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  size_t migrations = 0;
+  for (; migrations < kMigrations && std::chrono::steady_clock::now() < deadline; ++migrations) {
+    const size_t fired = state.fired;
+    while (state.fired == fired && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+    tlb_handle moved = tlb_evl_migrate(sub, loops[migrations % 2], loops[(migrations + 1) % 2]);
+    ASSERT_NE(TLB_HANDLE_INVALID, moved) << strerror(errno);
+    sub = moved;
+  }
+
+  running = false;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(kMigrations, migrations);
+  EXPECT_LE(kMigrations, state.fired.load());
+  EXPECT_EQ(1U, LiveSubscriptions(loops[migrations % 2]));
+  EXPECT_EQ(0U, LiveSubscriptions(loops[(migrations + 1) % 2]));
+  EXPECT_EQ(0, tlb_evl_remove(loops[migrations % 2], sub));
+}
+
+TEST_F(MigrateTest, Rebalance) {
+  // Every pipe is on the first loop and stays readable
+  std::array<Counter, kPipes> counters;
+  std::map<tlb_handle, tlb_event_loop *> subs;
+  for (size_t ii = 0; ii < kPipes; ++ii) {
+    counters[ii].pipe = &pipes[ii];
+    counters[ii].drain = false;
+    tlb_pipe_write(&pipes[ii], s_test_value);
+    tlb_handle sub = tlb_evl_add_fd(loops[0], pipes[ii].fd_read, TLB_EV_READ, false, Counter::Count, &counters[ii]);
+    ASSERT_NE(TLB_HANDLE_INVALID, sub);
+    subs[sub] = loops[0];
+  }
+  for (size_t ii = 0; ii < 10; ++ii) {
+    EXPECT_EQ(kPipes, tlb_evl_handle_events(loops[0], 100, 0));
+  }
+
+  tlb_rebalance_options options = {};
+  options.threshold = 0.25;
+  options.on_migrate = +[](tlb_handle from_handle, tlb_event_loop *from, tlb_handle to_handle, tlb_event_loop *to,
+                           void *userdata) {
+    auto &subs = *static_cast<std::map<tlb_handle, tlb_event_loop *> *>(userdata);
+    EXPECT_EQ(from, subs[from_handle]);
+    subs.erase(from_handle);
+    subs[to_handle] = to;
+  };
+  options.userdata = &subs;
+  EXPECT_EQ(2, tlb_evl_rebalance(loops.data(), loops.size(), &options));
+
+  EXPECT_EQ(2U, LiveSubscriptions(loops[0]));
+  EXPECT_EQ(1U, LiveSubscriptions(loops[1]));
+  EXPECT_EQ(1U, LiveSubscriptions(loops[2]));
+
+  // Nothing ran since, so there's no load to move
+  EXPECT_EQ(0, tlb_evl_rebalance(loops.data(), loops.size(), &options));
+
+  for (const auto &sub : subs) {
+    EXPECT_EQ(0, tlb_evl_remove(sub.second, sub.first));
+  }
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,152 @@
+#include "tlb/observer.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.h"
+#include <string>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+
+class ObserverTest : public LoopTest {
+ public:
+  ObserverTest() : LoopTest(1) {
+  }
+
+  struct Observed {
+    tlb_event_loop *loop = nullptr;
+    std::vector<std::string> calls;
+  };
+
+  static void OnPoll(const char *hook, tlb_event_loop *loop, int value, void *userdata) {
+    Observed *observed = static_cast<Observed *>(userdata);
+    EXPECT_EQ(observed->loop, loop);
+    observed->calls.push_back(std::string(hook) + " " + std::to_string(value));
+  }
+
+  static void OnSub(const char *hook, tlb_event_loop *loop, tlb_handle handle, const char *name, int events,
+                    void *userdata) {
+    Observed *observed = static_cast<Observed *>(userdata);
+    EXPECT_EQ(observed->loop, loop);
+    EXPECT_NE(TLB_HANDLE_INVALID, handle);
+    observed->calls.push_back(std::string(hook) + " " + name + " " + std::to_string(events));
+  }
+
+  void SetUp() override {
+    LoopTest::SetUp();
+    observed.loop = loop;
+
+    observer.on_poll_start = [](tlb_event_loop *loop, int value, void *userdata) {
+      OnPoll("poll start", loop, value, userdata);
+    };
+    observer.on_poll_end = [](tlb_event_loop *loop, int value, void *userdata) {
+      OnPoll("poll end", loop, value, userdata);
+    };
+    observer.on_dispatch_start = [](tlb_event_loop *loop, tlb_handle handle, const char *name, int events,
+                                    void *userdata) { OnSub("dispatch start", loop, handle, name, events, userdata); };
+    observer.on_dispatch_end = [](tlb_event_loop *loop, tlb_handle handle, const char *name, int events,
+                                  void *userdata) { OnSub("dispatch end", loop, handle, name, events, userdata); };
+    observer.on_rearm = [](tlb_event_loop *loop, tlb_handle handle, const char *name, int events, void *userdata) {
+      OnSub("rearm", loop, handle, name, events, userdata);
+    };
+    observer.userdata = &observed;
+  }
+
+  tlb_evl_observer observer = {};
+  Observed observed;
+};
+
+TEST_F(ObserverTest, Hooks) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, DrainPipe, &pipes[0]);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_name(loop, sub, "observed"));
+  ASSERT_EQ(0, tlb_evl_observe(loop, &observer));
+
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  const std::vector<std::string> expected = {
+      "poll start 1000", "poll end 1", "dispatch start observed 1", "dispatch end observed 1", "rearm observed 1",
+  };
+  EXPECT_EQ(expected, observed.calls);
+
+  // Removing them stops the calls
+  ASSERT_EQ(0, tlb_evl_observe(loop, nullptr));
+  observed.calls.clear();
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_TRUE(observed.calls.empty());
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(ObserverTest, Partial) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, DrainPipe, &pipes[0]);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  // Only the hooks that are set are called
+  observer.on_poll_start = nullptr;
+  observer.on_poll_end = nullptr;
+  observer.on_dispatch_end = nullptr;
+  ASSERT_EQ(0, tlb_evl_observe(loop, &observer));
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  const std::vector<std::string> expected = {"dispatch start fd 1", "rearm fd 1"};
+  EXPECT_EQ(expected, observed.calls);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(ObserverTest, Timer) {
+  ASSERT_EQ(0, tlb_evl_observe(loop, &observer));
+  tlb_handle timer = tlb_evl_add_timer(loop, 0, +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
+  ASSERT_EQ(0, tlb_evl_set_name(loop, timer, "timer"));
+
+  // Timers are removed rather than rearmed
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  const std::vector<std::string> expected = {
+      "poll start 1000", "poll end 1", "dispatch start timer 1", "dispatch end timer 1",
+  };
+  EXPECT_EQ(expected, observed.calls);
+}
+
+TEST_F(ObserverTest, Batch) {
+  std::vector<tlb_pipe> pipes(3);
+  std::vector<tlb_handle> subs;
+  for (tlb_pipe &batch_pipe : pipes) {
+    ASSERT_EQ(0, tlb_pipe_open(&batch_pipe));
+    subs.push_back(tlb_evl_add_fd_batch(
+        loop, batch_pipe.fd_read, TLB_EV_READ, false,
+        +[](const tlb_evl_batch_item *items, size_t count) {
+          for (size_t ii = 0; ii < count; ++ii) {
+            DrainPipe(items[ii].handle, items[ii].events, items[ii].userdata);
+          }
+        },
+        &batch_pipe));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+  }
+  ASSERT_EQ(0, tlb_evl_observe(loop, &observer));
+
+  // A single callback, but each one is rearmed
+  for (tlb_pipe &batch_pipe : pipes) {
+    tlb_pipe_write(&batch_pipe, s_test_value);
+  }
+  EXPECT_EQ((int)pipes.size(), tlb_evl_handle_events(loop, 0, 1000));
+  const std::vector<std::string> expected = {
+      "poll start 1000", "poll end 3", "dispatch start fd 1", "dispatch end fd 1", "rearm fd 1", "rearm fd 1",
+      "rearm fd 1",
+  };
+  EXPECT_EQ(expected, observed.calls);
+
+  for (size_t ii = 0; ii < pipes.size(); ++ii) {
+    EXPECT_EQ(0, tlb_evl_remove(loop, subs[ii]));
+    tlb_pipe_close(&pipes[ii]);
+  }
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -32,20 +32,27 @@ class PipeTest : public TlbTest {
     TlbTest::TearDown();
   }
 
-  tlb_handle SubscribeRead(tlb_on_event *on_event, void *userdata, bool edge_trigger = true) {
-    const tlb_handle handle = tlb_evl_add_fd(loop(), pipe.fd_read, TLB_EV_READ, edge_trigger, on_event, userdata);
+  tlb_handle Subscribe(int fd, int events, tlb_on_event *on_event, void *userdata, bool edge_trigger) {
+    // Hold the lock until the handle is tracked, the callback may try to unsubscribe it before add returns
+    std::lock_guard<std::mutex> guard(subscriptions_mutex);
+    const tlb_handle handle = tlb_evl_add_fd(loop(), fd, events, edge_trigger, on_event, userdata);
     open_subscriptions.emplace(handle);
     return handle;
   }
 
+  tlb_handle SubscribeRead(tlb_on_event *on_event, void *userdata, bool edge_trigger = true) {
+    return Subscribe(pipe.fd_read, TLB_EV_READ, on_event, userdata, edge_trigger);
+  }
+
   tlb_handle SubscribeWrite(tlb_on_event *on_event, void *userdata, bool edge_trigger = true) {
-    const tlb_handle handle = tlb_evl_add_fd(loop(), pipe.fd_write, TLB_EV_WRITE, edge_trigger, on_event, userdata);
-    open_subscriptions.emplace(handle);
-    return handle;
+    return Subscribe(pipe.fd_write, TLB_EV_WRITE, on_event, userdata, edge_trigger);
   }
 
   void Unsubscribe(tlb_handle subscription) {
-    open_subscriptions.erase(subscription);
+    {
+      std::lock_guard<std::mutex> guard(subscriptions_mutex);
+      open_subscriptions.erase(subscription);
+    }
     EXPECT_EQ(0, tlb_evl_remove(loop(), subscription)) << strerror(errno);
   }
 
@@ -73,6 +80,7 @@ class PipeTest : public TlbTest {
   }
 
   tlb_pipe pipe;
+  std::mutex subscriptions_mutex;
   std::unordered_set<tlb_handle> open_subscriptions;
 };
 
@@ -82,9 +90,55 @@ TEST_P(PipeTest, OpenClose) {
 TEST_P(PipeTest, SubscribeUnsubscribe) {
   tlb_handle sub = SubscribeRead(
       +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
-  ASSERT_NE(nullptr, sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  Unsubscribe(sub);
+}
+
+TEST_P(PipeTest, DoubleUnsubscribe) {
+  tlb_handle sub = SubscribeRead(
+      +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
 
   Unsubscribe(sub);
+  EXPECT_EQ(-1, tlb_evl_remove(loop(), sub));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(-1, tlb_evl_modify(loop(), sub, TLB_EV_WRITE));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(-1, tlb_evl_pause(loop(), sub));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_P(PipeTest, StaleHandle) {
+  tlb_handle stale = SubscribeRead(
+      +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, stale);
+  Unsubscribe(stale);
+
+  // The new subscription will likely reuse the slot, but the stale handle must not remove it
+  struct TestState {
+    PipeTest *test = nullptr;
+    int read_count = 0;
+  } state;
+  state.test = this;
+
+  tlb_handle sub = SubscribeRead(
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        uint64_t value;
+        ASSERT_TRUE(state->test->Read(value));
+
+        auto lock = state->test->lock();
+        state->read_count++;
+        state->test->notify();
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  EXPECT_NE(stale, sub);
+  EXPECT_EQ(-1, tlb_evl_remove(loop(), stale));
+
+  Write(s_test_value);
+  wait([&]() { return 1 == state.read_count; });
 }
 
 TEST_P(PipeTest, Readable) {
@@ -106,7 +160,7 @@ TEST_P(PipeTest, Readable) {
         state->test->notify();
       },
       &state);
-  ASSERT_NE(nullptr, sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
 
   Write(s_test_value);
   wait([&]() { return 1 == state.read_count; });
@@ -127,15 +181,17 @@ TEST_P(PipeTest, ReadableRecursive) {
         ASSERT_TRUE(state->test->Read<size_t>(value));
         EXPECT_EQ(state->read_count, value);
 
-        if (++state->read_count == kTargetReadCount) {
+        if (state->read_count + 1 == kTargetReadCount) {
+          // Only publish the final count under the lock, or the test may see it before this thread is done with it
           auto lock = state->test->lock();
+          state->read_count++;
           state->test->notify();
         } else {
-          state->test->Write(state->read_count);
+          state->test->Write(++state->read_count);
         }
       },
       &state);
-  ASSERT_NE(nullptr, sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
 
   Write(state.read_count);
   wait([&]() { return kTargetReadCount == state.read_count; });
@@ -160,7 +216,7 @@ TEST_P(PipeTest, ReadableUnsubscribe) {
         state->test->notify();
       },
       &state);
-  ASSERT_NE(nullptr, sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
 
   Write(s_test_value);
 
@@ -190,7 +246,7 @@ TEST_P(PipeTest, RecursiveUnsubscribe) {
         state->test->notify();
       },
       &state);
-  ASSERT_NE(nullptr, sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
 
   Write(s_test_value);
   wait([&]() { return state.read; });
@@ -214,7 +270,7 @@ TEST_P(PipeTest, Writable) {
         state->test->notify();
       },
       &state);
-  ASSERT_NE(nullptr, sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
 
   wait([&]() { return state.wrote; });
 
@@ -242,7 +298,7 @@ TEST_P(PipeTest, ReadableWritable) {
         state->test->notify();
       },
       &state);
-  ASSERT_NE(nullptr, read_sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, read_sub);
 
   tlb_handle write_sub = SubscribeWrite(
       +[](tlb_handle handle, int events, void *userdata) {
@@ -252,12 +308,99 @@ TEST_P(PipeTest, ReadableWritable) {
         state->test->Unsubscribe(handle);
       },
       &state);
-  ASSERT_NE(nullptr, write_sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, write_sub);
 
   // Run the events
   wait([&]() { return state.read_count == 1; });
 }
 
+TEST_P(PipeTest, ModifyFromCallback) {
+  struct TestState {
+    PipeTest *test = nullptr;
+    int write_count = 0;
+  } state;
+  state.test = this;
+
+  // Level triggered, so it would keep firing if the modify wasn't applied by the rearm
+  tlb_handle sub = SubscribeWrite(
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        EXPECT_EQ(0, tlb_evl_modify(state->test->loop(), handle, 0)) << strerror(errno);
+
+        auto lock = state->test->lock();
+        state->write_count++;
+        state->test->notify();
+      },
+      &state, false);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  wait([&]() { return state.write_count == 1; });
+}
+
+TEST_P(PipeTest, ModifyInterest) {
+  struct TestState {
+    PipeTest *test = nullptr;
+    int write_count = 0;
+  } state;
+  state.test = this;
+
+  // The write end never becomes readable
+  tlb_handle sub = Subscribe(
+      pipe.fd_write, TLB_EV_READ,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        EXPECT_TRUE(events & TLB_EV_WRITE);
+        state->test->Write(s_test_value);
+        EXPECT_EQ(0, tlb_evl_modify(state->test->loop(), handle, TLB_EV_READ)) << strerror(errno);
+
+        auto lock = state->test->lock();
+        state->write_count++;
+        state->test->notify();
+      },
+      &state, false);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  ASSERT_EQ(0, tlb_evl_modify(loop(), sub, TLB_EV_WRITE)) << strerror(errno);
+  wait([&]() { return state.write_count == 1; });
+
+  uint64_t value;
+  ASSERT_TRUE(Read(value));
+  EXPECT_EQ(s_test_value, value);
+}
+
+TEST_P(PipeTest, PauseResume) {
+  struct TestState {
+    PipeTest *test = nullptr;
+    std::atomic<bool> paused = {false};
+    int read_count = 0;
+  } state;
+  state.test = this;
+
+  tlb_handle sub = SubscribeRead(
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        EXPECT_FALSE(state->paused);
+        uint64_t value;
+        ASSERT_TRUE(state->test->Read(value));
+        EXPECT_EQ(s_test_value, value);
+
+        auto lock = state->test->lock();
+        state->read_count++;
+        state->test->notify();
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  state.paused = true;
+  ASSERT_EQ(0, tlb_evl_pause(loop(), sub)) << strerror(errno);
+  Write(s_test_value);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  state.paused = false;
+  ASSERT_EQ(0, tlb_evl_resume(loop(), sub)) << strerror(errno);
+  wait([&]() { return state.read_count == 1; });
+}
+
 TLB_INSTANTIATE_TEST(PipeTest);
 
 }  // namespace
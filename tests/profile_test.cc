@@ -0,0 +1,231 @@
+#include "tlb/profile.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <time.h>
+
+#include "test_helpers.h"
+#include <thread>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr uint64_t kSpinNs = 2000000;
+constexpr size_t kCalls = 3;
+
+class ProfileTest : public LoopTest {
+ public:
+  ProfileTest() : LoopTest(1) {
+  }
+
+  struct Conn {
+    tlb_pipe *pipe = nullptr;
+    uint64_t spin_ns = kSpinNs;
+    size_t calls = 0;
+  };
+
+  static uint64_t CpuNow() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+  }
+
+  // Burns CPU rather than sleeping, so both clocks move
+  static void OnRead(tlb_handle handle, int events, void *userdata) {
+    Conn *conn = static_cast<Conn *>(userdata);
+    uint64_t value;
+    tlb_pipe_read(conn->pipe, &value);
+    const uint64_t start = CpuNow();
+    while (CpuNow() - start < conn->spin_ns) {
+    }
+    conn->calls++;
+  }
+
+  void SetUp() override {
+    LoopTest::SetUp();
+    conn.pipe = &pipes[0];
+  }
+
+  void TearDown() override {
+    tlb_profile_disable();
+    LoopTest::TearDown();
+  }
+
+  // Totals are process wide and never reset, so tests use names of their own
+  static tlb_profile_entry Find(const char *name) {
+    std::vector<tlb_profile_entry> entries(64);
+    size_t count = tlb_profile_read(entries.data(), entries.size());
+    EXPECT_LE(count, entries.size());
+    for (size_t ii = 0; ii < count; ++ii) {
+      if (strcmp(entries[ii].name, name) == 0) {
+        return entries[ii];
+      }
+    }
+    return tlb_profile_entry{};
+  }
+
+  void Run(size_t calls) {
+    for (size_t ii = 0; ii < calls; ++ii) {
+      tlb_pipe_write(&pipes[0], s_test_value);
+      EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+    }
+  }
+
+  Conn conn;
+};
+
+TEST_F(ProfileTest, Named) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, OnRead, &conn);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_name(loop, sub, "profile.named"));
+
+  tlb_profile_enable(TLB_PROFILE_WALL | TLB_PROFILE_CPU);
+  Run(kCalls);
+
+  tlb_profile_entry entry = Find("profile.named");
+  EXPECT_EQ(kCalls, entry.calls);
+  EXPECT_GE(entry.cpu_ns, kCalls * kSpinNs);
+  EXPECT_GE(entry.wall_ns, entry.cpu_ns);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(ProfileTest, Disabled) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, OnRead, &conn);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_name(loop, sub, "profile.disabled"));
+
+  Run(1);
+  EXPECT_EQ(0U, Find("profile.disabled").calls);
+
+  // Only wall time
+  tlb_profile_enable(TLB_PROFILE_WALL);
+  Run(1);
+  tlb_profile_disable();
+  Run(1);
+  tlb_profile_entry entry = Find("profile.disabled");
+  EXPECT_EQ(1U, entry.calls);
+  EXPECT_GE(entry.wall_ns, kSpinNs);
+  EXPECT_EQ(0U, entry.cpu_ns);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(ProfileTest, SubLoopExclusive) {
+  tlb_event_loop *parent = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, parent);
+  tlb_handle child = tlb_evl_add_evl(parent, loop);
+  ASSERT_NE(TLB_HANDLE_INVALID, child);
+  ASSERT_EQ(0, tlb_evl_set_name(parent, child, "profile.outer"));
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, OnRead, &conn);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_name(loop, sub, "profile.inner"));
+
+  tlb_profile_enable(TLB_PROFILE_WALL | TLB_PROFILE_CPU);
+  conn.spin_ns = 10 * kSpinNs;
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(parent, 0, 1000));
+  ASSERT_EQ(1U, conn.calls);
+
+  // The inner callback's time isn't counted twice
+  tlb_profile_entry outer = Find("profile.outer");
+  tlb_profile_entry inner = Find("profile.inner");
+  EXPECT_EQ(1U, outer.calls);
+  EXPECT_EQ(1U, inner.calls);
+  EXPECT_GE(inner.cpu_ns, conn.spin_ns);
+  EXPECT_LT(outer.cpu_ns, conn.spin_ns);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(0, tlb_evl_remove(parent, child));
+  tlb_evl_destroy(parent);
+}
+
+TEST_F(ProfileTest, MergedAcrossThreads) {
+  // Equal names at different addresses, recorded into different threads' tables
+  static const char first[] = "profile.merged";
+  static const char second[] = "profile.merged";
+  ASSERT_NE(static_cast<const void *>(first), static_cast<const void *>(second));
+
+  tlb_profile_enable(TLB_PROFILE_WALL);
+  std::vector<std::thread> threads;
+  for (const char *name : {first, second}) {
+    threads.emplace_back([name]() {
+      tlb_event_loop *loop = tlb_evl_new(test_allocator());
+      ASSERT_NE(nullptr, loop);
+      tlb_handle timer = tlb_evl_add_timer(loop, 0, +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+      ASSERT_NE(TLB_HANDLE_INVALID, timer);
+      ASSERT_EQ(0, tlb_evl_set_name(loop, timer, name));
+      EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+      tlb_evl_destroy(loop);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(2U, Find("profile.merged").calls);
+}
+
+TEST_F(ProfileTest, Batch) {
+  std::vector<tlb_pipe> pipes(4);
+  std::vector<tlb_handle> subs;
+  for (tlb_pipe &batch_pipe : pipes) {
+    ASSERT_EQ(0, tlb_pipe_open(&batch_pipe));
+    subs.push_back(tlb_evl_add_fd_batch(
+        loop, batch_pipe.fd_read, TLB_EV_READ, false,
+        +[](const tlb_evl_batch_item *items, size_t count) {
+          for (size_t ii = 0; ii < count; ++ii) {
+            uint64_t value;
+            tlb_pipe_read(static_cast<tlb_pipe *>(items[ii].userdata), &value);
+          }
+        },
+        &batch_pipe));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+    ASSERT_EQ(0, tlb_evl_set_name(loop, subs.back(), "profile.batch"));
+  }
+
+  tlb_profile_enable(TLB_PROFILE_WALL);
+  for (tlb_pipe &batch_pipe : pipes) {
+    tlb_pipe_write(&batch_pipe, s_test_value);
+  }
+  EXPECT_EQ((int)pipes.size(), tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(pipes.size(), Find("profile.batch").calls);
+
+  for (size_t ii = 0; ii < pipes.size(); ++ii) {
+    EXPECT_EQ(0, tlb_evl_remove(loop, subs[ii]));
+    tlb_pipe_close(&pipes[ii]);
+  }
+}
+
+TEST_F(ProfileTest, MostExpensiveFirst) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, OnRead, &conn);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_EQ(0, tlb_evl_set_name(loop, sub, "profile.expensive"));
+
+  // Far more than anything else in the process gets
+  tlb_profile_enable(TLB_PROFILE_WALL);
+  conn.spin_ns = 50 * kSpinNs;
+  Run(1);
+
+  tlb_profile_entry entry;
+  EXPECT_LE(1U, tlb_profile_read(&entry, 1));
+  EXPECT_STREQ("profile.expensive", entry.name);
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(ProfileTest, Invalid) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, OnRead, &conn);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  EXPECT_EQ(-1, tlb_evl_set_name(loop, sub, nullptr));
+  EXPECT_EQ(EINVAL, errno);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(-1, tlb_evl_set_name(loop, sub, "profile.invalid"));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,131 @@
+#include "tlb/rate_limit.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <chrono>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kPipes = 2;
+constexpr auto kDuration = std::chrono::milliseconds(200);
+
+class RateLimitTest : public LoopTest {
+ public:
+  RateLimitTest() : LoopTest(kPipes) {
+  }
+
+  // Never drained, so it's ready whenever it's armed
+  tlb_handle AddReadable(size_t pipe, Counter *counter) {
+    counter->drain = false;
+    tlb_pipe_write(&pipes[pipe], s_test_value);
+    return Add(pipe, counter);
+  }
+};
+
+TEST_F(RateLimitTest, Events) {
+  Counter limited;
+  Counter unlimited;
+  tlb_handle limited_sub = AddReadable(0, &limited);
+  tlb_handle unlimited_sub = AddReadable(1, &unlimited);
+  ASSERT_NE(TLB_HANDLE_INVALID, limited_sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, unlimited_sub);
+
+  tlb_rate_limit limit = {};
+  limit.events_per_second = 100;
+  limit.event_burst = 5;
+  ASSERT_EQ(0, tlb_evl_set_rate_limit(loop, limited_sub, &limit));
+  Run(kDuration);
+
+  // The burst, plus 20 over the 200ms, with plenty of slack for slow machines
+  EXPECT_LE(10U, limited.calls);
+  EXPECT_GE(30U, limited.calls);
+  // Waiting out the limit doesn't hold anyone else up
+  EXPECT_LT(limited.calls * 10, unlimited.calls);
+
+  // Without the limit it's as busy as everything else, once its last wait is over
+  ASSERT_EQ(0, tlb_evl_set_rate_limit(loop, limited_sub, nullptr));
+  Run(std::chrono::milliseconds(20));
+  limited.calls = 0;
+  unlimited.calls = 0;
+  Run(kDuration);
+  EXPECT_LT(100U, limited.calls);
+  EXPECT_GE(1U, limited.calls > unlimited.calls ? limited.calls - unlimited.calls : unlimited.calls - limited.calls);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, limited_sub));
+  EXPECT_EQ(0, tlb_evl_remove(loop, unlimited_sub));
+}
+
+TEST_F(RateLimitTest, Bytes) {
+  Counter counter;
+  counter.bytes = 1000;
+  tlb_handle sub = AddReadable(0, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  tlb_rate_limit limit = {};
+  limit.bytes_per_second = 10000;
+  limit.byte_burst = 2000;
+  ASSERT_EQ(0, tlb_evl_set_rate_limit(loop, sub, &limit));
+  Run(kDuration);
+
+  // Two from the burst, then one every 100ms
+  EXPECT_LE(3U, counter.calls);
+  EXPECT_GE(6U, counter.calls);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(RateLimitTest, RefillTimer) {
+  Counter limited;
+  Counter unlimited;
+  tlb_handle limited_sub = AddReadable(0, &limited);
+  tlb_handle unlimited_sub = AddReadable(1, &unlimited);
+  ASSERT_NE(TLB_HANDLE_INVALID, limited_sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, unlimited_sub);
+
+  tlb_rate_limit limit = {};
+  limit.events_per_second = 1000;
+  limit.event_burst = 1;
+  ASSERT_EQ(0, tlb_evl_set_rate_limit(loop, limited_sub, &limit));
+
+  // Every callback throttles it, but it only ever has the one timer
+  tlb_evl_memory usage;
+  const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+  while (std::chrono::steady_clock::now() < end) {
+    EXPECT_LE(0, tlb_evl_handle_events(loop, 0, 10));
+    ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+    EXPECT_GE(3U, usage.slots_live);
+  }
+  EXPECT_LE(10U, limited.calls);
+
+  // Which goes with it
+  EXPECT_EQ(0, tlb_evl_remove(loop, limited_sub));
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(1U, usage.slots_live);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, unlimited_sub));
+}
+
+TEST_F(RateLimitTest, Invalid) {
+  tlb_rate_limit limit = {};
+  limit.events_per_second = 1;
+
+  tlb_handle timer = tlb_evl_add_timer(
+      loop, 60 * 1000, +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
+  EXPECT_EQ(-1, tlb_evl_set_rate_limit(loop, timer, &limit));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(0, tlb_evl_remove(loop, timer));
+
+  EXPECT_EQ(-1, tlb_evl_set_rate_limit(loop, timer, &limit));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(-1, tlb_evl_rate_consume(loop, timer, 1));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,214 @@
+#include "tlb/recorder.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+#include "tlb/tlb.h"
+
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kRounds = 10;
+constexpr size_t kThreads = 2;
+
+class RecorderTest : public LoopTest {
+ public:
+  RecorderTest() : LoopTest(1) {
+  }
+
+  static std::string Dump() {
+    FILE *file = tmpfile();
+    EXPECT_NE(nullptr, file);
+    EXPECT_EQ(0, tlb_recorder_dump(fileno(file)));
+
+    std::string dump;
+    rewind(file);
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      dump.append(buffer, length);
+    }
+    fclose(file);
+    return dump;
+  }
+
+  static size_t Count(const std::string &dump, const std::string &needle) {
+    size_t count = 0;
+    for (size_t at = dump.find(needle); at != std::string::npos; at = dump.find(needle, at + 1)) {
+      count++;
+    }
+    return count;
+  }
+
+  // Every object and array that's opened is closed again
+  static bool Balanced(const std::string &dump) {
+    int depth = 0;
+    bool quoted = false;
+    for (size_t ii = 0; ii < dump.size(); ++ii) {
+      if (quoted) {
+        ii += dump[ii] == '\\';
+        quoted = dump[ii] != '"';
+      } else if (dump[ii] == '"') {
+        quoted = true;
+      } else if (dump[ii] == '{' || dump[ii] == '[') {
+        depth++;
+      } else if ((dump[ii] == '}' || dump[ii] == ']') && --depth < 0) {
+        return false;
+      }
+    }
+    return depth == 0 && !quoted;
+  }
+};
+
+TEST_F(RecorderTest, Dispatch) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, DrainPipe, &pipes[0]);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  for (size_t ii = 0; ii < kRounds; ++ii) {
+    tlb_pipe_write(&pipes[0], s_test_value);
+    EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, TLB_WAIT_INDEFINITE));
+  }
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+
+  const std::string dump = Dump();
+  EXPECT_EQ(0U, dump.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+  EXPECT_TRUE(Balanced(dump));
+
+  // Older history may have been lapped in the ring, but the last rounds are all there
+  EXPECT_LE(kRounds, Count(dump, "{\"name\":\"fd\",\"ph\":\"B\""));
+  EXPECT_LE(kRounds, Count(dump, "{\"name\":\"fd\",\"ph\":\"E\""));
+  EXPECT_LE(kRounds, Count(dump, "{\"name\":\"poll\",\"ph\":\"B\""));
+  EXPECT_LE(kRounds, Count(dump, "{\"name\":\"rearm\""));
+}
+
+TEST_F(RecorderTest, RemoveDeferred) {
+  struct TestState {
+    tlb_event_loop *loop;
+    bool removed = false;
+  } state = {loop};
+
+  tlb_handle sub = tlb_evl_add_fd(
+      loop, pipes[0].fd_read, TLB_EV_READ, false,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        state->removed = tlb_evl_remove(state->loop, handle) == 0;
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  tlb_pipe_write(&pipes[0], s_test_value);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, TLB_WAIT_INDEFINITE));
+  ASSERT_TRUE(state.removed);
+
+  EXPECT_LE(1U, Count(Dump(), "{\"name\":\"remove deferred\""));
+}
+
+TEST_F(RecorderTest, Threads) {
+  tlb_options options = {};
+  options.max_thread_count = kThreads;
+  tlb *tlb_inst = tlb_new(TlbTest::alloc(), options);
+  ASSERT_NE(nullptr, tlb_inst);
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+  ASSERT_EQ(0, tlb_stop(tlb_inst));
+  tlb_destroy(tlb_inst);
+
+  const std::string dump = Dump();
+  EXPECT_LE(kThreads, Count(dump, "{\"name\":\"thread start\""));
+  EXPECT_LE(kThreads, Count(dump, "{\"name\":\"thread stop\""));
+  EXPECT_LE(kThreads, Count(dump, "\"ph\":\"M\",\"pid\""));
+}
+
+TEST_F(RecorderTest, DumpWhileRecording) {
+  // Never drained, so it fires on every poll and keeps lapping the ring
+  tlb_pipe_write(&pipes[0], s_test_value);
+  tlb_handle sub = tlb_evl_add_fd(
+      loop, pipes[0].fd_read, TLB_EV_READ, false, +[](tlb_handle handle, int events, void *userdata) {}, nullptr);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  std::atomic<bool> running = {true};
+  std::thread recorder([&]() {
+    while (running) {
+      tlb_evl_handle_events(loop, 0, TLB_WAIT_NONE);
+    }
+  });
+  for (size_t ii = 0; ii < kRounds; ++ii) {
+    const std::string dump = Dump();
+    EXPECT_TRUE(Balanced(dump));
+    EXPECT_GE(TLB_RECORDER_CAPACITY + 1, Count(dump, "{\"name\":\"fd\""));
+  }
+  running = false;
+  recorder.join();
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(RecorderTest, DumpOnCrash) {
+  const std::string path = ::testing::TempDir() + "tlb_recorder_" + std::to_string(getpid()) + ".json";
+  unlink(path.c_str());
+
+  EXPECT_DEATH(
+      {
+        ASSERT_EQ(0, tlb_recorder_dump_on_crash(path.c_str()));
+        tlb_pipe_write(&pipes[0], s_test_value);
+        tlb_handle sub = tlb_evl_add_fd(
+            loop, pipes[0].fd_read, TLB_EV_READ, false, +[](tlb_handle handle, int events, void *userdata) { abort(); },
+            nullptr);
+        tlb_evl_set_name(loop, sub, "crashing");
+        tlb_evl_handle_events(loop, 0, TLB_WAIT_INDEFINITE);
+      },
+      "");
+
+  std::ifstream file(path);
+  ASSERT_TRUE(file.good());
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string dump = contents.str();
+  EXPECT_TRUE(Balanced(dump));
+  // The callback it died in was started but never finished. Rings outlive their threads, so earlier tests' records are
+  // in there too, and only this one's subscription is counted.
+  EXPECT_EQ(1U, Count(dump, "{\"name\":\"crashing\",\"ph\":\"B\""));
+  EXPECT_EQ(0U, Count(dump, "{\"name\":\"crashing\",\"ph\":\"E\""));
+  unlink(path.c_str());
+}
+
+TEST_F(RecorderTest, DumpOnCrashChains) {
+  const std::string path = ::testing::TempDir() + "tlb_recorder_chain_" + std::to_string(getpid()) + ".json";
+  unlink(path.c_str());
+
+  // The handler that was there first still gets the signal once the dump is written
+  EXPECT_EXIT(
+      {
+        struct sigaction previous = {};
+        previous.sa_sigaction = +[](int signal, siginfo_t *info, void *context) {
+          const char message[] = "chained";
+          (void)!write(STDERR_FILENO, message, sizeof(message) - 1);
+          _exit(signal == SIGABRT && info ? 3 : 4);
+        };
+        previous.sa_flags = SA_SIGINFO;
+        sigemptyset(&previous.sa_mask);
+        ASSERT_EQ(0, sigaction(SIGABRT, &previous, nullptr));
+        ASSERT_EQ(0, tlb_recorder_dump_on_crash(path.c_str()));
+        // Again, which mustn't chain to itself
+        ASSERT_EQ(0, tlb_recorder_dump_on_crash(path.c_str()));
+        abort();
+      },
+      ::testing::ExitedWithCode(3), "chained");
+
+  std::ifstream file(path);
+  ASSERT_TRUE(file.good());
+  std::stringstream contents;
+  contents << file.rdbuf();
+  EXPECT_TRUE(Balanced(contents.str()));
+  unlink(path.c_str());
+}
+
+}  // namespace
+}  // namespace tlb_test
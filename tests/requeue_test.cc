@@ -0,0 +1,254 @@
+#include "tlb/event_loop.h"
+#include "tlb/metrics.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kValues = 10;
+
+class RequeueTest : public LoopTest {
+ public:
+  RequeueTest() : LoopTest(1) {
+  }
+
+  // Reads a single value per call, and asks to go again while there's more to read
+  struct Reader {
+    tlb_event_loop *loop = nullptr;
+    tlb_pipe *pipe = nullptr;
+    size_t calls = 0;
+    size_t reads = 0;
+    size_t written = 0;
+  };
+
+  static void ReadOne(tlb_handle handle, int events, void *userdata) {
+    Reader *reader = static_cast<Reader *>(userdata);
+    EXPECT_EQ(TLB_EV_READ, events);
+    reader->calls++;
+    uint64_t value;
+    if (tlb_pipe_read(reader->pipe, &value) == sizeof(value)) {
+      reader->reads++;
+    }
+    if (reader->reads < reader->written) {
+      EXPECT_EQ(0, tlb_evl_requeue(reader->loop, handle));
+    }
+  }
+
+  void SetUp() override {
+    LoopTest::SetUp();
+    reader.loop = loop;
+    reader.pipe = &pipes[0];
+  }
+
+  void Write(size_t count) {
+    for (size_t ii = 0; ii < count; ++ii) {
+      tlb_pipe_write(&pipes[0], s_test_value);
+    }
+    reader.written += count;
+  }
+
+  Reader reader;
+};
+
+TEST_F(RequeueTest, RunsAgainWithoutRearming) {
+  const std::string name = "/tlb_test." + std::to_string(getpid()) + ".requeue";
+  ASSERT_EQ(0, tlb_evl_metrics_enable(loop, name.c_str()));
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, ReadOne, &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  Write(kValues);
+  for (size_t ii = 1; ii <= kValues; ++ii) {
+    EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, TLB_WAIT_INDEFINITE));
+    EXPECT_EQ(ii, reader.reads);
+    EXPECT_EQ(ii < kValues ? 1U : 0U, tlb_evl_requeued_count(loop));
+  }
+  EXPECT_EQ(kValues, reader.calls);
+
+  // Only rearmed once it was done
+  tlb_metrics_values total = {};
+  ASSERT_EQ(0, tlb_metrics_read(name.c_str(), nullptr, &total, nullptr, 0));
+  EXPECT_EQ(1U, total.values[TLB_METRIC_REARMS]);
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+
+  Write(1);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(kValues + 1, reader.reads);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  tlb_evl_metrics_disable(loop);
+}
+
+TEST_F(RequeueTest, RemovedWhileQueued) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, ReadOne, &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  Write(2);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  ASSERT_EQ(1U, tlb_evl_requeued_count(loop));
+
+  // Freed by the poll that takes it off the queue, without calling it
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(-1, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 10));
+  EXPECT_EQ(1U, reader.calls);
+  EXPECT_EQ(0U, tlb_evl_requeued_count(loop));
+
+  tlb_evl_memory usage;
+  ASSERT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  EXPECT_EQ(0U, usage.slots_live);
+}
+
+TEST_F(RequeueTest, PausedWhileQueued) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, ReadOne, &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  Write(2);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  ASSERT_EQ(0, tlb_evl_pause(loop, sub));
+
+  // Left disarmed rather than run again
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 10));
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+  EXPECT_EQ(1U, reader.calls);
+
+  ASSERT_EQ(0, tlb_evl_resume(loop, sub));
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(2U, reader.reads);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(RequeueTest, SubLoop) {
+  tlb_event_loop *parent = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, parent);
+  tlb_handle child = tlb_evl_add_evl(parent, loop);
+  ASSERT_NE(TLB_HANDLE_INVALID, child);
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, ReadOne, &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  // The sub-loop's fd isn't readable while its subscription is queued, so it requeues itself in the parent
+  Write(kValues);
+  for (size_t ii = 0; ii < kValues && reader.reads < kValues; ++ii) {
+    EXPECT_EQ(1, tlb_evl_handle_events(parent, 0, 1000));
+  }
+  EXPECT_EQ(kValues, reader.reads);
+  EXPECT_EQ(0U, tlb_evl_requeued_count(parent));
+  EXPECT_EQ(0U, tlb_evl_requeued_count(loop));
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(0, tlb_evl_remove(parent, child));
+  tlb_evl_destroy(parent);
+}
+
+TEST_F(RequeueTest, Invalid) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, ReadOne, &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  // Not running
+  EXPECT_EQ(-1, tlb_evl_requeue(loop, sub));
+  EXPECT_EQ(EINVAL, errno);
+
+  tlb_handle timer = tlb_evl_add_timer(
+      loop, 0,
+      +[](tlb_handle handle, int events, void *userdata) {
+        EXPECT_EQ(-1, tlb_evl_requeue(static_cast<tlb_event_loop *>(userdata), handle));
+        EXPECT_EQ(EINVAL, errno);
+      },
+      loop);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+  EXPECT_EQ(-1, tlb_evl_requeue(loop, sub));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_F(RequeueTest, Batch) {
+  tlb_handle sub = tlb_evl_add_fd_batch(
+      loop, pipes[0].fd_read, TLB_EV_READ, false,
+      +[](const tlb_evl_batch_item *items, size_t count) {
+        for (size_t ii = 0; ii < count; ++ii) {
+          ReadOne(items[ii].handle, items[ii].events, items[ii].userdata);
+        }
+      },
+      &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  Write(2);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_EQ(1U, tlb_evl_requeued_count(loop));
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 10));
+  EXPECT_EQ(2U, reader.reads);
+  EXPECT_EQ(0U, tlb_evl_requeued_count(loop));
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(RequeueTest, OtherThread) {
+  struct TestState {
+    std::atomic<bool> running = {false};
+    std::atomic<bool> checked = {false};
+  } state;
+  tlb_handle sub = tlb_evl_add_fd(
+      loop, pipes[0].fd_read, TLB_EV_READ, false,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        state->running = true;
+        while (!state->checked) {
+          std::this_thread::yield();
+        }
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  Write(1);
+  std::thread poller([&]() { EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000)); });
+  while (!state.running) {
+    std::this_thread::yield();
+  }
+  // Running, but not on this thread, so it isn't this thread's to requeue
+  EXPECT_EQ(-1, tlb_evl_requeue(loop, sub));
+  EXPECT_EQ(EINVAL, errno);
+  state.checked = true;
+  poller.join();
+  EXPECT_EQ(0U, tlb_evl_requeued_count(loop));
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(RequeueTest, DispatchedTwice) {
+  tlb_handle sub = tlb_evl_add_fd(loop, pipes[0].fd_read, TLB_EV_READ, false, ReadOne, &reader);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  Write(3);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  ASSERT_EQ(1U, tlb_evl_requeued_count(loop));
+
+  // Only the dispatch of the event that took it off the queue runs it, one from an earlier poll doesn't
+  tlb_evl_event event = {};
+  ASSERT_EQ(1, tlb_evl_poll(loop, &event, 1, 0));
+  tlb_evl_dispatch(loop, &event, 1);
+  EXPECT_EQ(2U, reader.calls);
+  ASSERT_EQ(1U, tlb_evl_requeued_count(loop));
+  tlb_evl_dispatch(loop, &event, 1);
+  EXPECT_EQ(2U, reader.calls);
+
+  ASSERT_EQ(1, tlb_evl_poll(loop, &event, 1, 0));
+  tlb_evl_dispatch(loop, &event, 1);
+  tlb_evl_dispatch(loop, &event, 1);
+  EXPECT_EQ(3U, reader.calls);
+  EXPECT_EQ(3U, reader.reads);
+  EXPECT_EQ(0U, tlb_evl_requeued_count(loop));
+
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,192 @@
+#include "tlb/sendfile.h"
+
+#include "tlb/event_loop.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kFileSize = 3 << 20;
+
+class SendfileTest : public LoopTest {
+ public:
+  struct Transfer {
+    int fds[2] = {-1, -1};
+    std::string received;
+    std::vector<uint64_t> progress;
+    bool done = false;
+    int error = -1;
+  };
+
+  static void OnSendfile(tlb_event_loop *loop, uint64_t sent, bool done, int error, void *userdata) {
+    Transfer *transfer = static_cast<Transfer *>(userdata);
+    EXPECT_FALSE(transfer->done);
+    transfer->progress.push_back(sent);
+    transfer->done = done;
+    transfer->error = error;
+  }
+
+  void SetUp() override {
+    LoopTest::SetUp();
+    file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    contents.resize(kFileSize);
+    for (size_t ii = 0; ii < contents.size(); ++ii) {
+      contents[ii] = static_cast<char>('a' + (ii * 7 + ii / 4096) % 26);
+    }
+    ASSERT_EQ(static_cast<ssize_t>(contents.size()), write(fileno(file), contents.data(), contents.size()));
+  }
+
+  void TearDown() override {
+    LoopTest::TearDown();
+    for (Transfer &transfer : transfers) {
+      close(transfer.fds[0]);
+      close(transfer.fds[1]);
+    }
+    fclose(file);
+  }
+
+  Transfer &Connect() {
+    transfers.emplace_back();
+    Transfer &transfer = transfers.back();
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, transfer.fds));
+    return transfer;
+  }
+
+  // Handles events and reads whatever's arrived, until every transfer is done and has been read
+  void Run(size_t expected) {
+    for (int ii = 0; ii < 10000; ++ii) {
+      bool finished = true;
+      for (Transfer &transfer : transfers) {
+        char buffer[65536];
+        ssize_t bytes = 0;
+        while ((bytes = read(transfer.fds[1], buffer, sizeof(buffer))) > 0) {
+          transfer.received.append(buffer, bytes);
+        }
+        finished = finished && transfer.done && transfer.received.size() >= expected;
+      }
+      if (finished) {
+        return;
+      }
+      ASSERT_LE(0, tlb_evl_handle_events(loop, 0, 10));
+    }
+    FAIL() << "Transfers didn't finish";
+  }
+
+  FILE *file = nullptr;
+  std::string contents;
+  std::deque<Transfer> transfers;
+};
+
+TEST_F(SendfileTest, Whole) {
+  Transfer &transfer = Connect();
+  ASSERT_NE(TLB_HANDLE_INVALID,
+            tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), 0, 0, OnSendfile, &transfer));
+  Run(kFileSize);
+  EXPECT_EQ(0, transfer.error);
+  EXPECT_TRUE(contents == transfer.received);
+
+  // Reported as it went, as the socket drained
+  ASSERT_GT(transfer.progress.size(), 2U);
+  EXPECT_EQ(kFileSize, transfer.progress.back());
+  for (size_t ii = 1; ii < transfer.progress.size(); ++ii) {
+    EXPECT_LE(transfer.progress[ii - 1], transfer.progress[ii]);
+  }
+
+  // Where writing the file left it
+  EXPECT_EQ(static_cast<off_t>(kFileSize), lseek(fileno(file), 0, SEEK_CUR));
+}
+
+TEST_F(SendfileTest, Range) {
+  Transfer &transfer = Connect();
+  ASSERT_NE(TLB_HANDLE_INVALID,
+            tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), 1000, 5000, OnSendfile, &transfer));
+  Run(5000);
+  EXPECT_EQ(0, transfer.error);
+  EXPECT_EQ(contents.substr(1000, 5000), transfer.received);
+}
+
+TEST_F(SendfileTest, AlreadySubscribed) {
+  // Streams alongside the socket's own subscription, for the same direction and the other, without taking it over
+  Transfer &transfer = Connect();
+  Counter counter = {loop};
+  counter.drain = false;
+  tlb_handle sub = tlb_evl_add_fd(loop, transfer.fds[0], TLB_EV_READ | TLB_EV_WRITE, false, Counter::Count, &counter);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  ASSERT_NE(TLB_HANDLE_INVALID, tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), 0, 0, OnSendfile, &transfer));
+  Run(kFileSize);
+  EXPECT_EQ(0, transfer.error);
+  EXPECT_TRUE(contents == transfer.received);
+
+  const size_t calls = counter.calls;
+  for (int ii = 0; ii < 100 && counter.calls == calls; ++ii) {
+    ASSERT_LE(0, tlb_evl_handle_events(loop, 0, 10));
+  }
+  EXPECT_LT(calls, counter.calls);
+  EXPECT_EQ(0, tlb_evl_remove(loop, sub));
+}
+
+TEST_F(SendfileTest, ShortFile) {
+  // Ends early when the file does
+  Transfer &transfer = Connect();
+  ASSERT_NE(TLB_HANDLE_INVALID, tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), kFileSize - 100, 1000,
+                                                    OnSendfile, &transfer));
+  Run(100);
+  EXPECT_EQ(0, transfer.error);
+  EXPECT_EQ(100U, transfer.progress.back());
+  EXPECT_EQ(contents.substr(kFileSize - 100), transfer.received);
+}
+
+TEST_F(SendfileTest, Concurrent) {
+  constexpr size_t kTransfers = 8;
+  for (size_t ii = 0; ii < kTransfers; ++ii) {
+    Transfer &transfer = Connect();
+    ASSERT_NE(TLB_HANDLE_INVALID,
+              tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), 0, 0, OnSendfile, &transfer));
+  }
+  Run(kFileSize);
+  for (Transfer &transfer : transfers) {
+    EXPECT_EQ(0, transfer.error);
+    EXPECT_TRUE(contents == transfer.received);
+  }
+}
+
+TEST_F(SendfileTest, Cancel) {
+  Transfer &transfer = Connect();
+  tlb_handle handle = tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), 0, 0, OnSendfile, &transfer);
+  ASSERT_NE(TLB_HANDLE_INVALID, handle);
+  EXPECT_EQ(1, tlb_evl_handle_events(loop, 0, 1000));
+  EXPECT_FALSE(transfer.done);
+
+  // Stops without calling back again
+  const size_t calls = transfer.progress.size();
+  EXPECT_EQ(0, tlb_evl_remove(loop, handle));
+  char buffer[65536];
+  while (read(transfer.fds[1], buffer, sizeof(buffer)) > 0) {
+  }
+  EXPECT_EQ(0, tlb_evl_handle_events(loop, 0, 10));
+  EXPECT_EQ(calls, transfer.progress.size());
+}
+
+TEST_F(SendfileTest, Invalid) {
+  Transfer &transfer = Connect();
+  EXPECT_EQ(TLB_HANDLE_INVALID, tlb_sendfile_stream(loop, transfer.fds[0], -1, 0, 0, OnSendfile, &transfer));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(TLB_HANDLE_INVALID,
+            tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), -1, 0, OnSendfile, &transfer));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(TLB_HANDLE_INVALID, tlb_sendfile_stream(loop, transfer.fds[0], fileno(file), 0, 0, nullptr, nullptr));
+  EXPECT_EQ(EINVAL, errno);
+}
+
+}  // namespace
+}  // namespace tlb_test
@@ -0,0 +1,140 @@
+#include "tlb/strand.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <array>
+#include <chrono>
+#include <vector>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kPipes = 4;
+constexpr size_t kCallbacks = 1000;
+constexpr auto kTimeout = std::chrono::seconds(10);
+
+class StrandTest : public TlbTest {
+ public:
+  void SetUp() override {
+    TlbTest::SetUp();
+
+    strand = tlb_strand_new(loop());
+    ASSERT_NE(nullptr, strand);
+    for (tlb_pipe &pipe : pipes) {
+      ASSERT_EQ(0, tlb_pipe_open(&pipe));
+    }
+  }
+
+  void TearDown() override {
+    TlbTest::TearDown();
+
+    tlb_strand_destroy(strand);
+    for (tlb_pipe &pipe : pipes) {
+      tlb_pipe_close(&pipe);
+    }
+  }
+
+  tlb_strand *strand = nullptr;
+  std::array<tlb_pipe, kPipes> pipes;
+};
+
+TEST_P(StrandTest, Exclusive) {
+  struct TestState {
+    const StrandTest *test = nullptr;
+    std::atomic<bool> inside = {false};
+    std::atomic<size_t> count = {0};
+  } state;
+  state.test = this;
+
+  // Every pipe stays readable, so every subscription fires constantly on every loop thread
+  std::vector<tlb_handle> subs;
+  for (tlb_pipe &pipe : pipes) {
+    tlb_pipe_write(&pipe, s_test_value);
+    subs.push_back(tlb_strand_add_fd(
+        strand, pipe.fd_read, TLB_EV_READ, false,
+        +[](tlb_handle handle, int events, void *userdata) {
+          TestState *state = static_cast<TestState *>(userdata);
+          EXPECT_FALSE(state->inside.exchange(true));
+          EXPECT_TRUE(tlb_strand_running_in_this_thread(state->test->strand));
+          std::this_thread::yield();
+          state->inside = false;
+          state->count++;
+        },
+        &state));
+    ASSERT_NE(TLB_HANDLE_INVALID, subs.back());
+  }
+
+  // Callbacks keep coming after the count is reached, so poll rather than holding them up on the fixture's lock
+  const auto deadline = std::chrono::steady_clock::now() + kTimeout;
+  while (state.count < kCallbacks && std::chrono::steady_clock::now() < deadline) {
+    if (thread_count() == 0) {
+      tlb_evl_handle_events(loop(), 100, 0);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  EXPECT_LE(kCallbacks, state.count);
+  EXPECT_FALSE(tlb_strand_running_in_this_thread(strand));
+
+  for (tlb_handle sub : subs) {
+    EXPECT_EQ(0, tlb_evl_remove(loop(), sub)) << strerror(errno);
+  }
+  // Let any in-flight callbacks finish before the state goes away
+  Stop();
+}
+
+TEST_P(StrandTest, Dispatch) {
+  struct TestState {
+    tlb_strand *strand = nullptr;
+    std::vector<int> order;
+  } state;
+  state.strand = strand;
+
+  // Idle strands run it straight away, anything dispatched from inside runs once the current one returns
+  ASSERT_EQ(0, tlb_strand_dispatch(
+                   strand,
+                   +[](void *userdata) {
+                     TestState *state = static_cast<TestState *>(userdata);
+                     EXPECT_TRUE(tlb_strand_running_in_this_thread(state->strand));
+                     EXPECT_EQ(0, tlb_strand_dispatch(
+                                      state->strand,
+                                      +[](void *userdata) { static_cast<TestState *>(userdata)->order.push_back(2); },
+                                      state));
+                     state->order.push_back(1);
+                   },
+                   &state));
+
+  EXPECT_EQ((std::vector<int>{1, 2}), state.order);
+  EXPECT_FALSE(tlb_strand_running_in_this_thread(strand));
+}
+
+TEST_P(StrandTest, Timer) {
+  struct TestState {
+    StrandTest *test = nullptr;
+    size_t trigger_count = 0;
+  } state;
+  state.test = this;
+
+  tlb_handle timer = tlb_strand_add_timer(
+      strand, 10,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        EXPECT_TRUE(tlb_strand_running_in_this_thread(state->test->strand));
+        auto lock = state->test->lock();
+        state->trigger_count++;
+        state->test->notify();
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
+
+  wait([&]() { return state.trigger_count == 1; });
+}
+
+TLB_INSTANTIATE_TEST(StrandTest);
+
+}  // namespace
+}  // namespace tlb_test
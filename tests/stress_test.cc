@@ -0,0 +1,135 @@
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <array>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kHammerThreads = 8;
+constexpr size_t kIterations = 2000;
+
+class StressTest : public TlbTest {
+ public:
+  void SetUp() override {
+    TlbTest::SetUp();
+
+    for (tlb_pipe &pipe : pipes) {
+      ASSERT_EQ(0, tlb_pipe_open(&pipe));
+    }
+  }
+
+  void TearDown() override {
+    TlbTest::TearDown();
+
+    for (tlb_pipe &pipe : pipes) {
+      tlb_pipe_close(&pipe);
+    }
+  }
+
+  template <typename Function>
+  void Hammer(Function &&function) {
+    std::vector<std::thread> hammers;
+    for (size_t ii = 0; ii < kHammerThreads; ++ii) {
+      hammers.emplace_back([&, ii]() { function(ii); });
+    }
+    for (auto &thread : hammers) {
+      thread.join();
+    }
+  }
+
+  std::array<tlb_pipe, kHammerThreads> pipes;
+};
+
+struct FireCounter {
+  tlb_pipe *pipe = nullptr;
+  std::atomic<size_t> fired = {0};
+};
+
+TEST_P(StressTest, AddRemoveFire) {
+  std::array<FireCounter, kHammerThreads> counters;
+
+  Hammer([&](size_t index) {
+    FireCounter &counter = counters[index];
+    counter.pipe = &pipes[index];
+
+    for (size_t ii = 0; ii < kIterations; ++ii) {
+      tlb_handle sub = tlb_evl_add_fd(
+          loop(), counter.pipe->fd_read, TLB_EV_READ, false,
+          +[](tlb_handle handle, int events, void *userdata) {
+            FireCounter *counter = static_cast<FireCounter *>(userdata);
+            uint8_t value;
+            tlb_pipe_read(counter->pipe, &value);
+            counter->fired++;
+          },
+          &counter);
+      ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+      // Race the dispatch of this write against the removal
+      const uint8_t value = ii;
+      tlb_pipe_write(counter.pipe, value);
+      if (ii % 2 == 0) {
+        std::this_thread::yield();
+      }
+      EXPECT_EQ(0, tlb_evl_remove(loop(), sub)) << strerror(errno);
+    }
+  });
+
+  // Let any in-flight callbacks finish before the counters go away
+  Stop();
+}
+
+TEST_P(StressTest, CrossThreadRemove) {
+  // Every pipe is always readable, so subscriptions fire constantly on every loop thread
+  for (tlb_pipe &pipe : pipes) {
+    tlb_pipe_write(&pipe, s_test_value);
+  }
+
+  std::atomic<size_t> fired = {0};
+  std::array<std::atomic<tlb_handle>, kHammerThreads> slots;
+  for (auto &slot : slots) {
+    slot = TLB_HANDLE_INVALID;
+  }
+
+  Hammer([&](size_t index) {
+    for (size_t ii = 0; ii < kIterations; ++ii) {
+      tlb_handle sub = tlb_evl_add_fd(
+          loop(), pipes[(index + ii) % kHammerThreads].fd_read, TLB_EV_READ, false,
+          +[](tlb_handle handle, int events, void *userdata) {
+            static_cast<std::atomic<size_t> *>(userdata)->fetch_add(1);
+          },
+          &fired);
+      if (sub == TLB_HANDLE_INVALID) {
+        // Another thread already has this fd subscribed
+        continue;
+      }
+
+      // Swap it with whatever some other thread left behind, and remove that one instead
+      tlb_handle previous = slots[(index + ii) % kHammerThreads].exchange(sub);
+      if (previous != TLB_HANDLE_INVALID) {
+        EXPECT_EQ(0, tlb_evl_remove(loop(), previous)) << strerror(errno);
+      }
+    }
+  });
+
+  for (auto &slot : slots) {
+    tlb_handle sub = slot.exchange(TLB_HANDLE_INVALID);
+    if (sub != TLB_HANDLE_INVALID) {
+      EXPECT_EQ(0, tlb_evl_remove(loop(), sub)) << strerror(errno);
+    }
+  }
+
+  Stop();
+  EXPECT_LT(0, fired.load());
+}
+
+INSTANTIATE_TEST_SUITE_P(RawLoop, StressTest,
+                         ::testing::Combine(::testing::Values(LoopMode::RawLoop), ::testing::Values<size_t>(8, 16)));
+INSTANTIATE_TEST_SUITE_P(TlbLoop, StressTest,
+                         ::testing::Combine(::testing::Values(LoopMode::TlbLoop), ::testing::Values<size_t>(8, 16)));
+
+}  // namespace
+}  // namespace tlb_test
@@ -2,6 +2,7 @@
 
 #include "tlb/allocator.h"
 #include "tlb/event_loop.h"
+#include "tlb/rate_limit.h"
 #include "tlb/tlb.h"
 
 #include <iostream>
@@ -168,6 +169,68 @@ tlb_event_loop *TlbTest::handled_loop() {
   }
 }
 
+void DrainPipe(tlb_handle handle, int events, void *userdata) {
+  uint64_t value;
+  tlb_pipe_read(static_cast<tlb_pipe *>(userdata), &value);
+}
+
+void Counter::Count(tlb_handle handle, int events, void *userdata) {
+  Counter *counter = static_cast<Counter *>(userdata);
+  counter->calls++;
+  if (events & TLB_EV_TIMEOUT) {
+    EXPECT_EQ(TLB_EV_TIMEOUT, events);
+    counter->timeouts++;
+    counter->last_timeout = std::chrono::steady_clock::now();
+  } else if (counter->drain) {
+    uint64_t value;
+    tlb_pipe_read(counter->pipe, &value);
+    counter->reads++;
+  }
+  if (counter->bytes) {
+    EXPECT_EQ(0, tlb_evl_rate_consume(counter->loop, handle, counter->bytes));
+  }
+}
+
+void LoopTest::SetUp() {
+  loop = tlb_evl_new(test_allocator());
+  ASSERT_NE(nullptr, loop);
+  for (tlb_pipe &pipe : pipes) {
+    ASSERT_EQ(0, tlb_pipe_open(&pipe));
+  }
+}
+
+void LoopTest::TearDown() {
+  tlb_evl_destroy(loop);
+  for (tlb_pipe &pipe : pipes) {
+    tlb_pipe_close(&pipe);
+  }
+}
+
+tlb_handle LoopTest::Add(size_t pipe, Counter *counter) {
+  counter->loop = loop;
+  counter->pipe = &pipes[pipe];
+  return tlb_evl_add_fd(loop, pipes[pipe].fd_read, TLB_EV_READ, false, Counter::Count, counter);
+}
+
+void LoopTest::WriteAll() {
+  for (tlb_pipe &pipe : pipes) {
+    tlb_pipe_write(&pipe, s_test_value);
+  }
+}
+
+void LoopTest::Run(std::chrono::milliseconds duration) {
+  const auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+    EXPECT_LE(0, tlb_evl_handle_events(loop, 0, 5));
+  }
+}
+
+size_t LoopTest::LiveSubscriptions() {
+  tlb_evl_memory usage;
+  EXPECT_EQ(0, tlb_evl_memory_usage(loop, &usage));
+  return usage.slots_live;
+}
+
 namespace {
 class FixtureTest : public TlbTest {};
 
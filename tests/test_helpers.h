@@ -3,11 +3,13 @@
 
 #include "tlb/allocator.h"
 #include "tlb/event_loop.h"
+#include "tlb/pipe.h"
 #include "tlb/tlb.h"
 
 #include <gtest/gtest.h>
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
@@ -88,6 +90,46 @@ class TlbTest : public ::testing::TestWithParam<std::tuple<LoopMode, size_t>> {
   std::condition_variable on_event;
 };
 
+// on_event for a tlb_pipe, reads a single value from it
+void DrainPipe(tlb_handle handle, int events, void *userdata);
+
+// Counts the callbacks a subscription gets, see LoopTest::Add
+struct Counter {
+  static void Count(tlb_handle handle, int events, void *userdata);
+
+  tlb_event_loop *loop = nullptr;
+  tlb_pipe *pipe = nullptr;
+  bool drain = true;  // Reads a value for each read event, otherwise the pipe stays readable
+  size_t bytes = 0;   // Charged to the subscription's rate limit for each callback
+  size_t calls = 0;
+  size_t reads = 0;
+  size_t timeouts = 0;
+  std::chrono::steady_clock::time_point last_timeout;
+};
+
+// A single loop with some pipes open, for tests that handle events themselves instead of running threads like TlbTest
+class LoopTest : public ::testing::Test {
+ public:
+  explicit LoopTest(size_t pipe_count = 0) : pipes(pipe_count) {
+  }
+
+  void SetUp() override;
+  void TearDown() override;
+
+  // Subscribes counter to reads on a pipe
+  tlb_handle Add(size_t pipe, Counter *counter);
+
+  void WriteAll();
+
+  // Keeps handling events until duration is up, even while there are none
+  void Run(std::chrono::milliseconds duration);
+
+  size_t LiveSubscriptions();
+
+  tlb_event_loop *loop = nullptr;
+  std::vector<tlb_pipe> pipes;
+};
+
 #define TLB_INSTANTIATE_TEST(suite)                                                                        \
   INSTANTIATE_TEST_SUITE_P(                                                                                \
       RawLoop, suite,                                                                                      \
@@ -27,7 +27,7 @@ TEST_P(TimerTest, Timer) {
         state->trigger_count++;
       },
       &state);
-  ASSERT_NE(nullptr, timer);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
 
   // Sleep, and include a bit of extra time for safety
   std::this_thread::sleep_for(duration + s_timer_epsilon);
@@ -51,7 +51,7 @@ TEST_P(TimerTest, TimerUnsubscribe) {
         state->test->notify();
       },
       &state);
-  ASSERT_NE(nullptr, timer);
+  ASSERT_NE(TLB_HANDLE_INVALID, timer);
 
   EXPECT_EQ(0, state.trigger_count);
 
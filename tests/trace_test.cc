@@ -0,0 +1,145 @@
+#include "tlb/trace.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include <chrono>
+
+namespace tlb_test {
+namespace {
+constexpr auto s_slow_callback = std::chrono::milliseconds(5);
+
+class TraceTest : public TlbTest {
+ public:
+  void SetUp() override {
+    TlbTest::SetUp();
+
+    ASSERT_EQ(0, tlb_pipe_open(&pipe));
+  }
+
+  void TearDown() override {
+    TlbTest::TearDown();
+
+    tlb_pipe_close(&pipe);
+  }
+
+  tlb_pipe pipe;
+};
+
+TEST_P(TraceTest, Disabled) {
+  tlb_trace_summary summary;
+  EXPECT_EQ(-1, tlb_evl_trace_summary(loop(), TLB_TRACE_CALLBACK_DURATION, &summary));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_P(TraceTest, SlowCallback) {
+  struct TestState {
+    TraceTest *test = nullptr;
+    int read_count = 0;
+    int slow_count = 0;
+    std::string slow_name;
+  } state;
+  state.test = this;
+
+  tlb_trace_options options = {};
+  options.slow_callback_us = std::chrono::duration_cast<std::chrono::microseconds>(s_slow_callback).count() / 2;
+  options.on_slow_callback = +[](const char *name, tlb_handle handle, uint64_t duration_ns, void *userdata) {
+    TestState *state = static_cast<TestState *>(userdata);
+    EXPECT_LE(std::chrono::nanoseconds(s_slow_callback).count(), duration_ns);
+
+    auto lock = state->test->lock();
+    state->slow_count++;
+    state->slow_name = name;
+    state->test->notify();
+  };
+  options.userdata = &state;
+  ASSERT_EQ(0, tlb_evl_trace_enable(loop(), &options));
+
+  tlb_handle sub = tlb_evl_add_fd(
+      loop(), pipe.fd_read, TLB_EV_READ, true,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        uint64_t value;
+        tlb_pipe_read(&state->test->pipe, &value);
+        std::this_thread::sleep_for(s_slow_callback);
+
+        auto lock = state->test->lock();
+        state->read_count++;
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  tlb_pipe_write(&pipe, s_test_value);
+  wait([&]() { return state.read_count == 1 && state.slow_count == 1; });
+  EXPECT_EQ("fd", state.slow_name);
+
+  tlb_trace_summary summary;
+  ASSERT_EQ(0, tlb_evl_trace_summary(loop(), TLB_TRACE_CALLBACK_DURATION, &summary));
+  EXPECT_EQ(1, summary.count);
+  EXPECT_LE(std::chrono::nanoseconds(s_slow_callback).count(), summary.min_ns);
+  EXPECT_LE(summary.min_ns, summary.p50_ns);
+  EXPECT_LE(summary.p50_ns, summary.p999_ns);
+  // Buckets are at most 1/16th wide
+  EXPECT_GE(summary.max_ns + (summary.max_ns / 16), summary.p999_ns);
+
+  ASSERT_EQ(0, tlb_evl_trace_summary(loop(), TLB_TRACE_QUEUE_DELAY, &summary));
+  EXPECT_EQ(1, summary.count);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop(), sub));
+  tlb_evl_trace_disable(loop());
+}
+
+TEST_P(TraceTest, Percentiles) {
+  struct TestState {
+    TraceTest *test = nullptr;
+    size_t read_count = 0;
+  } state;
+  state.test = this;
+
+  tlb_trace_options options = {};
+  ASSERT_EQ(0, tlb_evl_trace_enable(loop(), &options));
+
+  static constexpr size_t kReadCount = 100;
+  tlb_handle sub = tlb_evl_add_fd(
+      loop(), pipe.fd_read, TLB_EV_READ, true,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        uint64_t value;
+        tlb_pipe_read(&state->test->pipe, &value);
+
+        auto lock = state->test->lock();
+        if (++state->read_count < kReadCount) {
+          tlb_pipe_write(&state->test->pipe, s_test_value);
+        } else {
+          state->test->notify();
+        }
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+
+  tlb_pipe_write(&pipe, s_test_value);
+  wait([&]() { return state.read_count == kReadCount; });
+
+  tlb_trace_summary summary;
+  ASSERT_EQ(0, tlb_evl_trace_summary(loop(), TLB_TRACE_CALLBACK_DURATION, &summary));
+  EXPECT_EQ(kReadCount, summary.count);
+  EXPECT_LE(summary.p50_ns, summary.p90_ns);
+  EXPECT_LE(summary.p90_ns, summary.p99_ns);
+  EXPECT_LE(summary.p99_ns, summary.p999_ns);
+
+  // Re-enabling starts from scratch
+  ASSERT_EQ(0, tlb_evl_trace_enable(loop(), &options));
+  ASSERT_EQ(0, tlb_evl_trace_summary(loop(), TLB_TRACE_CALLBACK_DURATION, &summary));
+  EXPECT_EQ(0, summary.count);
+
+  EXPECT_EQ(0, tlb_evl_remove(loop(), sub));
+}
+
+TLB_INSTANTIATE_TEST(TraceTest);
+
+}  // namespace
+}  // namespace tlb_test
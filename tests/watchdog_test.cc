@@ -0,0 +1,127 @@
+#include "tlb/tlb.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.h"
+#include <chrono>
+
+namespace tlb_test {
+namespace {
+constexpr uint32_t s_stall_threshold_ms = 50;
+constexpr auto s_stall = std::chrono::milliseconds(s_stall_threshold_ms * 6);
+
+class WatchdogTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_EQ(0, tlb_pipe_open(&blocking_pipe));
+    ASSERT_EQ(0, tlb_pipe_open(&other_pipe));
+  }
+
+  void TearDown() override {
+    if (tlb_inst) {
+      tlb_destroy(tlb_inst);
+    }
+    tlb_pipe_close(&blocking_pipe);
+    tlb_pipe_close(&other_pipe);
+  }
+
+  void Start(size_t compensating) {
+    tlb_options options = {};
+    options.max_thread_count = 1;
+    options.stall_threshold_ms = s_stall_threshold_ms;
+    options.max_compensating_threads = compensating;
+    options.on_stall = +[](size_t worker, uint64_t stalled_ms, void *userdata) {
+      EXPECT_LE(s_stall_threshold_ms, stalled_ms);
+      static_cast<WatchdogTest *>(userdata)->stall_count++;
+    };
+    options.stall_userdata = this;
+
+    tlb_inst = tlb_new(TlbTest::alloc(), options);
+    ASSERT_NE(nullptr, tlb_inst);
+    ASSERT_EQ(0, tlb_start(tlb_inst));
+
+    tlb_event_loop *loop = tlb_get_evl(tlb_inst);
+    ASSERT_NE(TLB_HANDLE_INVALID, tlb_evl_add_fd(
+                                      loop, blocking_pipe.fd_read, TLB_EV_READ, true,
+                                      +[](tlb_handle handle, int events, void *userdata) {
+                                        WatchdogTest *test = static_cast<WatchdogTest *>(userdata);
+                                        uint64_t value;
+                                        tlb_pipe_read(&test->blocking_pipe, &value);
+                                        std::this_thread::sleep_for(s_stall);
+                                        test->blocked_done = true;
+                                      },
+                                      this));
+    ASSERT_NE(TLB_HANDLE_INVALID, tlb_evl_add_fd(
+                                      loop, other_pipe.fd_read, TLB_EV_READ, true,
+                                      +[](tlb_handle handle, int events, void *userdata) {
+                                        WatchdogTest *test = static_cast<WatchdogTest *>(userdata);
+                                        uint64_t value;
+                                        tlb_pipe_read(&test->other_pipe, &value);
+                                        test->other_handled = true;
+                                      },
+                                      this));
+  }
+
+  template <typename Predicate>
+  bool WaitFor(Predicate &&predicate, std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!predicate()) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }
+
+  tlb *tlb_inst = nullptr;
+  tlb_pipe blocking_pipe;
+  tlb_pipe other_pipe;
+
+  std::atomic<int> stall_count = {0};
+  std::atomic<bool> blocked_done = {false};
+  std::atomic<bool> other_handled = {false};
+};
+
+TEST_F(WatchdogTest, ReportsStall) {
+  Start(0);
+
+  tlb_pipe_write(&blocking_pipe, s_test_value);
+  EXPECT_TRUE(WaitFor([&]() { return stall_count == 1; }, s_stall));
+
+  // Nothing takes over, the only worker is busy
+  tlb_pipe_write(&other_pipe, s_test_value);
+  EXPECT_TRUE(WaitFor([&]() { return blocked_done.load(); }, s_stall * 2));
+  EXPECT_TRUE(WaitFor([&]() { return other_handled.load(); }, s_stall));
+  EXPECT_EQ(1, stall_count);
+  EXPECT_EQ(1, tlb_active_threads(tlb_inst));
+}
+
+TEST_F(WatchdogTest, CompensatingThread) {
+  Start(1);
+
+  tlb_pipe_write(&blocking_pipe, s_test_value);
+  EXPECT_TRUE(WaitFor([&]() { return tlb_active_threads(tlb_inst) == 2; }, s_stall));
+  EXPECT_EQ(1, stall_count);
+
+  // Handled by the compensating thread while the regular one is still stuck
+  tlb_pipe_write(&other_pipe, s_test_value);
+  EXPECT_TRUE(WaitFor([&]() { return other_handled.load(); }, s_stall));
+  EXPECT_FALSE(blocked_done);
+
+  // And it goes away once the stall clears
+  EXPECT_TRUE(WaitFor([&]() { return blocked_done.load(); }, s_stall * 2));
+  EXPECT_TRUE(WaitFor([&]() { return tlb_active_threads(tlb_inst) == 1; }, s_stall));
+
+  // Restarting brings back just the regular workers
+  ASSERT_EQ(0, tlb_stop(tlb_inst));
+  EXPECT_EQ(0, tlb_active_threads(tlb_inst));
+  ASSERT_EQ(0, tlb_start(tlb_inst));
+  EXPECT_EQ(1, tlb_active_threads(tlb_inst));
+}
+
+}  // namespace
+}  // namespace tlb_test
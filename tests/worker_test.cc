@@ -0,0 +1,148 @@
+#include "tlb/tlb.h"
+
+#include "tlb/event_loop.h"
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace tlb_test {
+namespace {
+constexpr size_t kThreads = 4;
+constexpr size_t kSlot = 3;
+
+class WorkerTest : public ::testing::Test {
+ public:
+  struct Hooks {
+    std::mutex mtx;
+    std::multiset<size_t> started;
+    std::multiset<size_t> stopped;
+    std::atomic<size_t> mismatched = {0};
+  };
+
+  void TearDown() override {
+    if (tlb_inst) {
+      tlb_destroy(tlb_inst);
+    }
+  }
+
+  void Start() {
+    tlb_options options = {};
+    options.max_thread_count = kThreads;
+    options.on_thread_start = +[](tlb *tlb, size_t worker, void *userdata) {
+      Hooks *hooks = static_cast<Hooks *>(userdata);
+      if (tlb_current_worker() != worker) {
+        hooks->mismatched++;
+      }
+      // Each worker keeps something of its own in its slot
+      tlb_worker_slot_set(tlb, worker, kSlot, new size_t(worker));
+      std::lock_guard<std::mutex> lock(hooks->mtx);
+      hooks->started.insert(worker);
+    };
+    options.on_thread_stop = +[](tlb *tlb, size_t worker, void *userdata) {
+      Hooks *hooks = static_cast<Hooks *>(userdata);
+      if (tlb_current_worker() != worker) {
+        hooks->mismatched++;
+      }
+      delete static_cast<size_t *>(tlb_worker_slot_get(tlb, worker, kSlot));
+      tlb_worker_slot_set(tlb, worker, kSlot, nullptr);
+      std::lock_guard<std::mutex> lock(hooks->mtx);
+      hooks->stopped.insert(worker);
+    };
+    options.thread_userdata = &hooks;
+
+    tlb_inst = tlb_new(TlbTest::alloc(), options);
+    ASSERT_NE(nullptr, tlb_inst);
+    ASSERT_EQ(0, tlb_start(tlb_inst));
+  }
+
+  tlb *tlb_inst = nullptr;
+  Hooks hooks;
+};
+
+TEST_F(WorkerTest, Hooks) {
+  Start();
+
+  // Everything's started by the time tlb_start returns
+  {
+    std::lock_guard<std::mutex> lock(hooks.mtx);
+    EXPECT_EQ(kThreads, hooks.started.size());
+    EXPECT_EQ(kThreads, std::set<size_t>(hooks.started.begin(), hooks.started.end()).size());
+    EXPECT_TRUE(hooks.stopped.empty());
+  }
+  ASSERT_EQ(kThreads, tlb_worker_count(tlb_inst));
+  for (size_t worker = 0; worker < kThreads; ++worker) {
+    size_t *value = static_cast<size_t *>(tlb_worker_slot_get(tlb_inst, worker, kSlot));
+    ASSERT_NE(nullptr, value);
+    EXPECT_EQ(worker, *value);
+  }
+
+  ASSERT_EQ(0, tlb_stop(tlb_inst));
+  EXPECT_EQ(hooks.started, hooks.stopped);
+  EXPECT_EQ(0U, hooks.mismatched.load());
+  for (size_t worker = 0; worker < kThreads; ++worker) {
+    EXPECT_EQ(nullptr, tlb_worker_slot_get(tlb_inst, worker, kSlot));
+  }
+}
+
+TEST_F(WorkerTest, CurrentWorker) {
+  Start();
+  EXPECT_EQ(TLB_WORKER_NONE, tlb_current_worker());
+
+  struct TestState {
+    tlb *tlb_inst = nullptr;
+    tlb_pipe pipe;
+    std::atomic<size_t> worker = {TLB_WORKER_NONE};
+    std::atomic<bool> own_slot = {false};
+  } state;
+  state.tlb_inst = tlb_inst;
+  ASSERT_EQ(0, tlb_pipe_open(&state.pipe));
+
+  tlb_handle sub = tlb_evl_add_fd(
+      tlb_get_evl(tlb_inst), state.pipe.fd_read, TLB_EV_READ, true,
+      +[](tlb_handle handle, int events, void *userdata) {
+        TestState *state = static_cast<TestState *>(userdata);
+        const size_t worker = tlb_current_worker();
+        size_t *value = static_cast<size_t *>(tlb_worker_slot_get(state->tlb_inst, worker, kSlot));
+        state->own_slot = value && *value == worker;
+        state->worker = worker;
+      },
+      &state);
+  ASSERT_NE(TLB_HANDLE_INVALID, sub);
+  tlb_pipe_write(&state.pipe, s_test_value);
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (state.worker == TLB_WORKER_NONE && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_GT(kThreads, state.worker.load());
+  EXPECT_TRUE(state.own_slot);
+
+  ASSERT_EQ(0, tlb_stop(tlb_inst));
+  tlb_pipe_close(&state.pipe);
+}
+
+TEST_F(WorkerTest, InvalidSlot) {
+  tlb_options options = {};
+  options.max_thread_count = 1;
+  tlb_inst = tlb_new(TlbTest::alloc(), options);
+  ASSERT_NE(nullptr, tlb_inst);
+
+  int value = 0;
+  EXPECT_EQ(0, tlb_worker_slot_set(tlb_inst, 0, TLB_WORKER_SLOTS - 1, &value));
+  EXPECT_EQ(&value, tlb_worker_slot_get(tlb_inst, 0, TLB_WORKER_SLOTS - 1));
+  EXPECT_EQ(-1, tlb_worker_slot_set(tlb_inst, 0, TLB_WORKER_SLOTS, &value));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(-1, tlb_worker_slot_set(tlb_inst, 1, 0, &value));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(nullptr, tlb_worker_slot_get(tlb_inst, 1, 0));
+}
+
+}  // namespace
+}  // namespace tlb_test
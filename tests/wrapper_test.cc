@@ -0,0 +1,191 @@
+#include "tlb/tlb.hpp"
+
+#include "tlb/pipe.h"
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.h"
+#include <memory>
+#include <string>
+
+namespace tlb_test {
+namespace {
+
+class WrapperTest : public TlbTest {
+ public:
+  void SetUp() override {
+    TlbTest::SetUp();
+
+    ASSERT_EQ(0, tlb_pipe_open(&pipe));
+    evl = libtlb::EventLoop::borrow(loop());
+  }
+
+  void TearDown() override {
+    TlbTest::TearDown();
+
+    tlb_pipe_close(&pipe);
+  }
+
+  void Read() {
+    uint64_t value = 0;
+    tlb_pipe_read(&pipe, &value);
+    EXPECT_EQ(s_test_value, value);
+  }
+
+  void Done(int &counter) {
+    auto lock = this->lock();
+    counter++;
+    notify();
+  }
+
+  tlb_pipe pipe;
+  libtlb::EventLoop evl = libtlb::EventLoop::borrow(nullptr);
+};
+
+struct Handler {
+  void on_read(int events) {
+    EXPECT_TRUE(events & TLB_EV_READ);
+    test->Read();
+    test->Done(read_count);
+  }
+
+  WrapperTest *test = nullptr;
+  int read_count = 0;
+};
+
+TEST_P(WrapperTest, MemberTrampoline) {
+  Handler handler;
+  handler.test = this;
+
+  libtlb::Subscription sub = evl.add_fd<&Handler::on_read>(pipe.fd_read, TLB_EV_READ, &handler);
+  ASSERT_TRUE(sub);
+
+  tlb_pipe_write(&pipe, s_test_value);
+  wait([&]() { return handler.read_count == 1; });
+}
+
+TEST_P(WrapperTest, MemberTrampolineExplicit) {
+  Handler handler;
+  handler.test = this;
+
+  libtlb::Subscription sub = evl.add_fd<Handler, &Handler::on_read>(pipe.fd_read, TLB_EV_READ, &handler);
+  ASSERT_TRUE(sub);
+
+  tlb_pipe_write(&pipe, s_test_value);
+  wait([&]() { return handler.read_count == 1; });
+}
+
+TEST_P(WrapperTest, InlineCallable) {
+  int read_count = 0;
+  static_assert(sizeof(void *) * 2 <= TLB_EVL_INLINE_SIZE, "Lambda below should be stored inline");
+
+  libtlb::Subscription sub = evl.add_fd(pipe.fd_read, TLB_EV_READ, [this, &read_count](int events) {
+    Read();
+    Done(read_count);
+  });
+  ASSERT_TRUE(sub);
+
+  tlb_pipe_write(&pipe, s_test_value);
+  wait([&]() { return read_count == 1; });
+}
+
+TEST_P(WrapperTest, BoxedCallable) {
+  int read_count = 0;
+  auto owned = std::make_shared<std::string>("boxed");
+  std::weak_ptr<std::string> weak = owned;
+
+  libtlb::Subscription sub = evl.add_fd(pipe.fd_read, TLB_EV_READ, [this, &read_count, owned](int events) {
+    EXPECT_EQ("boxed", *owned);
+    Read();
+    Done(read_count);
+  });
+  ASSERT_TRUE(sub);
+  owned.reset();
+  EXPECT_FALSE(weak.expired());
+
+  tlb_pipe_write(&pipe, s_test_value);
+  wait([&]() { return read_count == 1; });
+
+  // The callable is destroyed with the subscription
+  sub.reset();
+  Stop();
+  EXPECT_TRUE(weak.expired());
+  Restart();
+}
+
+TEST_P(WrapperTest, BoxedCallableFailed) {
+  auto owned = std::make_shared<std::string>("boxed");
+  std::weak_ptr<std::string> weak = owned;
+
+  // Adding fails without releasing, so the wrapper frees it itself
+  libtlb::Subscription sub = evl.add_fd(-1, TLB_EV_READ, [owned](int events) {});
+  EXPECT_FALSE(sub);
+  owned.reset();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST_P(WrapperTest, Timer) {
+  int fired = 0;
+
+  libtlb::Subscription timer = evl.add_timer(10, [this, &fired](int events) { Done(fired); });
+  ASSERT_TRUE(timer);
+
+  wait([&]() { return fired == 1; });
+  // Already removed itself, resetting the stale handle is harmless
+  timer.reset();
+}
+
+TEST_P(WrapperTest, UnsubscribeOnDestruction) {
+  int read_count = 0;
+
+  {
+    libtlb::Subscription sub = evl.add_fd(pipe.fd_read, TLB_EV_READ, [this, &read_count](int events) {
+      Read();
+      Done(read_count);
+    });
+    ASSERT_TRUE(sub);
+
+    // Moving keeps the subscription alive
+    libtlb::Subscription moved = std::move(sub);
+    EXPECT_FALSE(sub);
+    EXPECT_TRUE(moved);
+  }
+
+  tlb_pipe_write(&pipe, s_test_value);
+  wait([&]() { return read_count == 0; });
+  Read();
+}
+
+TEST(WrapperTlbTest, StartStop) {
+  tlb_options options = {};
+  options.max_thread_count = 2;
+  libtlb::Tlb tlb(TlbTest::alloc(), options);
+  ASSERT_TRUE(tlb);
+  ASSERT_TRUE(tlb.loop());
+
+  tlb_pipe pipe;
+  ASSERT_EQ(0, tlb_pipe_open(&pipe));
+
+  std::atomic<int> read_count = {0};
+  ASSERT_EQ(0, tlb.start());
+  {
+    libtlb::Subscription sub = tlb.loop().add_fd(pipe.fd_read, TLB_EV_READ, [&](int events) {
+      uint64_t value = 0;
+      tlb_pipe_read(&pipe, &value);
+      read_count++;
+    });
+    tlb_pipe_write(&pipe, s_test_value);
+    while (read_count == 0) {
+      std::this_thread::yield();
+    }
+  }
+  EXPECT_EQ(0, tlb.stop());
+  EXPECT_EQ(1, read_count);
+
+  tlb_pipe_close(&pipe);
+}
+
+TLB_INSTANTIATE_TEST(WrapperTest);
+
+}  // namespace
+}  // namespace tlb_test
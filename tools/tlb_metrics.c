@@ -0,0 +1,101 @@
+/**
+ * Prints the counters a process published with tlb_evl_metrics_enable or tlb_metrics_enable.
+ *
+ * Usage: tlb_metrics name [interval ms]
+ *
+ * Without an interval the totals and each record in use are printed once. With one, the totals are printed as rates
+ * every interval until it's interrupted or the name goes away.
+ */
+
+#include "tlb/metrics.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#define MAX_RECORDS 1024U
+
+static const double s_nanos_per_milli = 1e6;
+
+static const char *s_kind_name(enum tlb_metrics_kind kind) {
+  switch (kind) {
+    case TLB_METRICS_LOOP:
+      return "loop";
+    case TLB_METRICS_WORKERS:
+      return "workers";
+  }
+  return "unknown";
+}
+
+static void s_print_values(const char *label, const struct tlb_metrics_values *values) {
+  const uint64_t *value = values->values;
+  /* Per thread this is only adds minus removes, which may be negative */
+  const int64_t live = (int64_t)(value[TLB_METRIC_SUBSCRIBED] - value[TLB_METRIC_UNSUBSCRIBED]);
+  printf("%-8s %12" PRIu64 " dispatches %10" PRIu64 " wakeups %12" PRIu64 " rearms %8" PRId64 " live %12.1f ms busy\n",
+         label, value[TLB_METRIC_DISPATCHES], value[TLB_METRIC_WAKEUPS], value[TLB_METRIC_REARMS], live,
+         (double)value[TLB_METRIC_BUSY_NS] / s_nanos_per_milli);
+}
+
+static int s_print_once(const char *name) {
+  static struct tlb_metrics_values records[MAX_RECORDS];
+  struct tlb_metrics_info info;
+  struct tlb_metrics_values total;
+  if (tlb_metrics_read(name, &info, &total, records, MAX_RECORDS) != 0) {
+    fprintf(stderr, "Failed to read %s: %s\n", name, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: %s metrics from pid %" PRId64 ", %zu records\n", name, s_kind_name(info.kind), info.pid,
+         info.record_count);
+  s_print_values("total", &total);
+  for (size_t ii = 0; ii < info.record_count && ii < MAX_RECORDS; ++ii) {
+    if (records[ii].values[TLB_METRIC_WAKEUPS] || records[ii].values[TLB_METRIC_SUBSCRIBED]) {
+      char label[32];
+      snprintf(label, sizeof(label), "[%zu]", ii);
+      s_print_values(label, &records[ii]);
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+static int s_print_rates(const char *name, unsigned long interval_ms) {
+  struct tlb_metrics_values last;
+  if (tlb_metrics_read(name, NULL, &last, NULL, 0) != 0) {
+    fprintf(stderr, "Failed to read %s: %s\n", name, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  const double seconds = (double)interval_ms / 1e3;
+  const struct timespec interval = {.tv_sec = (time_t)(interval_ms / 1000),
+                                    .tv_nsec = (long)(interval_ms % 1000) * 1000000L};
+  for (;;) {
+    nanosleep(&interval, NULL);
+    struct tlb_metrics_values now;
+    if (tlb_metrics_read(name, NULL, &now, NULL, 0) != 0) {
+      fprintf(stderr, "Failed to read %s: %s\n", name, strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+    const uint64_t *value = now.values;
+    const uint64_t *previous = last.values;
+    /* Busy time as a share of the interval, more than 100% when several threads are busy */
+    printf("%12.0f dispatches/s %10.0f wakeups/s %12.0f rearms/s %8" PRIu64 " live %6.1f%% busy\n",
+           (double)(value[TLB_METRIC_DISPATCHES] - previous[TLB_METRIC_DISPATCHES]) / seconds,
+           (double)(value[TLB_METRIC_WAKEUPS] - previous[TLB_METRIC_WAKEUPS]) / seconds,
+           (double)(value[TLB_METRIC_REARMS] - previous[TLB_METRIC_REARMS]) / seconds,
+           value[TLB_METRIC_SUBSCRIBED] - value[TLB_METRIC_UNSUBSCRIBED],
+           (double)(value[TLB_METRIC_BUSY_NS] - previous[TLB_METRIC_BUSY_NS]) / (seconds * 1e7));
+    fflush(stdout);
+    last = now;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s name [interval ms]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const unsigned long interval_ms = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+  return interval_ms ? s_print_rates(argv[1], interval_ms) : s_print_once(argv[1]);
+}